@@ -0,0 +1,1302 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#if !defined(YARDSTICK_TRACE_H)
+#define YARDSTICK_TRACE_H
+
+// ---- Public Dependencies ----
+
+#include <yardstick/yardstick.h>
+
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+// ---- Public API ----
+
+/// Summary of one block of events in a trace file.
+struct ysTraceBlock
+{
+	/// Offset of the block from the start of the file.
+	std::uint64_t offset;
+	/// Earliest and latest timestamps in the block. Both are 0 if the block has no timed events.
+	ysTime begin;
+	ysTime end;
+	/// Number of ticks before the block, and within it.
+	std::uint64_t firstTick;
+	std::uint32_t ticks;
+	std::uint32_t events;
+};
+
+/// Description of an instrumentation site that appears in a trace file.
+struct ysTraceSite
+{
+	ysSiteHandle id;
+	ysStringHandle name;
+	ysStringHandle file;
+	std::uint32_t line;
+};
+
+/// A process whose trace was merged into a file, and the threads it was given there.
+struct ysTraceProcess
+{
+	ysStringHandle name;
+	std::uint16_t firstThread;
+	std::uint16_t threads;
+};
+
+/// A Header event, starting a stream.
+struct ysHeaderEvent
+{
+	ysTime frequency;
+	ysTime start;
+};
+
+/// A Tick event, ending a frame.
+struct ysTickEvent
+{
+	std::uint16_t thread;
+	ysTime when;
+};
+
+/// A completed region.
+struct ysRegionEvent
+{
+	std::uint16_t thread;
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	ysTime begin;
+	ysTime end;
+};
+
+/// A counter value.
+struct ysCounterSetEvent
+{
+	std::uint16_t thread;
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	ysTime when;
+	double value;
+};
+
+/// A counter increment.
+struct ysCounterAddEvent
+{
+	std::uint16_t thread;
+	ysStringHandle name;
+	double amount;
+};
+
+/// Durations of the regions recorded at one site over a frame, summed over every thread.
+struct ysRegionSummaryEvent
+{
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	/// End of the frame.
+	ysTime when;
+	std::uint32_t count;
+	ysTime total;
+	ysTime min;
+	ysTime max;
+	double sumSquares;
+};
+
+/// Histogram of the durations recorded at one site over a frame, summed over every thread.
+/// The buckets point into the decoded data.
+struct ysHistogramEvent
+{
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	/// End of the frame.
+	ysTime when;
+	/// Number of non-empty buckets.
+	std::uint16_t buckets;
+	unsigned char const* data;
+
+	/// <summary> Reads a non-empty bucket, whose index is as used by ysDurationHistogram. </summary>
+	void GetBucket(std::size_t index, std::uint16_t& out_bucket, std::uint32_t& out_count) const
+	{
+		std::memcpy(&out_bucket, data + index * 6, sizeof(out_bucket));
+		std::memcpy(&out_count, data + index * 6 + 2, sizeof(out_count));
+	}
+};
+
+/// Quantiles of the values recorded at one site over each ysWindow, estimated from every thread's values.
+/// The windows point into the decoded data.
+struct ysQuantilesEvent
+{
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	/// End of the windows.
+	ysTime when;
+	/// Region for the durations of a region, or CounterSet for the values of a counter.
+	ysEventType source;
+	unsigned char const* data;
+
+	/// <summary> Reads the quantiles over one window. </summary>
+	void GetWindow(ysWindow window, ysQuantiles& out_quantiles) const
+	{
+		std::memcpy(&out_quantiles, data + static_cast<std::size_t>(window) * sizeof(ysQuantiles), sizeof(ysQuantiles));
+	}
+};
+
+/// Times of the paths through nested regions over a frame, merged from every thread's regions.
+/// The nodes point into the decoded data.
+struct ysCallTreeEvent
+{
+	/// End of the frame.
+	ysTime when;
+	std::uint16_t nodes;
+	unsigned char const* data;
+
+	/// <summary> Reads a node. Every node's parent comes before it. </summary>
+	void GetNode(std::size_t index, ysCallTreeNode& out_node) const
+	{
+		unsigned char const* const pos = data + index * 36;
+		std::memcpy(&out_node.parent, pos, 4);
+		std::memcpy(&out_node.name, pos + 4, 4);
+		std::memcpy(&out_node.file, pos + 8, 4);
+		std::memcpy(&out_node.line, pos + 12, 4);
+		std::memcpy(&out_node.count, pos + 16, 4);
+		std::memcpy(&out_node.inclusive, pos + 20, 8);
+		std::memcpy(&out_node.exclusive, pos + 28, 8);
+	}
+};
+
+/// Samples of every thread's open regions over a second, by path of enclosing regions.
+/// The nodes point into the decoded data.
+struct ysSamplesEvent
+{
+	/// End of the second the samples were taken in.
+	ysTime when;
+	/// Number of times a thread was sampled, including those found outside any region.
+	std::uint32_t samples;
+	std::uint16_t nodes;
+	unsigned char const* data;
+
+	/// <summary> Reads a node. Every node's parent comes before it. </summary>
+	void GetNode(std::size_t index, ysSampleNode& out_node) const
+	{
+		std::memcpy(&out_node, data + index * 24, sizeof(out_node));
+	}
+};
+
+/// A thread found inside the same region for longer than the stall threshold.
+struct ysStallEvent
+{
+	std::uint16_t thread;
+	std::uint32_t line;
+	ysStringHandle name;
+	ysStringHandle file;
+	/// When the thread entered the region.
+	ysTime since;
+	/// When the thread was found still inside it.
+	ysTime when;
+};
+
+/// Definition of a string handle. The string points into the decoded data, and is not NUL-terminated.
+struct ysStringEvent
+{
+	ysStringHandle id;
+	std::uint16_t size;
+	char const* str;
+};
+
+/// Base for visitors passed to the decoders, which ignores every event.
+/// Visitors are called statically, so hide the handlers for the events of interest rather than
+/// making them virtual.
+struct ysEventVisitor
+{
+	void OnHeader(ysHeaderEvent const&) {}
+	void OnTick(ysTickEvent const&) {}
+	void OnRegion(ysRegionEvent const&) {}
+	void OnCounterSet(ysCounterSetEvent const&) {}
+	void OnCounterAdd(ysCounterAddEvent const&) {}
+	void OnRegionSummary(ysRegionSummaryEvent const&) {}
+	void OnHistogram(ysHistogramEvent const&) {}
+	void OnQuantiles(ysQuantilesEvent const&) {}
+	void OnCallTree(ysCallTreeEvent const&) {}
+	void OnSamples(ysSamplesEvent const&) {}
+	void OnStall(ysStallEvent const&) {}
+	void OnString(ysStringEvent const&) {}
+};
+
+/// Events decoded into one set of columns per event type.
+/// Order is only kept within each type. Strings are copied, so a batch outlives the decoded data.
+struct ysEventBatch
+{
+	struct Ticks
+	{
+		std::vector<std::uint16_t> thread;
+		std::vector<ysTime> when;
+	} ticks;
+
+	struct Regions
+	{
+		std::vector<std::uint16_t> thread;
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> begin;
+		std::vector<ysTime> end;
+	} regions;
+
+	struct CounterSets
+	{
+		std::vector<std::uint16_t> thread;
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> when;
+		std::vector<double> value;
+	} counterSets;
+
+	struct CounterAdds
+	{
+		std::vector<std::uint16_t> thread;
+		std::vector<ysStringHandle> name;
+		std::vector<double> amount;
+	} counterAdds;
+
+	struct RegionSummaries
+	{
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> when;
+		std::vector<std::uint32_t> count;
+		std::vector<ysTime> total;
+		std::vector<ysTime> min;
+		std::vector<ysTime> max;
+		std::vector<double> sumSquares;
+	} regionSummaries;
+
+	struct Histograms
+	{
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> when;
+		/// Each histogram's non-empty buckets are size entries of the bucket columns from offset.
+		std::vector<std::uint32_t> offset;
+		std::vector<std::uint16_t> size;
+		std::vector<std::uint16_t> bucket;
+		std::vector<std::uint32_t> count;
+	} histograms;
+
+	struct Quantiles
+	{
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> when;
+		std::vector<ysEventType> source;
+		/// ysWindowCount entries per event, in ysWindow order.
+		std::vector<ysQuantiles> windows;
+	} quantiles;
+
+	struct CallTrees
+	{
+		std::vector<ysTime> when;
+		/// Each tree's nodes are size entries of the node column from offset.
+		std::vector<std::uint32_t> offset;
+		std::vector<std::uint16_t> size;
+		/// Parents are indices within the same tree.
+		std::vector<ysCallTreeNode> node;
+	} callTrees;
+
+	struct Samples
+	{
+		std::vector<ysTime> when;
+		std::vector<std::uint32_t> samples;
+		/// Each event's nodes are size entries of the node column from offset.
+		std::vector<std::uint32_t> offset;
+		std::vector<std::uint16_t> size;
+		/// Parents are indices within the same event.
+		std::vector<ysSampleNode> node;
+	} samples;
+
+	struct Stalls
+	{
+		std::vector<std::uint16_t> thread;
+		std::vector<std::uint32_t> line;
+		std::vector<ysStringHandle> name;
+		std::vector<ysStringHandle> file;
+		std::vector<ysTime> since;
+		std::vector<ysTime> when;
+	} stalls;
+
+	struct Strings
+	{
+		std::vector<ysStringHandle> id;
+		/// Offset of each string within text.
+		std::vector<std::uint32_t> offset;
+		std::vector<std::uint16_t> size;
+		std::vector<char> text;
+	} strings;
+
+	/// Set by the most recent Header event, if any.
+	ysTime frequency = 0;
+	ysTime start = 0;
+
+	/// <summary> Empties every column, keeping their memory. </summary>
+	inline void Clear();
+
+	void OnHeader(ysHeaderEvent const& ev) { frequency = ev.frequency; start = ev.start; }
+	inline void OnTick(ysTickEvent const& ev);
+	inline void OnRegion(ysRegionEvent const& ev);
+	inline void OnCounterSet(ysCounterSetEvent const& ev);
+	inline void OnCounterAdd(ysCounterAddEvent const& ev);
+	inline void OnRegionSummary(ysRegionSummaryEvent const& ev);
+	inline void OnHistogram(ysHistogramEvent const& ev);
+	inline void OnQuantiles(ysQuantilesEvent const& ev);
+	inline void OnCallTree(ysCallTreeEvent const& ev);
+	inline void OnSamples(ysSamplesEvent const& ev);
+	inline void OnStall(ysStallEvent const& ev);
+	inline void OnString(ysStringEvent const& ev);
+};
+
+/// Decodes a stream of encoded events, as sent by ysListenWeb or stored in trace file blocks.
+/// The stream may be split at any byte; an event cut off at the end of one call is completed by
+/// the next.
+class ysEventDecoder
+{
+	std::vector<unsigned char> _partial;
+	std::uint16_t _thread = 0;
+	bool _failed = false;
+
+public:
+	/// <summary> Decodes the next piece of the stream, passing each event to the visitor in order. </summary>
+	/// <returns> Success, or InvalidParameter once malformed data has been found. </returns>
+	template <typename Visitor>
+	ysResult Decode(void const* data, std::size_t size, Visitor& visitor);
+
+	/// <summary> Starts decoding a new stream. </summary>
+	void Reset() { _partial.clear(); _thread = 0; _failed = false; }
+
+	/// <summary> True if decoding stopped because of malformed data. </summary>
+	bool HasFailed() const { return _failed; }
+
+	/// <summary> True if the stream ended partway through an event. </summary>
+	bool IsIncomplete() const { return !_partial.empty(); }
+};
+
+/// Log-linear histogram of durations, in clock ticks.
+/// Values are kept to within 1/32 of their size, using at most 1920 buckets however long the
+/// durations are. Merging histograms gives the same result in any order.
+class ysDurationHistogram
+{
+	static constexpr unsigned kSubBucketBits = 5;
+	static constexpr std::size_t kSubBuckets = std::size_t(1) << kSubBucketBits;
+
+	std::vector<std::uint64_t> _counts;
+	std::uint64_t _count = 0;
+
+	static inline std::size_t BucketIndex(ysTime value);
+
+public:
+	/// <summary> Adds a duration. </summary>
+	inline void Record(ysTime duration);
+
+	/// <summary> Adds every duration recorded by another histogram. </summary>
+	void Merge(ysDurationHistogram const& other);
+
+	/// <summary> Adds durations to a bucket, as read from a ysHistogramEvent. </summary>
+	inline void AddBucket(std::size_t index, std::uint64_t count);
+
+	std::uint64_t GetCount() const { return _count; }
+
+	/// <summary> Number of buckets in use. Later buckets are all empty. </summary>
+	std::size_t GetBucketCount() const { return _counts.size(); }
+	std::uint64_t GetBucket(std::size_t index) const { return _counts[index]; }
+
+	/// <summary> Returns the smallest duration counted by a bucket. The bucket ends where the next begins. </summary>
+	static inline ysTime GetBucketLowest(std::size_t index);
+
+	/// <summary> Estimates the duration below which a fraction of the recorded durations fall. </summary>
+	/// <param name="quantile"> The fraction, from 0 to 1. </param>
+	/// <returns> The midpoint of the bucket holding the quantile, or 0 if nothing was recorded. </returns>
+	ysTime GetQuantile(double quantile) const;
+};
+
+/// Statistics of the regions recorded at each site, usable as a visitor or as a partial result of
+/// ysTraceReader::DecodeParallel.
+/// Optionally only counts the regions within a window of time, and keeps statistics per thread too.
+class ysRegionStats : public ysEventVisitor
+{
+public:
+	struct Site
+	{
+		ysSiteHandle id;
+		ysStringHandle name;
+		ysStringHandle file;
+		std::uint32_t line;
+		/// The thread of a site from GetThreadSites, or 0.
+		std::uint16_t thread;
+		std::uint64_t count;
+		/// Regions only seen in per-frame summaries, which are in the count, total, min and max but
+		/// not in the self time or the durations.
+		std::uint64_t summarized;
+		ysTime total;
+		/// Total less the time spent in regions nested within these, on the same thread.
+		ysTime self;
+		ysTime min;
+		ysTime max;
+		ysDurationHistogram durations;
+	};
+
+private:
+	// completed regions are held until the region containing them ends, up to a limit per thread
+	static constexpr std::size_t kMaxPending = 1 << 16;
+
+	struct Pending
+	{
+		ysTime begin;
+		ysTime end;
+	};
+
+	ysTime _begin = 0;
+	ysTime _end = ~ysTime(0);
+	bool _perThread = false;
+
+	std::vector<Site> _sites;
+	std::unordered_map<std::uint64_t, std::size_t> _lookup;
+	std::vector<Site> _threadSites;
+	std::unordered_map<std::uint64_t, std::size_t> _threadLookup;
+	std::unordered_map<std::uint16_t, std::vector<Pending>> _pending;
+
+	static Site& FindSite(std::vector<Site>& sites, std::unordered_map<std::uint64_t, std::size_t>& lookup, Site const& like, std::uint16_t thread);
+	Site& FindSite(ysSiteHandle id, ysStringHandle name, ysStringHandle file, std::uint32_t line);
+	static void MergeSite(Site& site, Site const& from);
+	static inline void AddRegion(Site& site, ysTime duration, ysTime self);
+
+public:
+	ysRegionStats() = default;
+
+	/// <summary> Only counts the regions within a window of time, and summaries of frames ending within it. </summary>
+	/// <remarks> Regions outside the window are still followed for the self time of those within it. The partials of DecodeParallel are default constructed, so only use these with Decode. </remarks>
+	/// <param name="perThread"> Also keep the statistics of each site on each thread, for GetThreadSites. </param>
+	ysRegionStats(ysTime begin, ysTime end, bool perThread) : _begin(begin), _end(end), _perThread(perThread) {}
+
+	inline void OnRegion(ysRegionEvent const& ev);
+	inline void OnRegionSummary(ysRegionSummaryEvent const& ev);
+
+	/// <summary> Adds the statistics from another set, which should cover later events. </summary>
+	/// <remarks> Nesting isn't followed across sets, so the few regions that contain regions from an earlier set have their self time overstated. </remarks>
+	void Merge(ysRegionStats const& other);
+
+	/// <summary> Returns each site, in the order it was first seen. </summary>
+	std::vector<Site> const& GetSites() const { return _sites; }
+
+	/// <summary> Returns each site on each thread it was seen on, if kept. </summary>
+	/// <remarks> Summaries are merged over every thread, so they only count towards GetSites. </remarks>
+	std::vector<Site> const& GetThreadSites() const { return _threadSites; }
+};
+
+class ysTraceReader;
+
+/// Decodes the events of a range of blocks directly out of a mapped trace file.
+/// String events point into the mapping, and remain valid while the reader is open.
+class ysTraceCursor
+{
+	ysTraceReader const* _reader = nullptr;
+	std::size_t _block = 0;
+	std::size_t _last = 0;
+	unsigned char const* _pos = nullptr;
+	unsigned char const* _end = nullptr;
+	std::uint16_t _thread = 0;
+	bool _failed = false;
+
+	void EnterBlock();
+
+public:
+	ysTraceCursor() = default;
+	ysTraceCursor(ysTraceReader const& reader, std::size_t first, std::size_t last);
+
+	/// <summary> Decodes the next event. Thread events are consumed rather than returned. </summary>
+	/// <returns> False once the range is exhausted or malformed data is found. </returns>
+	bool Next(ysEvent& out_event);
+
+	/// <summary> True if decoding stopped because of malformed data. </summary>
+	bool HasFailed() const { return _failed; }
+
+	/// <summary> Index of the block containing the most recently decoded event. </summary>
+	std::size_t GetBlock() const { return _block; }
+};
+
+/// Random access to a trace file written by ysStartCapture or ysDumpFlightRecorder, or to the ring
+/// file of a flight recorder.
+/// The file is memory mapped. Its index is used when present; files that were never finished
+/// are indexed by walking their blocks when opened.
+class ysTraceReader
+{
+	struct StringEntry
+	{
+		ysStringHandle id;
+		std::uint32_t length;
+		std::uint64_t offset;
+	};
+
+	unsigned char const* _data = nullptr;
+	std::size_t _size = 0;
+
+	ysTime _frequency = 0;
+	ysTime _start = 0;
+	std::int64_t _realtime = 0;
+	std::uint32_t _version = 0;
+	std::size_t _headerSize = 0;
+	bool _indexed = false;
+
+	std::vector<ysTraceBlock> _blocks;
+	// running maximum of block end times, and running minimum of block begin times from the back,
+	// which are both sorted even though block ranges overlap
+	std::vector<ysTime> _maxEnd;
+	std::vector<ysTime> _minBegin;
+
+	ysTime const* _ticks = nullptr;
+	std::uint64_t _tickCount = 0;
+	std::vector<ysTime> _ownedTicks;
+
+	std::vector<StringEntry> _strings;
+	std::vector<ysTraceSite> _sites;
+	std::vector<ysTraceProcess> _processes;
+
+	ysResult Map(char const* path);
+	ysResult ReadIndex();
+	ysResult ScanBlock(std::uint64_t offset, std::uint64_t limit, std::uint64_t& out_end);
+	void FinishScan();
+	ysResult ScanBlocks();
+	ysResult ReadRing();
+	void BuildSearch();
+
+	friend class ysTraceCursor;
+
+public:
+	ysTraceReader() = default;
+	~ysTraceReader() { Close(); }
+
+	ysTraceReader(ysTraceReader const&) = delete;
+	ysTraceReader& operator=(ysTraceReader const&) = delete;
+
+	ysResult Open(char const* path);
+	void Close();
+
+	/// <summary> True if the file carried its own index rather than being walked on open. </summary>
+	bool IsIndexed() const { return _indexed; }
+
+	ysTime GetFrequency() const { return _frequency; }
+	ysTime GetStart() const { return _start; }
+
+	/// <summary> Wall clock time at GetStart(), in nanoseconds since the Unix epoch, or 0 for files too old to record it. </summary>
+	std::int64_t GetRealtime() const { return _realtime; }
+
+	std::size_t GetBlockCount() const { return _blocks.size(); }
+	ysTraceBlock const& GetBlock(std::size_t index) const { return _blocks[index]; }
+
+	std::uint64_t GetTickCount() const { return _tickCount; }
+	ysTime GetTickTime(std::uint64_t tick) const { return _ticks[tick]; }
+
+	std::size_t GetSiteCount() const { return _sites.size(); }
+	ysTraceSite const& GetSite(std::size_t index) const { return _sites[index]; }
+
+	/// <summary> Looks up a site by handle. </summary>
+	/// <returns> The site, or nullptr if it does not appear in the file. </returns>
+	ysTraceSite const* FindSite(ysSiteHandle id) const;
+
+	/// <summary> Looks up a string by handle. The result points into the file, and is not NUL-terminated. </summary>
+	/// <returns> The string, or nullptr if it does not appear in the file. </returns>
+	char const* FindString(ysStringHandle id, std::uint32_t& out_length) const;
+
+	std::size_t GetStringCount() const { return _strings.size(); }
+
+	/// <summary> Returns a string by index, in handle order. The result points into the file, and is not NUL-terminated. </summary>
+	char const* GetString(std::size_t index, ysStringHandle& out_id, std::uint32_t& out_length) const;
+
+	/// <summary> Number of processes the file was merged from, or 0 if it was recorded by a single process. </summary>
+	std::size_t GetProcessCount() const { return _processes.size(); }
+	ysTraceProcess const& GetProcess(std::size_t index) const { return _processes[index]; }
+
+	/// <summary> Looks up the process a thread belongs to. </summary>
+	/// <returns> The process, or nullptr if the file was not merged. </returns>
+	ysTraceProcess const* FindProcess(std::uint16_t thread) const;
+
+	/// <summary> Returns one more than the highest thread that has events in the blocks [first, last). </summary>
+	/// <remarks> Only the block headers are read. </remarks>
+	std::uint32_t FindThreadLimit(std::size_t first, std::size_t last) const;
+
+	/// <summary> Finds the blocks that may hold events within a time range, in O(log n). </summary>
+	/// <remarks> Blocks overlap in time, so the range may include a few events outside the window. </remarks>
+	/// <param name="out_first"> First block of the range. </param>
+	/// <param name="out_last"> One past the last block of the range. </param>
+	void FindBlocks(ysTime begin, ysTime end, std::size_t& out_first, std::size_t& out_last) const;
+
+	/// <summary> Finds the block containing a tick, in O(log n). </summary>
+	/// <returns> The block index, or GetBlockCount() if the tick is not in the file. </returns>
+	std::size_t FindTickBlock(std::uint64_t tick) const;
+
+	/// <summary> Decodes the events of the blocks in [first, last). </summary>
+	ysTraceCursor Read(std::size_t first, std::size_t last) const { return ysTraceCursor(*this, first, last); }
+
+	/// <summary> Returns the encoded events of a block, which are complete and start with no thread selected. </summary>
+	unsigned char const* GetBlockData(std::size_t index, std::size_t& out_size) const;
+
+	/// <summary> Decodes the events of the blocks in [first, last), passing each to the visitor in order. </summary>
+	/// <remarks> This is considerably faster than reading through a cursor. </remarks>
+	/// <returns> Success, or InvalidParameter if malformed data was found. </returns>
+	template <typename Visitor>
+	ysResult Decode(std::size_t first, std::size_t last, Visitor& visitor) const;
+
+	/// <summary> Decodes the blocks in [first, last) on a pool of threads, aggregating them into a result. </summary>
+	/// <remarks>
+	/// The blocks are split into chunks of several megabytes, each decoded into a fresh Partial,
+	/// which must be default constructible and act as a visitor. Partials are combined with
+	/// <c>result.Merge(partial)</c> on the calling thread, strictly in chunk order, so the result
+	/// is the same for any number of threads. Only a few partials per thread exist at once.
+	/// </remarks>
+	/// <param name="threads"> Number of decoding threads, or 0 to use one per core. </param>
+	/// <returns> Success, or InvalidParameter if malformed data was found. </returns>
+	template <typename Partial>
+	ysResult DecodeParallel(std::size_t first, std::size_t last, Partial& inout_result, unsigned threads = 0) const;
+
+private:
+	using ChunkDecoder = std::function<ysResult(std::size_t slot, std::size_t first, std::size_t last)>;
+	using ChunkMerger = std::function<void(std::size_t slot)>;
+
+	ysResult RunChunks(std::size_t first, std::size_t last, unsigned threads, std::size_t slots, ChunkDecoder const& decode, ChunkMerger const& merge) const;
+};
+
+/// Writes a trace file in the format used by ysStartCapture, from events decoded out of other traces.
+/// Each string is written once however often it is passed in, and must be written before the
+/// events that use it. The index is written when the file is closed.
+class ysTraceWriter
+{
+	struct State;
+	State* _state = nullptr;
+
+public:
+	ysTraceWriter() = default;
+	~ysTraceWriter() { Close(); }
+
+	ysTraceWriter(ysTraceWriter const&) = delete;
+	ysTraceWriter& operator=(ysTraceWriter const&) = delete;
+
+	/// <summary> Creates the file and writes its header. </summary>
+	/// <param name="realtime"> Wall clock time at start, in nanoseconds since the Unix epoch, or 0 if unknown. </param>
+	/// <returns> Success or error code. </returns>
+	ysResult Open(char const* path, ysTime frequency, ysTime start, std::int64_t realtime);
+
+	/// <summary> Writes an event. Header and Thread events are ignored, as the header is written by Open and each event carries its thread. </summary>
+	/// <returns> Success or error code. </returns>
+	ysResult Write(ysEvent const& ev);
+
+	/// <summary> Records that a range of threads came from one process, for files merged from several. </summary>
+	/// <param name="name"> The name of the process, which is written to the file as a string. </param>
+	/// <returns> Success or error code. </returns>
+	ysResult AddProcess(char const* name, std::uint16_t firstThread, std::uint16_t threads);
+
+	/// <summary> Writes the last block and the index, and closes the file. </summary>
+	/// <returns> Success or error code. </returns>
+	ysResult Close();
+};
+
+/// <summary> Converts a trace file to Chrome's JSON trace event format or Perfetto's protobuf format. </summary>
+/// <remarks> Events are streamed from the mapping to the output, so files of any size convert in bounded memory. </remarks>
+/// <param name="reader"> An open trace file. </param>
+/// <param name="path"> The file to create or overwrite. </param>
+/// <param name="format"> The format to write. </param>
+/// <returns> Success or error code. </returns>
+ysResult ysExportTrace(ysTraceReader const& reader, char const* path, ysExportFormat format);
+
+// ---- Private Implementation ----
+
+namespace _ys_
+{
+	/// Returns the index of the highest set bit of a non-zero value.
+	/// @internal
+	inline unsigned highest_bit(std::uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<unsigned>(index);
+#elif defined(__GNUC__)
+		return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+		unsigned index = 0;
+		while (value >>= 1)
+			++index;
+		return index;
+#endif
+	}
+
+	/// @internal
+	template <typename T>
+	T load_value(unsigned char const* pos)
+	{
+		T value;
+		std::memcpy(&value, pos, sizeof(value));
+		return value;
+	}
+
+	/// Returns the size of the encoded event at pos, given the bytes available. For a string whose
+	/// length isn't available yet, the size of its fixed part is returned.
+	/// @returns The size, or 0 if the event type is unknown.
+	/// @internal
+	inline std::size_t encoded_event_size(unsigned char const* pos, std::size_t available)
+	{
+		switch (static_cast<ysEventType>(pos[0]))
+		{
+		case ysEventType::None: return 1;
+		case ysEventType::Header: return 17;
+		case ysEventType::Tick: return 9;
+		case ysEventType::Region: return 29;
+		case ysEventType::CounterSet: return 29;
+		case ysEventType::String: return available < 7 ? 7 : 7 + load_value<std::uint16_t>(pos + 5);
+		case ysEventType::CounterAdd: return 13;
+		case ysEventType::Thread: return 3;
+		case ysEventType::RegionSummary: return 57;
+		case ysEventType::Histogram: return available < 23 ? 23 : 23 + 6 * std::size_t(load_value<std::uint16_t>(pos + 21));
+		case ysEventType::Quantiles: return 22 + sizeof(ysQuantiles) * ysWindowCount;
+		case ysEventType::CallTree: return available < 11 ? 11 : 11 + 36 * std::size_t(load_value<std::uint16_t>(pos + 9));
+		case ysEventType::Samples: return available < 15 ? 15 : 15 + 24 * std::size_t(load_value<std::uint16_t>(pos + 13));
+		case ysEventType::Stall: return 29;
+		default: return 0;
+		}
+	}
+
+	/// Decodes complete events from the front of a buffer.
+	/// There is one dispatch per event and a single bounds check, which is always taken the same
+	/// way until the end of the buffer; each event type is then decoded by straight-line code.
+	/// @returns The number of bytes decoded. Decoding stops before an incomplete event, or sets
+	/// out_failed at an unknown one.
+	/// @internal
+	template <typename Visitor>
+	std::size_t decode_events(unsigned char const* data, std::size_t size, std::uint16_t& inout_thread, Visitor& visitor, bool& out_failed)
+	{
+		unsigned char const* pos = data;
+		unsigned char const* const end = data + size;
+		std::uint16_t thread = inout_thread;
+
+		while (pos != end)
+		{
+			std::size_t const available = static_cast<std::size_t>(end - pos);
+
+			switch (static_cast<ysEventType>(pos[0]))
+			{
+			case ysEventType::Region:
+				if (available < 29)
+					goto done;
+				visitor.OnRegion(ysRegionEvent{thread, load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), load_value<ysTime>(pos + 21)});
+				pos += 29;
+				break;
+			case ysEventType::Thread:
+				if (available < 3)
+					goto done;
+				thread = load_value<std::uint16_t>(pos + 1);
+				pos += 3;
+				break;
+			case ysEventType::CounterAdd:
+				if (available < 13)
+					goto done;
+				visitor.OnCounterAdd(ysCounterAddEvent{thread, load_value<ysStringHandle>(pos + 1), load_value<double>(pos + 5)});
+				pos += 13;
+				break;
+			case ysEventType::Tick:
+				if (available < 9)
+					goto done;
+				visitor.OnTick(ysTickEvent{thread, load_value<ysTime>(pos + 1)});
+				pos += 9;
+				break;
+			case ysEventType::CounterSet:
+				if (available < 29)
+					goto done;
+				visitor.OnCounterSet(ysCounterSetEvent{thread, load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), load_value<double>(pos + 21)});
+				pos += 29;
+				break;
+			case ysEventType::String:
+			{
+				if (available < 7)
+					goto done;
+				std::uint16_t const length = load_value<std::uint16_t>(pos + 5);
+				if (available - 7 < length)
+					goto done;
+				visitor.OnString(ysStringEvent{load_value<ysStringHandle>(pos + 1), length, reinterpret_cast<char const*>(pos + 7)});
+				pos += 7 + length;
+				break;
+			}
+			case ysEventType::RegionSummary:
+				if (available < 57)
+					goto done;
+				visitor.OnRegionSummary(ysRegionSummaryEvent{load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), load_value<std::uint32_t>(pos + 21), load_value<ysTime>(pos + 25), load_value<ysTime>(pos + 33), load_value<ysTime>(pos + 41), load_value<double>(pos + 49)});
+				pos += 57;
+				break;
+			case ysEventType::Histogram:
+			{
+				if (available < 23)
+					goto done;
+				std::uint16_t const buckets = load_value<std::uint16_t>(pos + 21);
+				if (available - 23 < 6 * std::size_t(buckets))
+					goto done;
+				visitor.OnHistogram(ysHistogramEvent{load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), buckets, pos + 23});
+				pos += 23 + 6 * std::size_t(buckets);
+				break;
+			}
+			case ysEventType::Quantiles:
+				if (available < 22 + sizeof(ysQuantiles) * ysWindowCount)
+					goto done;
+				visitor.OnQuantiles(ysQuantilesEvent{load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), static_cast<ysEventType>(pos[21]), pos + 22});
+				pos += 22 + sizeof(ysQuantiles) * ysWindowCount;
+				break;
+			case ysEventType::CallTree:
+			{
+				if (available < 11)
+					goto done;
+				std::uint16_t const nodes = load_value<std::uint16_t>(pos + 9);
+				if (available - 11 < 36 * std::size_t(nodes))
+					goto done;
+				visitor.OnCallTree(ysCallTreeEvent{load_value<ysTime>(pos + 1), nodes, pos + 11});
+				pos += 11 + 36 * std::size_t(nodes);
+				break;
+			}
+			case ysEventType::Samples:
+			{
+				if (available < 15)
+					goto done;
+				std::uint16_t const nodes = load_value<std::uint16_t>(pos + 13);
+				if (available - 15 < 24 * std::size_t(nodes))
+					goto done;
+				visitor.OnSamples(ysSamplesEvent{load_value<ysTime>(pos + 1), load_value<std::uint32_t>(pos + 9), nodes, pos + 15});
+				pos += 15 + 24 * std::size_t(nodes);
+				break;
+			}
+			case ysEventType::Stall:
+				if (available < 29)
+					goto done;
+				visitor.OnStall(ysStallEvent{thread, load_value<std::uint32_t>(pos + 1), load_value<ysStringHandle>(pos + 5), load_value<ysStringHandle>(pos + 9), load_value<ysTime>(pos + 13), load_value<ysTime>(pos + 21)});
+				pos += 29;
+				break;
+			case ysEventType::Header:
+				if (available < 17)
+					goto done;
+				visitor.OnHeader(ysHeaderEvent{load_value<ysTime>(pos + 1), load_value<ysTime>(pos + 9)});
+				pos += 17;
+				break;
+			case ysEventType::None:
+				pos += 1;
+				break;
+			default:
+				out_failed = true;
+				goto done;
+			}
+		}
+
+	done:
+		inout_thread = thread;
+		return static_cast<std::size_t>(pos - data);
+	}
+} // namespace _ys_
+
+void ysEventBatch::Clear()
+{
+	ticks.thread.clear();
+	ticks.when.clear();
+
+	regions.thread.clear();
+	regions.line.clear();
+	regions.name.clear();
+	regions.file.clear();
+	regions.begin.clear();
+	regions.end.clear();
+
+	counterSets.thread.clear();
+	counterSets.line.clear();
+	counterSets.name.clear();
+	counterSets.file.clear();
+	counterSets.when.clear();
+	counterSets.value.clear();
+
+	counterAdds.thread.clear();
+	counterAdds.name.clear();
+	counterAdds.amount.clear();
+
+	regionSummaries.line.clear();
+	regionSummaries.name.clear();
+	regionSummaries.file.clear();
+	regionSummaries.when.clear();
+	regionSummaries.count.clear();
+	regionSummaries.total.clear();
+	regionSummaries.min.clear();
+	regionSummaries.max.clear();
+	regionSummaries.sumSquares.clear();
+
+	histograms.line.clear();
+	histograms.name.clear();
+	histograms.file.clear();
+	histograms.when.clear();
+	histograms.offset.clear();
+	histograms.size.clear();
+	histograms.bucket.clear();
+	histograms.count.clear();
+
+	quantiles.line.clear();
+	quantiles.name.clear();
+	quantiles.file.clear();
+	quantiles.when.clear();
+	quantiles.source.clear();
+	quantiles.windows.clear();
+
+	callTrees.when.clear();
+	callTrees.offset.clear();
+	callTrees.size.clear();
+	callTrees.node.clear();
+
+	samples.when.clear();
+	samples.samples.clear();
+	samples.offset.clear();
+	samples.size.clear();
+	samples.node.clear();
+
+	stalls.thread.clear();
+	stalls.line.clear();
+	stalls.name.clear();
+	stalls.file.clear();
+	stalls.since.clear();
+	stalls.when.clear();
+
+	strings.id.clear();
+	strings.offset.clear();
+	strings.size.clear();
+	strings.text.clear();
+
+	frequency = 0;
+	start = 0;
+}
+
+void ysEventBatch::OnTick(ysTickEvent const& ev)
+{
+	ticks.thread.push_back(ev.thread);
+	ticks.when.push_back(ev.when);
+}
+
+void ysEventBatch::OnRegion(ysRegionEvent const& ev)
+{
+	regions.thread.push_back(ev.thread);
+	regions.line.push_back(ev.line);
+	regions.name.push_back(ev.name);
+	regions.file.push_back(ev.file);
+	regions.begin.push_back(ev.begin);
+	regions.end.push_back(ev.end);
+}
+
+void ysEventBatch::OnCounterSet(ysCounterSetEvent const& ev)
+{
+	counterSets.thread.push_back(ev.thread);
+	counterSets.line.push_back(ev.line);
+	counterSets.name.push_back(ev.name);
+	counterSets.file.push_back(ev.file);
+	counterSets.when.push_back(ev.when);
+	counterSets.value.push_back(ev.value);
+}
+
+void ysEventBatch::OnCounterAdd(ysCounterAddEvent const& ev)
+{
+	counterAdds.thread.push_back(ev.thread);
+	counterAdds.name.push_back(ev.name);
+	counterAdds.amount.push_back(ev.amount);
+}
+
+void ysEventBatch::OnRegionSummary(ysRegionSummaryEvent const& ev)
+{
+	regionSummaries.line.push_back(ev.line);
+	regionSummaries.name.push_back(ev.name);
+	regionSummaries.file.push_back(ev.file);
+	regionSummaries.when.push_back(ev.when);
+	regionSummaries.count.push_back(ev.count);
+	regionSummaries.total.push_back(ev.total);
+	regionSummaries.min.push_back(ev.min);
+	regionSummaries.max.push_back(ev.max);
+	regionSummaries.sumSquares.push_back(ev.sumSquares);
+}
+
+void ysEventBatch::OnHistogram(ysHistogramEvent const& ev)
+{
+	histograms.line.push_back(ev.line);
+	histograms.name.push_back(ev.name);
+	histograms.file.push_back(ev.file);
+	histograms.when.push_back(ev.when);
+	histograms.offset.push_back(static_cast<std::uint32_t>(histograms.bucket.size()));
+	histograms.size.push_back(ev.buckets);
+	for (std::size_t index = 0; index != ev.buckets; ++index)
+	{
+		std::uint16_t bucket;
+		std::uint32_t count;
+		ev.GetBucket(index, bucket, count);
+		histograms.bucket.push_back(bucket);
+		histograms.count.push_back(count);
+	}
+}
+
+void ysEventBatch::OnQuantiles(ysQuantilesEvent const& ev)
+{
+	quantiles.line.push_back(ev.line);
+	quantiles.name.push_back(ev.name);
+	quantiles.file.push_back(ev.file);
+	quantiles.when.push_back(ev.when);
+	quantiles.source.push_back(ev.source);
+	for (std::size_t window = 0; window != ysWindowCount; ++window)
+	{
+		ysQuantiles windowQuantiles;
+		ev.GetWindow(static_cast<ysWindow>(window), windowQuantiles);
+		quantiles.windows.push_back(windowQuantiles);
+	}
+}
+
+void ysEventBatch::OnCallTree(ysCallTreeEvent const& ev)
+{
+	callTrees.when.push_back(ev.when);
+	callTrees.offset.push_back(static_cast<std::uint32_t>(callTrees.node.size()));
+	callTrees.size.push_back(ev.nodes);
+	for (std::size_t index = 0; index != ev.nodes; ++index)
+	{
+		ysCallTreeNode node;
+		ev.GetNode(index, node);
+		callTrees.node.push_back(node);
+	}
+}
+
+void ysEventBatch::OnSamples(ysSamplesEvent const& ev)
+{
+	samples.when.push_back(ev.when);
+	samples.samples.push_back(ev.samples);
+	samples.offset.push_back(static_cast<std::uint32_t>(samples.node.size()));
+	samples.size.push_back(ev.nodes);
+	for (std::size_t index = 0; index != ev.nodes; ++index)
+	{
+		ysSampleNode node;
+		ev.GetNode(index, node);
+		samples.node.push_back(node);
+	}
+}
+
+void ysEventBatch::OnStall(ysStallEvent const& ev)
+{
+	stalls.thread.push_back(ev.thread);
+	stalls.line.push_back(ev.line);
+	stalls.name.push_back(ev.name);
+	stalls.file.push_back(ev.file);
+	stalls.since.push_back(ev.since);
+	stalls.when.push_back(ev.when);
+}
+
+void ysEventBatch::OnString(ysStringEvent const& ev)
+{
+	strings.id.push_back(ev.id);
+	strings.offset.push_back(static_cast<std::uint32_t>(strings.text.size()));
+	strings.size.push_back(ev.size);
+	strings.text.insert(strings.text.end(), ev.str, ev.str + ev.size);
+}
+
+template <typename Visitor>
+ysResult ysEventDecoder::Decode(void const* data, std::size_t size, Visitor& visitor)
+{
+	if (_failed)
+		return ysResult::InvalidParameter;
+
+	if (data == nullptr && size != 0)
+		return ysResult::InvalidParameter;
+
+	unsigned char const* pos = static_cast<unsigned char const*>(data);
+	unsigned char const* const end = pos + size;
+
+	// complete an event left over from the previous call, topping it up until its full size is
+	// known. events are at most a call tree's 11 + 36 * 65535 bytes.
+	while (!_partial.empty())
+	{
+		std::size_t const needed = _ys_::encoded_event_size(_partial.data(), _partial.size());
+		if (needed == 0)
+		{
+			_failed = true;
+			return ysResult::InvalidParameter;
+		}
+
+		if (needed > _partial.size())
+		{
+			std::size_t const missing = needed - _partial.size();
+			std::size_t const taken = missing < static_cast<std::size_t>(end - pos) ? missing : static_cast<std::size_t>(end - pos);
+			_partial.insert(_partial.end(), pos, pos + taken);
+			pos += taken;
+			if (taken != missing)
+				return ysResult::Success;
+			continue;
+		}
+
+		_ys_::decode_events(_partial.data(), _partial.size(), _thread, visitor, _failed);
+		_partial.clear();
+	}
+
+	std::size_t const used = _ys_::decode_events(pos, static_cast<std::size_t>(end - pos), _thread, visitor, _failed);
+	if (_failed)
+		return ysResult::InvalidParameter;
+
+	_partial.assign(pos + used, end);
+	return ysResult::Success;
+}
+
+std::size_t ysDurationHistogram::BucketIndex(ysTime value)
+{
+	// the first two ranges are exact, and each later power of two is split into kSubBuckets
+	if (value < 2 * kSubBuckets)
+		return static_cast<std::size_t>(value);
+
+	unsigned const shift = _ys_::highest_bit(value) - kSubBucketBits;
+	return shift * kSubBuckets + static_cast<std::size_t>(value >> shift);
+}
+
+ysTime ysDurationHistogram::GetBucketLowest(std::size_t index)
+{
+	if (index < 2 * kSubBuckets)
+		return index;
+
+	unsigned const shift = static_cast<unsigned>(index / kSubBuckets - 1);
+	return static_cast<ysTime>(index % kSubBuckets + kSubBuckets) << shift;
+}
+
+void ysDurationHistogram::Record(ysTime duration)
+{
+	std::size_t const index = BucketIndex(duration);
+	if (index >= _counts.size())
+		_counts.resize(index + 1);
+	++_counts[index];
+	++_count;
+}
+
+void ysDurationHistogram::AddBucket(std::size_t index, std::uint64_t count)
+{
+	if (index >= _counts.size())
+		_counts.resize(index + 1);
+	_counts[index] += count;
+	_count += count;
+}
+
+void ysRegionStats::AddRegion(Site& site, ysTime duration, ysTime self)
+{
+	++site.count;
+	site.total += duration;
+	site.self += self;
+	if (duration < site.min)
+		site.min = duration;
+	if (duration > site.max)
+		site.max = duration;
+	site.durations.Record(duration);
+}
+
+void ysRegionStats::OnRegion(ysRegionEvent const& ev)
+{
+	ysTime const duration = ev.end > ev.begin ? ev.end - ev.begin : 0;
+
+	// regions on a thread end in order, so the regions nested within this one are exactly the
+	// pending regions it contains
+	std::vector<Pending>& pending = _pending[ev.thread];
+	ysTime children = 0;
+	while (!pending.empty() && pending.back().begin >= ev.begin && pending.back().end <= ev.end)
+	{
+		children += pending.back().end - pending.back().begin;
+		pending.pop_back();
+	}
+
+	if (pending.size() == kMaxPending)
+		pending.erase(pending.begin(), pending.begin() + kMaxPending / 2);
+	pending.push_back(Pending{ev.begin, ev.end});
+
+	if (ev.begin < _begin || ev.end > _end)
+		return;
+
+	ysTime const self = duration > children ? duration - children : 0;
+	Site& site = FindSite(_ys_::hash_site(ev.name, ev.file, ev.line), ev.name, ev.file, ev.line);
+	AddRegion(site, duration, self);
+	if (_perThread)
+		AddRegion(FindSite(_threadSites, _threadLookup, site, ev.thread), duration, self);
+}
+
+void ysRegionStats::OnRegionSummary(ysRegionSummaryEvent const& ev)
+{
+	if (ev.when < _begin || ev.when > _end)
+		return;
+
+	Site& site = FindSite(_ys_::hash_site(ev.name, ev.file, ev.line), ev.name, ev.file, ev.line);
+
+	site.count += ev.count;
+	site.summarized += ev.count;
+	site.total += ev.total;
+	if (ev.min < site.min)
+		site.min = ev.min;
+	if (ev.max > site.max)
+		site.max = ev.max;
+}
+
+template <typename Visitor>
+ysResult ysTraceReader::Decode(std::size_t first, std::size_t last, Visitor& visitor) const
+{
+	if (last > _blocks.size())
+		last = _blocks.size();
+
+	for (std::size_t index = first; index < last; ++index)
+	{
+		std::size_t size;
+		unsigned char const* const data = GetBlockData(index, size);
+
+		// the reader validated every block when it was opened, so an incomplete event is as
+		// malformed as an unknown one
+		std::uint16_t thread = 0;
+		bool failed = false;
+		if (_ys_::decode_events(data, size, thread, visitor, failed) != size || failed)
+			return ysResult::InvalidParameter;
+	}
+
+	return ysResult::Success;
+}
+
+template <typename Partial>
+ysResult ysTraceReader::DecodeParallel(std::size_t first, std::size_t last, Partial& inout_result, unsigned threads) const
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+
+	// enough partials that threads rarely wait for the merge to catch up
+	std::vector<Partial> partials(threads * 2);
+
+	return RunChunks(first, last, threads, partials.size(),
+		[&](std::size_t slot, std::size_t chunkFirst, std::size_t chunkLast) { return Decode(chunkFirst, chunkLast, partials[slot]); },
+		[&](std::size_t slot) { inout_result.Merge(partials[slot]); partials[slot] = Partial(); });
+}
+
+#endif // YARDSTICK_TRACE_H
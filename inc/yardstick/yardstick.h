@@ -31,9 +31,12 @@
 
 // ---- Public Dependencies ----
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cassert>
+#include <cstring>
+#include <type_traits>
 
 // ---- Support Code ----
 
@@ -73,8 +76,16 @@
 using ysTime = std::uint64_t;
 
 /// Type used to represent unique string identifiers.
+/// Handles are derived from the contents of the string, so the same string has the same handle
+/// across runs, builds, and hosts, as long as no two strings in the process share a handle.
+/// A string whose handle is already taken by a different string is rejected rather than given
+/// another handle: sites named by it are disabled and ysInternString returns 0 for it.
 using ysStringHandle = std::uint32_t;
 
+/// Type used to represent unique instrumentation site identifiers.
+/// Derived from the site's name, file, and line, and stable in the same way as string handles.
+using ysSiteHandle = std::uint32_t;
+
 /// Memory allocation callback.
 /// Follows the rules of realloc(), except that it will only be used to allocate or free.
 using ysAllocator = void*(YS_CALL*)(void* block, std::size_t bytes);
@@ -98,8 +109,262 @@ enum class ysResult : std::uint8_t
 	Disabled,
 	/// Yardstick has already been initialized.
 	AlreadyInitialized,
+	/// A string has the same handle as a different, previously registered string.
+	Collision,
+};
+
+/// Types of events.
+/// The values match the type byte of the wire protocol.
+enum class ysEventType : std::uint8_t
+{
+	None = 0,
+	/// Start of a stream, giving the clock frequency and start time.
+	Header = 1,
+	/// End of a frame, from ysTick.
+	Tick = 2,
+	/// A completed region, from ysProfile.
+	Region = 3,
+	/// A counter value, from ysCounterSet.
+	CounterSet = 4,
+	/// Definition of a string handle. Always delivered before the first event that uses the handle.
+	String = 5,
+	/// A counter increment, from ysCounterAdd.
+	CounterAdd = 6,
+	/// Marks the thread that emitted the events following it in an encoded stream.
+	Thread = 7,
+	/// Durations of the regions recorded at one site over a frame, in ysCaptureMode::Statistics,
+	/// in a frame that wasn't slow in ysCaptureMode::SlowFrames, or when shorter than the minimum duration.
+	RegionSummary = 8,
+	/// Histogram of the durations recorded at one ysProfileHistogram site over a frame.
+	Histogram = 9,
+	/// Quantiles of the values recorded at one site over each ysWindow, once a second.
+	Quantiles = 10,
+	/// Times of the paths through nested regions over a frame, in ysCaptureMode::CallTree.
+	CallTree = 11,
+	/// Samples of every thread's open regions per path of enclosing regions, once a second, from ysStartSampling.
+	Samples = 12,
+	/// A thread found inside the same region for longer than the threshold given to ysStartSampling.
+	Stall = 13,
+};
+
+/// Number of buckets in a duration histogram.
+/// Durations below 64 have a bucket each; every later power of two is split into 32 buckets, so
+/// durations are kept to within 1/32 of their size.
+constexpr std::size_t ysHistogramBuckets = 1920;
+
+/// Durations recorded at the ysProfileHistogram sites of one name, from ysQueryHistogram.
+struct ysHistogram
+{
+	std::uint64_t count;
+	std::uint64_t buckets[ysHistogramBuckets];
+};
+
+/// Sliding windows over which quantiles are estimated. Each ends at the start of the current second.
+enum class ysWindow : std::uint8_t
+{
+	Second,
+	TenSeconds,
+	Minute,
+};
+
+/// Number of ysWindow values.
+constexpr std::size_t ysWindowCount = 3;
+
+/// Quantiles of region durations or counter values over a ysWindow, each within 1% of its true value.
+/// Durations are in clock ticks.
+struct ysQuantiles
+{
+	std::uint64_t count;
+	double p50;
+	double p90;
+	double p99;
+	double p999;
+};
+
+/// One node of a CallTree event: a region reached by one path of enclosing regions.
+/// Encoded packed and little-endian, in field order, as 36 bytes.
+struct ysCallTreeNode
+{
+	/// Index of the enclosing node within the same event, which always comes earlier, or ~0 for a root.
+	std::uint32_t parent;
+	ysStringHandle name;
+	ysStringHandle file;
+	std::uint32_t line;
+	/// Number of regions that ended this frame. A node with none only encloses nodes that have some.
+	std::uint32_t count;
+	/// Time inside the regions.
+	ysTime inclusive;
+	/// Time inside the regions but outside the regions nested in them.
+	ysTime exclusive;
+};
+
+/// One node of a Samples event: a region reached by one path of enclosing regions.
+/// Encoded packed and little-endian, in field order, as 24 bytes.
+struct ysSampleNode
+{
+	/// Index of the enclosing node within the same event, which always comes earlier, or ~0 for a root.
+	std::uint32_t parent;
+	ysStringHandle name;
+	ysStringHandle file;
+	std::uint32_t line;
+	/// Number of samples that found a thread in this region with no other region open inside it.
+	std::uint32_t self;
+	/// Number of samples that found a thread in this region.
+	std::uint32_t total;
+};
+
+/// An event as delivered to a callback sink.
+struct ysEvent
+{
+	ysEventType type;
+	/// Index of the emitting thread, starting at 1, or 0 for events generated by Yardstick itself.
+	std::uint16_t thread;
+	union
+	{
+		struct
+		{
+			ysTime frequency;
+			ysTime start;
+		} header;
+		struct
+		{
+			ysTime when;
+		} tick;
+		struct
+		{
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			ysTime begin;
+			ysTime end;
+		} region;
+		struct
+		{
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			ysTime when;
+			double value;
+		} counter_set;
+		struct
+		{
+			ysStringHandle id;
+			std::uint16_t size;
+			/// Not NUL-terminated. Valid until Yardstick is shut down.
+			char const* str;
+		} string;
+		struct
+		{
+			ysStringHandle name;
+			double amount;
+		} counter_add;
+		/// Summed over every thread, so not attributed to any of them.
+		struct
+		{
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			std::uint32_t count;
+			/// End of the frame, just before its Tick event.
+			ysTime when;
+			ysTime total;
+			ysTime min;
+			ysTime max;
+			double sumSquares;
+		} region_summary;
+		/// Summed over every thread, so not attributed to any of them.
+		struct
+		{
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			/// Number of non-empty buckets.
+			std::uint16_t buckets;
+			/// End of the frame, just before its Tick event.
+			ysTime when;
+			/// For each non-empty bucket, its index as a 16-bit value followed by its count as a
+			/// 32-bit value, packed and little-endian. Only valid during the callback.
+			void const* data;
+		} histogram;
+		/// Estimated from every thread's values, so not attributed to any of them.
+		struct
+		{
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			/// Region for the durations of a region, or CounterSet for the values of a counter.
+			ysEventType source;
+			/// End of the windows.
+			ysTime when;
+			/// One ysQuantiles per ysWindow, in order, packed and little-endian. May not be aligned,
+			/// so copy the entries out. Only valid during the callback.
+			void const* data;
+		} quantiles;
+		/// Merged from every thread's regions, so not attributed to any of them.
+		struct
+		{
+			/// End of the frame, just before its Tick event.
+			ysTime when;
+			std::uint16_t nodes;
+			/// One ysCallTreeNode per node, each encoded as 36 packed bytes. Only valid during the callback.
+			void const* data;
+		} call_tree;
+		/// Taken from every thread, so not attributed to any of them.
+		struct
+		{
+			/// End of the second the samples were taken in.
+			ysTime when;
+			/// Number of times a thread was sampled, including those found outside any region.
+			std::uint32_t samples;
+			std::uint16_t nodes;
+			/// One ysSampleNode per node, each encoded as 24 packed bytes. Only valid during the callback.
+			void const* data;
+		} samples;
+		/// Attributed to the stalled thread.
+		struct
+		{
+			/// The innermost region the thread is in.
+			ysStringHandle name;
+			ysStringHandle file;
+			std::uint32_t line;
+			/// When the thread entered the region.
+			ysTime since;
+			/// When the thread was found still inside it.
+			ysTime when;
+		} stall;
+	};
+};
+
+/// File formats that events can be exported to.
+enum class ysExportFormat : std::uint8_t
+{
+	/// Chrome's JSON trace event format, as read by chrome://tracing and the Perfetto UI.
+	ChromeJson,
+	/// Perfetto's protobuf trace format.
+	Perfetto,
+};
+
+/// How regions are delivered to sinks.
+enum class ysCaptureMode : std::uint8_t
+{
+	/// Every region is delivered as a Region event, except those shorter than the minimum duration
+	/// from ysSetMinimumDuration or ysProfileAtLeast, which are summarized as in Statistics.
+	Events,
+	/// Regions are accumulated per site on the thread that records them, and one RegionSummary
+	/// event per active site is delivered at the end of each frame.
+	Statistics,
+	/// Regions are accumulated on the thread that records them per path of enclosing regions, and
+	/// one CallTree event merging every thread's paths is delivered at the end of each frame.
+	CallTree,
+	/// Regions are held on the thread that records them until the end of their frame. A frame slower
+	/// than the threshold from ysSetSlowFrameThreshold has all of its regions delivered as Region
+	/// events; the regions of any other frame are summarized as in Statistics.
+	SlowFrames,
 };
 
+/// Callback receiving batches of events, in order, on a thread owned by Yardstick.
+using ysEventCallback = void(YS_CALL*)(void* userData, ysEvent const* events, std::size_t count);
+
 // ---- Public Macros ----
 
 #if !defined(NO_YS)
@@ -108,17 +373,117 @@ enum class ysResult : std::uint8_t
 #	define ysInitialize(config) (::_ys_::initialize((config)))
 #	define ysShutdown() (::_ys_::shutdown())
 #	define ysTick() (::_ys_::tick())
-#	define ysListenWeb(port) (::_ys_::listen_web((port)))
+#	define ysListenWeb(port) (::_ys_::listen_web((port), 0))
+#	define ysListenWebWithHistory(port, historyBytes) (::_ys_::listen_web((port), (historyBytes)))
+#	define ysStartCapture(path) (::_ys_::start_capture((path)))
+#	define ysStopCapture() (::_ys_::stop_capture())
+#	define ysStartExport(path, format) (::_ys_::start_export((path), (format)))
+#	define ysStopExport() (::_ys_::stop_export())
+#	define ysStartFlightRecorder(path, bytes) (::_ys_::start_flight_recorder((path), (bytes)))
+#	define ysStopFlightRecorder() (::_ys_::stop_flight_recorder())
+#	define ysDumpFlightRecorder(path) (::_ys_::dump_flight_recorder((path)))
+#	define ysRequestFlightRecorderDump() (::_ys_::request_flight_recorder_dump())
+#	define ysDumpFlightRecorderOnSignal(signal) (::_ys_::dump_flight_recorder_on_signal((signal)))
+#	define ysAddCallbackSink(callback, userData) (::_ys_::add_callback_sink((callback), (userData)))
+#	define ysRemoveCallbackSink(callback, userData) (::_ys_::remove_callback_sink((callback), (userData)))
+#	define ysQueryDroppedEvents(count) (::_ys_::query_dropped_events((count)))
+#	define ysQueryStringCollisions(count) (::_ys_::query_string_collisions((count)))
+#	define ysSetCaptureMode(mode) (::_ys_::set_capture_mode((mode)))
+#	define ysSetMinimumDuration(nanoseconds) (::_ys_::set_minimum_duration((nanoseconds)))
+#	define ysSetSlowFrameThreshold(nanoseconds, percentile) (::_ys_::set_slow_frame_threshold((nanoseconds), (percentile)))
+#	define ysEnableCategory(category) (::_ys_::set_category_enabled((category), true))
+#	define ysDisableCategory(category) (::_ys_::set_category_enabled((category), false))
+#	define ysQueryHistogram(name, histogram) (::_ys_::query_histogram(YS_STRING_ID(name), (histogram)))
+#	define ysHistogramQuantile(histogram, quantile) (::_ys_::histogram_quantile((histogram), (quantile)))
+#	define ysQueryQuantiles(name, source, window, quantiles) (::_ys_::query_quantiles(YS_STRING_ID(name), (source), (window), (quantiles)))
+#	define ysStartSampling(rate, stallMilliseconds) (::_ys_::start_sampling((rate), (stallMilliseconds)))
+#	define ysStopSampling() (::_ys_::stop_sampling())
 
   /// Marks the current scope as being in a region, and automatically closes the region at the end of the scope.
 #	define ysProfile(name) \
-		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(("" name), __FILE__, __LINE__)
+		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(YS_SITE(name))
+
+	/// Equivalent to ysProfile, but also keeps a histogram of the region's durations, which is
+	/// delivered with each frame and can be read back with ysQueryHistogram.
+#	define ysProfileHistogram(name) \
+		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(YS_SITE_WITH(name, ::_ys_::kSiteHistogram))
+
+	/// Equivalent to ysProfile, but regions shorter than a number of nanoseconds are only counted in
+	/// a RegionSummary per frame, as if the minimum duration were raised for this site alone.
+#	define ysProfileAtLeast(name, nanoseconds) \
+		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(YS_SITE_WITH_MINIMUM(name, 0, (nanoseconds)))
 
 #	define ysCounterSet(name, value) \
-		(::_ys_::emit_record(::_ys_::read_clock(), (value), ("" name), __FILE__, __LINE__))
+		(::_ys_::emit_record(::_ys_::read_clock(), (value), YS_SITE(name)))
 
 #	define ysCounterAdd(name, amount) \
-		(::_ys_::emit_count((amount), ("" name)))
+		(::_ys_::emit_count((amount), YS_SITE(name)))
+
+	/// Equivalent to ysCounterAdd, for counters incremented from many threads at once. Increments
+	/// are summed per CPU rather than per thread.
+#	define ysCounterAddPerCpu(name, amount) \
+		(::_ys_::emit_count((amount), YS_SITE_WITH(name, ::_ys_::kSitePerCpu)))
+
+	/// Equivalent to ysProfile, in a category that can be disabled with ysDisableCategory. A region
+	/// in a disabled category costs a single check of its site and doesn't read the clock.
+#	define ysProfileIn(category, name) \
+		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(YS_SITE_IN(category, name))
+
+	/// Equivalent to ysCounterSet, in a category that can be disabled with ysDisableCategory.
+#	define ysCounterSetIn(category, name, value) \
+		(::_ys_::record_value((value), YS_SITE_IN(category, name)))
+
+	/// Equivalent to ysCounterAdd, in a category that can be disabled with ysDisableCategory.
+#	define ysCounterAddIn(category, name, amount) \
+		(::_ys_::add_count((amount), YS_SITE_IN(category, name)))
+
+	/// Copies a runtime-built string into Yardstick's string arena, if not already present, and
+	/// returns its handle. The handle may be used with the *Handle macros below and remains valid
+	/// until Yardstick is shut down. Returns 0 on failure, including when a different string
+	/// already has the same handle, the string is longer than 65535 bytes, or Yardstick is not
+	/// initialized. Collisions are counted by ysQueryStringCollisions.
+#	define ysInternString(str) (::_ys_::intern_string((str), ::std::strlen((str))))
+
+	/// Equivalent to ysProfile, but named by a handle from ysInternString.
+#	define ysProfileHandle(handle) \
+		::_ys_::ScopedRegion YS_CAT(_ys_region, __LINE__)(YS_SITE(#handle), (handle))
+
+	/// Equivalent to ysCounterSet, but named by a handle from ysInternString.
+#	define ysCounterSetHandle(handle, value) \
+		(::_ys_::emit_record(::_ys_::read_clock(), (value), YS_SITE(#handle), (handle)))
+
+	/// Equivalent to ysCounterAdd, but named by a handle from ysInternString.
+#	define ysCounterAddHandle(handle, amount) \
+		(::_ys_::emit_count((amount), YS_SITE(#handle), (handle)))
+
+	/// Computes the handle of a string literal at compile time.
+	/// @internal
+#	define YS_STRING_ID(str) (::std::integral_constant<::ysStringHandle, ::_ys_::hash_string("" str)>::value)
+
+	/// Yields a reference to the static site description for the current source location.
+	/// @internal
+#	define YS_SITE(name) YS_SITE_WITH(name, 0)
+
+	/// Equivalent to YS_SITE, with flags from SiteFlags.
+	/// @internal
+#	define YS_SITE_WITH(name, flags) YS_SITE_WITH_MINIMUM(name, flags, 0)
+
+	/// Equivalent to YS_SITE_WITH, with a minimum region duration in nanoseconds.
+	/// @internal
+#	define YS_SITE_WITH_MINIMUM(name, flags, minimum) YS_SITE_DEFINE(0, name, flags, minimum)
+
+	/// Equivalent to YS_SITE, in a category named by a string literal.
+	/// @internal
+#	define YS_SITE_IN(category, name) YS_SITE_DEFINE(YS_STRING_ID(category), name, 0, 0)
+
+	/// Defines a site with a category handle, or 0 for none, flags, and a minimum region duration.
+	/// @internal
+#	define YS_SITE_DEFINE(category, name, flags, minimum) \
+		([]() -> ::_ys_::Site& { \
+			static ::_ys_::Site _ys_site = { ("" name), __FILE__, __LINE__, YS_STRING_ID(name), YS_STRING_ID(__FILE__), \
+				::std::integral_constant<::ysSiteHandle, ::_ys_::hash_site(YS_STRING_ID(name), YS_STRING_ID(__FILE__), __LINE__)>::value, (flags), (minimum), (category), 0, { ::_ys_::kSiteUnseen }, 0, nullptr }; \
+			return _ys_site; \
+		}())
 
 #else // !defined(NO_YS)
 
@@ -127,9 +492,43 @@ enum class ysResult : std::uint8_t
 #	define ysShutdown() (::ysResult::Disabled)
 #	define ysTick() (::ysResult::Disabled)
 #	define ysProfile(name) do{YS_IGNORE((name));}while(false)
+#	define ysProfileHistogram(name) do{YS_IGNORE((name));}while(false)
+#	define ysProfileAtLeast(name, nanoseconds) do{YS_IGNORE((name));YS_IGNORE((nanoseconds));}while(false)
 #	define ysCounterSet(name, value) (YS_IGNORE((name)),YS_IGNORE((value)),::ysResult::Disabled)
 #	define ysCounterAdd(name, amount) (YS_IGNORE((name)),YS_IGNORE((amount)),::ysResult::Disabled)
+#	define ysCounterAddPerCpu(name, amount) (YS_IGNORE((name)),YS_IGNORE((amount)),::ysResult::Disabled)
+#	define ysProfileIn(category, name) do{YS_IGNORE((category));YS_IGNORE((name));}while(false)
+#	define ysCounterSetIn(category, name, value) (YS_IGNORE((category)),YS_IGNORE((name)),YS_IGNORE((value)),::ysResult::Disabled)
+#	define ysCounterAddIn(category, name, amount) (YS_IGNORE((category)),YS_IGNORE((name)),YS_IGNORE((amount)),::ysResult::Disabled)
+#	define ysInternString(str) (YS_IGNORE((str)),::ysStringHandle(0))
+#	define ysProfileHandle(handle) do{YS_IGNORE((handle));}while(false)
+#	define ysCounterSetHandle(handle, value) (YS_IGNORE((handle)),YS_IGNORE((value)),::ysResult::Disabled)
+#	define ysCounterAddHandle(handle, amount) (YS_IGNORE((handle)),YS_IGNORE((amount)),::ysResult::Disabled)
 #	define ysListenWeb(port) (YS_IGNORE((port)),::ysResult::Disabled)
+#	define ysListenWebWithHistory(port, historyBytes) (YS_IGNORE((port)),YS_IGNORE((historyBytes)),::ysResult::Disabled)
+#	define ysStartCapture(path) (YS_IGNORE((path)),::ysResult::Disabled)
+#	define ysStopCapture() (::ysResult::Disabled)
+#	define ysStartExport(path, format) (YS_IGNORE((path)),YS_IGNORE((format)),::ysResult::Disabled)
+#	define ysStopExport() (::ysResult::Disabled)
+#	define ysStartFlightRecorder(path, bytes) (YS_IGNORE((path)),YS_IGNORE((bytes)),::ysResult::Disabled)
+#	define ysStopFlightRecorder() (::ysResult::Disabled)
+#	define ysDumpFlightRecorder(path) (YS_IGNORE((path)),::ysResult::Disabled)
+#	define ysRequestFlightRecorderDump() do{}while(false)
+#	define ysDumpFlightRecorderOnSignal(signal) (YS_IGNORE((signal)),::ysResult::Disabled)
+#	define ysAddCallbackSink(callback, userData) (YS_IGNORE((callback)),YS_IGNORE((userData)),::ysResult::Disabled)
+#	define ysRemoveCallbackSink(callback, userData) (YS_IGNORE((callback)),YS_IGNORE((userData)),::ysResult::Disabled)
+#	define ysQueryDroppedEvents(count) (YS_IGNORE((count)),::ysResult::Disabled)
+#	define ysQueryStringCollisions(count) (YS_IGNORE((count)),::ysResult::Disabled)
+#	define ysSetCaptureMode(mode) (YS_IGNORE((mode)),::ysResult::Disabled)
+#	define ysSetMinimumDuration(nanoseconds) (YS_IGNORE((nanoseconds)),::ysResult::Disabled)
+#	define ysSetSlowFrameThreshold(nanoseconds, percentile) (YS_IGNORE((nanoseconds)),YS_IGNORE((percentile)),::ysResult::Disabled)
+#	define ysEnableCategory(category) (YS_IGNORE((category)),::ysResult::Disabled)
+#	define ysDisableCategory(category) (YS_IGNORE((category)),::ysResult::Disabled)
+#	define ysQueryHistogram(name, histogram) (YS_IGNORE((name)),YS_IGNORE((histogram)),::ysResult::Disabled)
+#	define ysHistogramQuantile(histogram, quantile) (YS_IGNORE((histogram)),YS_IGNORE((quantile)),::ysTime(0))
+#	define ysQueryQuantiles(name, source, window, quantiles) (YS_IGNORE((name)),YS_IGNORE((source)),YS_IGNORE((window)),YS_IGNORE((quantiles)),::ysResult::Disabled)
+#	define ysStartSampling(rate, stallMilliseconds) (YS_IGNORE((rate)),YS_IGNORE((stallMilliseconds)),::ysResult::Disabled)
+#	define ysStopSampling() (::ysResult::Disabled)
 
 #endif // !defined(NO_YS)
 
@@ -139,6 +538,78 @@ enum class ysResult : std::uint8_t
 
 namespace _ys_
 {
+	/// FNV-1a parameters used for string handles.
+	/// @internal
+	constexpr ysStringHandle kStringHashBasis = 2166136261u;
+	constexpr ysStringHandle kStringHashPrime = 16777619u;
+
+	/// Computes the handle of a string from its contents.
+	/// @internal
+	constexpr ysStringHandle hash_string(char const* str, ysStringHandle hash = kStringHashBasis)
+	{
+		return *str == '\0' ? hash : hash_string(str + 1, static_cast<ysStringHandle>((hash ^ static_cast<unsigned char>(*str)) * kStringHashPrime));
+	}
+
+	/// Mixes a value into an existing hash.
+	/// @internal
+	constexpr std::uint32_t hash_combine(std::uint32_t seed, std::uint32_t value)
+	{
+		return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+	}
+
+	/// Computes the handle of a site from its name, file, and line.
+	/// @internal
+	constexpr ysSiteHandle hash_site(ysStringHandle name, ysStringHandle file, std::uint32_t line)
+	{
+		return hash_combine(hash_combine(name, file), line);
+	}
+
+	/// Optional behaviors of an instrumentation site.
+	/// @internal
+	enum SiteFlags : std::uint32_t
+	{
+		/// Durations of the site's regions are also kept in a histogram.
+		kSiteHistogram = 1 << 0,
+		/// Increments of the site's counter are summed per CPU.
+		kSitePerCpu = 1 << 1,
+	};
+
+	/// Whether a site's category is enabled, kept in the site so that it is checked where the site is used.
+	/// @internal
+	enum SiteFilter : std::uint8_t
+	{
+		/// Yardstick hasn't seen the site yet, so it is treated as enabled until it has.
+		kSiteUnseen = 0,
+		kSiteEnabled,
+		kSiteDisabled,
+	};
+
+	/// Static description of an instrumentation site.
+	/// One instance exists for each expansion of ysProfile, ysCounterSet, or ysCounterAdd.
+	/// @internal
+	struct Site
+	{
+		char const* name;
+		char const* file;
+		std::uint32_t line;
+		ysStringHandle nameId;
+		ysStringHandle fileId;
+		ysSiteHandle id;
+		std::uint32_t flags;
+		/// Regions shorter than this many nanoseconds are summarized rather than delivered, or 0.
+		std::uint32_t minimum;
+		/// Handle of the category the site belongs to, or 0.
+		ysStringHandle category;
+
+		// owned by the Yardstick background thread
+		std::uint32_t epoch;
+
+		// set when Yardstick first sees the site, and owned by its category filter
+		std::atomic<std::uint8_t> filter;
+		ysTime minimumTicks;
+		Site* next;
+	};
+
 	/// Initializes the Yardstick library.
 	/// Must be called before any other Yardstick function.
 	/// @param allocator Custom allocator to override the default.
@@ -154,39 +625,188 @@ namespace _ys_
 
 	/// <summary> Listens for incoming Yardstick tool connections on the given port.  </summary>
 	/// <param name="port"> The port to listen on. </param>
+	/// <param name="history"> Bytes of recent events kept to replay to tools when they connect, or 0 for none. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL listen_web(unsigned short port, std::size_t history);
+
+	/// <summary> Starts writing all further events to a trace file, replacing any current capture. </summary>
+	/// <param name="path"> The file to create or overwrite. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL start_capture(char const* path);
+
+	/// <summary> Finishes writing the current trace file. </summary>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL stop_capture();
+
+	/// <summary> Starts writing all further events to a Chrome JSON or Perfetto trace, replacing any current export. </summary>
+	/// <param name="path"> The file to create or overwrite. </param>
+	/// <param name="format"> The format to write. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL start_export(char const* path, ysExportFormat format);
+
+	/// <summary> Finishes writing the current export. </summary>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL stop_export();
+
+	/// <summary> Starts keeping the most recent events in a ring file of fixed size, replacing any current recorder. </summary>
+	/// <remarks> The ring file survives a crash, and can be opened directly by the trace tools. </remarks>
+	/// <param name="path"> The ring file to create or overwrite. </param>
+	/// <param name="bytes"> Size of the ring file, which bounds how much history is kept. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL start_flight_recorder(char const* path, std::size_t bytes);
+
+	/// <summary> Stops the flight recorder. The ring file is left in place. </summary>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL stop_flight_recorder();
+
+	/// <summary> Writes the flight recorder's history to a trace file. </summary>
+	/// <param name="path"> The trace file to create or overwrite. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL dump_flight_recorder(char const* path);
+
+	/// <summary> Asks the flight recorder to dump its history next to its ring file as soon as possible. </summary>
+	/// <remarks> Safe to call from a signal handler. </remarks>
+	YS_API void YS_CALL request_flight_recorder_dump();
+
+	/// <summary> Installs a handler that requests a flight recorder dump whenever a signal is raised. </summary>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL dump_flight_recorder_on_signal(int signal);
+
+	/// <summary> Delivers all further events to a callback, alongside any other sinks. </summary>
+	/// <param name="callback"> Invoked with batches of events from a dedicated thread. </param>
+	/// <param name="userData"> Passed to the callback. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL add_callback_sink(ysEventCallback callback, void* userData);
+
+	/// <summary> Stops delivering events to a callback added with add_callback_sink. </summary>
 	/// <returns> Success or error code. </returns>
-	YS_API ysResult YS_CALL listen_web(unsigned short port);
+	YS_API ysResult YS_CALL remove_callback_sink(ysEventCallback callback, void* userData);
+
+	/// <summary> Counts the events sinks have dropped since initialize for falling too far behind. </summary>
+	/// <remarks> Trace files and exports never drop anything, short of memory. The websocket, flight recorder and callback sinks drop events once they are a whole buffer behind, until they have caught up, and are then sent again the strings they missed. </remarks>
+	/// <param name="out_count"> Receives the number of events dropped. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL query_dropped_events(std::uint64_t* out_count);
+
+	/// <summary> Counts the strings refused since initialize because a different string has the same handle. </summary>
+	/// <remarks> Each region or counter site is counted once when it is rejected, and its events are then discarded until the next initialize. Each intern_string call that returns 0 for a collision is counted too. </remarks>
+	/// <param name="out_count"> Receives the number of collisions. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL query_string_collisions(std::uint64_t* out_count);
+
+	/// <summary> Chooses whether regions are delivered individually, summarized per frame, or merged into a call tree per frame. </summary>
+	/// <remarks> May be called at any time, including before initialize. Summaries are delivered when ysTick is called. </remarks>
+	/// <param name="mode"> The mode to capture further regions in. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL set_capture_mode(ysCaptureMode mode);
+
+	/// <summary> Sets the duration below which regions are counted in a RegionSummary per frame instead of being delivered as Region events. </summary>
+	/// <remarks> May be called at any time, including before initialize. Applies in ysCaptureMode::Events, alongside any minimum of each site. Histograms still record every region. </remarks>
+	/// <param name="nanoseconds"> The minimum duration, or 0 to deliver every region. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL set_minimum_duration(std::uint64_t nanoseconds);
+
+	/// <summary> Sets how slow a frame must be for ysCaptureMode::SlowFrames to deliver its regions as Region events. </summary>
+	/// <remarks> May be called at any time, including before initialize. A frame is slow if it is longer than either limit. By default only the percentile, of 0.99, applies. </remarks>
+	/// <param name="nanoseconds"> The length of a slow frame, or 0 for none. </param>
+	/// <param name="percentile"> The fraction of the last 256 frames a slow frame must be longer than, from 0 to below 1, or 0 for none. Applies once 32 frames have ended. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL set_slow_frame_threshold(std::uint64_t nanoseconds, double percentile);
+
+	/// <summary> Turns the regions and counters of a category from ysProfileIn, ysCounterSetIn or ysCounterAddIn on or off. </summary>
+	/// <remarks> May be called at any time, including before initialize, and lasts until it is called again. Every category is enabled until it is first disabled. A region open when its category is disabled is discarded. </remarks>
+	/// <param name="category"> The name of the category. </param>
+	/// <param name="enabled"> Whether to deliver the category's regions and counters. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL set_category_enabled(char const* category, bool enabled);
+
+	/// <summary> Reads the durations recorded so far at every ysProfileHistogram site with a name. </summary>
+	/// <remarks> Durations are merged in the background, so the most recent ones may not be included yet. </remarks>
+	/// <param name="name"> The handle of the sites' name. </param>
+	/// <param name="out_histogram"> Receives the durations. Empty if no site has recorded any. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL query_histogram(ysStringHandle name, ysHistogram* out_histogram);
+
+	/// <summary> Estimates the duration below which a fraction of a histogram's durations fall. </summary>
+	/// <param name="quantile"> The fraction, from 0 to 1. </param>
+	/// <returns> The midpoint of the bucket holding the quantile, or 0 for an empty histogram. </returns>
+	YS_API ysTime YS_CALL histogram_quantile(ysHistogram const* histogram, double quantile);
+
+	/// <summary> Estimates quantiles of the durations recorded at every region site with a name, or of the values recorded at every counter site with a name. </summary>
+	/// <remarks> Values are sketched in the background from the events it delivers, so regions summarized in ysCaptureMode::Statistics or ysCaptureMode::CallTree, or for being shorter than the minimum duration, are not included. In ysCaptureMode::SlowFrames, regions of slow frames are included and those of other frames are not. </remarks>
+	/// <param name="name"> The handle of the sites' name. </param>
+	/// <param name="source"> Region for the durations of regions, or CounterSet for the values of counters. </param>
+	/// <param name="window"> The window of time to estimate over. </param>
+	/// <param name="out_quantiles"> Receives the estimates. Zero if no values were recorded in the window. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL query_quantiles(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles* out_quantiles);
+
+	/// <summary> Samples the regions every thread is inside from the background thread, and reports threads that stay inside one. </summary>
+	/// <remarks> May be called at any time, including before initialize, and again to change the rate or threshold. Regions entered before sampling starts are not seen. </remarks>
+	/// <param name="rate"> Samples per second, from 1 to 10000. </param>
+	/// <param name="stallMilliseconds"> How long a thread must stay inside its innermost region to be reported in a Stall event, or 0 to report none. </param>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL start_sampling(std::uint32_t rate, std::uint32_t stallMilliseconds);
+
+	/// <summary> Stops sampling started with start_sampling. The samples taken in the last second are still delivered. </summary>
+	/// <returns> Success or error code. </returns>
+	YS_API ysResult YS_CALL stop_sampling();
+
+	/// Interns a string.
+	/// @internal
+	YS_API ysStringHandle YS_CALL intern_string(char const* str, std::size_t length);
 
 	/// Emit a record.
+	/// A name of 0 uses the site's name.
 	/// @internal
-	YS_API ysResult YS_CALL emit_record(ysTime when, double value, char const* name, char const* file, int line);
+	YS_API ysResult YS_CALL emit_record(ysTime when, double value, Site& site, ysStringHandle name = 0);
 
 	/// Emit a counter.
+	/// A name of 0 uses the site's name.
 	/// @internal
-	YS_API ysResult YS_CALL emit_count(double amount, char const* name);
+	YS_API ysResult YS_CALL emit_count(double amount, Site& site, ysStringHandle name = 0);
 
 	/// Emit a region.
+	/// A name of 0 uses the site's name.
 	/// @internal
-	YS_API ysResult YS_CALL emit_region(ysTime startTime, ysTime endTime, char const* name, char const* file, int line);
+	YS_API ysResult YS_CALL emit_region(ysTime startTime, ysTime endTime, Site& site, ysStringHandle name = 0);
 
 	/// Read the current clock value.
 	/// @internal
 	YS_API ysTime YS_CALL read_clock();
 
+	/// Read the current clock value at the start of a region, entering it on the thread's shadow stack.
+	/// @internal
+	YS_API ysTime YS_CALL begin_region(Site& site, ysStringHandle name);
+
+	/// Reads the clock and records a counter value, unless the site's category is disabled.
+	/// @internal
+	inline ysResult record_value(double value, Site& site)
+	{
+		return site.filter.load(std::memory_order_relaxed) != kSiteDisabled ? emit_record(read_clock(), value, site) : ysResult::Success;
+	}
+
+	/// Adds to a counter, unless the site's category is disabled.
+	/// @internal
+	inline ysResult add_count(double amount, Site& site)
+	{
+		return site.filter.load(std::memory_order_relaxed) != kSiteDisabled ? emit_count(amount, site) : ysResult::Success;
+	}
+
 	/// Managed a scoped region.
 	/// @internal
 	struct ScopedRegion final
 	{
-		YS_INLINE ScopedRegion(char const* name, char const* file, int line) : _startTime(read_clock()), _name(name), _file(file), _line(line) {}
-		YS_INLINE ~ScopedRegion() { emit_region(_startTime, read_clock(), _name, _file, _line); }
+		YS_INLINE ScopedRegion(Site& site, ysStringHandle name = 0) : _enabled(site.filter.load(std::memory_order_relaxed) != kSiteDisabled), _startTime(_enabled ? begin_region(site, name) : 0), _site(site), _name(name) {}
+		YS_INLINE ~ScopedRegion() { if (_enabled) emit_region(_startTime, read_clock(), _site, _name); }
 
 		ScopedRegion(ScopedRegion const&) = delete;
 		ScopedRegion& operator=(ScopedRegion const&) = delete;
 
+		bool _enabled;
 		ysTime _startTime;
-		char const* _name;
-		char const* _file;
-		int _line;
+		Site& _site;
+		ysStringHandle _name;
 	};
 
 } // namespace _ys_
@@ -0,0 +1,128 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace _ys_ {
+
+/// Growable array of plain values, using the Yardstick allocator.
+template <typename T>
+class Array
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Array only supports trivially copyable types");
+
+	ysAllocator _allocator = nullptr;
+	T* _data = nullptr;
+	std::size_t _size = 0;
+	std::size_t _capacity = 0;
+
+public:
+	Array() = default;
+	~Array() { Reset(); }
+
+	Array(Array const&) = delete;
+	Array& operator=(Array const&) = delete;
+
+	void Initialize(ysAllocator allocator) { Reset(); _allocator = allocator; }
+	inline void Reset();
+	void Clear() { _size = 0; }
+
+	inline bool Reserve(std::size_t capacity);
+	inline bool Resize(std::size_t size);
+	inline void Swap(Array& other);
+	bool PushBack(T const& value) { if (_size == _capacity && !Reserve(_capacity != 0 ? _capacity * 2 : 64)) return false; _data[_size++] = value; return true; }
+
+	std::size_t Size() const { return _size; }
+	bool Empty() const { return _size == 0; }
+
+	T* Data() { return _data; }
+	T const* Data() const { return _data; }
+	T* begin() { return _data; }
+	T* end() { return _data + _size; }
+	T const* begin() const { return _data; }
+	T const* end() const { return _data + _size; }
+
+	T& operator[](std::size_t index) { return _data[index]; }
+	T const& operator[](std::size_t index) const { return _data[index]; }
+};
+
+template <typename T>
+void Array<T>::Reset()
+{
+	if (_data != nullptr)
+		_allocator(_data, 0);
+	_data = nullptr;
+	_size = 0;
+	_capacity = 0;
+}
+
+template <typename T>
+bool Array<T>::Reserve(std::size_t capacity)
+{
+	if (capacity <= _capacity)
+		return true;
+
+	if (_allocator == nullptr)
+		return false;
+
+	// the allocator is only ever used to allocate or free, never to resize
+	T* const data = static_cast<T*>(_allocator(nullptr, capacity * sizeof(T)));
+	if (data == nullptr)
+		return false;
+
+	if (_data != nullptr)
+	{
+		std::memcpy(data, _data, _size * sizeof(T));
+		_allocator(_data, 0);
+	}
+
+	_data = data;
+	_capacity = capacity;
+	return true;
+}
+
+template <typename T>
+bool Array<T>::Resize(std::size_t size)
+{
+	if (!Reserve(size))
+		return false;
+
+	// new elements are zero-filled
+	if (size > _size)
+		std::memset(_data + _size, 0, (size - _size) * sizeof(T));
+	_size = size;
+	return true;
+}
+
+template <typename T>
+void Array<T>::Swap(Array& other)
+{
+	std::swap(_allocator, other._allocator);
+	std::swap(_data, other._data);
+	std::swap(_size, other._size);
+	std::swap(_capacity, other._capacity);
+}
+
+} // namespace _ys_
@@ -0,0 +1,167 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "BlockWriter.h"
+#include "Protocol.h"
+
+#include <cstring>
+
+using namespace _ys_;
+
+namespace {
+
+void ExtendRange(TraceBlockHeader& header, ysTime begin, ysTime end)
+{
+	if (header.begin == 0 && header.end == 0)
+	{
+		header.begin = begin;
+		header.end = end;
+		return;
+	}
+
+	if (begin < header.begin)
+		header.begin = begin;
+	if (end > header.end)
+		header.end = end;
+}
+
+} // anonymous namespace
+
+void BlockWriter::Begin(void* buffer, std::size_t capacity, std::uint64_t firstTick)
+{
+	_buffer = static_cast<char*>(buffer);
+	_capacity = capacity;
+	_size = kReserved;
+	_last = kReserved;
+	_current = nullptr;
+
+	std::memset(&_header, 0, sizeof(_header));
+	_header.magic = kTraceBlockMagic;
+	_header.firstTick = firstTick;
+}
+
+bool BlockWriter::SelectThread(std::uint16_t thread)
+{
+	if (_current != nullptr && _current->thread == thread)
+		return true;
+
+	EventData marker;
+	marker.type = EventType::Thread;
+	marker.thread = thread;
+
+	std::size_t length;
+	if (EncodeEvent(_buffer + _size, _capacity - _size, marker, length) != ysResult::Success)
+		return false;
+
+	TraceBlockThread* const end = _threads + _header.threads;
+	TraceBlockThread* entry = _threads;
+	while (entry != end && entry->thread != thread)
+		++entry;
+
+	if (entry == end)
+	{
+		if (_header.threads == kMaxThreads)
+			return false;
+
+		entry->thread = thread;
+		entry->reserved = 0;
+		entry->events = 0;
+		++_header.threads;
+	}
+
+	_size += length;
+	_current = entry;
+	return true;
+}
+
+bool BlockWriter::Append(EventData const& ev)
+{
+	if (_buffer == nullptr)
+		return false;
+
+	bool const threaded = IsThreadEvent(ev.type);
+
+	// the marker and the event must fit together, or the marker would be stranded
+	std::size_t const needed = EncodeSize(ev) + (threaded ? 3 : 0);
+	if (needed > _capacity - _size)
+		return false;
+
+	if (threaded && !SelectThread(ev.thread))
+		return false;
+
+	std::size_t length;
+	if (EncodeEvent(_buffer + _size, _capacity - _size, ev, length) != ysResult::Success)
+		return false;
+	_last = _size;
+	_size += length;
+
+	++_header.events;
+	if (threaded)
+		++_current->events;
+
+	switch (ev.type)
+	{
+	case EventType::Tick:
+		++_header.ticks;
+		ExtendRange(_header, ev.tick.when, ev.tick.when);
+		break;
+	case EventType::Region:
+		ExtendRange(_header, ev.region.begin, ev.region.end);
+		break;
+	case EventType::CounterSet:
+		ExtendRange(_header, ev.counter_set.when, ev.counter_set.when);
+		break;
+	case EventType::RegionSummary:
+		ExtendRange(_header, ev.region_summary.when, ev.region_summary.when);
+		break;
+	case EventType::Histogram:
+		ExtendRange(_header, ev.histogram.when, ev.histogram.when);
+		break;
+	case EventType::Quantiles:
+		ExtendRange(_header, ev.quantiles.when, ev.quantiles.when);
+		break;
+	case EventType::CallTree:
+		ExtendRange(_header, ev.call_tree.when, ev.call_tree.when);
+		break;
+	case EventType::Samples:
+		ExtendRange(_header, ev.samples.when, ev.samples.when);
+		break;
+	case EventType::Stall:
+		ExtendRange(_header, ev.stall.since, ev.stall.when);
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+void const* BlockWriter::Finish(std::size_t& out_size)
+{
+	std::size_t const table = _header.threads * sizeof(TraceBlockThread);
+	char* const start = _buffer + kReserved - table - sizeof(TraceBlockHeader);
+
+	_header.size = static_cast<std::uint32_t>(_size - kReserved);
+
+	std::memcpy(start, &_header, sizeof(_header));
+	std::memcpy(start + sizeof(_header), _threads, table);
+
+	out_size = _size - (start - _buffer);
+	return start;
+}
@@ -0,0 +1,80 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "TraceFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace _ys_ {
+
+struct EventData;
+
+/// Encodes events into a trace block in caller-provided memory.
+/// The block header and thread table are written in front of the payload once the block is
+/// finished, so a finished block is a single contiguous range of bytes.
+class BlockWriter
+{
+public:
+	static constexpr std::size_t kMaxThreads = 256;
+	static constexpr std::size_t kReserved = sizeof(TraceBlockHeader) + kMaxThreads * sizeof(TraceBlockThread);
+
+private:
+	char* _buffer = nullptr;
+	std::size_t _capacity = 0;
+	std::size_t _size = 0;
+	std::size_t _last = 0;
+
+	TraceBlockHeader _header;
+	TraceBlockThread _threads[kMaxThreads];
+	TraceBlockThread* _current = nullptr;
+
+	bool SelectThread(std::uint16_t thread);
+
+public:
+	BlockWriter() { Begin(nullptr, 0, 0); }
+
+	BlockWriter(BlockWriter const&) = delete;
+	BlockWriter& operator=(BlockWriter const&) = delete;
+
+	/// <summary> Starts a new block. </summary>
+	/// <param name="buffer"> Memory for the block, which must be larger than kReserved. </param>
+	/// <param name="firstTick"> Number of ticks written to the stream before this block. </param>
+	void Begin(void* buffer, std::size_t capacity, std::uint64_t firstTick);
+
+	/// <summary> Appends an event to the block. </summary>
+	/// <returns> False if the block has no room left for the event. </returns>
+	bool Append(EventData const& ev);
+
+	/// <summary> Writes the block header and thread table in front of the payload. </summary>
+	/// <returns> The start of the finished block. </returns>
+	void const* Finish(std::size_t& out_size);
+
+	bool IsEmpty() const { return _header.events == 0; }
+	/// Offset of the most recently appended event within the payload.
+	std::size_t GetLastPosition() const { return _last - kReserved; }
+	TraceBlockHeader const& GetHeader() const { return _header; }
+	std::uint64_t GetNextTick() const { return _header.firstTick + _header.ticks; }
+};
+
+} // namespace _ys_
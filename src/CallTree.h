@@ -0,0 +1,155 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "PointerHash.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace _ys_ {
+
+/// <summary> Marks the absence of a node, such as the parent of a root. </summary>
+static constexpr std::uint32_t kNoNode = ~std::uint32_t(0);
+
+/// <summary> A region reached by one path of enclosing regions, with its times over a frame. </summary>
+struct CallTreeNode
+{
+	Site* site;
+	ysStringHandle name;
+	std::uint32_t parent;
+	std::uint32_t count;
+	// time inside the region, and the part of it not spent in regions nested inside
+	ysTime inclusive;
+	ysTime exclusive;
+	// left to the table's owner: the merged node of a thread's node, or a frame node's place in its event
+	std::uint32_t mark;
+};
+
+/// <summary> An open region on a thread's shadow stack. </summary>
+struct CallStackEntry
+{
+	// read by the background thread while sampling, so they may be seen mid-change
+	std::atomic<Site*> site;
+	std::atomic<ysStringHandle> name;
+	std::atomic<ysTime> start;
+
+	// only used by the owning thread
+	std::uint32_t node;
+	// time spent in the regions nested inside that have already ended
+	ysTime children;
+};
+
+/// <summary> Tree of CallTreeNode, keyed by parent, site and name. </summary>
+/// <remarks> Nodes are never removed, so their indices stay valid; a node is always added after its parent. ClearTimes empties every node's times. </remarks>
+template <std::uint32_t S>
+class CallTreeTable
+{
+	static constexpr std::uint32_t kCapacity = S;
+	// the index is kept at most half full, which keeps probes short
+	static constexpr std::uint32_t kIndexSize = kCapacity * 2;
+	static constexpr std::uint32_t kIndexMask = kIndexSize - 1;
+
+	static_assert((kCapacity & (kCapacity - 1)) == 0, "CallTreeTable size must be a power of 2");
+
+	CallTreeNode _nodes[kCapacity];
+	// one more than the index of a node, or 0 for an empty slot
+	std::uint32_t _index[kIndexSize];
+	std::uint32_t _count = 0;
+
+public:
+	CallTreeTable() { std::memset(_index, 0, sizeof(_index)); }
+	CallTreeTable(CallTreeTable const&) = delete;
+	CallTreeTable& operator=(CallTreeTable const&) = delete;
+
+	/// <summary> Finds the node of a site entered from a parent, adding it if there is none. </summary>
+	/// <param name="parent"> The parent node, or kNoNode for a root. </param>
+	/// <returns> The node, or kNoNode if the table is full. </returns>
+	inline std::uint32_t FindChild(std::uint32_t parent, Site& site, ysStringHandle name);
+
+	/// <summary> Adds one region's times to a node. </summary>
+	void Record(std::uint32_t node, ysTime inclusive, ysTime exclusive)
+	{
+		CallTreeNode& entry = _nodes[node];
+		++entry.count;
+		entry.inclusive += inclusive;
+		entry.exclusive += exclusive;
+	}
+
+	/// <summary> Adds the times accumulated by another node to a node. </summary>
+	void Merge(std::uint32_t node, CallTreeNode const& from)
+	{
+		CallTreeNode& entry = _nodes[node];
+		entry.count += from.count;
+		entry.inclusive += from.inclusive;
+		entry.exclusive += from.exclusive;
+	}
+
+	std::uint32_t GetCount() const { return _count; }
+	CallTreeNode& GetNode(std::uint32_t index) { return _nodes[index]; }
+	CallTreeNode const& GetNode(std::uint32_t index) const { return _nodes[index]; }
+
+	inline void ClearTimes();
+};
+
+template <std::uint32_t S>
+std::uint32_t CallTreeTable<S>::FindChild(std::uint32_t parent, Site& site, ysStringHandle name)
+{
+	for (std::uint32_t slot = hash_combine(hash_combine(hash_pointer(&site), name), parent) & kIndexMask;; slot = (slot + 1) & kIndexMask)
+	{
+		std::uint32_t const index = _index[slot];
+		if (index == 0)
+		{
+			if (_count == kCapacity)
+				return kNoNode;
+
+			CallTreeNode& entry = _nodes[_count];
+			entry.site = &site;
+			entry.name = name;
+			entry.parent = parent;
+			entry.count = 0;
+			entry.inclusive = 0;
+			entry.exclusive = 0;
+			entry.mark = kNoNode;
+			_index[slot] = ++_count;
+			return _count - 1;
+		}
+
+		CallTreeNode const& entry = _nodes[index - 1];
+		if (entry.site == &site && entry.name == name && entry.parent == parent)
+			return index - 1;
+	}
+}
+
+template <std::uint32_t S>
+void CallTreeTable<S>::ClearTimes()
+{
+	for (std::uint32_t index = 0; index != _count; ++index)
+	{
+		CallTreeNode& entry = _nodes[index];
+		entry.count = 0;
+		entry.inclusive = 0;
+		entry.exclusive = 0;
+	}
+}
+
+} // namespace _ys_
@@ -0,0 +1,45 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CallbackSink.h"
+#include "Protocol.h"
+
+using namespace _ys_;
+
+ysResult CallbackSink::Consume(EventData const* events, std::size_t count)
+{
+	ysEvent batch[kBatchSize];
+	std::size_t used = 0;
+
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		ConvertEvent(events[index], batch[used++]);
+
+		if (used == kBatchSize)
+		{
+			_callback(_userData, batch, used);
+			used = 0;
+		}
+	}
+
+	if (used != 0)
+		_callback(_userData, batch, used);
+
+	return ysResult::Success;
+}
@@ -68,3 +68,18 @@ static inline ysTime GetClockFrequency()
 } // namespace _ys_
 
 #endif
+
+#include <chrono>
+
+namespace _ys_ {
+
+/// Reads the wall clock, in nanoseconds since the Unix epoch.
+/// Only used to relate the clocks of different processes, so precision matters less than for ReadClock.
+/// @internal
+static inline std::int64_t ReadRealtime()
+{
+	auto const time = std::chrono::system_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+} // namespace _ys_
@@ -45,6 +45,7 @@ public:
 
 	bool TryWrite(void const* data, std::uint32_t size);
 	int Read(void* out, std::uint32_t max);
+	bool IsEmpty() const { return _write.load(std::memory_order_acquire) == _read.load(std::memory_order_acquire); }
 };
 
 template <std::uint32_t S>
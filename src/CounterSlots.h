@@ -0,0 +1,114 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "PointerHash.h"
+
+#include <atomic>
+
+namespace _ys_ {
+
+/// <summary> The increments one thread has made to one counter, summed. </summary>
+struct CounterSlot
+{
+	Site* site;
+	ysStringHandle name;
+	/// Running total, written by the owning thread only.
+	std::atomic<double> total;
+	/// The total already delivered, owned by the Yardstick background thread.
+	double seen;
+};
+
+/// <summary> Open addressed table of CounterSlot, keyed by site and name, filled by one thread and read by another. </summary>
+/// <remarks>
+/// Only the owning thread adds slots or changes totals, so adding is a relaxed load and store of
+/// the total with no atomic read-modify-write. A slot's key is written before the slot is
+/// published through the used count, and never changes afterwards. The reader delivers the
+/// difference between a total and what it saw last; totals stay exact up to 2^53 for whole
+/// amounts, and to within the total's precision otherwise.
+/// </remarks>
+template <std::uint32_t S>
+class CounterSlotTable
+{
+	static constexpr std::uint32_t kCapacity = S;
+	static constexpr std::uint32_t kMask = kCapacity - 1;
+	// slots are only claimed while the table is at most 3/4 full, which keeps probes short
+	static constexpr std::uint32_t kLimit = kCapacity / 4 * 3;
+
+	static_assert((kCapacity & kMask) == 0, "CounterSlotTable size must be a power of 2");
+
+	CounterSlot _slots[kCapacity];
+	std::uint32_t _used[kLimit];
+	std::atomic<std::uint32_t> _usedCount;
+
+public:
+	CounterSlotTable() : _usedCount(0)
+	{
+		for (CounterSlot& slot : _slots)
+		{
+			slot.site = nullptr;
+			slot.name = 0;
+			slot.total.store(0, std::memory_order_relaxed);
+			slot.seen = 0;
+		}
+	}
+	CounterSlotTable(CounterSlotTable const&) = delete;
+	CounterSlotTable& operator=(CounterSlotTable const&) = delete;
+
+	/// <summary> Adds an amount to a counter's total. Only called by the owning thread. </summary>
+	/// <returns> False if the counter has no slot and the table is full. </returns>
+	inline bool Add(Site& site, ysStringHandle name, double amount);
+
+	/// <summary> Number of slots published to the reader. </summary>
+	std::uint32_t GetCount() const { return _usedCount.load(std::memory_order_acquire); }
+	CounterSlot& GetSlot(std::uint32_t index) { return _slots[_used[index]]; }
+};
+
+template <std::uint32_t S>
+bool CounterSlotTable<S>::Add(Site& site, ysStringHandle name, double amount)
+{
+	for (std::uint32_t index = hash_combine(hash_pointer(&site), name) & kMask;; index = (index + 1) & kMask)
+	{
+		CounterSlot& slot = _slots[index];
+		if (slot.site == &site && slot.name == name)
+		{
+			slot.total.store(slot.total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+			return true;
+		}
+
+		if (slot.site == nullptr)
+		{
+			std::uint32_t const count = _usedCount.load(std::memory_order_relaxed);
+			if (count == kLimit)
+				return false;
+
+			slot.site = &site;
+			slot.name = name;
+			slot.total.store(amount, std::memory_order_relaxed);
+			_used[count] = index;
+			_usedCount.store(count + 1, std::memory_order_release);
+			return true;
+		}
+	}
+}
+
+} // namespace _ys_
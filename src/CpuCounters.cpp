@@ -0,0 +1,297 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuCounters.h"
+#include "PointerHash.h"
+
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if defined(__linux__)
+#	include <unistd.h>
+#	if defined(__has_include) && defined(__has_builtin)
+#		if __has_include(<sys/rseq.h>) && __has_builtin(__builtin_thread_pointer)
+#			include <sys/rseq.h>
+#			define YS_HAS_RSEQ 1
+#			if defined(__x86_64__)
+#				define YS_HAS_RSEQ_COMMIT 1
+#			endif
+#		endif
+#	endif
+#endif
+
+#define YS_STR2(x) #x
+#define YS_STR(x) YS_STR2(x)
+
+using namespace _ys_;
+
+namespace {
+
+// order in which the calling thread first added while the current CPU was unknown, plus one
+thread_local std::uint32_t tFallbackShard = 0;
+std::atomic<std::uint32_t> gNextFallbackShard(0);
+
+#if defined(YS_HAS_RSEQ)
+struct rseq* GetRseqArea()
+{
+	// glibc leaves __rseq_size at zero if it could not register the thread's area
+	if (__rseq_size == 0)
+		return nullptr;
+	return reinterpret_cast<struct rseq*>(static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+}
+#endif
+
+#if defined(YS_HAS_RSEQ_COMMIT)
+// adds to a slot of the given CPU's block as a restartable sequence. the kernel sends the thread to
+// the abort label instead if it is preempted, migrated or signalled before the final store, so the
+// store only ever happens on that CPU and nothing else can have written the slot in between.
+bool AddOnCpu(struct rseq* area, std::uint32_t cpu, std::atomic<std::uint64_t>* slot, double amount)
+{
+	__asm__ __volatile__ goto (
+		".pushsection __rseq_cs, \"aw\"\n\t"
+		".balign 32\n\t"
+		"3:\n\t"
+		".long 0, 0\n\t"
+		".quad 1f, (2f - 1f), 4f\n\t"
+		".popsection\n\t"
+		"leaq 3b(%%rip), %%rax\n\t"
+		"movq %%rax, %[cs]\n\t"
+		"1:\n\t"
+		"cmpl %[cpu], %[current]\n\t"
+		"jnz 4f\n\t"
+		"movsd %[slot], %%xmm0\n\t"
+		"addsd %[amount], %%xmm0\n\t"
+		"movsd %%xmm0, %[slot]\n\t"
+		"2:\n\t"
+		".pushsection __rseq_failure, \"ax\"\n\t"
+		// the kernel only jumps to an abort label preceded by the signature glibc registered
+		".byte 0x0f, 0xb9, 0x3d\n\t"
+		".long " YS_STR(RSEQ_SIG) "\n\t"
+		"4:\n\t"
+		"jmp %l[aborted]\n\t"
+		".popsection\n\t"
+		:
+		: [cs] "m" (area->rseq_cs), [cpu] "r" (cpu), [current] "m" (area->cpu_id), [slot] "m" (*slot), [amount] "x" (amount)
+		: "memory", "cc", "rax", "xmm0"
+		: aborted);
+	return true;
+aborted:
+	return false;
+}
+#endif
+
+std::uint32_t CountCpus()
+{
+#if defined(__linux__)
+	// configured rather than online CPUs, as CPUs brought online later keep their numbers
+	long const cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (cpus > 0)
+		return cpus < 1024 ? static_cast<std::uint32_t>(cpus) : 1024;
+#endif
+	unsigned const threads = std::thread::hardware_concurrency();
+	return threads != 0 ? threads : 1;
+}
+
+} // anonymous namespace
+
+ysResult CpuCounterTable::Initialize(ysAllocator allocator)
+{
+	// the memory of the initialization before last is freed now, while the last one's is kept for
+	// the threads that got past IsActive before the shutdown and may still be adding to it
+	if (_retiredMemory != nullptr)
+		_retiredAllocator(_retiredMemory, 0);
+	_retiredMemory = _memory;
+	_retiredAllocator = _allocator;
+
+	_allocator = allocator;
+	_shards = CountCpus();
+
+	// the entries come first, then the slots, where every shard starts on a cache line of its own
+	std::size_t const slotCount = std::size_t(kMaxCounters) * (_shards + 1);
+	std::size_t const bytes = sizeof(Entry) * kCapacity + kCachelineSize + sizeof(std::atomic<std::uint64_t>) * slotCount;
+	_memory = _allocator(nullptr, bytes);
+	if (_memory == nullptr)
+	{
+		_entries.store(nullptr, std::memory_order_release);
+		_slots.store(nullptr, std::memory_order_release);
+		return ysResult::NoMemory;
+	}
+
+	Entry* const entries = static_cast<Entry*>(_memory);
+	for (std::uint32_t index = 0; index != kCapacity; ++index)
+	{
+		Entry* const entry = new (entries + index) Entry;
+		entry->site.store(nullptr, std::memory_order_relaxed);
+		entry->index.store(0, std::memory_order_relaxed);
+	}
+
+	std::uintptr_t const aligned = (reinterpret_cast<std::uintptr_t>(entries + kCapacity) + kCachelineSize - 1) & ~std::uintptr_t(kCachelineSize - 1);
+	std::atomic<std::uint64_t>* const slots = reinterpret_cast<std::atomic<std::uint64_t>*>(aligned);
+	for (std::size_t index = 0; index != slotCount; ++index)
+		new (slots + index) std::atomic<std::uint64_t>(0);
+
+	for (std::uint32_t index = 0; index != kMaxCounters; ++index)
+	{
+		_sites[index].store(nullptr, std::memory_order_relaxed);
+		_seen[index] = 0;
+	}
+	_count.store(0, std::memory_order_release);
+
+	_entries.store(entries, std::memory_order_release);
+	_slots.store(slots, std::memory_order_release);
+
+	return ysResult::Success;
+}
+
+bool CpuCounterTable::Add(Site& site, double amount)
+{
+	Entry* const entries = _entries.load(std::memory_order_acquire);
+	std::atomic<std::uint64_t>* const slots = _slots.load(std::memory_order_acquire);
+	if (entries == nullptr || slots == nullptr)
+		return false;
+
+	std::uint32_t const index = FindIndex(entries, site);
+	if (index == kNoIndex)
+		return false;
+
+	if (AddToCurrentCpu(slots, index, amount))
+		return true;
+
+	std::atomic<std::uint64_t>& slot = slots[std::size_t(GetShard()) * kMaxCounters + index];
+
+	std::uint64_t expected = slot.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		double total;
+		std::memcpy(&total, &expected, sizeof(total));
+		total += amount;
+
+		std::uint64_t desired;
+		std::memcpy(&desired, &total, sizeof(desired));
+		if (slot.compare_exchange_weak(expected, desired, std::memory_order_relaxed))
+			return true;
+	}
+}
+
+std::uint32_t CpuCounterTable::GetCount() const
+{
+	std::uint32_t const count = _count.load(std::memory_order_acquire);
+	return count < kMaxCounters ? count : kMaxCounters;
+}
+
+double CpuCounterTable::ReadTotal(std::uint32_t index) const
+{
+	std::atomic<std::uint64_t> const* const slots = _slots.load(std::memory_order_acquire);
+
+	double sum = 0;
+	for (std::uint32_t shard = 0; shard != _shards + 1; ++shard)
+	{
+		std::uint64_t const bits = slots[std::size_t(shard) * kMaxCounters + index].load(std::memory_order_relaxed);
+		double total;
+		std::memcpy(&total, &bits, sizeof(total));
+		sum += total;
+	}
+	return sum;
+}
+
+std::uint32_t CpuCounterTable::FindIndex(Entry* entries, Site& site)
+{
+	for (std::uint32_t probe = 0, position = hash_pointer(&site) & kMask; probe != kCapacity; ++probe, position = (position + 1) & kMask)
+	{
+		Entry& entry = entries[position];
+
+		Site* current = entry.site.load(std::memory_order_acquire);
+		if (current == nullptr)
+		{
+			if (entry.site.compare_exchange_strong(current, &site, std::memory_order_acq_rel))
+			{
+				std::uint32_t const index = _count.fetch_add(1, std::memory_order_relaxed);
+				if (index >= kMaxCounters)
+				{
+					entry.index.store(kNoIndex, std::memory_order_release);
+					return kNoIndex;
+				}
+
+				_sites[index].store(&site, std::memory_order_release);
+				entry.index.store(index + 1, std::memory_order_release);
+				return index;
+			}
+			// current now holds the site that won the entry
+		}
+
+		if (current != &site)
+			continue;
+
+		// the entry may have been claimed but not yet given an index by another thread
+		std::uint32_t index;
+		while ((index = entry.index.load(std::memory_order_acquire)) == 0)
+			;
+		return index != kNoIndex ? index - 1 : kNoIndex;
+	}
+
+	return kNoIndex;
+}
+
+bool CpuCounterTable::AddToCurrentCpu(std::atomic<std::uint64_t>* slots, std::uint32_t index, double amount)
+{
+#if defined(YS_HAS_RSEQ_COMMIT)
+	struct rseq* const area = GetRseqArea();
+	if (area == nullptr)
+		return false;
+
+	// an aborted sequence is retried on whichever CPU the thread is now on
+	for (;;)
+	{
+		std::uint32_t const cpu = __atomic_load_n(&area->cpu_id, __ATOMIC_RELAXED);
+		if (static_cast<std::int32_t>(cpu) < 0 || cpu >= _shards)
+			return false;
+
+		if (AddOnCpu(area, cpu, &slots[std::size_t(cpu) * kMaxCounters + index], amount))
+			return true;
+	}
+#else
+	(void)slots;
+	(void)index;
+	(void)amount;
+	return false;
+#endif
+}
+
+std::uint32_t CpuCounterTable::GetShard() const
+{
+#if defined(YS_HAS_RSEQ)
+	if (struct rseq const* const area = GetRseqArea())
+	{
+#	if defined(YS_HAS_RSEQ_COMMIT)
+		// the CPUs' blocks belong to the restartable sequences, which an atomic update could race
+		// with, so a thread that can't use one shares the last block
+		return _shards;
+#	else
+		std::uint32_t const cpu = __atomic_load_n(&area->cpu_id, __ATOMIC_RELAXED);
+		if (static_cast<std::int32_t>(cpu) >= 0)
+			return cpu < _shards ? cpu : cpu % _shards;
+#	endif
+	}
+#endif
+
+	if (tFallbackShard == 0)
+		tFallbackShard = gNextFallbackShard.fetch_add(1, std::memory_order_relaxed) + 1;
+	return (tFallbackShard - 1) % _shards;
+}
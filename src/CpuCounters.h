@@ -0,0 +1,107 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Atomics.h"
+
+namespace _ys_ {
+
+/// <summary> Counters summed per CPU, for counters incremented from many threads at once. </summary>
+/// <remarks>
+/// Every CPU has a block of slots with one per counter, so an increment only touches a cache
+/// line that the CPU it runs on already owns, and memory grows with the number of CPUs rather
+/// than the number of threads. The background thread reads one slot per CPU for each counter.
+///
+/// The current CPU is read from the restartable sequence area that glibc registers for every
+/// thread, which the kernel keeps up to date. On x86-64 the slot is then updated by a restartable
+/// sequence, which the kernel aborts if the thread is preempted or migrated before its final store,
+/// so the update needs no atomic instruction. Elsewhere a thread may migrate between reading its
+/// CPU and adding, so slots are updated atomically, but the update is almost never contended.
+/// Without rseq, threads are spread over the shards in the order they first add.
+///
+/// Threads may still be adding when Yardstick shuts down, so the table's memory outlives the
+/// shutdown and the next initialization, and is only freed by the one after that.
+/// </remarks>
+class CpuCounterTable
+{
+public:
+	static constexpr std::uint32_t kMaxCounters = 256;
+
+private:
+	static constexpr std::uint32_t kCapacity = kMaxCounters * 2;
+	static constexpr std::uint32_t kMask = kCapacity - 1;
+	static constexpr std::uint32_t kNoIndex = ~std::uint32_t(0);
+
+	struct Entry
+	{
+		std::atomic<Site*> site;
+		// one more than the counter's index once published, or kNoIndex if the table is full
+		std::atomic<std::uint32_t> index;
+	};
+
+	// one allocation holding the entries and the slots, and the one it replaced
+	ysAllocator _allocator = nullptr;
+	void* _memory = nullptr;
+	ysAllocator _retiredAllocator = nullptr;
+	void* _retiredMemory = nullptr;
+
+	std::atomic<Entry*> _entries;
+	// a block of kMaxCounters slots per CPU, each holding the bits of a double, and one more for the
+	// threads that can't use a restartable sequence while others do
+	std::atomic<std::atomic<std::uint64_t>*> _slots;
+	std::uint32_t _shards = 0;
+
+	std::atomic<std::uint32_t> _count;
+	std::atomic<Site*> _sites[kMaxCounters];
+
+	// the total already delivered, owned by the Yardstick background thread
+	double _seen[kMaxCounters];
+
+	std::uint32_t FindIndex(Entry* entries, Site& site);
+	bool AddToCurrentCpu(std::atomic<std::uint64_t>* slots, std::uint32_t index, double amount);
+	std::uint32_t GetShard() const;
+
+public:
+	CpuCounterTable() : _entries(nullptr), _slots(nullptr), _count(0) {}
+	CpuCounterTable(CpuCounterTable const&) = delete;
+	CpuCounterTable& operator=(CpuCounterTable const&) = delete;
+
+	/// <summary> Allocates the table afresh, freeing the memory of the initialization before last. </summary>
+	ysResult Initialize(ysAllocator allocator);
+
+	/// <summary> Adds an increment to the current CPU's slot for a counter. </summary>
+	/// <returns> False if the counter could not be given slots. </returns>
+	bool Add(Site& site, double amount);
+
+	/// <summary> Number of counters that may have been given slots. </summary>
+	std::uint32_t GetCount() const;
+
+	/// <summary> Returns the site of a counter, or nullptr if it is still being added. </summary>
+	Site* GetSite(std::uint32_t index) const { return _sites[index].load(std::memory_order_acquire); }
+
+	/// <summary> Sums a counter's slots over every CPU. </summary>
+	double ReadTotal(std::uint32_t index) const;
+
+	double& GetSeen(std::uint32_t index) { return _seen[index]; }
+};
+
+} // namespace _ys_
@@ -0,0 +1,53 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ExportSink.h"
+#include "Protocol.h"
+#include "StringTable.h"
+
+using namespace _ys_;
+
+char const* ExportSink::ResolveString(void* userData, ysStringHandle id, std::uint32_t& out_length)
+{
+	return static_cast<ExportSink*>(userData)->_strings.Find(id, out_length);
+}
+
+ysResult ExportSink::Open(char const* path, ysExportFormat format, ysAllocator allocator)
+{
+	_exporter.SetResolver(&ResolveString, this);
+	return _exporter.Open(path, format, allocator);
+}
+
+ysResult ExportSink::Consume(EventData const* events, std::size_t count)
+{
+	ysResult result = ysResult::Success;
+
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		ysEvent ev;
+		ConvertEvent(events[index], ev);
+
+		// keep going after a failure, so that one dropped counter doesn't end the export
+		ysResult const written = _exporter.Write(ev);
+		if (written != ysResult::Success)
+			result = written;
+	}
+
+	return result;
+}
@@ -0,0 +1,49 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Sink.h"
+#include "TraceExporter.h"
+
+namespace _ys_ {
+
+class StringTable;
+
+/// Sink writing events straight to a Chrome JSON or Perfetto trace file.
+class ExportSink : public Sink
+{
+	StringTable const& _strings;
+	TraceExporter _exporter;
+
+	static char const* ResolveString(void* userData, ysStringHandle id, std::uint32_t& out_length);
+
+public:
+	explicit ExportSink(StringTable const& strings) : _strings(strings) {}
+
+	ysResult Open(char const* path, ysExportFormat format, ysAllocator allocator);
+
+	ysResult Consume(EventData const* events, std::size_t count) override;
+	ysResult Flush() override { return ysResult::Success; }
+	bool IsLossless() const override { return true; }
+};
+
+} // namespace _ys_
@@ -0,0 +1,242 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FileSink.h"
+#include "Clock.h"
+#include "Protocol.h"
+#include "TraceFormat.h"
+
+#include <functional>
+
+using namespace _ys_;
+
+FileSink::FileSink() : _active(false), _failed(false)
+{
+}
+
+FileSink::~FileSink()
+{
+	Close();
+}
+
+ysResult FileSink::Open(char const* path, ysAllocator allocator)
+{
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	if (_file != nullptr)
+		return ysResult::AlreadyInitialized;
+
+	_allocator = allocator;
+	_index.Initialize(_allocator);
+
+	for (Buffer& buffer : _buffers)
+	{
+		buffer.data = static_cast<char*>(_allocator(nullptr, kBufferSize));
+		if (buffer.data == nullptr)
+		{
+			Close();
+			return ysResult::NoMemory;
+		}
+	}
+
+	_file = std::fopen(path, "wb");
+	if (_file == nullptr)
+	{
+		Close();
+		return ysResult::System;
+	}
+
+	// blocks are already large, so stdio buffering would only add a copy
+	std::setvbuf(_file, nullptr, _IONBF, 0);
+
+	_current = 0;
+	YS_TRY(BeginBlock(0));
+
+	_active.store(true, std::memory_order_seq_cst);
+	_writer = std::thread(std::bind(&FileSink::WriterMain, this));
+
+	return ysResult::Success;
+}
+
+ysResult FileSink::Close()
+{
+	ysResult result = ysResult::Success;
+
+	if (_writer.joinable())
+	{
+		if (!_block.IsEmpty())
+			result = SubmitBlock();
+
+		// the writer finishes any pending blocks before exiting
+		_active.store(false, std::memory_order_seq_cst);
+		_pendingSignal.Post();
+		_writer.join();
+	}
+
+	if (_file != nullptr)
+	{
+		// the writer has exited, so the index can follow the last block directly. without an
+		// index, readers fall back to walking the blocks.
+		if (_headerWritten && result == ysResult::Success && !_failed.load(std::memory_order_acquire))
+			result = _index.Write(_file, _offset);
+
+		if (std::fclose(_file) != 0)
+			result = ysResult::System;
+		_file = nullptr;
+	}
+
+	for (Buffer& buffer : _buffers)
+	{
+		if (buffer.data != nullptr)
+			_allocator(buffer.data, 0);
+		buffer.data = nullptr;
+		buffer.pending.store(false, std::memory_order_relaxed);
+	}
+
+	_block.Begin(nullptr, 0, 0);
+	_index.Reset();
+	_headerWritten = false;
+	_offset = 0;
+
+	if (_failed.load(std::memory_order_acquire))
+		result = ysResult::System;
+	return result;
+}
+
+void FileSink::WriterMain()
+{
+	std::size_t next = 0;
+
+	for (;;)
+	{
+		Buffer& buffer = _buffers[next];
+
+		if (!buffer.pending.load(std::memory_order_acquire))
+		{
+			// only exit once every submitted block has been written
+			if (!_active.load(std::memory_order_seq_cst) && !buffer.pending.load(std::memory_order_acquire))
+				break;
+
+			_pendingSignal.Wait(100);
+			continue;
+		}
+
+		if (std::fwrite(buffer.block, 1, buffer.size, _file) != buffer.size)
+			_failed.store(true, std::memory_order_release);
+
+		buffer.pending.store(false, std::memory_order_release);
+		_writtenSignal.Post();
+
+		next = (next + 1) % kBufferCount;
+	}
+}
+
+ysResult FileSink::BeginBlock(std::uint64_t firstTick)
+{
+	Buffer& buffer = _buffers[_current];
+
+	// wait for the writer to be done with the buffer before reusing it
+	while (buffer.pending.load(std::memory_order_acquire))
+		_writtenSignal.Wait(100);
+
+	_block.Begin(buffer.data, kBufferSize, firstTick);
+	_blockStart = ReadClock();
+	return ysResult::Success;
+}
+
+ysResult FileSink::SubmitBlock()
+{
+	Buffer& buffer = _buffers[_current];
+	buffer.block = _block.Finish(buffer.size);
+
+	_index.AddBlock(_offset, _block.GetHeader());
+	_offset += buffer.size;
+
+	buffer.pending.store(true, std::memory_order_release);
+	_pendingSignal.Post();
+
+	_current = (_current + 1) % kBufferCount;
+	return BeginBlock(_block.GetNextTick());
+}
+
+ysResult FileSink::Consume(EventData const* events, std::size_t count)
+{
+	if (_file == nullptr)
+		return ysResult::Uninitialized;
+
+	if (_failed.load(std::memory_order_relaxed))
+		return ysResult::System;
+
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		EventData const& ev = events[index];
+
+		// the stream header becomes the file header rather than part of a block
+		if (ev.type == EventType::Header)
+		{
+			if (_headerWritten)
+				continue;
+
+			TraceFileHeader header;
+			header.magic = kTraceFileMagic;
+			header.version = kTraceVersion;
+			header.frequency = ev.header.frequency;
+			header.start = ev.header.start;
+			header.realtime = ev.header.realtime;
+
+			// no block has been submitted yet, so the writer thread is idle
+			if (std::fwrite(&header, sizeof(header), 1, _file) != 1)
+				return ysResult::System;
+
+			_headerWritten = true;
+			_frequency = ev.header.frequency;
+			_offset = sizeof(header);
+			continue;
+		}
+
+		if (!_block.Append(ev))
+		{
+			YS_TRY(SubmitBlock());
+			if (!_block.Append(ev))
+				return ysResult::NoMemory;
+		}
+
+		_index.AddEvent(ev, _block.GetLastPosition());
+	}
+
+	return ysResult::Success;
+}
+
+ysResult FileSink::Flush()
+{
+	return Update();
+}
+
+ysResult FileSink::Update()
+{
+	if (_file == nullptr || _block.IsEmpty())
+		return ysResult::Success;
+
+	// keep the file reasonably current even when events trickle in slowly
+	if (ReadClock() - _blockStart < _frequency / 4)
+		return ysResult::Success;
+
+	return SubmitBlock();
+}
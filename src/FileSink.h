@@ -0,0 +1,89 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Atomics.h"
+#include "BlockWriter.h"
+#include "Signal.h"
+#include "Sink.h"
+#include "TraceIndexWriter.h"
+
+#include <cstdio>
+#include <thread>
+
+namespace _ys_ {
+
+/// Captures events to a trace file on disk.
+/// Events are encoded into large blocks, and finished blocks are written by a dedicated thread
+/// while the next block fills, so the sink only waits on the disk if it falls a whole block behind.
+class FileSink : public Sink
+{
+	static constexpr std::size_t kBufferCount = 2;
+	static constexpr std::size_t kBufferSize = 1 << 20;
+
+	struct Buffer
+	{
+		char* data = nullptr;
+		void const* block = nullptr;
+		std::size_t size = 0;
+		// set by the sink when the block is finished, and cleared by the writer once it is on disk
+		std::atomic<bool> pending;
+
+		Buffer() : pending(false) {}
+	};
+
+	ysAllocator _allocator = nullptr;
+	std::FILE* _file = nullptr;
+	bool _headerWritten = false;
+	ysTime _frequency = 0;
+
+	Buffer _buffers[kBufferCount];
+	std::size_t _current = 0;
+	BlockWriter _block;
+	ysTime _blockStart = 0;
+	std::uint64_t _offset = 0;
+	TraceIndexWriter _index;
+
+	std::thread _writer;
+	AlignedAtomic<bool> _active;
+	std::atomic<bool> _failed;
+	Signal _pendingSignal;
+	Signal _writtenSignal;
+
+	void WriterMain();
+	ysResult BeginBlock(std::uint64_t firstTick);
+	ysResult SubmitBlock();
+
+public:
+	FileSink();
+	~FileSink() override;
+
+	ysResult Open(char const* path, ysAllocator allocator);
+	ysResult Close();
+
+	ysResult Consume(EventData const* events, std::size_t count) override;
+	ysResult Flush() override;
+	ysResult Update() override;
+	bool IsLossless() const override { return true; }
+};
+
+} // namespace _ys_
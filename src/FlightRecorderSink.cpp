@@ -0,0 +1,581 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FlightRecorderSink.h"
+#include "Clock.h"
+#include "Protocol.h"
+#include "StringTable.h"
+#include "TraceFormat.h"
+
+#include <yardstick/trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+using namespace _ys_;
+
+namespace {
+
+// plain atomics are the only state a signal handler may safely touch
+std::atomic<std::uint32_t> s_dumpRequests(0);
+
+constexpr std::uint64_t kRingHeaderSize = 4096;
+
+// passes the string handles used by the events of a block to a function
+template <typename Function>
+struct StringUses : ysEventVisitor
+{
+	Function function;
+
+	explicit StringUses(Function function) : function(function) {}
+
+	void OnRegion(ysRegionEvent const& ev) { function(ev.name); function(ev.file); }
+	void OnCounterSet(ysCounterSetEvent const& ev) { function(ev.name); function(ev.file); }
+	void OnCounterAdd(ysCounterAddEvent const& ev) { function(ev.name); }
+	void OnRegionSummary(ysRegionSummaryEvent const& ev) { function(ev.name); function(ev.file); }
+	void OnHistogram(ysHistogramEvent const& ev) { function(ev.name); function(ev.file); }
+	void OnQuantiles(ysQuantilesEvent const& ev) { function(ev.name); function(ev.file); }
+	void OnStall(ysStallEvent const& ev) { function(ev.name); function(ev.file); }
+
+	void OnCallTree(ysCallTreeEvent const& ev)
+	{
+		ysCallTreeNode node;
+		for (std::size_t index = 0; index != ev.nodes; ++index)
+		{
+			ev.GetNode(index, node);
+			function(node.name);
+			function(node.file);
+		}
+	}
+
+	void OnSamples(ysSamplesEvent const& ev)
+	{
+		ysSampleNode node;
+		for (std::size_t index = 0; index != ev.nodes; ++index)
+		{
+			ev.GetNode(index, node);
+			function(node.name);
+			function(node.file);
+		}
+	}
+};
+
+template <typename Function>
+StringUses<Function> MakeStringUses(Function function) { return StringUses<Function>(function); }
+
+std::size_t SortUnique(Array<ysStringHandle>& handles)
+{
+	std::sort(handles.begin(), handles.end());
+	std::size_t const size = static_cast<std::size_t>(std::unique(handles.begin(), handles.end()) - handles.begin());
+	handles.Resize(size);
+	return size;
+}
+
+// reads the handle of the String event at pos, and returns its encoded size
+std::uint32_t ReadString(unsigned char const* pos, ysStringHandle& out_id)
+{
+	std::uint16_t length;
+	std::memcpy(&out_id, pos + 1, sizeof(out_id));
+	std::memcpy(&length, pos + 5, sizeof(length));
+	return 7 + std::uint32_t(length);
+}
+
+} // anonymous namespace
+
+FlightRecorderSink::~FlightRecorderSink()
+{
+	Close();
+}
+
+ysResult FlightRecorderSink::Open(char const* path, std::size_t bytes, StringTable const& strings, ysAllocator allocator)
+{
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	Close();
+	_allocator = allocator;
+	_strings = &strings;
+	_live.Initialize(allocator);
+	_found.Initialize(allocator);
+
+	// strings get a sixteenth of the ring, within reason
+	std::size_t stringsCapacity = bytes / 16;
+	if (stringsCapacity < 64 * 1024)
+		stringsCapacity = 64 * 1024;
+	if (stringsCapacity > 4 * 1024 * 1024)
+		stringsCapacity = 4 * 1024 * 1024;
+
+	std::size_t const overhead = kRingHeaderSize + stringsCapacity;
+	std::size_t const slotCount = bytes > overhead ? (bytes - overhead) / kSlotSize : 0;
+	if (slotCount < kMinSlots)
+		return ysResult::InvalidParameter;
+
+	std::size_t const length = std::strlen(path);
+	_path = static_cast<char*>(_allocator(nullptr, length + 1));
+	if (_path == nullptr)
+		return ysResult::NoMemory;
+	std::memcpy(_path, path, length + 1);
+
+	ysResult const result = _file.Create(path, overhead + slotCount * kSlotSize);
+	if (result != ysResult::Success)
+	{
+		Close();
+		return result;
+	}
+
+	// a fresh file is zero-filled, so every slot starts out empty
+	_header = reinterpret_cast<TraceRingHeader*>(_file.GetData());
+	_header->magic = kTraceRingMagic;
+	_header->version = kTraceVersion;
+	_header->frequency = 0;
+	_header->start = 0;
+	_header->realtime = 0;
+	_header->strings = kRingHeaderSize;
+	_header->slots = overhead;
+	_header->stringsCapacity = static_cast<std::uint32_t>(stringsCapacity);
+	_header->stringsUsed = 0;
+	_header->slotSize = kSlotSize;
+	_header->slotCount = static_cast<std::uint32_t>(slotCount);
+
+	_stringCount = 0;
+	_stringsPending = 0;
+	_stringsLost = false;
+	_compactAfter = 0;
+	_slot = 0;
+	_sequence = 0;
+	_ticks = 0;
+	BeginBlock();
+
+	// requests made before the recorder existed have nothing to dump
+	_requests = s_dumpRequests.load(std::memory_order_acquire);
+	_dumps = 0;
+
+	return ysResult::Success;
+}
+
+void FlightRecorderSink::Close()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	// leave the last partial block in the file for anyone reading it afterwards
+	if (_header != nullptr && !_block.IsEmpty())
+		SubmitBlock();
+
+	_block.Begin(nullptr, 0, 0);
+	_header = nullptr;
+	_file.Close();
+	_live.Reset();
+	_found.Reset();
+
+	if (_path != nullptr)
+		_allocator(_path, 0);
+	_path = nullptr;
+}
+
+TraceRingSlot* FlightRecorderSink::GetSlot(std::uint32_t index) const
+{
+	return reinterpret_cast<TraceRingSlot*>(_file.GetData() + _header->slots + std::uint64_t(index) * _header->slotSize);
+}
+
+void FlightRecorderSink::BeginBlock()
+{
+	TraceRingSlot* const slot = GetSlot(_slot);
+
+	// mark the slot empty before overwriting its block, so a crash can't leave a torn block behind
+	slot->sequence = 0;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+
+	_block.Begin(slot + 1, _header->slotSize - sizeof(TraceRingSlot), _ticks);
+	_blockStart = ReadClock();
+}
+
+void FlightRecorderSink::SubmitBlock()
+{
+	TraceRingSlot* const slot = GetSlot(_slot);
+
+	std::size_t size;
+	unsigned char const* const block = static_cast<unsigned char const*>(_block.Finish(size));
+	slot->offset = static_cast<std::uint32_t>(block - reinterpret_cast<unsigned char const*>(slot));
+	slot->size = static_cast<std::uint32_t>(size);
+	_ticks = _block.GetNextTick();
+
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	slot->sequence = ++_sequence;
+
+	_slot = (_slot + 1) % _header->slotCount;
+	BeginBlock();
+}
+
+bool FlightRecorderSink::AppendString(EventData const& ev)
+{
+	unsigned char* const area = _file.GetData() + _header->strings;
+	std::uint32_t const used = _header->stringsUsed;
+
+	std::size_t length;
+	if (EncodeEvent(area + used, _header->stringsCapacity - used, ev, length) != ysResult::Success)
+	{
+		_stringsLost = true;
+		return false;
+	}
+
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	_header->stringsUsed = used + static_cast<std::uint32_t>(length);
+	++_stringCount;
+	return true;
+}
+
+void FlightRecorderSink::AddString(EventData const& ev)
+{
+	if (AppendString(ev))
+		return;
+
+	// strings lost while a full area may not be compacted are still in the string table, and
+	// come back with the next compaction or dump
+	if (_sequence < _compactAfter)
+		return;
+
+	CompactStrings();
+	AppendString(ev);
+}
+
+template <typename Visitor>
+void FlightRecorderSink::DecodeSlot(std::uint32_t index, Visitor& visitor) const
+{
+	TraceRingSlot const* const slot = GetSlot(index);
+	if (slot->sequence == 0)
+		return;
+
+	unsigned char const* const block = reinterpret_cast<unsigned char const*>(slot) + slot->offset;
+
+	TraceBlockHeader header;
+	std::memcpy(&header, block, sizeof(header));
+
+	std::uint16_t thread = 0;
+	bool failed = false;
+	_ys_::decode_events(block + sizeof(header) + header.threads * sizeof(TraceBlockThread), header.size, thread, visitor, failed);
+}
+
+bool FlightRecorderSink::CollectLive()
+{
+	_live.Clear();
+
+	bool failed = false;
+	Array<ysStringHandle>& live = _live;
+	auto visitor = MakeStringUses([&live, &failed](ysStringHandle id) { if (!live.PushBack(id)) failed = true; });
+
+	std::size_t unique = 0;
+	for (std::uint32_t index = 0; index != _header->slotCount; ++index)
+	{
+		DecodeSlot(index, visitor);
+
+		// blocks repeat the same few strings, so drop the repeats as they pile up
+		if (_live.Size() >= 2 * unique + 4096)
+			unique = SortUnique(_live);
+	}
+	SortUnique(_live);
+
+	if (failed || !_found.Resize(_live.Size()))
+		return false;
+	std::fill(_found.begin(), _found.end(), false);
+	return true;
+}
+
+bool FlightRecorderSink::MarkLive(ysStringHandle id)
+{
+	ysStringHandle const* const found = std::lower_bound(_live.begin(), _live.end(), id);
+	if (found == _live.end() || *found != id)
+		return false;
+
+	_found[found - _live.begin()] = true;
+	return true;
+}
+
+void FlightRecorderSink::CompactStrings()
+{
+	// only events in the ring are looked at, so the block being filled goes in first
+	if (!_block.IsEmpty())
+		SubmitBlock();
+
+	if (!CollectLive())
+		return;
+	_stringsLost = false;
+
+	unsigned char* const area = _file.GetData() + _header->strings;
+	std::uint32_t const used = _header->stringsUsed;
+	std::uint32_t const pending = _stringsPending;
+
+	// the strings kept slide to the front. the area is cut short before each move, so a crash
+	// never finds a torn string in it
+	std::uint32_t write = 0;
+	std::uint32_t count = 0;
+	for (std::uint32_t read = 0; read != used;)
+	{
+		if (read == pending)
+			_stringsPending = write;
+
+		ysStringHandle id;
+		std::uint32_t const length = ReadString(area + read, id);
+
+		if (MarkLive(id) || read >= pending)
+		{
+			if (write != read)
+			{
+				_header->stringsUsed = write;
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+				std::memmove(area + write, area + read, length);
+			}
+			write += length;
+			++count;
+		}
+		read += length;
+	}
+	if (pending == used)
+		_stringsPending = write;
+
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	_header->stringsUsed = write;
+	_stringCount = count;
+
+	// strings lost while the area was full may still be in use. the newest blocks get theirs back
+	// first, as they will be in the ring the longest
+	auto visitor = MakeStringUses([this](ysStringHandle id) { RestoreString(id); });
+	for (std::uint32_t index = 0; index != _header->slotCount; ++index)
+		DecodeSlot((_slot + _header->slotCount - 1 - index) % _header->slotCount, visitor);
+
+	// when the live strings barely fit, let a part of the ring turn over before trying again
+	if (_stringsLost || _header->stringsUsed > _header->stringsCapacity / 4 * 3)
+		_compactAfter = _sequence + _header->slotCount / 4;
+}
+
+void FlightRecorderSink::RestoreString(ysStringHandle id)
+{
+	ysStringHandle const* const found = std::lower_bound(_live.begin(), _live.end(), id);
+	std::size_t const index = static_cast<std::size_t>(found - _live.begin());
+	if (_found[index])
+		return;
+
+	_found[index] = true;
+	EventData ev;
+	if (MakeStringEvent(*_strings, id, ev))
+		AppendString(ev);
+}
+
+ysResult FlightRecorderSink::Consume(EventData const* events, std::size_t count)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	if (_header == nullptr)
+		return ysResult::Uninitialized;
+
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		EventData const& ev = events[index];
+
+		if (ev.type == EventType::Header)
+		{
+			if (_header->frequency == 0)
+			{
+				_header->frequency = ev.header.frequency;
+				_header->start = ev.header.start;
+				_header->realtime = ev.header.realtime;
+			}
+			continue;
+		}
+
+		// strings must outlive the blocks that use them, so they are kept apart from the ring
+		if (ev.type == EventType::String)
+		{
+			AddString(ev);
+			continue;
+		}
+
+		if (!_block.Append(ev))
+		{
+			SubmitBlock();
+			if (!_block.Append(ev))
+				return ysResult::NoMemory;
+		}
+		_stringsPending = _header->stringsUsed;
+	}
+
+	// strings lost to a full area are wanted back even if no new ones arrive to force it
+	if (_stringsLost && _sequence >= _compactAfter)
+		CompactStrings();
+
+	return ysResult::Success;
+}
+
+ysResult FlightRecorderSink::Flush()
+{
+	return Update();
+}
+
+ysResult FlightRecorderSink::Update()
+{
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+
+		// bound how much a crash can lose when events trickle in slowly
+		if (_header != nullptr && !_block.IsEmpty() && ReadClock() - _blockStart >= _header->frequency / 4)
+			SubmitBlock();
+	}
+
+	return ServiceRequests();
+}
+
+ysResult FlightRecorderSink::ServiceRequests()
+{
+	std::uint32_t const requests = s_dumpRequests.load(std::memory_order_acquire);
+	if (requests == _requests)
+		return ysResult::Success;
+	_requests = requests;
+
+	// requested dumps are numbered and written next to the ring file
+	std::size_t const length = std::strlen(_path) + 16;
+	char* const path = static_cast<char*>(_allocator(nullptr, length));
+	if (path == nullptr)
+		return ysResult::NoMemory;
+	std::snprintf(path, length, "%s.dump%u", _path, ++_dumps);
+
+	ysResult const result = Dump(path);
+
+	_allocator(path, 0);
+	return result;
+}
+
+void FlightRecorderSink::RequestDump()
+{
+	s_dumpRequests.fetch_add(1, std::memory_order_release);
+}
+
+ysResult FlightRecorderSink::Dump(char const* path)
+{
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	std::lock_guard<std::mutex> guard(_lock);
+
+	if (_header == nullptr)
+		return ysResult::Uninitialized;
+
+	if (!_block.IsEmpty())
+		SubmitBlock();
+
+	return WriteDump(path);
+}
+
+ysResult FlightRecorderSink::WriteDump(char const* path)
+{
+	std::FILE* const file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return ysResult::System;
+
+	bool written = true;
+
+	TraceFileHeader fileHeader;
+	fileHeader.magic = kTraceFileMagic;
+	fileHeader.version = kTraceVersion;
+	fileHeader.frequency = _header->frequency;
+	fileHeader.start = _header->start;
+	fileHeader.realtime = _header->realtime;
+	written = written && std::fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1;
+
+	// the first block defines every string, as the blocks that originally did may be gone. those
+	// the area lost while it was full are taken from the string table
+	unsigned char const* const area = _file.GetData() + _header->strings;
+	std::uint32_t const used = _header->stringsUsed;
+	bool const live = CollectLive();
+	if (live)
+	{
+		ysStringHandle id;
+		for (std::uint32_t read = 0; read != used; read += ReadString(area + read, id))
+			MarkLive(id);
+	}
+
+	TraceBlockHeader strings;
+	std::memset(&strings, 0, sizeof(strings));
+	strings.magic = kTraceBlockMagic;
+	strings.size = used;
+	strings.events = _stringCount;
+
+	std::size_t largest = 0;
+	for (std::size_t index = 0; live && index != _live.Size(); ++index)
+	{
+		EventData ev;
+		if (_found[index] || !MakeStringEvent(*_strings, _live[index], ev))
+			continue;
+
+		std::size_t const size = EncodeSize(ev);
+		strings.size += static_cast<std::uint32_t>(size);
+		++strings.events;
+		largest = size > largest ? size : largest;
+	}
+
+	unsigned char* const buffer = largest != 0 ? static_cast<unsigned char*>(_allocator(nullptr, largest)) : nullptr;
+	if (largest != 0 && buffer == nullptr)
+	{
+		std::fclose(file);
+		return ysResult::NoMemory;
+	}
+
+	written = written && std::fwrite(&strings, sizeof(strings), 1, file) == 1;
+	written = written && std::fwrite(area, 1, used, file) == used;
+	for (std::size_t index = 0; live && index != _live.Size() && written; ++index)
+	{
+		EventData ev;
+		if (_found[index] || !MakeStringEvent(*_strings, _live[index], ev))
+			continue;
+
+		std::size_t length;
+		EncodeEvent(buffer, largest, ev, length);
+		written = std::fwrite(buffer, 1, length, file) == length;
+	}
+
+	if (buffer != nullptr)
+		_allocator(buffer, 0);
+
+	// the oldest block follows the one being filled, and ticks are counted from the oldest block
+	bool first = true;
+	std::uint64_t tickBase = 0;
+	for (std::uint32_t index = 1; index <= _header->slotCount && written; ++index)
+	{
+		TraceRingSlot const* const slot = GetSlot((_slot + index) % _header->slotCount);
+		if (slot->sequence == 0)
+			continue;
+
+		unsigned char const* const block = reinterpret_cast<unsigned char const*>(slot) + slot->offset;
+
+		TraceBlockHeader header;
+		std::memcpy(&header, block, sizeof(header));
+		if (first)
+			tickBase = header.firstTick;
+		first = false;
+		header.firstTick -= tickBase;
+
+		written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+			std::fwrite(block + sizeof(header), 1, slot->size - sizeof(header), file) == slot->size - sizeof(header);
+	}
+
+	if (std::fclose(file) != 0)
+		written = false;
+
+	return written ? ysResult::Success : ysResult::System;
+}
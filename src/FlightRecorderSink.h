@@ -0,0 +1,111 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Array.h"
+#include "BlockWriter.h"
+#include "MappedFile.h"
+#include "Sink.h"
+
+#include <mutex>
+
+namespace _ys_ {
+
+class StringTable;
+struct TraceRingHeader;
+struct TraceRingSlot;
+
+/// Keeps the most recent events in a fixed-size ring of blocks, which can be dumped to a trace
+/// file on demand.
+/// The ring lives in a memory-mapped file, so its contents survive a crash of the process.
+/// Strings are kept in an area of their own ahead of the ring. When it fills up, the strings no
+/// block uses any more are dropped from it, and dumps take any it lacks from the string table.
+class FlightRecorderSink : public Sink
+{
+	static constexpr std::uint32_t kSlotSize = 64 * 1024;
+	static constexpr std::uint32_t kMinSlots = 4;
+
+	ysAllocator _allocator = nullptr;
+	StringTable const* _strings = nullptr;
+	char* _path = nullptr;
+
+	MappedFile _file;
+	TraceRingHeader* _header = nullptr;
+	std::uint32_t _stringCount = 0;
+	// end of the string area when the last other event was consumed; the strings after it may
+	// belong to events yet to come
+	std::uint32_t _stringsPending = 0;
+	// the area is not compacted again before this block, so an area full of live strings doesn't
+	// get compacted for every new one
+	std::uint64_t _compactAfter = 0;
+	bool _stringsLost = false;
+	// handles used by the blocks in the ring, sorted, and which of them the area holds
+	Array<ysStringHandle> _live;
+	Array<bool> _found;
+
+	std::uint32_t _slot = 0;
+	std::uint64_t _sequence = 0;
+	std::uint64_t _ticks = 0;
+	BlockWriter _block;
+	ysTime _blockStart = 0;
+
+	std::uint32_t _requests = 0;
+	std::uint32_t _dumps = 0;
+
+	// held while the ring is written, and for the whole of a dump. a dump takes long enough that
+	// spinning would waste a core.
+	std::mutex _lock;
+
+	TraceRingSlot* GetSlot(std::uint32_t index) const;
+	void BeginBlock();
+	void SubmitBlock();
+	bool AppendString(EventData const& ev);
+	void AddString(EventData const& ev);
+	bool CollectLive();
+	bool MarkLive(ysStringHandle id);
+	void RestoreString(ysStringHandle id);
+	template <typename Visitor>
+	void DecodeSlot(std::uint32_t index, Visitor& visitor) const;
+	void CompactStrings();
+	ysResult WriteDump(char const* path);
+	ysResult ServiceRequests();
+
+public:
+	FlightRecorderSink() = default;
+	~FlightRecorderSink() override;
+
+	ysResult Open(char const* path, std::size_t bytes, StringTable const& strings, ysAllocator allocator);
+	void Close();
+
+	/// <summary> Writes the contents of the ring to a trace file. May be called from any thread. </summary>
+	ysResult Dump(char const* path);
+
+	/// <summary> Asks the recorder to dump itself next to its ring file as soon as possible. </summary>
+	/// <remarks> Safe to call from a signal handler. </remarks>
+	static void RequestDump();
+
+	ysResult Consume(EventData const* events, std::size_t count) override;
+	ysResult Flush() override;
+	ysResult Update() override;
+};
+
+} // namespace _ys_
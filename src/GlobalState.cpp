@@ -19,8 +19,17 @@
 
 #include "GlobalState.h"
 #include "Algorithm.h"
+#include "CallbackSink.h"
+#include "ExportSink.h"
+#include "FileSink.h"
+#include "FlightRecorderSink.h"
 #include "ThreadState.h"
 #include "Clock.h"
+#include "Protocol.h"
+#include "SinkChannel.h"
+#include "WebsocketSink.h"
+
+#include <functional>
 
 using namespace _ys_;
 
@@ -35,6 +44,37 @@ ysResult GlobalState::Initialize(ysAllocator alloc)
 	LockGuard guard(_stateLock);
 	_allocator = alloc;
 
+	YS_TRY(_strings.Initialize(_allocator));
+	YS_TRY(_cpuCounters.Initialize(_allocator));
+
+	{
+		LockGuard sketchesGuard(_sketchesLock);
+		YS_TRY(_sketches.Initialize(_allocator, GetClockFrequency(), ReadClock()));
+	}
+
+	// the first frame starts now
+	_lastFrameEnd = ReadClock();
+
+	{
+		LockGuard sinksGuard(_sinksLock);
+		_droppedEvents = 0;
+	}
+
+	// sites registered during a previous initialization must register again with the new table,
+	// including those rejected by the old one
+	_epoch.fetch_add(1, std::memory_order_relaxed);
+	{
+		LockGuard categoriesGuard(_categoriesLock);
+		while (_rejectedSites != nullptr)
+		{
+			Site* const site = _rejectedSites;
+			_rejectedSites = site->next;
+			site->next = nullptr;
+			site->filter.store(kSiteUnseen, std::memory_order_relaxed);
+		}
+	}
+	_stringCollisions.store(0, std::memory_order_relaxed);
+
 	// activate the system if not already.
 	// the active boolean must be set before the background thread starts to ensure that it
 	// doesn't early-exit.
@@ -62,69 +102,1565 @@ ysResult GlobalState::Shutdown()
 		_backgroundThread.join();
 	}
 
+	// sinks drain everything the background thread handed them before stopping
+	RemoveAllSinks();
+
+	// statistics, histograms and counter increments for an unfinished frame are discarded
+	{
+		LockGuard threadsGuard(_threadsLock);
+
+		while (_retiredHistograms != nullptr)
+		{
+			ThreadHistogram* const next = _retiredHistograms->next;
+			_retiredHistograms->~ThreadHistogram();
+			_retiredHistogramsAllocator(_retiredHistograms, 0);
+			_retiredHistograms = next;
+		}
+		_retiredHistogramsAllocator = _allocator;
+
+		for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+		{
+			LockGuard statsGuard(thread->_statsLock);
+			thread->_stats.Clear();
+			RetireHistograms(thread);
+
+			LockGuard treeGuard(thread->_treeLock);
+			thread->_tree.ClearTimes();
+
+			FreeFrameBuffer(thread);
+
+			for (std::uint32_t index = 0; index != thread->_counters.GetCount(); ++index)
+			{
+				CounterSlot& slot = thread->_counters.GetSlot(index);
+				slot.seen = slot.total.load(std::memory_order_relaxed);
+			}
+		}
+		_frameStats.Clear();
+		_frameTree.ClearTimes();
+		_frameHistory.Clear();
+		if (_spareFrame != nullptr)
+			_allocator(_spareFrame, 0);
+		_spareFrame = nullptr;
+		_sampleTree.ClearTimes();
+		_sampleCount = 0;
+		_nextSample = 0;
+
+		LockGuard histogramsGuard(_histogramsLock);
+		while (_siteHistograms != nullptr)
+		{
+			SiteHistogram* const next = _siteHistograms->next;
+			_allocator(_siteHistograms, 0);
+			_siteHistograms = next;
+		}
+	}
+
+	{
+		LockGuard sketchesGuard(_sketchesLock);
+		_sketches.Reset();
+	}
+
+	// the per-CPU counters keep their memory, as threads that got past IsActive before the
+	// shutdown may still be adding to them
+	_strings.Reset();
 	_allocator = nullptr;
 
 	return ysResult::Success;
 }
 
-ysResult GlobalState::ListenWebsocket(unsigned short port)
+ysResult GlobalState::ListenWebsocket(unsigned short port, std::size_t history)
 {
 	LockGuard guard(_stateLock);
 
 	if (!_active.load(std::memory_order_acquire))
 		return ysResult::Uninitialized;
 
-	return _websocketSink.Listen(port, _allocator);
+	if (_websocketSink != nullptr)
+	{
+		RemoveSink(_websocketSink);
+		_websocketSink = nullptr;
+	}
+
+	WebsocketSink* const sink = CreateSink<WebsocketSink>(_strings);
+	if (sink == nullptr)
+		return ysResult::NoMemory;
+
+	ysResult const result = sink->Listen(port, history, _allocator);
+	if (result != ysResult::Success)
+	{
+		DestroySink(sink);
+		return result;
+	}
+
+	YS_TRY(AddSink(sink));
+	_websocketSink = sink;
+	return ysResult::Success;
 }
 
-void GlobalState::ThreadMain()
+ysResult GlobalState::StartCapture(char const* path)
 {
-	while (_active.load(std::memory_order_seq_cst))
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	if (_fileSink != nullptr)
 	{
-		_signal.Wait(100);
+		RemoveSink(_fileSink);
+		_fileSink = nullptr;
+	}
 
-		FlushThreads();
+	FileSink* const sink = CreateSink<FileSink>();
+	if (sink == nullptr)
+		return ysResult::NoMemory;
 
-		_websocketSink.Flush();
-		_websocketSink.Update();
+	ysResult const result = sink->Open(path, _allocator);
+	if (result != ysResult::Success)
+	{
+		DestroySink(sink);
+		return result;
 	}
+
+	YS_TRY(AddSink(sink));
+	_fileSink = sink;
+	return ysResult::Success;
 }
 
-ysResult GlobalState::ProcessThread(ThreadState* thread)
+ysResult GlobalState::StopCapture()
 {
-	EventData ev;
-	int count = 512;
-	while (--count && thread->Deque(ev))
-		YS_TRY(WriteEvent(ev));
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (_fileSink == nullptr)
+		return ysResult::InvalidParameter;
+
+	ysResult const result = RemoveSink(_fileSink);
+	_fileSink = nullptr;
+	return result;
+}
+
+ysResult GlobalState::StartExport(char const* path, ysExportFormat format)
+{
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	if (_exportSink != nullptr)
+	{
+		RemoveSink(_exportSink);
+		_exportSink = nullptr;
+	}
+
+	ExportSink* const sink = CreateSink<ExportSink>(_strings);
+	if (sink == nullptr)
+		return ysResult::NoMemory;
+
+	ysResult const result = sink->Open(path, format, _allocator);
+	if (result != ysResult::Success)
+	{
+		DestroySink(sink);
+		return result;
+	}
+
+	YS_TRY(AddSink(sink));
+	_exportSink = sink;
 	return ysResult::Success;
 }
 
-ysResult GlobalState::FlushThreads()
+ysResult GlobalState::StopExport()
 {
-	LockGuard guard(_threadsLock);
-	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
-		YS_TRY(ProcessThread(thread));
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (_exportSink == nullptr)
+		return ysResult::InvalidParameter;
+
+	ysResult const result = RemoveSink(_exportSink);
+	_exportSink = nullptr;
+	return result;
+}
+
+ysResult GlobalState::StartFlightRecorder(char const* path, std::size_t bytes)
+{
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	if (_flightRecorder != nullptr)
+	{
+		RemoveSink(_flightRecorder);
+		_flightRecorder = nullptr;
+	}
+
+	FlightRecorderSink* const sink = CreateSink<FlightRecorderSink>();
+	if (sink == nullptr)
+		return ysResult::NoMemory;
+
+	ysResult const result = sink->Open(path, bytes, _strings, _allocator);
+	if (result != ysResult::Success)
+	{
+		DestroySink(sink);
+		return result;
+	}
+
+	YS_TRY(AddSink(sink));
+	_flightRecorder = sink;
 	return ysResult::Success;
 }
 
-ysResult GlobalState::WriteEvent(EventData const& ev)
+ysResult GlobalState::StopFlightRecorder()
 {
-	return _websocketSink.WriteEvent(ev);
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (_flightRecorder == nullptr)
+		return ysResult::InvalidParameter;
+
+	ysResult const result = RemoveSink(_flightRecorder);
+	_flightRecorder = nullptr;
+	return result;
 }
 
-void GlobalState::RegisterThread(ThreadState* thread)
+ysResult GlobalState::DumpFlightRecorder(char const* path)
 {
-	LockGuard guard(_threadsLock);
+	LockGuard guard(_stateLock);
 
-	thread->_next = _threads;
-	if (_threads != nullptr)
-		_threads->_next = thread;
-	_threads = thread;
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (_flightRecorder == nullptr)
+		return ysResult::Uninitialized;
+
+	// the sink stays alive while the state lock is held
+	return _flightRecorder->Dump(path);
 }
 
-void GlobalState::DeregisterThread(ThreadState* thread)
+void GlobalState::RequestFlightRecorderDump()
 {
-	LockGuard guard(_threadsLock);
+	FlightRecorderSink::RequestDump();
+}
+
+ysResult GlobalState::AddCallbackSink(ysEventCallback callback, void* userData)
+{
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	if (callback == nullptr)
+		return ysResult::InvalidParameter;
+
+	CallbackSink* const sink = CreateSink<CallbackSink>(callback, userData);
+	if (sink == nullptr)
+		return ysResult::NoMemory;
+
+	return AddSink(sink);
+}
+
+ysResult GlobalState::RemoveCallbackSink(ysEventCallback callback, void* userData)
+{
+	LockGuard guard(_stateLock);
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	CallbackSink* found = nullptr;
+	{
+		LockGuard sinksGuard(_sinksLock);
+		for (std::size_t index = 0; index != _sinkCount && found == nullptr; ++index)
+		{
+			CallbackSink* const sink = dynamic_cast<CallbackSink*>(_sinks[index]->GetSink());
+			if (sink != nullptr && sink->Matches(callback, userData))
+				found = sink;
+		}
+	}
+
+	if (found == nullptr)
+		return ysResult::InvalidParameter;
+
+	return RemoveSink(found);
+}
+
+ysResult GlobalState::SetCaptureMode(ysCaptureMode mode)
+{
+	if (mode != ysCaptureMode::Events && mode != ysCaptureMode::Statistics && mode != ysCaptureMode::CallTree && mode != ysCaptureMode::SlowFrames)
+		return ysResult::InvalidParameter;
+
+	_captureMode.store(mode, std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+ysResult GlobalState::SetMinimumDuration(std::uint64_t nanoseconds)
+{
+	_minimumDuration.store(static_cast<ysTime>(nanoseconds * _ticksPerNanosecond), std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+ysResult GlobalState::SetSlowFrameThreshold(std::uint64_t nanoseconds, double percentile)
+{
+	if (!(percentile >= 0 && percentile < 1))
+		return ysResult::InvalidParameter;
+
+	_slowFrameLength.store(static_cast<ysTime>(nanoseconds * _ticksPerNanosecond), std::memory_order_relaxed);
+	_slowFramePercentile.store(percentile, std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+ysResult GlobalState::SetCategoryEnabled(ysStringHandle category, bool enabled)
+{
+	LockGuard guard(_categoriesLock);
+
+	std::uint32_t const index = static_cast<std::uint32_t>(FindValue(_disabledCategories, _disabledCategories + _disabledCategoryCount, category));
+	if (enabled && index != _disabledCategoryCount)
+		_disabledCategories[index] = _disabledCategories[--_disabledCategoryCount];
+	else if (!enabled && index == _disabledCategoryCount)
+	{
+		if (_disabledCategoryCount == kMaxDisabledCategories)
+			return ysResult::NoMemory;
+		_disabledCategories[_disabledCategoryCount++] = category;
+	}
+
+	// sites not seen yet pick up the change when they are
+	for (Site* site = _categorizedSites; site != nullptr; site = site->next)
+		if (site->category == category)
+			site->filter.store(enabled ? kSiteEnabled : kSiteDisabled, std::memory_order_relaxed);
+
+	return ysResult::Success;
+}
+
+SiteFilter GlobalState::SeeSite(Site& site)
+{
+	LockGuard guard(_categoriesLock);
+
+	// another thread may have seen the site first
+	std::uint8_t const seen = site.filter.load(std::memory_order_relaxed);
+	if (seen != kSiteUnseen)
+		return static_cast<SiteFilter>(seen);
+
+	// the minimum is compared with every region the site ends, so it is only converted once
+	site.minimumTicks = static_cast<ysTime>(site.minimum * _ticksPerNanosecond);
+
+	bool disabled = false;
+	if (site.category != 0)
+	{
+		site.next = _categorizedSites;
+		_categorizedSites = &site;
+		disabled = FindValue(_disabledCategories, _disabledCategories + _disabledCategoryCount, site.category) != _disabledCategoryCount;
+	}
+
+	// published after the minimum, which is read by whoever sees the filter set
+	SiteFilter const filter = disabled ? kSiteDisabled : kSiteEnabled;
+	site.filter.store(filter, std::memory_order_release);
+	return filter;
+}
+
+void GlobalState::RejectSite(Site& site)
+{
+	LockGuard guard(_categoriesLock);
+
+	// events queued before the rejection try to register the site again
+	for (Site* rejected = _rejectedSites; rejected != nullptr; rejected = rejected->next)
+	{
+		if (rejected == &site)
+			return;
+	}
+
+	// unlinked so that enabling its category doesn't enable it again
+	for (Site** link = &_categorizedSites; *link != nullptr; link = &(*link)->next)
+	{
+		if (*link == &site)
+		{
+			*link = site.next;
+			break;
+		}
+	}
+	site.next = _rejectedSites;
+	_rejectedSites = &site;
+
+	site.filter.store(kSiteDisabled, std::memory_order_relaxed);
+	_stringCollisions.fetch_add(1, std::memory_order_relaxed);
+}
+
+ysResult GlobalState::StartSampling(std::uint32_t rate, std::uint32_t stallMilliseconds)
+{
+	if (rate == 0 || rate > 10000)
+		return ysResult::InvalidParameter;
+
+	ysTime const frequency = GetClockFrequency();
+	_sampleInterval.store(frequency / rate, std::memory_order_relaxed);
+	_stallThreshold.store(frequency / 1000 * stallMilliseconds, std::memory_order_relaxed);
+	_sampling.store(true, std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+ysResult GlobalState::StopSampling()
+{
+	_sampling.store(false, std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+void GlobalState::DestroySink(Sink* sink)
+{
+	// sinks are allocated as their most-derived type
+	void* const memory = dynamic_cast<void*>(sink);
+	sink->~Sink();
+	_allocator(memory, 0);
+}
+
+ysResult GlobalState::AddSink(Sink* sink)
+{
+	void* const memory = _allocator(nullptr, sizeof(SinkChannel));
+	if (memory == nullptr)
+	{
+		DestroySink(sink);
+		return ysResult::NoMemory;
+	}
+
+	SinkChannel* const channel = new (memory) SinkChannel(sink, _strings, _allocator);
+
+	// the background thread can't write events while we hold the lock, so the channel's string
+	// preamble is exactly the set of strings that it will not see in its buffer
+	LockGuard guard(_sinksLock);
+
+	if (_sinkCount == kMaxSinks)
+	{
+		channel->~SinkChannel();
+		_allocator(memory, 0);
+		DestroySink(sink);
+		return ysResult::NoMemory;
+	}
+
+	channel->Start();
+	_sinks[_sinkCount++] = channel;
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::RemoveSink(Sink* sink)
+{
+	SinkChannel* channel = nullptr;
+	{
+		LockGuard guard(_sinksLock);
+
+		std::size_t const index = FindIf(_sinks, _sinks + _sinkCount, [sink](SinkChannel const* c){ return c->GetSink() == sink; });
+		if (index == _sinkCount)
+			return ysResult::InvalidParameter;
+
+		channel = _sinks[index];
+		_sinks[index] = _sinks[--_sinkCount];
+		_sinks[_sinkCount] = nullptr;
+
+		// nothing more is written to the channel once it is out of the list
+		_droppedEvents += channel->GetDropped();
+	}
+
+	// stopping waits for the sink to catch up, so don't block the background thread meanwhile
+	channel->~SinkChannel();
+	_allocator(channel, 0);
+	DestroySink(sink);
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::QueryDroppedEvents(std::uint64_t* out_count)
+{
+	if (out_count == nullptr)
+		return ysResult::InvalidParameter;
+
+	LockGuard guard(_sinksLock);
+
+	std::uint64_t count = _droppedEvents;
+	for (std::size_t index = 0; index != _sinkCount; ++index)
+		count += _sinks[index]->GetDropped();
+
+	*out_count = count;
+	return ysResult::Success;
+}
+
+ysResult GlobalState::QueryStringCollisions(std::uint64_t* out_count)
+{
+	if (out_count == nullptr)
+		return ysResult::InvalidParameter;
+
+	*out_count = _stringCollisions.load(std::memory_order_relaxed);
+	return ysResult::Success;
+}
+
+void GlobalState::RemoveAllSinks()
+{
+	while (_sinkCount != 0)
+		RemoveSink(_sinks[0]->GetSink());
+	_websocketSink = nullptr;
+	_fileSink = nullptr;
+	_exportSink = nullptr;
+	_flightRecorder = nullptr;
+}
+
+void GlobalState::ThreadMain()
+{
+	while (_active.load(std::memory_order_seq_cst))
+	{
+		_signal.Wait(GetFlushWait());
+
+		FlushThreads();
+		WaitForSinks();
+	}
+
+	// pass on anything emitted before shutdown began
+	FlushThreads();
+}
+
+void GlobalState::WaitForSinks()
+{
+	// a lossless sink that fell behind sets aside what doesn't fit in its buffer. waiting for it
+	// here, with no locks held, holds up only the background thread and not the other sinks or
+	// threads coming and going.
+	while (_active.load(std::memory_order_relaxed))
+	{
+		bool backlogged = false;
+		{
+			LockGuard guard(_sinksLock);
+			for (std::size_t index = 0; index != _sinkCount; ++index)
+				backlogged = backlogged || _sinks[index]->IsBacklogged();
+		}
+		if (!backlogged)
+			return;
+
+		_signal.Wait(1000);
+	}
+}
+
+std::uint32_t GlobalState::GetFlushWait() const
+{
+	std::uint32_t const wait = 100;
+	if (!_sampling.load(std::memory_order_relaxed) || _nextSample == 0)
+		return wait;
+
+	// samples are taken by the flush, so an idle process must still be woken for each one. the
+	// schedule is only written by this thread, so it can be read without the lock.
+	ysTime const now = ReadClock();
+	if (now >= _nextSample)
+		return 0;
+
+	ysTime const microseconds = (_nextSample - now) * 1000000 / GetClockFrequency();
+	return microseconds < wait ? static_cast<std::uint32_t>(microseconds) : wait;
+}
+
+ysStringHandle GlobalState::InternString(char const* str, std::uint32_t length, ysStringHandle hash)
+{
+	if (!_active.load(std::memory_order_acquire))
+		return 0;
+
+	ysResult const result = _strings.Intern(str, length, hash);
+	if (result == ysResult::Collision)
+		_stringCollisions.fetch_add(1, std::memory_order_relaxed);
+	return result == ysResult::Success ? hash : 0;
+}
+
+ysResult GlobalState::AnnounceString(ysStringHandle id)
+{
+	if (!_strings.Announce(id))
+		return ysResult::Success;
+
+	EventData ev;
+	if (!MakeStringEvent(_strings, id, ev))
+		return ysResult::Success;
+	ev.thread = 0;
+
+	return WriteEvent(ev);
+}
+
+ysResult GlobalState::RegisterSite(Site& site)
+{
+	std::uint32_t const epoch = _epoch.load(std::memory_order_relaxed);
+	if (site.epoch == epoch)
+		return ysResult::Success;
+
+	// a site whose name or file shares a handle with a different string would be attributed to
+	// that string, so it is rejected rather than given handles that don't match YS_STRING_ID
+	ysResult result = _strings.Register(site.nameId, site.name, static_cast<std::uint32_t>(std::strlen(site.name)));
+	if (result == ysResult::Success)
+		result = _strings.Register(site.fileId, site.file, static_cast<std::uint32_t>(std::strlen(site.file)));
+	if (result == ysResult::Collision)
+		RejectSite(site);
+	YS_TRY(result);
+	YS_TRY(AnnounceString(site.nameId));
+	YS_TRY(AnnounceString(site.fileId));
+
+	site.epoch = epoch;
+	return ysResult::Success;
+}
+
+ysResult GlobalState::ProcessThread(ThreadState* thread)
+{
+	EventData ev;
+	int count = 512;
+	while (--count && thread->Deque(ev))
+		YS_TRY(ProcessEvent(thread, ev));
+	return ysResult::Success;
+}
+
+ysResult GlobalState::ProcessEvent(ThreadState* thread, EventData& ev)
+{
+	ev.thread = thread->_index;
+
+	// a site that fails to register for want of memory is still written with its handles, but
+	// the events of a site rejected for a handle collision are dropped
+	switch (ev.type)
+	{
+	case EventType::Tick:
+		// the frame's held regions, counter increments, statistics, call tree and histograms
+		// are delivered ahead of the tick that ends it
+		YS_TRY(ResolveFrames(ev.tick.when));
+		for (ThreadState* other = _threads; other != nullptr; other = other->_next)
+			YS_TRY(WriteCounters(other));
+		YS_TRY(WriteCpuCounters());
+		YS_TRY(WriteStats(ev.tick.when));
+		YS_TRY(WriteCallTree(ev.tick.when));
+		YS_TRY(WriteHistograms(ev.tick.when));
+		break;
+	case EventType::Region:
+		if (!PrepareRegion(ev))
+			return ysResult::Success;
+		break;
+	case EventType::CounterSet:
+		if (RegisterSite(*ev.counter_set.site) == ysResult::Collision)
+			return ysResult::Success;
+		if (ev.counter_set.name == 0)
+			ev.counter_set.name = ev.counter_set.site->nameId;
+		else
+			AnnounceString(ev.counter_set.name);
+		_sketches.Record(ev.counter_set.site, ev.counter_set.name, EventType::CounterSet, ev.counter_set.when, ev.counter_set.value);
+		break;
+	case EventType::CounterAdd:
+		if (RegisterSite(*ev.counter_add.site) == ysResult::Collision)
+			return ysResult::Success;
+		if (ev.counter_add.name == 0)
+			ev.counter_add.name = ev.counter_add.site->nameId;
+		else
+			AnnounceString(ev.counter_add.name);
+		break;
+	default: break;
+	}
+
+	return WriteEvent(ev);
+}
+
+bool GlobalState::PrepareRegion(EventData& ev)
+{
+	if (RegisterSite(*ev.region.site) == ysResult::Collision)
+		return false;
+	if (ev.region.name == 0)
+		ev.region.name = ev.region.site->nameId;
+	else
+		AnnounceString(ev.region.name);
+	_sketches.Record(ev.region.site, ev.region.name, EventType::Region, ev.region.end, static_cast<double>(ev.region.end > ev.region.begin ? ev.region.end - ev.region.begin : 0));
+	return true;
+}
+
+ysResult GlobalState::ResolveFrames(ysTime when)
+{
+	ysTime const length = when > _lastFrameEnd ? when - _lastFrameEnd : 0;
+	_lastFrameEnd = when;
+
+	// the frame is judged against the ones before it, so a run of slow frames only stops counting
+	// as slow once it has become typical
+	ysTime const threshold = _slowFrameLength.load(std::memory_order_relaxed);
+	double const percentile = _slowFramePercentile.load(std::memory_order_relaxed);
+	ysTime typical = 0;
+	bool const slow = (threshold != 0 && length > threshold) ||
+		(percentile != 0 && _frameHistory.FindPercentile(percentile, typical) && length > typical);
+	_frameHistory.Add(length);
+
+	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+		YS_TRY(ResolveFrame(thread, when, slow));
+	return ysResult::Success;
+}
+
+ysResult GlobalState::ResolveFrame(ThreadState* thread, ysTime when, bool slow)
+{
+	// the thread's regions are swapped for an empty buffer and resolved after its lock is released,
+	// so that a sink that has fallen behind never holds up the thread. without a spare buffer, the
+	// regions stay held until there is one.
+	if (_spareFrame == nullptr)
+	{
+		_spareFrame = static_cast<FrameBuffer*>(_allocator(nullptr, sizeof(FrameBuffer)));
+		if (_spareFrame == nullptr)
+			return ysResult::Success;
+		_spareFrame->count = 0;
+	}
+
+	FrameBuffer* frame;
+	{
+		LockGuard guard(thread->_frameLock);
+		frame = thread->_frame;
+		if (frame == nullptr)
+			return ysResult::Success;
+		thread->_frame = _spareFrame;
+	}
+	_spareFrame = frame;
+
+	// regions that ended after the tick belong to the next frame and stay held
+	std::uint32_t held = 0;
+	for (std::uint32_t index = 0; index != frame->count; ++index)
+	{
+		HeldRegion const& region = frame->regions[index];
+		if (region.end > when)
+		{
+			frame->regions[held++] = region;
+			continue;
+		}
+
+		// a site that can't be given an entry this frame is delivered as an ordinary region
+		ysTime const duration = region.end > region.begin ? region.end - region.begin : 0;
+		if (!slow && _frameStats.Record(*region.site, region.name, duration))
+			continue;
+
+		EventData ev;
+		ev.type = EventType::Region;
+		ev.thread = thread->_index;
+		ev.region.site = region.site;
+		ev.region.name = region.name;
+		ev.region.begin = region.begin;
+		ev.region.end = region.end;
+		if (PrepareRegion(ev))
+			WriteEvent(ev);
+	}
+
+	// the held regions go back to the thread, after any it has held since. those that no longer fit
+	// are summarized with the next frame, as if the thread had run out of room for them itself.
+	if (held != 0)
+	{
+		LockGuard guard(thread->_frameLock);
+		FrameBuffer* const current = thread->_frame;
+		for (std::uint32_t index = 0; index != held; ++index)
+		{
+			HeldRegion const& region = frame->regions[index];
+			if (current->count != FrameBuffer::kCapacity)
+				current->regions[current->count++] = region;
+			else
+				_frameStats.Record(*region.site, region.name, region.end > region.begin ? region.end - region.begin : 0);
+		}
+	}
+
+	frame->count = 0;
+	return ysResult::Success;
+}
+
+void GlobalState::FreeFrameBuffer(ThreadState* thread)
+{
+	LockGuard guard(thread->_frameLock);
+
+	if (thread->_frame != nullptr)
+		_allocator(thread->_frame, 0);
+	thread->_frame = nullptr;
+}
+
+ysResult GlobalState::WriteCounters(ThreadState* thread)
+{
+	for (std::uint32_t index = 0; index != thread->_counters.GetCount(); ++index)
+	{
+		CounterSlot& slot = thread->_counters.GetSlot(index);
+		double const total = slot.total.load(std::memory_order_relaxed);
+		if (total == slot.seen)
+			continue;
+
+		// the slot keeps the name it was added with, so the site's name is only substituted here
+		if (RegisterSite(*slot.site) == ysResult::Collision)
+		{
+			slot.seen = total;
+			continue;
+		}
+		ysStringHandle name = slot.name;
+		if (name == 0)
+			name = slot.site->nameId;
+		else
+			AnnounceString(name);
+
+		EventData ev;
+		ev.type = EventType::CounterAdd;
+		ev.thread = thread->_index;
+		ev.counter_add.site = slot.site;
+		ev.counter_add.name = name;
+		ev.counter_add.amount = total - slot.seen;
+		slot.seen = total;
+
+		YS_TRY(WriteEvent(ev));
+	}
+	return ysResult::Success;
+}
+
+ysResult GlobalState::WriteCpuCounters()
+{
+	for (std::uint32_t index = 0; index != _cpuCounters.GetCount(); ++index)
+	{
+		Site* const site = _cpuCounters.GetSite(index);
+		if (site == nullptr)
+			continue;
+
+		double const total = _cpuCounters.ReadTotal(index);
+		double& seen = _cpuCounters.GetSeen(index);
+		if (total == seen)
+			continue;
+
+		if (RegisterSite(*site) == ysResult::Collision)
+		{
+			seen = total;
+			continue;
+		}
+
+		// summed over every thread, so not attributed to any of them
+		EventData ev;
+		ev.type = EventType::CounterAdd;
+		ev.thread = 0;
+		ev.counter_add.site = site;
+		ev.counter_add.name = site->nameId;
+		ev.counter_add.amount = total - seen;
+		seen = total;
+
+		YS_TRY(WriteEvent(ev));
+	}
+	return ysResult::Success;
+}
+
+ysResult GlobalState::HarvestStats(ThreadState* thread, ysTime when)
+{
+	// a site that doesn't fit is written on its own, so it may be summarized twice this frame. it
+	// is only written once the thread's lock is released, so that a sink can't hold up the thread.
+	{
+		LockGuard guard(thread->_statsLock);
+
+		for (std::uint32_t index = 0; index != thread->_stats.GetCount(); ++index)
+		{
+			SiteStats const& stats = thread->_stats.GetEntry(index);
+			if (!_frameStats.Merge(stats))
+				_overflowStats.Merge(stats);
+		}
+
+		thread->_stats.Clear();
+	}
+
+	// the statistics are gone from the thread either way, so a failure doesn't stop the rest
+	ysResult result = ysResult::Success;
+	for (std::uint32_t index = 0; index != _overflowStats.GetCount(); ++index)
+	{
+		ysResult const written = WriteSummary(_overflowStats.GetEntry(index), when);
+		if (result == ysResult::Success)
+			result = written;
+	}
+
+	_overflowStats.Clear();
+	return result;
+}
+
+ysResult GlobalState::WriteSummary(SiteStats const& stats, ysTime when)
+{
+	if (RegisterSite(*stats.site) == ysResult::Collision)
+		return ysResult::Success;
+
+	EventData ev;
+	ev.type = EventType::RegionSummary;
+	ev.thread = 0;
+	ev.region_summary.site = stats.site;
+	ev.region_summary.name = stats.name;
+	ev.region_summary.count = stats.count;
+	ev.region_summary.when = when;
+	ev.region_summary.total = stats.total;
+	ev.region_summary.min = stats.min;
+	ev.region_summary.max = stats.max;
+	ev.region_summary.sumSquares = stats.sumSquares;
+
+	if (ev.region_summary.name == 0)
+		ev.region_summary.name = stats.site->nameId;
+	else
+		AnnounceString(ev.region_summary.name);
+
+	return WriteEvent(ev);
+}
+
+ysResult GlobalState::WriteStats(ysTime when)
+{
+	ysResult result = ysResult::Success;
+	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+	{
+		ysResult const harvested = HarvestStats(thread, when);
+		if (result == ysResult::Success)
+			result = harvested;
+	}
+
+	// a failure mustn't leave the frame's statistics to be counted again with the next one
+	for (std::uint32_t index = 0; index != _frameStats.GetCount(); ++index)
+	{
+		ysResult const written = WriteSummary(_frameStats.GetEntry(index), when);
+		if (result == ysResult::Success)
+			result = written;
+	}
+
+	_frameStats.Clear();
+	return result;
+}
+
+void GlobalState::HarvestCallTree(ThreadState* thread)
+{
+	LockGuard guard(thread->_treeLock);
+
+	// parents come before their children, so a node's parent is always merged first. a path that
+	// doesn't fit loses its times, as do the paths beneath it.
+	for (std::uint32_t index = 0; index != thread->_tree.GetCount(); ++index)
+	{
+		CallTreeNode& node = thread->_tree.GetNode(index);
+		if (node.mark == kNoNode)
+		{
+			std::uint32_t const parent = node.parent == kNoNode ? kNoNode : thread->_tree.GetNode(node.parent).mark;
+			if (node.parent == kNoNode || parent != kNoNode)
+				node.mark = _frameTree.FindChild(parent, *node.site, node.name);
+		}
+
+		if (node.count != 0 && node.mark != kNoNode)
+			_frameTree.Merge(node.mark, node);
+	}
+
+	thread->_tree.ClearTimes();
+}
+
+ysResult GlobalState::WriteCallTree(ysTime when)
+{
+	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+		HarvestCallTree(thread);
+
+	// the paths with regions this frame are written with every node enclosing them, numbered in
+	// order so parents still come first
+	static constexpr std::uint32_t kEnclosing = kNoNode - 1;
+	std::uint32_t const count = _frameTree.GetCount();
+	for (std::uint32_t index = 0; index != count; ++index)
+		_frameTree.GetNode(index).mark = kNoNode;
+
+	for (std::uint32_t index = 0; index != count; ++index)
+	{
+		if (_frameTree.GetNode(index).count == 0)
+			continue;
+
+		for (std::uint32_t node = index; node != kNoNode && _frameTree.GetNode(node).mark == kNoNode; node = _frameTree.GetNode(node).parent)
+			_frameTree.GetNode(node).mark = kEnclosing;
+	}
+
+	std::uint16_t nodes = 0;
+	for (std::uint32_t index = 0; index != count; ++index)
+	{
+		if (_frameTree.GetNode(index).mark != kNoNode)
+			_frameTree.GetNode(index).mark = nodes++;
+	}
+
+	if (nodes == 0)
+		return ysResult::Success;
+
+	static constexpr std::uint32_t kNodeSize = 36;
+
+	// a frame whose tree can't be allocated is not delivered
+	EventPayload* const payload = CreatePayload(_allocator, nodes * kNodeSize);
+	if (payload == nullptr)
+	{
+		_frameTree.ClearTimes();
+		return ysResult::Success;
+	}
+
+	unsigned char* out = payload->GetData();
+	for (std::uint32_t index = 0; index != count; ++index)
+	{
+		CallTreeNode const& node = _frameTree.GetNode(index);
+		if (node.mark == kNoNode)
+			continue;
+
+		// a rejected site's node is kept for the sake of its children, but left unnamed
+		ysStringHandle name = node.name;
+		ysStringHandle file = node.site->fileId;
+		if (RegisterSite(*node.site) == ysResult::Collision)
+			name = file = 0;
+		else if (name == 0)
+			name = node.site->nameId;
+		else
+			AnnounceString(name);
+
+		std::uint32_t const parent = node.parent == kNoNode ? kNoNode : _frameTree.GetNode(node.parent).mark;
+		std::memcpy(out, &parent, 4);
+		std::memcpy(out + 4, &name, 4);
+		std::memcpy(out + 8, &file, 4);
+		std::memcpy(out + 12, &node.site->line, 4);
+		std::memcpy(out + 16, &node.count, 4);
+		std::memcpy(out + 20, &node.inclusive, 8);
+		std::memcpy(out + 28, &node.exclusive, 8);
+		out += kNodeSize;
+	}
+
+	_frameTree.ClearTimes();
+
+	EventData ev;
+	ev.type = EventType::CallTree;
+	ev.thread = 0;
+	ev.call_tree.when = when;
+	ev.call_tree.nodes = nodes;
+	ev.call_tree.data = payload;
+
+	ysResult const result = WriteEvent(ev);
+	ReleasePayload(payload);
+	return result;
+}
+
+ysResult GlobalState::SampleThreads(ysTime now)
+{
+	if (!_sampling.load(std::memory_order_relaxed))
+	{
+		// deliver what was sampled before sampling stopped
+		_nextSample = 0;
+		if (_sampleCount == 0)
+			return ysResult::Success;
+		return WriteSamples(now);
+	}
+
+	if (_nextSample == 0)
+	{
+		_nextSample = now;
+		_nextSampleReport = now + GetClockFrequency();
+	}
+
+	if (now < _nextSample)
+		return ysResult::Success;
+
+	// samples missed while the background thread was busy are skipped rather than caught up
+	_nextSample = now + _sampleInterval.load(std::memory_order_relaxed);
+	ysTime const stallThreshold = _stallThreshold.load(std::memory_order_relaxed);
+
+	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+	{
+		++_sampleCount;
+
+		// the entries beneath the depth may be changing as they are read, which at worst puts a
+		// sample in the wrong place
+		std::uint32_t depth = thread->_depth.load(std::memory_order_acquire);
+		if (depth > ThreadState::kMaxStackDepth)
+			depth = ThreadState::kMaxStackDepth;
+		if (depth == 0)
+			continue;
+
+		std::uint32_t parent = kNoNode;
+		for (std::uint32_t index = 0; index != depth; ++index)
+		{
+			CallStackEntry const& entry = thread->_stack[index];
+			std::uint32_t const node = _sampleTree.FindChild(parent, *entry.site.load(std::memory_order_relaxed), entry.name.load(std::memory_order_relaxed));
+			if (node == kNoNode)
+				break;
+
+			++_sampleTree.GetNode(node).inclusive;
+			if (index == depth - 1)
+				++_sampleTree.GetNode(node).exclusive;
+			parent = node;
+		}
+
+		// a stall is reported once, when it first passes the threshold
+		CallStackEntry const& innermost = thread->_stack[depth - 1];
+		ysTime const start = innermost.start.load(std::memory_order_relaxed);
+		if (stallThreshold != 0 && now > start && now - start >= stallThreshold && thread->_stalled != start)
+		{
+			thread->_stalled = start;
+			YS_TRY(WriteStall(thread, innermost, now));
+		}
+	}
+
+	if (now >= _nextSampleReport)
+	{
+		_nextSampleReport = now + GetClockFrequency();
+		YS_TRY(WriteSamples(now));
+	}
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::WriteStall(ThreadState* thread, CallStackEntry const& entry, ysTime now)
+{
+	Site* const site = entry.site.load(std::memory_order_relaxed);
+	if (RegisterSite(*site) == ysResult::Collision)
+		return ysResult::Success;
+
+	EventData ev;
+	ev.type = EventType::Stall;
+	ev.thread = thread->_index;
+	ev.stall.site = site;
+	ev.stall.name = entry.name.load(std::memory_order_relaxed);
+	ev.stall.since = entry.start.load(std::memory_order_relaxed);
+	ev.stall.when = now;
+
+	if (ev.stall.name == 0)
+		ev.stall.name = site->nameId;
+	else
+		AnnounceString(ev.stall.name);
+
+	return WriteEvent(ev);
+}
+
+ysResult GlobalState::WriteSamples(ysTime when)
+{
+	// a node's samples include its children's, so every node with samples has a parent with them
+	std::uint32_t const count = _sampleTree.GetCount();
+	std::uint16_t nodes = 0;
+	for (std::uint32_t index = 0; index != count; ++index)
+	{
+		CallTreeNode& node = _sampleTree.GetNode(index);
+		node.mark = node.inclusive != 0 ? nodes++ : kNoNode;
+	}
+
+	static constexpr std::uint32_t kNodeSize = 24;
+
+	// a second whose samples can't be allocated is not delivered
+	EventPayload* const payload = CreatePayload(_allocator, nodes * kNodeSize);
+	std::uint32_t const samples = _sampleCount;
+	_sampleCount = 0;
+	if (payload == nullptr)
+	{
+		_sampleTree.ClearTimes();
+		return ysResult::Success;
+	}
+
+	unsigned char* out = payload->GetData();
+	for (std::uint32_t index = 0; index != count; ++index)
+	{
+		CallTreeNode const& node = _sampleTree.GetNode(index);
+		if (node.mark == kNoNode)
+			continue;
+
+		// a rejected site's node is kept for the sake of its children, but left unnamed
+		ysStringHandle name = node.name;
+		ysStringHandle file = node.site->fileId;
+		if (RegisterSite(*node.site) == ysResult::Collision)
+			name = file = 0;
+		else if (name == 0)
+			name = node.site->nameId;
+		else
+			AnnounceString(name);
+
+		std::uint32_t const parent = node.parent == kNoNode ? kNoNode : _sampleTree.GetNode(node.parent).mark;
+		std::uint32_t const self = static_cast<std::uint32_t>(node.exclusive);
+		std::uint32_t const total = static_cast<std::uint32_t>(node.inclusive);
+		std::memcpy(out, &parent, 4);
+		std::memcpy(out + 4, &name, 4);
+		std::memcpy(out + 8, &file, 4);
+		std::memcpy(out + 12, &node.site->line, 4);
+		std::memcpy(out + 16, &self, 4);
+		std::memcpy(out + 20, &total, 4);
+		out += kNodeSize;
+	}
+
+	_sampleTree.ClearTimes();
+
+	EventData ev;
+	ev.type = EventType::Samples;
+	ev.thread = 0;
+	ev.samples.when = when;
+	ev.samples.samples = samples;
+	ev.samples.nodes = nodes;
+	ev.samples.data = payload;
+
+	ysResult const result = WriteEvent(ev);
+	ReleasePayload(payload);
+	return result;
+}
+
+ThreadHistogram* GlobalState::CreateHistogram(Site& site)
+{
+	if (!_active.load(std::memory_order_acquire))
+		return nullptr;
+
+	void* const memory = _allocator(nullptr, sizeof(ThreadHistogram));
+	if (memory == nullptr)
+		return nullptr;
+
+	ThreadHistogram* const histogram = new (memory) ThreadHistogram;
+	histogram->site = &site;
+	histogram->next = nullptr;
+	histogram->count.store(0, std::memory_order_relaxed);
+	histogram->limit.store(0, std::memory_order_relaxed);
+	for (std::atomic<std::uint32_t>& count : histogram->counts)
+		count.store(0, std::memory_order_relaxed);
+	histogram->merged = nullptr;
+	histogram->seenCount = 0;
+	std::memset(histogram->seen, 0, sizeof(histogram->seen));
+	return histogram;
+}
+
+FrameBuffer* GlobalState::CreateFrameBuffer()
+{
+	if (!_active.load(std::memory_order_acquire))
+		return nullptr;
+
+	FrameBuffer* const frame = static_cast<FrameBuffer*>(_allocator(nullptr, sizeof(FrameBuffer)));
+	if (frame == nullptr)
+		return nullptr;
+
+	frame->count = 0;
+	return frame;
+}
+
+ysResult GlobalState::QueryHistogram(ysStringHandle name, ysHistogram* out_histogram)
+{
+	if (out_histogram == nullptr)
+		return ysResult::InvalidParameter;
+
+	std::memset(out_histogram, 0, sizeof(*out_histogram));
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	LockGuard guard(_histogramsLock);
+	for (SiteHistogram const* histogram = _siteHistograms; histogram != nullptr; histogram = histogram->next)
+	{
+		if (histogram->site->nameId != name)
+			continue;
+
+		out_histogram->count += histogram->count;
+		for (std::uint32_t index = 0; index != histogram->limit; ++index)
+			out_histogram->buckets[index] += histogram->counts[index];
+	}
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::QueryQuantiles(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles* out_quantiles)
+{
+	if (out_quantiles == nullptr)
+		return ysResult::InvalidParameter;
+
+	std::memset(out_quantiles, 0, sizeof(*out_quantiles));
+
+	if (static_cast<std::size_t>(window) >= ysWindowCount)
+		return ysResult::InvalidParameter;
+	if (source != ysEventType::Region && source != ysEventType::CounterSet)
+		return ysResult::InvalidParameter;
+
+	if (!_active.load(std::memory_order_acquire))
+		return ysResult::Uninitialized;
+
+	LockGuard guard(_sketchesLock);
+	_sketches.Estimate(name, source, window, *out_quantiles);
+	return ysResult::Success;
+}
+
+SiteHistogram* GlobalState::FindSiteHistogram(Site* site)
+{
+	for (SiteHistogram* histogram = _siteHistograms; histogram != nullptr; histogram = histogram->next)
+	{
+		if (histogram->site == site)
+			return histogram;
+	}
+
+	void* const memory = _allocator(nullptr, sizeof(SiteHistogram));
+	if (memory == nullptr)
+		return nullptr;
+
+	SiteHistogram* const histogram = new (memory) SiteHistogram;
+	std::memset(histogram, 0, sizeof(*histogram));
+	histogram->site = site;
+	histogram->next = _siteHistograms;
+	_siteHistograms = histogram;
+	return histogram;
+}
+
+void GlobalState::HarvestHistograms(ThreadState* thread)
+{
+	for (ThreadHistogram* histogram = thread->_histograms.load(std::memory_order_acquire); histogram != nullptr; histogram = histogram->next)
+	{
+		// buckets are counted before the total, so every bucket behind this total is visible
+		std::uint32_t const count = histogram->count.load(std::memory_order_acquire);
+		if (count == histogram->seenCount)
+			continue;
+
+		if (histogram->merged == nullptr)
+			histogram->merged = FindSiteHistogram(histogram->site);
+		if (histogram->merged == nullptr)
+			continue;
+		histogram->seenCount = count;
+
+		SiteHistogram& merged = *histogram->merged;
+		std::uint32_t const limit = histogram->limit.load(std::memory_order_relaxed);
+		for (std::uint32_t index = 0; index != limit; ++index)
+		{
+			std::uint32_t const current = histogram->counts[index].load(std::memory_order_relaxed);
+			std::uint32_t const added = current - histogram->seen[index];
+			if (added == 0)
+				continue;
+
+			histogram->seen[index] = current;
+			merged.counts[index] += added;
+			merged.count += added;
+			merged.frame[index] += added;
+			merged.frameCount += added;
+		}
+
+		if (limit > merged.limit)
+			merged.limit = limit;
+	}
+}
+
+ysResult GlobalState::WriteHistograms(ysTime when)
+{
+	LockGuard guard(_histogramsLock);
+
+	for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+		HarvestHistograms(thread);
+
+	for (SiteHistogram* histogram = _siteHistograms; histogram != nullptr; histogram = histogram->next)
+	{
+		if (histogram->frameCount == 0)
+			continue;
+
+		std::uint16_t buckets = 0;
+		for (std::uint32_t index = 0; index != histogram->limit; ++index)
+			buckets += histogram->frame[index] != 0;
+
+		// a frame whose histogram can't be allocated is not delivered, though it is still queryable
+		EventPayload* const payload = CreatePayload(_allocator, buckets * (sizeof(std::uint16_t) + sizeof(std::uint32_t)));
+		if (payload != nullptr)
+		{
+			unsigned char* out = payload->GetData();
+			for (std::uint16_t index = 0; index != histogram->limit; ++index)
+			{
+				if (histogram->frame[index] == 0)
+					continue;
+
+				std::memcpy(out, &index, sizeof(index));
+				std::memcpy(out + sizeof(index), &histogram->frame[index], sizeof(histogram->frame[index]));
+				out += sizeof(std::uint16_t) + sizeof(std::uint32_t);
+			}
+		}
+
+		std::memset(histogram->frame, 0, histogram->limit * sizeof(histogram->frame[0]));
+		histogram->frameCount = 0;
+
+		if (payload == nullptr)
+			continue;
+
+		if (RegisterSite(*histogram->site) == ysResult::Collision)
+		{
+			ReleasePayload(payload);
+			continue;
+		}
+
+		EventData ev;
+		ev.type = EventType::Histogram;
+		ev.thread = 0;
+		ev.histogram.site = histogram->site;
+		ev.histogram.when = when;
+		ev.histogram.buckets = buckets;
+		ev.histogram.data = payload;
+
+		ysResult const result = WriteEvent(ev);
+		ReleasePayload(payload);
+		YS_TRY(result);
+	}
+
+	return ysResult::Success;
+}
+
+void GlobalState::RetireHistograms(ThreadState* thread)
+{
+	// the thread may be recording into its histograms at this moment, so they are only unlinked, and
+	// the thread is told to forget them
+	ThreadHistogram* const histograms = thread->_histograms.exchange(nullptr, std::memory_order_acquire);
+	thread->_histogramsTaken.store(true, std::memory_order_release);
+	if (histograms == nullptr)
+		return;
+
+	ThreadHistogram* last = histograms;
+	while (last->next != nullptr)
+		last = last->next;
+	last->next = _retiredHistograms;
+	_retiredHistograms = histograms;
+}
+
+void GlobalState::FreeHistograms(ThreadState* thread)
+{
+	// only called as the thread exits, so nothing is recording into them
+	ThreadHistogram* histogram = thread->_histograms.exchange(nullptr, std::memory_order_acquire);
+	while (histogram != nullptr)
+	{
+		ThreadHistogram* const next = histogram->next;
+		histogram->~ThreadHistogram();
+		_allocator(histogram, 0);
+		histogram = next;
+	}
+}
+
+ysResult GlobalState::WriteQuantiles(ysTime now)
+{
+	if (!_sketches.Advance(now))
+		return ysResult::Success;
+
+	static_assert(sizeof(ysQuantiles) == 40, "ysQuantiles is encoded as laid out in memory");
+
+	for (std::uint32_t index = 0; index != _sketches.GetCount(); ++index)
+	{
+		SketchSeries const& series = _sketches.GetSeries(index);
+		if (!_sketches.IsRecent(series))
+			continue;
+
+		// a site rejected for a string collision has no handles that its quantiles could be written with
+		if (RegisterSite(*series.site) == ysResult::Collision)
+			continue;
+
+		// a second whose quantiles can't be allocated is not delivered, though it is still queryable
+		EventPayload* const payload = CreatePayload(_allocator, sizeof(ysQuantiles) * ysWindowCount);
+		if (payload == nullptr)
+			continue;
+
+		ysQuantiles* const windows = reinterpret_cast<ysQuantiles*>(payload->GetData());
+		for (std::size_t window = 0; window != ysWindowCount; ++window)
+			_sketches.Estimate(series, static_cast<ysWindow>(window), windows[window]);
+
+		EventData ev;
+		ev.type = EventType::Quantiles;
+		ev.thread = 0;
+		ev.quantiles.site = series.site;
+		ev.quantiles.name = series.name;
+		ev.quantiles.source = series.source;
+		ev.quantiles.when = _sketches.GetWindowEnd();
+		ev.quantiles.data = payload;
+
+		ysResult const result = WriteEvent(ev);
+		ReleasePayload(payload);
+		YS_TRY(result);
+	}
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::FlushThreads()
+{
+	// holding the sinks lock for the whole pass keeps string announcements and the events
+	// that follow them consistent for sinks being added concurrently
+	LockGuard sinksGuard(_sinksLock);
+	LockGuard guard(_threadsLock);
+
+	{
+		LockGuard sketchesGuard(_sketchesLock);
+		for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+		{
+			YS_TRY(ProcessThread(thread));
+			YS_TRY(WriteCounters(thread));
+		}
+		YS_TRY(WriteCpuCounters());
+
+		YS_TRY(WriteQuantiles(ReadClock()));
+	}
+
+	YS_TRY(SampleThreads(ReadClock()));
+
+	// keep queries current between frames
+	{
+		LockGuard histogramsGuard(_histogramsLock);
+		for (ThreadState* thread = _threads; thread != nullptr; thread = thread->_next)
+			HarvestHistograms(thread);
+	}
+
+	for (std::size_t index = 0; index != _sinkCount; ++index)
+		_sinks[index]->Post();
+
+	return ysResult::Success;
+}
+
+ysResult GlobalState::WriteEvent(EventData const& ev)
+{
+	// each sink holds a reference to the payload until it has consumed the event
+	EventPayload* const payload = GetPayload(ev);
+
+	// a sink that has fallen behind drops the event; the others are unaffected
+	for (std::size_t index = 0; index != _sinkCount; ++index)
+	{
+		if (payload != nullptr)
+			AcquirePayload(payload);
+		if (!_sinks[index]->Write(ev) && payload != nullptr)
+			ReleasePayload(payload);
+	}
+
+	return ysResult::Success;
+}
+
+void GlobalState::RegisterThread(ThreadState* thread)
+{
+	LockGuard guard(_threadsLock);
+
+	// index 0 is reserved for events generated by Yardstick itself
+	if (++_lastThreadIndex == 0)
+		++_lastThreadIndex;
+	thread->_index = _lastThreadIndex;
+
+	thread->_prev = nullptr;
+	thread->_next = _threads;
+	if (_threads != nullptr)
+		_threads->_prev = thread;
+	_threads = thread;
+}
+
+void GlobalState::DeregisterThread(ThreadState* thread)
+{
+	LockGuard sinksGuard(_sinksLock);
+	LockGuard guard(_threadsLock);
+
+	// the thread's queue and counter increments go with it, so deliver what is left of them now
+	if (_active.load(std::memory_order_acquire))
+	{
+		LockGuard sketchesGuard(_sketchesLock);
+
+		EventData ev;
+		while (thread->Deque(ev))
+			ProcessEvent(thread, ev);
+		WriteCounters(thread);
+	}
+
+	// the thread's statistics are delivered with the next frame, as far as there is room for them
+	{
+		LockGuard statsGuard(thread->_statsLock);
+		for (std::uint32_t index = 0; index != thread->_stats.GetCount(); ++index)
+			_frameStats.Merge(thread->_stats.GetEntry(index));
+		thread->_stats.Clear();
+	}
+
+	// as are the times in its call tree
+	HarvestCallTree(thread);
+
+	// and the regions it still holds, whose frame hasn't been judged yet
+	{
+		LockGuard frameGuard(thread->_frameLock);
+		FrameBuffer* const frame = thread->_frame;
+		for (std::uint32_t index = 0; frame != nullptr && index != frame->count; ++index)
+		{
+			HeldRegion const& region = frame->regions[index];
+			_frameStats.Record(*region.site, region.name, region.end > region.begin ? region.end - region.begin : 0);
+		}
+	}
+	if (_active.load(std::memory_order_acquire))
+		FreeFrameBuffer(thread);
+
+	// as are its histograms, which are merged before they go
+	if (_active.load(std::memory_order_acquire))
+	{
+		LockGuard histogramsGuard(_histogramsLock);
+		HarvestHistograms(thread);
+		FreeHistograms(thread);
+	}
 
 	if (thread->_next != nullptr)
 		thread->_next->_prev = thread->_prev;
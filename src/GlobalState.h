@@ -22,16 +22,32 @@
 #include <yardstick/yardstick.h>
 
 #include "Atomics.h"
+#include "CallTree.h"
+#include "Clock.h"
+#include "CpuCounters.h"
+#include "Histogram.h"
+#include "QuantileSketch.h"
+#include "SiteStats.h"
+#include "SlowFrames.h"
 #include "Spinlock.h"
 #include "Signal.h"
-#include "WebsocketSink.h"
+#include "StringTable.h"
 
 #include <cstring>
+#include <new>
 #include <thread>
+#include <utility>
 
 namespace _ys_ {
 
+class ExportSink;
+class FileSink;
+class FlightRecorderSink;
+class Sink;
+class SinkChannel;
 class ThreadState;
+class WebsocketSink;
+struct EventData;
 
 class GlobalState
 {
@@ -44,16 +60,124 @@ class GlobalState
 
 	Spinlock _threadsLock;
 	ThreadState* _threads = nullptr;
+	std::uint16_t _lastThreadIndex = 0;
 
-	WebsocketSink _websocketSink;
+	StringTable _strings;
+	std::atomic<std::uint32_t> _epoch;
+
+	std::atomic<ysCaptureMode> _captureMode;
+	// regions shorter than the minimum, in clock ticks, are summarized like Statistics
+	std::atomic<ysTime> _minimumDuration;
+	double const _ticksPerNanosecond;
+	// every thread's statistics for the frame being harvested, and those of one thread that didn't
+	// fit. guarded by _threadsLock.
+	SiteStatsTable<1024> _frameStats;
+	SiteStatsTable<256> _overflowStats;
+	// every thread's call tree merged by path. nodes are kept for good, so only the first 1024 paths
+	// are ever delivered, which keeps a frame's tree within any sink's block. guarded by _threadsLock.
+	CallTreeTable<1024> _frameTree;
+
+	// how slow a frame must be for ysCaptureMode::SlowFrames to deliver its regions, in clock ticks
+	// or as a percentile of the recent frames. the history and the end of the last frame are only
+	// touched by the background thread.
+	std::atomic<ysTime> _slowFrameLength;
+	std::atomic<double> _slowFramePercentile;
+	FrameHistory _frameHistory;
+	ysTime _lastFrameEnd = 0;
+	// swapped with a thread's held regions while they are resolved. guarded by _threadsLock.
+	FrameBuffer* _spareFrame = nullptr;
+
+	// stack sampling from ysStartSampling. the interval and threshold are in clock ticks.
+	std::atomic<bool> _sampling;
+	std::atomic<ysTime> _sampleInterval;
+	std::atomic<ysTime> _stallThreshold;
+	// the samples of the current second by path: inclusive counts the samples taken inside a node,
+	// exclusive those taken with it innermost. guarded by _threadsLock, like the schedule below.
+	CallTreeTable<1024> _sampleTree;
+	std::uint32_t _sampleCount = 0;
+	ysTime _nextSample = 0;
+	ysTime _nextSampleReport = 0;
+
+	// sites with a category, linked through Site::next, and the categories turned off. these outlive
+	// initialization, as the sites are static. sites rejected for a string collision are linked
+	// separately, so that the next initialization can let them register again.
+	static constexpr std::uint32_t kMaxDisabledCategories = 64;
+	Spinlock _categoriesLock;
+	Site* _categorizedSites = nullptr;
+	Site* _rejectedSites = nullptr;
+	ysStringHandle _disabledCategories[kMaxDisabledCategories];
+	std::uint32_t _disabledCategoryCount = 0;
+
+	// strings refused since initialization because a different string has the same handle
+	std::atomic<std::uint64_t> _stringCollisions{0};
+
+	// every thread's histograms merged by site, read by QueryHistogram. lock after _threadsLock.
+	Spinlock _histogramsLock;
+	SiteHistogram* _siteHistograms = nullptr;
+	// the threads' histograms taken by the last shutdown, which a thread may still be recording into.
+	// they are freed by the next shutdown.
+	ThreadHistogram* _retiredHistograms = nullptr;
+	ysAllocator _retiredHistogramsAllocator = nullptr;
+
+	// counters summed per CPU, delivered with the per-thread ones
+	CpuCounterTable _cpuCounters;
+
+	// sketches of the regions and counters delivered, read by QueryQuantiles. lock after _threadsLock.
+	Spinlock _sketchesLock;
+	QuantileSketchTable _sketches;
+
+	static constexpr std::size_t kMaxSinks = 8;
+
+	Spinlock _sinksLock;
+	SinkChannel* _sinks[kMaxSinks] = {};
+	std::size_t _sinkCount = 0;
+	// events dropped by sinks since removed. guarded by _sinksLock.
+	std::uint64_t _droppedEvents = 0;
+
+	WebsocketSink* _websocketSink = nullptr;
+	FileSink* _fileSink = nullptr;
+	ExportSink* _exportSink = nullptr;
+	FlightRecorderSink* _flightRecorder = nullptr;
 
 	void ThreadMain();
+	void WaitForSinks();
+	std::uint32_t GetFlushWait() const;
+	ysResult AnnounceString(ysStringHandle id);
+	ysResult RegisterSite(Site& site);
+	void RejectSite(Site& site);
 	ysResult ProcessThread(ThreadState* thread);
+	ysResult ProcessEvent(ThreadState* thread, EventData& ev);
+	bool PrepareRegion(EventData& ev);
+	ysResult ResolveFrames(ysTime when);
+	ysResult ResolveFrame(ThreadState* thread, ysTime when, bool slow);
+	void FreeFrameBuffer(ThreadState* thread);
+	ysResult WriteCounters(ThreadState* thread);
+	ysResult WriteCpuCounters();
+	ysResult HarvestStats(ThreadState* thread, ysTime when);
+	ysResult WriteSummary(SiteStats const& stats, ysTime when);
+	ysResult WriteStats(ysTime when);
+	void HarvestCallTree(ThreadState* thread);
+	ysResult WriteCallTree(ysTime when);
+	ysResult SampleThreads(ysTime now);
+	ysResult WriteStall(ThreadState* thread, CallStackEntry const& entry, ysTime now);
+	ysResult WriteSamples(ysTime when);
+	SiteHistogram* FindSiteHistogram(Site* site);
+	void HarvestHistograms(ThreadState* thread);
+	ysResult WriteHistograms(ysTime when);
+	void RetireHistograms(ThreadState* thread);
+	void FreeHistograms(ThreadState* thread);
+	ysResult WriteQuantiles(ysTime now);
 	ysResult FlushThreads();
 	ysResult WriteEvent(EventData const& ev);
 
+	template <typename T, typename... Args> T* CreateSink(Args&&... args);
+	void DestroySink(Sink* sink);
+	ysResult AddSink(Sink* sink);
+	ysResult RemoveSink(Sink* sink);
+	void RemoveAllSinks();
+
 public:
-	GlobalState() : _active(false) {}
+	GlobalState() : _active(false), _epoch(0), _captureMode(ysCaptureMode::Events), _minimumDuration(0), _ticksPerNanosecond(GetClockFrequency() / 1e9), _slowFrameLength(0), _slowFramePercentile(0.99), _sampling(false), _sampleInterval(0), _stallThreshold(0) {}
 	GlobalState(GlobalState const&) = delete;
 	GlobalState& operator=(GlobalState const&) = delete;
 
@@ -63,7 +187,60 @@ public:
 	bool IsActive() const { return _active.load(std::memory_order_relaxed); }
 	ysResult Shutdown();
 
-	ysResult ListenWebsocket(unsigned short port);
+	ysResult ListenWebsocket(unsigned short port, std::size_t history);
+	ysResult StartCapture(char const* path);
+	ysResult StopCapture();
+	ysResult StartExport(char const* path, ysExportFormat format);
+	ysResult StopExport();
+	ysResult StartFlightRecorder(char const* path, std::size_t bytes);
+	ysResult StopFlightRecorder();
+	ysResult DumpFlightRecorder(char const* path);
+	static void RequestFlightRecorderDump();
+	ysResult AddCallbackSink(ysEventCallback callback, void* userData);
+	ysResult RemoveCallbackSink(ysEventCallback callback, void* userData);
+	ysResult QueryDroppedEvents(std::uint64_t* out_count);
+	ysResult QueryStringCollisions(std::uint64_t* out_count);
+
+	ysResult SetCaptureMode(ysCaptureMode mode);
+	ysCaptureMode GetCaptureMode() const { return _captureMode.load(std::memory_order_relaxed); }
+
+	ysResult SetMinimumDuration(std::uint64_t nanoseconds);
+
+	/// <summary> Returns true if a region is shorter than the minimum duration, or its site's. </summary>
+	/// <remarks> The site must have been seen, as it always is by the time its first region ends. </remarks>
+	bool IsShort(Site const& site, ysTime duration) const
+	{
+		return duration < _minimumDuration.load(std::memory_order_relaxed) || duration < site.minimumTicks;
+	}
+
+	ysResult SetSlowFrameThreshold(std::uint64_t nanoseconds, double percentile);
+
+	ysResult SetCategoryEnabled(ysStringHandle category, bool enabled);
+	SiteFilter SeeSite(Site& site);
+
+	/// <summary> Returns true if a site's category is disabled, seeing the site first if need be. </summary>
+	bool IsFiltered(Site& site)
+	{
+		std::uint8_t filter = site.filter.load(std::memory_order_acquire);
+		if (filter == kSiteUnseen)
+			filter = SeeSite(site);
+		return filter == kSiteDisabled;
+	}
+
+	ysResult StartSampling(std::uint32_t rate, std::uint32_t stallMilliseconds);
+	ysResult StopSampling();
+	bool IsSampling() const { return _sampling.load(std::memory_order_relaxed); }
+
+	bool AddCpuCount(Site& site, double amount) { return _cpuCounters.Add(site, amount); }
+
+	ThreadHistogram* CreateHistogram(Site& site);
+	FrameBuffer* CreateFrameBuffer();
+	ysResult QueryHistogram(ysStringHandle name, ysHistogram* out_histogram);
+	ysResult QueryQuantiles(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles* out_quantiles);
+
+	std::uint32_t GetEpoch() const { return _epoch.load(std::memory_order_relaxed); }
+	ysStringHandle InternString(char const* str, std::uint32_t length, ysStringHandle hash);
+	char const* FindString(ysStringHandle id, std::uint32_t& out_length) const { return _strings.Find(id, out_length); }
 
 	void RegisterThread(ThreadState* thread);
 	void DeregisterThread(ThreadState* thread);
@@ -77,4 +254,13 @@ GlobalState& GlobalState::instance()
 	return state;
 }
 
+template <typename T, typename... Args>
+T* GlobalState::CreateSink(Args&&... args)
+{
+	void* const memory = _allocator(nullptr, sizeof(T));
+	if (memory == nullptr)
+		return nullptr;
+	return new (memory) T(std::forward<Args>(args)...);
+}
+
 } // namespace _ys_
@@ -0,0 +1,125 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+namespace _ys_ {
+
+struct SiteHistogram;
+
+static constexpr std::uint32_t kHistogramSubBucketBits = 5;
+static constexpr std::uint32_t kHistogramSubBuckets = 1 << kHistogramSubBucketBits;
+static constexpr std::uint32_t kHistogramBuckets = static_cast<std::uint32_t>(ysHistogramBuckets);
+
+static_assert((64 - kHistogramSubBucketBits + 1) * kHistogramSubBuckets == kHistogramBuckets, "ysHistogramBuckets does not match the bucket layout");
+
+/// <summary> Returns the bucket counting a duration. </summary>
+static inline YS_INLINE std::uint32_t HistogramBucket(ysTime value)
+{
+	// the first two ranges are exact, and each later power of two is split into kHistogramSubBuckets
+	if (value < 2 * kHistogramSubBuckets)
+		return static_cast<std::uint32_t>(value);
+
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long highest;
+	_BitScanReverse64(&highest, value);
+#elif defined(__GNUC__)
+	unsigned const highest = 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+	unsigned highest = 0;
+	for (ysTime rest = value; rest >>= 1;)
+		++highest;
+#endif
+
+	std::uint32_t const shift = static_cast<std::uint32_t>(highest) - kHistogramSubBucketBits;
+	return shift * kHistogramSubBuckets + static_cast<std::uint32_t>(value >> shift);
+}
+
+/// <summary> Returns the smallest duration counted by a bucket. The bucket ends where the next begins. </summary>
+static inline ysTime HistogramBucketLowest(std::uint32_t index)
+{
+	if (index < 2 * kHistogramSubBuckets)
+		return index;
+
+	std::uint32_t const shift = index / kHistogramSubBuckets - 1;
+	return static_cast<ysTime>(index % kHistogramSubBuckets + kHistogramSubBuckets) << shift;
+}
+
+/// <summary> Durations recorded by one thread at one histogram site. </summary>
+/// <remarks>
+/// Only the owning thread writes the counts, which only ever grow, so recording needs no atomic
+/// read-modify-write. The background thread finds what was added since it last looked by
+/// comparing against its own copy; a count that wraps around still gives the right difference.
+/// </remarks>
+struct ThreadHistogram
+{
+	Site* site;
+	// published to the background thread by the owning thread's list head
+	ThreadHistogram* next;
+
+	// written by the owning thread only
+	std::atomic<std::uint32_t> count;
+	std::atomic<std::uint32_t> limit;
+	std::atomic<std::uint32_t> counts[kHistogramBuckets];
+
+	// owned by the Yardstick background thread
+	SiteHistogram* merged;
+	std::uint32_t seenCount;
+	std::uint32_t seen[kHistogramBuckets];
+
+	inline void Record(ysTime duration);
+};
+
+/// <summary> Every thread's durations at one histogram site, merged by the background thread. </summary>
+struct SiteHistogram
+{
+	Site* site;
+	SiteHistogram* next;
+
+	/// One past the highest non-empty bucket, ever.
+	std::uint32_t limit;
+	std::uint64_t count;
+	std::uint64_t counts[kHistogramBuckets];
+
+	/// Durations added since the last frame was delivered.
+	std::uint32_t frameCount;
+	std::uint32_t frame[kHistogramBuckets];
+};
+
+void ThreadHistogram::Record(ysTime duration)
+{
+	std::uint32_t const bucket = HistogramBucket(duration);
+
+	counts[bucket].store(counts[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (bucket >= limit.load(std::memory_order_relaxed))
+		limit.store(bucket + 1, std::memory_order_relaxed);
+
+	// releases the bucket to a background thread that acquires the count
+	count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace _ys_
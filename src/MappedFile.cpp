@@ -0,0 +1,186 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+using namespace _ys_;
+
+#if defined(_WIN32)
+
+namespace {
+
+ysResult MapHandle(HANDLE file, std::size_t size, bool writable, unsigned char*& out_data)
+{
+	DWORD const protect = writable ? PAGE_READWRITE : PAGE_READONLY;
+	DWORD const access = writable ? FILE_MAP_WRITE : FILE_MAP_READ;
+	unsigned long long const size64 = size;
+
+	HANDLE const mapping = CreateFileMappingA(file, nullptr, protect, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), nullptr);
+	if (mapping == nullptr)
+		return ysResult::System;
+
+	// the view keeps the mapping alive
+	void* const view = MapViewOfFile(mapping, access, 0, 0, size);
+	CloseHandle(mapping);
+	if (view == nullptr)
+		return ysResult::System;
+
+	out_data = static_cast<unsigned char*>(view);
+	return ysResult::Success;
+}
+
+} // anonymous namespace
+
+ysResult MappedFile::Open(char const* path)
+{
+	Close();
+
+	HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return ysResult::System;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return ysResult::InvalidParameter;
+	}
+
+	ysResult const result = MapHandle(file, static_cast<std::size_t>(size.QuadPart), false, _data);
+	CloseHandle(file);
+	if (result != ysResult::Success)
+		return result;
+
+	_size = static_cast<std::size_t>(size.QuadPart);
+	return ysResult::Success;
+}
+
+ysResult MappedFile::Create(char const* path, std::size_t size)
+{
+	Close();
+
+	if (size == 0)
+		return ysResult::InvalidParameter;
+
+	HANDLE const file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return ysResult::System;
+
+	// creating the mapping extends the file to its full size
+	ysResult const result = MapHandle(file, size, true, _data);
+	CloseHandle(file);
+	if (result != ysResult::Success)
+		return result;
+
+	_size = size;
+	return ysResult::Success;
+}
+
+void MappedFile::Close()
+{
+	Unmap(_data, _size);
+	_data = nullptr;
+	_size = 0;
+}
+
+void MappedFile::Unmap(void* data, std::size_t)
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+}
+
+#else // defined(_WIN32)
+
+ysResult MappedFile::Open(char const* path)
+{
+	Close();
+
+	int const fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return ysResult::System;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return ysResult::InvalidParameter;
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	void* const view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return ysResult::System;
+
+	_data = static_cast<unsigned char*>(view);
+	_size = static_cast<std::size_t>(info.st_size);
+	return ysResult::Success;
+}
+
+ysResult MappedFile::Create(char const* path, std::size_t size)
+{
+	Close();
+
+	if (size == 0)
+		return ysResult::InvalidParameter;
+
+	int const fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return ysResult::System;
+
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		close(fd);
+		return ysResult::System;
+	}
+
+	void* const view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return ysResult::System;
+
+	_data = static_cast<unsigned char*>(view);
+	_size = size;
+	return ysResult::Success;
+}
+
+void MappedFile::Close()
+{
+	Unmap(_data, _size);
+	_data = nullptr;
+	_size = 0;
+}
+
+void MappedFile::Unmap(void* data, std::size_t size)
+{
+	if (data != nullptr)
+		munmap(data, size);
+}
+
+#endif // defined(_WIN32)
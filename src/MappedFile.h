@@ -0,0 +1,59 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <cstddef>
+
+namespace _ys_ {
+
+/// A file mapped into memory.
+class MappedFile
+{
+	unsigned char* _data = nullptr;
+	std::size_t _size = 0;
+
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	/// <summary> Maps an existing file for reading. </summary>
+	ysResult Open(char const* path);
+
+	/// <summary> Creates or truncates a file of the given size, and maps it for reading and writing. </summary>
+	/// <remarks> Writes reach the file even if the process crashes. </remarks>
+	ysResult Create(char const* path, std::size_t size);
+
+	void Close();
+
+	/// <summary> Gives up ownership of the mapping, which must later be passed to Unmap. </summary>
+	void Release() { _data = nullptr; _size = 0; }
+
+	static void Unmap(void* data, std::size_t size);
+
+	unsigned char* GetData() const { return _data; }
+	std::size_t GetSize() const { return _size; }
+};
+
+} // namespace _ys_
@@ -20,26 +20,15 @@
 #include <yardstick/yardstick.h>
 
 #include "Protocol.h"
-#include "PointerHash.h"
+#include "StringTable.h"
 
 #include <cstring>
+#include <new>
 
 using namespace _ys_;
 
 namespace {
 
-template <typename T>
-bool read(T& out_value, void const* buffer, std::size_t available, std::size_t& inout_read)
-{
-	if (sizeof(out_value) > available - inout_read)
-		return false;
-
-	std::memcpy(&out_value, static_cast<char const*>(buffer) + inout_read, sizeof(out_value));
-	inout_read += sizeof(out_value);
-
-	return true;
-}
-
 template <typename T>
 bool write(T const& value, void* buffer, std::size_t available, std::size_t& inout_written)
 {
@@ -52,11 +41,6 @@ bool write(T const& value, void* buffer, std::size_t available, std::size_t& ino
 	return true;
 }
 
-#if defined(TRY_READ)
-#	undef TRY_READ
-#endif
-#define TRY_READ(value) do{ if (!read((value), buffer, available, out_length)) return ysResult::NoMemory; }while(false)
-
 #if defined(TRY_WRITE)
 #	undef TRY_WRITE
 #endif
@@ -86,29 +70,91 @@ ysResult _ys_::EncodeEvent(void* out_buffer, std::size_t available, EventData co
 		TRY_WRITE(ev.tick.when);
 		break;
 	case EventType::Region:
-		TRY_WRITE(ev.counter_set.line);
-		TRY_WRITE(hash_pointer(ev.counter_set.name));
-		TRY_WRITE(hash_pointer(ev.counter_set.file));
-		TRY_WRITE(ev.counter_set.begin);
-		TRY_WRITE(ev.counter_set.end);
+		TRY_WRITE(ev.region.site->line);
+		TRY_WRITE(ev.region.name);
+		TRY_WRITE(ev.region.site->fileId);
+		TRY_WRITE(ev.region.begin);
+		TRY_WRITE(ev.region.end);
 		break;
 	case EventType::CounterSet:
-		TRY_WRITE(ev.record.line);
-		TRY_WRITE(hash_pointer(ev.record.name));
-		TRY_WRITE(hash_pointer(ev.record.file));
-		TRY_WRITE(ev.record.when);
-		TRY_WRITE(ev.record.value);
+		TRY_WRITE(ev.counter_set.site->line);
+		TRY_WRITE(ev.counter_set.name);
+		TRY_WRITE(ev.counter_set.site->fileId);
+		TRY_WRITE(ev.counter_set.when);
+		TRY_WRITE(ev.counter_set.value);
 		break;
 	case EventType::String:
 		TRY_WRITE(ev.string.id);
 		TRY_WRITE(ev.string.size);
+		if (ev.string.size > available - out_length)
+			return ysResult::NoMemory;
 		std::memcpy(static_cast<char*>(out_buffer) + out_length, ev.string.str, ev.string.size);
 		out_length += ev.string.size;
 		break;
 	case EventType::CounterAdd:
-		TRY_WRITE(hash_pointer(ev.counter_add.name));
+		TRY_WRITE(ev.counter_add.name);
 		TRY_WRITE(ev.counter_add.amount);
 		break;
+	case EventType::Thread:
+		TRY_WRITE(ev.thread);
+		break;
+	case EventType::RegionSummary:
+		TRY_WRITE(ev.region_summary.site->line);
+		TRY_WRITE(ev.region_summary.name);
+		TRY_WRITE(ev.region_summary.site->fileId);
+		TRY_WRITE(ev.region_summary.when);
+		TRY_WRITE(ev.region_summary.count);
+		TRY_WRITE(ev.region_summary.total);
+		TRY_WRITE(ev.region_summary.min);
+		TRY_WRITE(ev.region_summary.max);
+		TRY_WRITE(ev.region_summary.sumSquares);
+		break;
+	case EventType::Histogram:
+		TRY_WRITE(ev.histogram.site->line);
+		TRY_WRITE(ev.histogram.site->nameId);
+		TRY_WRITE(ev.histogram.site->fileId);
+		TRY_WRITE(ev.histogram.when);
+		TRY_WRITE(ev.histogram.buckets);
+		if (ev.histogram.data->size > available - out_length)
+			return ysResult::NoMemory;
+		std::memcpy(static_cast<char*>(out_buffer) + out_length, ev.histogram.data->GetData(), ev.histogram.data->size);
+		out_length += ev.histogram.data->size;
+		break;
+	case EventType::Quantiles:
+		TRY_WRITE(ev.quantiles.site->line);
+		TRY_WRITE(ev.quantiles.name);
+		TRY_WRITE(ev.quantiles.site->fileId);
+		TRY_WRITE(ev.quantiles.when);
+		TRY_WRITE(static_cast<std::uint8_t>(ev.quantiles.source));
+		if (ev.quantiles.data->size > available - out_length)
+			return ysResult::NoMemory;
+		std::memcpy(static_cast<char*>(out_buffer) + out_length, ev.quantiles.data->GetData(), ev.quantiles.data->size);
+		out_length += ev.quantiles.data->size;
+		break;
+	case EventType::CallTree:
+		TRY_WRITE(ev.call_tree.when);
+		TRY_WRITE(ev.call_tree.nodes);
+		if (ev.call_tree.data->size > available - out_length)
+			return ysResult::NoMemory;
+		std::memcpy(static_cast<char*>(out_buffer) + out_length, ev.call_tree.data->GetData(), ev.call_tree.data->size);
+		out_length += ev.call_tree.data->size;
+		break;
+	case EventType::Samples:
+		TRY_WRITE(ev.samples.when);
+		TRY_WRITE(ev.samples.samples);
+		TRY_WRITE(ev.samples.nodes);
+		if (ev.samples.data->size > available - out_length)
+			return ysResult::NoMemory;
+		std::memcpy(static_cast<char*>(out_buffer) + out_length, ev.samples.data->GetData(), ev.samples.data->size);
+		out_length += ev.samples.data->size;
+		break;
+	case EventType::Stall:
+		TRY_WRITE(ev.stall.site->line);
+		TRY_WRITE(ev.stall.name);
+		TRY_WRITE(ev.stall.site->fileId);
+		TRY_WRITE(ev.stall.since);
+		TRY_WRITE(ev.stall.when);
+		break;
 	}
 
 	return ysResult::Success;
@@ -132,62 +178,145 @@ std::size_t _ys_::EncodeSize(EventData const& ev)
 		return 1/*type*/ + 4/*id*/ + 2/*size*/ + ev.string.size/*data*/;
 	case EventType::CounterAdd:
 		return 1/*type*/ + 4/*name*/ + 8/*amount*/;
+	case EventType::Thread:
+		return 1/*type*/ + 2/*thread*/;
+	case EventType::RegionSummary:
+		return 1/*type*/ + 4/*line*/ + 4/*name*/ + 4/*file*/ + 8/*time*/ + 4/*count*/ + 8/*total*/ + 8/*min*/ + 8/*max*/ + 8/*sum of squares*/;
+	case EventType::Histogram:
+		return 1/*type*/ + 4/*line*/ + 4/*name*/ + 4/*file*/ + 8/*time*/ + 2/*buckets*/ + ev.histogram.data->size/*index and count pairs*/;
+	case EventType::Quantiles:
+		return 1/*type*/ + 4/*line*/ + 4/*name*/ + 4/*file*/ + 8/*time*/ + 1/*source*/ + ev.quantiles.data->size/*windows*/;
+	case EventType::CallTree:
+		return 1/*type*/ + 8/*time*/ + 2/*nodes*/ + ev.call_tree.data->size/*nodes*/;
+	case EventType::Samples:
+		return 1/*type*/ + 8/*time*/ + 4/*samples*/ + 2/*nodes*/ + ev.samples.data->size/*nodes*/;
+	case EventType::Stall:
+		return 1/*type*/ + 4/*line*/ + 4/*name*/ + 4/*file*/ + 8/*since*/ + 8/*time*/;
 	default:
 		return std::size_t(-1);
 	}
 }
 
-//YS_API ysResult YS_CALL read_event(ysEvent& out_ev, void const* buffer, std::size_t available, ysStringMapper mapper, std::size_t& out_length)
-//{
-//	out_length = 0;
-//
-//	if (buffer == nullptr)
-//		return ysResult::InvalidParameter;
-//
-//	std::uint8_t type;
-//	TRY_READ(type);
-//	out_ev.type = static_cast<decltype(out_ev.type)>(type);
-//
-//	ysStringHandle str1, str2;
-//
-//	switch (out_ev.type)
-//	{
-//	case ysEvent::TypeNone:
-//		break;
-//	case ysEvent::TypeHeader:
-//		TRY_READ(out_ev.header.frequency);
-//		break;
-//	case ysEvent::TypeTick:
-//		TRY_READ(out_ev.tick.when);
-//		break;
-//	case ysEvent::TypeRegion:
-//		TRY_READ(out_ev.region.line);
-//		TRY_READ(str1);
-//		out_ev.region.name = mapper(str1, 0, nullptr);
-//		TRY_READ(str2);
-//		out_ev.region.file = mapper(str2, 0, nullptr);
-//		TRY_READ(out_ev.region.begin);
-//		TRY_READ(out_ev.region.end);
-//		break;
-//	case ysEvent::TypeCounter:
-//		TRY_READ(out_ev.counter.line);
-//		TRY_READ(str1);
-//		out_ev.counter.name = mapper(str1, 0, nullptr);
-//		TRY_READ(str2);
-//		out_ev.counter.file = mapper(str1, 0, nullptr);
-//		TRY_READ(out_ev.counter.when);
-//		TRY_READ(out_ev.counter.value);
-//		break;
-//	case ysEvent::TypeString:
-//		TRY_READ(out_ev.string.id);
-//		TRY_READ(out_ev.string.size);
-//		if (available - out_length < out_ev.string.size)
-//			return ysResult::NoMemory;
-//		mapper(out_ev.string.id, out_ev.string.size, static_cast<char const*>(buffer) + out_length);
-//		out_length += out_ev.string.size;
-//		// #FIXME - where to store the string?
-//		break;
-//	}
-//
-//	return ysResult::Success;
-//}
+void _ys_::ConvertEvent(EventData const& ev, ysEvent& out)
+{
+	out.type = ev.type;
+	out.thread = ev.thread;
+	switch (ev.type)
+	{
+	case EventType::None:
+	case EventType::Thread:
+		break;
+	case EventType::Header:
+		out.header.frequency = ev.header.frequency;
+		out.header.start = ev.header.start;
+		break;
+	case EventType::Tick:
+		out.tick.when = ev.tick.when;
+		break;
+	case EventType::Region:
+		out.region.name = ev.region.name;
+		out.region.file = ev.region.site->fileId;
+		out.region.line = ev.region.site->line;
+		out.region.begin = ev.region.begin;
+		out.region.end = ev.region.end;
+		break;
+	case EventType::CounterSet:
+		out.counter_set.name = ev.counter_set.name;
+		out.counter_set.file = ev.counter_set.site->fileId;
+		out.counter_set.line = ev.counter_set.site->line;
+		out.counter_set.when = ev.counter_set.when;
+		out.counter_set.value = ev.counter_set.value;
+		break;
+	case EventType::String:
+		out.string.id = ev.string.id;
+		out.string.size = ev.string.size;
+		out.string.str = ev.string.str;
+		break;
+	case EventType::CounterAdd:
+		out.counter_add.name = ev.counter_add.name;
+		out.counter_add.amount = ev.counter_add.amount;
+		break;
+	case EventType::RegionSummary:
+		out.region_summary.name = ev.region_summary.name;
+		out.region_summary.file = ev.region_summary.site->fileId;
+		out.region_summary.line = ev.region_summary.site->line;
+		out.region_summary.count = ev.region_summary.count;
+		out.region_summary.when = ev.region_summary.when;
+		out.region_summary.total = ev.region_summary.total;
+		out.region_summary.min = ev.region_summary.min;
+		out.region_summary.max = ev.region_summary.max;
+		out.region_summary.sumSquares = ev.region_summary.sumSquares;
+		break;
+	case EventType::Histogram:
+		out.histogram.name = ev.histogram.site->nameId;
+		out.histogram.file = ev.histogram.site->fileId;
+		out.histogram.line = ev.histogram.site->line;
+		out.histogram.buckets = ev.histogram.buckets;
+		out.histogram.when = ev.histogram.when;
+		out.histogram.data = ev.histogram.data->GetData();
+		break;
+	case EventType::Quantiles:
+		out.quantiles.name = ev.quantiles.name;
+		out.quantiles.file = ev.quantiles.site->fileId;
+		out.quantiles.line = ev.quantiles.site->line;
+		out.quantiles.source = ev.quantiles.source;
+		out.quantiles.when = ev.quantiles.when;
+		out.quantiles.data = ev.quantiles.data->GetData();
+		break;
+	case EventType::CallTree:
+		out.call_tree.when = ev.call_tree.when;
+		out.call_tree.nodes = ev.call_tree.nodes;
+		out.call_tree.data = ev.call_tree.data->GetData();
+		break;
+	case EventType::Samples:
+		out.samples.when = ev.samples.when;
+		out.samples.samples = ev.samples.samples;
+		out.samples.nodes = ev.samples.nodes;
+		out.samples.data = ev.samples.data->GetData();
+		break;
+	case EventType::Stall:
+		out.stall.name = ev.stall.name;
+		out.stall.file = ev.stall.site->fileId;
+		out.stall.line = ev.stall.site->line;
+		out.stall.since = ev.stall.since;
+		out.stall.when = ev.stall.when;
+		break;
+	}
+}
+
+EventPayload* _ys_::CreatePayload(ysAllocator allocator, std::uint32_t size)
+{
+	void* const memory = allocator(nullptr, sizeof(EventPayload) + size);
+	if (memory == nullptr)
+		return nullptr;
+
+	EventPayload* const payload = new (memory) EventPayload;
+	payload->refs.store(1, std::memory_order_relaxed);
+	payload->size = size;
+	payload->allocator = allocator;
+	return payload;
+}
+
+void _ys_::ReleasePayload(EventPayload* payload)
+{
+	if (payload->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	ysAllocator const allocator = payload->allocator;
+	payload->~EventPayload();
+	allocator(payload, 0);
+}
+
+bool _ys_::MakeStringEvent(StringTable const& strings, ysStringHandle id, EventData& out_ev)
+{
+	std::uint32_t length;
+	char const* const str = strings.Find(id, length);
+	if (str == nullptr)
+		return false;
+
+	out_ev.type = EventType::String;
+	out_ev.string.id = id;
+	out_ev.string.size = static_cast<std::uint16_t>(length < UINT16_MAX ? length : UINT16_MAX);
+	out_ev.string.str = str;
+	return true;
+}
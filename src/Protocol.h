@@ -19,19 +19,41 @@
 
 #pragma once
 
+#include <yardstick/yardstick.h>
+
+#include <atomic>
+
 namespace _ys_ {
 
-enum class EventType : std::uint8_t { None = 0, Header = 1, Tick = 2, Region = 3, CounterSet = 4, String = 5, CounterAdd = 6 };
+class StringTable;
+
+using EventType = ysEventType;
+
+/// <summary> Variable length data carried by an event, shared by every sink it is written to. </summary>
+/// <remarks> Whoever holds an event with a payload holds a reference to it, and releases it once done with the event. </remarks>
+struct EventPayload
+{
+	std::atomic<std::uint32_t> refs;
+	std::uint32_t size;
+	ysAllocator allocator;
+
+	unsigned char* GetData() { return reinterpret_cast<unsigned char*>(this + 1); }
+	unsigned char const* GetData() const { return reinterpret_cast<unsigned char const*>(this + 1); }
+};
 
 struct EventData
 {
 	EventType type;
+	// set by the background thread
+	std::uint16_t thread;
 	union
 	{
 		struct
 		{
 			ysTime frequency;
 			ysTime start;
+			// wall clock time at start; only kept in trace files
+			std::int64_t realtime;
 		} header;
 		struct
 		{
@@ -39,20 +61,18 @@ struct EventData
 		} tick;
 		struct
 		{
-			std::uint32_t line;
-			char const* name;
-			char const* file;
+			Site* site;
+			ysStringHandle name;
 			ysTime begin;
 			ysTime end;
-		} counter_set;
+		} region;
 		struct
 		{
-			std::uint32_t line;
-			char const* name;
-			char const* file;
+			Site* site;
+			ysStringHandle name;
 			ysTime when;
 			double value;
-		} record;
+		} counter_set;
 		struct
 		{
 			ysStringHandle id;
@@ -61,9 +81,60 @@ struct EventData
 		} string;
 		struct
 		{
-			char const* name;
+			Site* site;
+			ysStringHandle name;
 			double amount;
 		} counter_add;
+		struct
+		{
+			Site* site;
+			ysStringHandle name;
+			std::uint32_t count;
+			ysTime when;
+			ysTime total;
+			ysTime min;
+			ysTime max;
+			double sumSquares;
+		} region_summary;
+		struct
+		{
+			Site* site;
+			ysTime when;
+			std::uint16_t buckets;
+			// pairs of 16-bit bucket index and 32-bit count, as encoded
+			EventPayload* data;
+		} histogram;
+		struct
+		{
+			Site* site;
+			ysStringHandle name;
+			EventType source;
+			ysTime when;
+			// one ysQuantiles per ysWindow, as encoded
+			EventPayload* data;
+		} quantiles;
+		struct
+		{
+			ysTime when;
+			std::uint16_t nodes;
+			// one packed ysCallTreeNode per node, as encoded
+			EventPayload* data;
+		} call_tree;
+		struct
+		{
+			ysTime when;
+			std::uint32_t samples;
+			std::uint16_t nodes;
+			// one packed ysSampleNode per node, as encoded
+			EventPayload* data;
+		} samples;
+		struct
+		{
+			Site* site;
+			ysStringHandle name;
+			ysTime since;
+			ysTime when;
+		} stall;
 	};
 };
 
@@ -78,4 +149,36 @@ ysResult EncodeEvent(void* out_buffer, std::size_t available, EventData const& e
 /// <summary> Returns the amount of space needed to encode an event. </summary>
 std::size_t EncodeSize(EventData const& ev);
 
+/// <summary> Converts an event to the form delivered to applications. </summary>
+void ConvertEvent(EventData const& ev, ysEvent& out);
+
+/// <summary> Returns true if an event is attributed to the thread that emitted it. </summary>
+inline bool IsThreadEvent(EventType type) { return type == EventType::Tick || type == EventType::Region || type == EventType::CounterSet || type == EventType::CounterAdd || type == EventType::Stall; }
+
+/// <summary> Allocates a payload with a single reference. </summary>
+/// <returns> The payload, or nullptr if out of memory. </returns>
+EventPayload* CreatePayload(ysAllocator allocator, std::uint32_t size);
+
+/// <summary> Returns the payload carried by an event, if any. </summary>
+inline EventPayload* GetPayload(EventData const& ev)
+{
+	switch (ev.type)
+	{
+	case EventType::Histogram: return ev.histogram.data;
+	case EventType::Quantiles: return ev.quantiles.data;
+	case EventType::CallTree: return ev.call_tree.data;
+	case EventType::Samples: return ev.samples.data;
+	default: return nullptr;
+	}
+}
+
+inline void AcquirePayload(EventPayload* payload) { payload->refs.fetch_add(1, std::memory_order_relaxed); }
+
+/// <summary> Drops a reference to a payload, freeing it with the last. </summary>
+void ReleasePayload(EventPayload* payload);
+
+/// <summary> Builds the String event defining a registered string. </summary>
+/// <returns> False if the handle is not registered. </returns>
+bool MakeStringEvent(StringTable const& strings, ysStringHandle id, EventData& out_ev);
+
 } // namespace _ys_
\ No newline at end of file
@@ -0,0 +1,362 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "QuantileSketch.h"
+#include "PointerHash.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace _ys_;
+
+namespace {
+
+// ratio between the bounds of a bin
+constexpr double kGamma = (1 + kSketchAccuracy) / (1 - kSketchAccuracy);
+
+std::int64_t GetWindowSeconds(ysWindow window)
+{
+	switch (window)
+	{
+	case ysWindow::Second: return 1;
+	case ysWindow::TenSeconds: return 10;
+	case ysWindow::Minute: return 60;
+	}
+	return 0;
+}
+
+} // anonymous namespace
+
+ysResult QuantileSketchTable::Initialize(ysAllocator allocator, ysTime frequency, ysTime now)
+{
+	Reset();
+
+	_allocator = allocator;
+	_frequency = frequency != 0 ? frequency : 1;
+	_multiplier = 1 / std::log(kGamma);
+	_minIndex = static_cast<std::int32_t>(std::ceil(std::log(kSketchMinValue) * _multiplier));
+
+	_series = static_cast<SketchSeries**>(_allocator(nullptr, sizeof(SketchSeries*) * kCapacity));
+	if (_series == nullptr)
+		return ysResult::NoMemory;
+	std::memset(_series, 0, sizeof(SketchSeries*) * kCapacity);
+
+	_merged = static_cast<std::uint64_t*>(_allocator(nullptr, sizeof(std::uint64_t) * kSketchBins * 2));
+	if (_merged == nullptr)
+		return ysResult::NoMemory;
+	std::memset(_merged, 0, sizeof(std::uint64_t) * kSketchBins * 2);
+	ClearMerged();
+
+	_current = _published = -1;
+	Advance(now);
+	_published = _current;
+
+	return ysResult::Success;
+}
+
+void QuantileSketchTable::Reset()
+{
+	for (std::uint32_t index = 0; index != _usedCount; ++index)
+	{
+		SketchSeries* const series = _series[_used[index]];
+		for (QuantileSketch& sketch : series->seconds)
+		{
+			if (sketch.positive.bins != nullptr)
+				_allocator(sketch.positive.bins, 0);
+			if (sketch.negative.bins != nullptr)
+				_allocator(sketch.negative.bins, 0);
+		}
+		_allocator(series, 0);
+	}
+	_usedCount = 0;
+
+	if (_series != nullptr)
+		_allocator(_series, 0);
+	_series = nullptr;
+
+	if (_merged != nullptr)
+		_allocator(_merged, 0);
+	_merged = nullptr;
+}
+
+void QuantileSketchTable::Record(Site* site, ysStringHandle name, ysEventType source, ysTime when, double value)
+{
+	SketchSeries* const series = FindSeries(site, name, source);
+	if (series == nullptr)
+		return;
+
+	std::int64_t const second = GetSecond(when);
+	QuantileSketch* const sketch = FindSketch(*series, second);
+	if (sketch == nullptr)
+		return;
+
+	if (second > series->latest)
+		series->latest = second;
+
+	// NaN is counted with the zeroes rather than lost
+	double const magnitude = value < 0 ? -value : value;
+	if (!(magnitude >= kSketchMinValue))
+		++sketch->zero;
+	else
+		AddToStore(value < 0 ? sketch->negative : sketch->positive, GetBin(magnitude));
+}
+
+bool QuantileSketchTable::Advance(ysTime now)
+{
+	// windows end a quarter second behind the clock, giving events still queued on their
+	// threads time to be counted before a second is published
+	ysTime const lag = _frequency / 4;
+	std::int64_t const second = GetSecond(now > lag ? now - lag : 0);
+	if (second > _current)
+		_current = second;
+
+	if (_current == _published)
+		return false;
+
+	_published = _current;
+	return true;
+}
+
+void QuantileSketchTable::Estimate(SketchSeries const& series, ysWindow window, ysQuantiles& out)
+{
+	MergeSeries(series, _current - GetWindowSeconds(window));
+	EstimateMerged(out);
+	ClearMerged();
+}
+
+void QuantileSketchTable::Estimate(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles& out)
+{
+	std::int64_t const begin = _current - GetWindowSeconds(window);
+	for (std::uint32_t index = 0; index != _usedCount; ++index)
+	{
+		SketchSeries const& series = *_series[_used[index]];
+		if (series.name == name && series.source == source)
+			MergeSeries(series, begin);
+	}
+	EstimateMerged(out);
+	ClearMerged();
+}
+
+std::int64_t QuantileSketchTable::GetSecond(ysTime when) const
+{
+	return static_cast<std::int64_t>(when / _frequency);
+}
+
+SketchSeries* QuantileSketchTable::FindSeries(Site* site, ysStringHandle name, ysEventType source)
+{
+	if (_series == nullptr)
+		return nullptr;
+
+	for (std::uint32_t index = hash_combine(hash_pointer(site), name) & kMask;; index = (index + 1) & kMask)
+	{
+		SketchSeries* series = _series[index];
+		if (series != nullptr)
+		{
+			if (series->site == site && series->name == name)
+				return series;
+			continue;
+		}
+
+		if (_usedCount == kLimit)
+			return nullptr;
+
+		series = static_cast<SketchSeries*>(_allocator(nullptr, sizeof(SketchSeries)));
+		if (series == nullptr)
+			return nullptr;
+
+		std::memset(series, 0, sizeof(SketchSeries));
+		series->site = site;
+		series->name = name;
+		series->source = source;
+		series->latest = -1;
+		for (QuantileSketch& sketch : series->seconds)
+			sketch.second = -1;
+
+		_series[index] = series;
+		_used[_usedCount++] = index;
+		return series;
+	}
+}
+
+QuantileSketch* QuantileSketchTable::FindSketch(SketchSeries& series, std::int64_t second)
+{
+	// the longest window, the second in progress and the one after it each have a sketch of
+	// their own; anything further out is dropped
+	if (second > _current + 1 || second < _current + 2 - static_cast<std::int64_t>(kSketchSeconds))
+		return nullptr;
+
+	QuantileSketch& sketch = series.seconds[static_cast<std::uint64_t>(second) % kSketchSeconds];
+	if (sketch.second == second)
+		return &sketch;
+	if (sketch.second > second)
+		return nullptr;
+
+	// reuse the sketch of a second that has left every window
+	if (sketch.positive.bins != nullptr)
+		std::memset(sketch.positive.bins, 0, sketch.positive.size * sizeof(std::uint32_t));
+	if (sketch.negative.bins != nullptr)
+		std::memset(sketch.negative.bins, 0, sketch.negative.size * sizeof(std::uint32_t));
+	sketch.positive.count = 0;
+	sketch.negative.count = 0;
+	sketch.zero = 0;
+	sketch.second = second;
+	return &sketch;
+}
+
+std::uint32_t QuantileSketchTable::GetBin(double magnitude) const
+{
+	double const index = std::ceil(std::log(magnitude) * _multiplier) - _minIndex;
+	if (index <= 0)
+		return 0;
+	if (index >= kSketchBins - 1)
+		return kSketchBins - 1;
+	return static_cast<std::uint32_t>(index);
+}
+
+double QuantileSketchTable::GetBinValue(std::uint32_t bin) const
+{
+	// a bin holds magnitudes above gamma^(index-1) up to gamma^index; this estimate is within
+	// kSketchAccuracy of both
+	return std::exp((static_cast<std::int32_t>(bin) + _minIndex) / _multiplier) * (2 / (1 + kGamma));
+}
+
+bool QuantileSketchTable::AddToStore(SketchStore& store, std::uint32_t bin)
+{
+	if (store.bins == nullptr || bin < store.first || bin >= std::uint32_t(store.first) + store.size)
+	{
+		// grow in aligned runs of 64 bins, keeping the bins already counted
+		std::uint32_t low = bin & ~63u;
+		std::uint32_t high = (bin | 63u) + 1;
+		if (store.bins != nullptr)
+		{
+			if (store.first < low)
+				low = store.first;
+			if (std::uint32_t(store.first) + store.size > high)
+				high = std::uint32_t(store.first) + store.size;
+		}
+
+		std::uint32_t* const bins = static_cast<std::uint32_t*>(_allocator(nullptr, (high - low) * sizeof(std::uint32_t)));
+		if (bins == nullptr)
+			return false;
+
+		std::memset(bins, 0, (high - low) * sizeof(std::uint32_t));
+		if (store.bins != nullptr)
+		{
+			std::memcpy(bins + (store.first - low), store.bins, store.size * sizeof(std::uint32_t));
+			_allocator(store.bins, 0);
+		}
+
+		store.bins = bins;
+		store.first = static_cast<std::uint16_t>(low);
+		store.size = static_cast<std::uint16_t>(high - low);
+	}
+
+	++store.bins[bin - store.first];
+	++store.count;
+	return true;
+}
+
+void QuantileSketchTable::MergeSeries(SketchSeries const& series, std::int64_t begin)
+{
+	for (QuantileSketch const& sketch : series.seconds)
+	{
+		if (sketch.second < begin || sketch.second >= _current)
+			continue;
+
+		SketchStore const* const stores[2] = {&sketch.positive, &sketch.negative};
+		for (std::uint32_t sign = 0; sign != 2; ++sign)
+		{
+			SketchStore const& store = *stores[sign];
+			if (store.count == 0)
+				continue;
+
+			std::uint64_t* const merged = _merged + sign * kSketchBins + store.first;
+			for (std::uint32_t index = 0; index != store.size; ++index)
+				merged[index] += store.bins[index];
+
+			if (store.first < _mergedLow[sign])
+				_mergedLow[sign] = store.first;
+			if (std::uint32_t(store.first) + store.size > _mergedHigh[sign])
+				_mergedHigh[sign] = std::uint32_t(store.first) + store.size;
+			_mergedCount += store.count;
+		}
+
+		_mergedZero += sketch.zero;
+		_mergedCount += sketch.zero;
+	}
+}
+
+void QuantileSketchTable::EstimateMerged(ysQuantiles& out) const
+{
+	double const quantiles[] = {0.5, 0.9, 0.99, 0.999};
+	double* const values[] = {&out.p50, &out.p90, &out.p99, &out.p999};
+
+	out.count = _mergedCount;
+	for (std::size_t which = 0; which != 4; ++which)
+	{
+		*values[which] = 0;
+		if (_mergedCount == 0)
+			continue;
+
+		// values are visited in increasing order: negative ones by decreasing magnitude, then
+		// zeroes, then positive ones. the quantile is the first value ranked above its rank.
+		double const rank = quantiles[which] * static_cast<double>(_mergedCount - 1);
+		std::uint64_t seen = 0;
+
+		std::uint64_t const* const negative = _merged + kSketchBins;
+		for (std::uint32_t bin = _mergedHigh[1]; bin > _mergedLow[1]; --bin)
+		{
+			seen += negative[bin - 1];
+			if (seen > rank)
+			{
+				*values[which] = -GetBinValue(bin - 1);
+				break;
+			}
+		}
+		if (seen > rank)
+			continue;
+
+		seen += _mergedZero;
+		if (seen > rank)
+			continue;
+
+		for (std::uint32_t bin = _mergedLow[0]; bin < _mergedHigh[0]; ++bin)
+		{
+			seen += _merged[bin];
+			if (seen > rank)
+			{
+				*values[which] = GetBinValue(bin);
+				break;
+			}
+		}
+	}
+}
+
+void QuantileSketchTable::ClearMerged()
+{
+	for (std::uint32_t sign = 0; sign != 2; ++sign)
+	{
+		if (_mergedLow[sign] < _mergedHigh[sign])
+			std::memset(_merged + sign * kSketchBins + _mergedLow[sign], 0, (_mergedHigh[sign] - _mergedLow[sign]) * sizeof(std::uint64_t));
+		_mergedLow[sign] = kSketchBins;
+		_mergedHigh[sign] = 0;
+	}
+	_mergedZero = 0;
+	_mergedCount = 0;
+}
@@ -0,0 +1,152 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+namespace _ys_ {
+
+/// Values are estimated to within this fraction of themselves.
+static constexpr double kSketchAccuracy = 0.01;
+
+/// Smallest magnitude binned; anything closer to zero is counted as zero.
+static constexpr double kSketchMinValue = 1e-9;
+
+/// Number of bins on either side of zero. With the accuracy above, they span magnitudes from
+/// kSketchMinValue to beyond 1e25; larger values are counted in the last bin.
+static constexpr std::uint32_t kSketchBins = 4096;
+
+/// Seconds kept per series: the longest window, the second in progress, and slack for events
+/// that arrive out of order.
+static constexpr std::uint32_t kSketchSeconds = 64;
+
+/// <summary> Counts of values in a contiguous range of logarithmic bins. </summary>
+/// <remarks> The range only ever grows, so a store reused for a later second keeps its memory. </remarks>
+struct SketchStore
+{
+	std::uint32_t* bins;
+	std::uint16_t first;
+	std::uint16_t size;
+	std::uint32_t count;
+};
+
+/// <summary> The values recorded by one series in one second. </summary>
+struct QuantileSketch
+{
+	SketchStore positive;
+	SketchStore negative;
+	std::uint32_t zero;
+	/// The second the values were recorded in, or -1 for a sketch never used.
+	std::int64_t second;
+};
+
+/// <summary> Values recorded at one site, one sketch per second. </summary>
+struct SketchSeries
+{
+	Site* site;
+	ysStringHandle name;
+	/// Region for durations, or CounterSet for counter values.
+	ysEventType source;
+	/// The latest second any value was recorded in.
+	std::int64_t latest;
+	QuantileSketch seconds[kSketchSeconds];
+};
+
+/// <summary> Relative-error quantile sketches of every region and counter, over sliding windows. </summary>
+/// <remarks>
+/// Each value is counted in a bin covering values within kSketchAccuracy of each other, so any
+/// quantile is estimated within that fraction of its true value, however skewed the values are.
+/// Bins add up, which makes sketches mergeable: a window is estimated by merging the sketches of
+/// the seconds it covers, and a name by merging the series of every site with that name and source.
+/// Only used by the Yardstick background thread and queries, under GlobalState's lock.
+/// </remarks>
+class QuantileSketchTable
+{
+	static constexpr std::uint32_t kCapacity = 1024;
+	static constexpr std::uint32_t kMask = kCapacity - 1;
+	// series are only created while the table is at most 3/4 full, which keeps probes short
+	static constexpr std::uint32_t kLimit = kCapacity / 4 * 3;
+
+	ysAllocator _allocator = nullptr;
+	ysTime _frequency = 1;
+	// converts a natural logarithm to a bin index
+	double _multiplier = 0;
+	// the bin index, before offsetting, of kSketchMinValue
+	std::int32_t _minIndex = 0;
+
+	SketchSeries** _series = nullptr;
+	std::uint32_t _used[kLimit];
+	std::uint32_t _usedCount = 0;
+
+	// the second in progress; windows end where it begins
+	std::int64_t _current = 0;
+	std::int64_t _published = 0;
+
+	// merged bins of either sign, and the range of each touched by the merge in progress
+	std::uint64_t* _merged = nullptr;
+	std::uint32_t _mergedLow[2];
+	std::uint32_t _mergedHigh[2];
+	std::uint64_t _mergedZero = 0;
+	std::uint64_t _mergedCount = 0;
+
+	std::int64_t GetSecond(ysTime when) const;
+	SketchSeries* FindSeries(Site* site, ysStringHandle name, ysEventType source);
+	QuantileSketch* FindSketch(SketchSeries& series, std::int64_t second);
+	std::uint32_t GetBin(double magnitude) const;
+	double GetBinValue(std::uint32_t bin) const;
+	bool AddToStore(SketchStore& store, std::uint32_t bin);
+	void MergeSeries(SketchSeries const& series, std::int64_t begin);
+	void EstimateMerged(ysQuantiles& out) const;
+	void ClearMerged();
+
+public:
+	QuantileSketchTable() = default;
+	QuantileSketchTable(QuantileSketchTable const&) = delete;
+	QuantileSketchTable& operator=(QuantileSketchTable const&) = delete;
+
+	ysResult Initialize(ysAllocator allocator, ysTime frequency, ysTime now);
+	void Reset();
+
+	/// <summary> Adds a value to the sketch of the second it was recorded in. </summary>
+	/// <remarks> Values older than the longest window, or for a series the table has no room for, are dropped. </remarks>
+	void Record(Site* site, ysStringHandle name, ysEventType source, ysTime when, double value);
+
+	/// <summary> Moves the windows forward to the clock. </summary>
+	/// <returns> True once for each time a new second has begun, when the windows have moved. </returns>
+	bool Advance(ysTime now);
+
+	/// <summary> The time the windows end at. </summary>
+	ysTime GetWindowEnd() const { return static_cast<ysTime>(_current) * _frequency; }
+
+	std::uint32_t GetCount() const { return _usedCount; }
+	SketchSeries const& GetSeries(std::uint32_t index) const { return *_series[_used[index]]; }
+
+	/// <summary> Returns true if a series has values in the longest window. </summary>
+	bool IsRecent(SketchSeries const& series) const { return series.latest >= _current - 60; }
+
+	/// <summary> Estimates the quantiles of one series over a window. </summary>
+	void Estimate(SketchSeries const& series, ysWindow window, ysQuantiles& out);
+
+	/// <summary> Estimates the quantiles of every series with a name and source over a window. </summary>
+	/// <remarks> Durations and counter values are never merged, even under one name. </remarks>
+	void Estimate(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles& out);
+};
+
+} // namespace _ys_
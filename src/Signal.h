@@ -53,7 +53,8 @@ Signal::~Signal()
 
 void Signal::Wait(std::uint32_t microseconds)
 {
-	WaitForSingleObject(_handle, static_cast<DWORD>(microseconds));
+	// rounded up, so that a short wait still yields
+	WaitForSingleObject(_handle, static_cast<DWORD>((microseconds + 999) / 1000));
 }
 
 void Signal::Post()
@@ -0,0 +1,57 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <cstddef>
+
+namespace _ys_ {
+
+struct EventData;
+
+/// Destination for the stream of events collected by Yardstick.
+/// Each sink is driven by its own SinkChannel, so all methods are called from a single thread
+/// that is not shared with any other sink.
+class Sink
+{
+public:
+	Sink() = default;
+	virtual ~Sink() = default;
+
+	Sink(Sink const&) = delete;
+	Sink& operator=(Sink const&) = delete;
+
+	/// <summary> Receives the next batch of events, in order. </summary>
+	/// <remarks> Every String event for a handle precedes the first event using that handle. A lossy sink
+	/// that fell behind and missed events is sent the strings among them again, so it may see a string twice. </remarks>
+	virtual ysResult Consume(EventData const* events, std::size_t count) = 0;
+
+	/// <summary> Called whenever the sink has caught up with all pending events. </summary>
+	virtual ysResult Flush() = 0;
+
+	/// <summary> Called periodically, whether or not any events arrived. </summary>
+	virtual ysResult Update() { return ysResult::Success; }
+
+	/// <summary> Whether the sink must see every event, even if that holds up the background thread. </summary>
+	virtual bool IsLossless() const { return false; }
+};
+
+} // namespace _ys_
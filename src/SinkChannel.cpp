@@ -0,0 +1,241 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SinkChannel.h"
+#include "Clock.h"
+#include "Sink.h"
+#include "StringTable.h"
+
+#include <functional>
+
+using namespace _ys_;
+
+SinkChannel::SinkChannel(Sink* sink, StringTable const& strings, ysAllocator allocator) : _active(false), _dropped(0), _sink(sink), _strings(strings), _spilled(false)
+{
+	_spill.Initialize(allocator);
+	_draining.Initialize(allocator);
+}
+
+SinkChannel::~SinkChannel()
+{
+	Stop();
+
+	// events set aside after the thread stopped are never delivered
+	for (EventData const& ev : _spill)
+	{
+		if (EventPayload* const payload = GetPayload(ev))
+			ReleasePayload(payload);
+	}
+}
+
+void SinkChannel::Start()
+{
+	if (_thread.joinable())
+		return;
+
+	// strings announced before the channel existed will never appear in its buffer
+	_preamble = _strings.GetAnnouncedCount();
+
+	_active.store(true, std::memory_order_seq_cst);
+	_thread = std::thread(std::bind(&SinkChannel::ThreadMain, this));
+}
+
+void SinkChannel::Stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	_active.store(false, std::memory_order_seq_cst);
+	_signal.Post();
+	_thread.join();
+}
+
+bool SinkChannel::Write(EventData const& ev)
+{
+	if (_sink->IsLossless())
+	{
+		// once anything has been set aside, everything after it must be too
+		LockGuard guard(_lock);
+		if (!_spilled.load(std::memory_order_relaxed) && _buffer.TryWrite(&ev, sizeof(ev)))
+			return true;
+		return Spill(ev);
+	}
+
+	// a lossy sink that overflowed only takes events again once it has emptied its buffer, so that
+	// it isn't kept permanently on the edge of dropping them
+	if (_overflowed)
+	{
+		if (!_buffer.IsEmpty())
+		{
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// the channel's thread may not have picked up the strings from the last time yet
+		LockGuard guard(_lock);
+		if (_resendFrom == _resendTo || _missedFrom < _resendFrom)
+			_resendFrom = _missedFrom;
+		_resendTo = _strings.GetAnnouncedCount();
+		_overflowed = false;
+	}
+
+	if (_buffer.TryWrite(&ev, sizeof(ev)))
+		return true;
+
+	// a string is announced just before its event is written, so a dropped one is the latest
+	std::uint32_t const announced = _strings.GetAnnouncedCount();
+	_missedFrom = ev.type == EventType::String && announced != 0 ? announced - 1 : announced;
+	_overflowed = true;
+
+	_dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+bool SinkChannel::Spill(EventData const& ev)
+{
+	if (!_spill.PushBack(ev))
+	{
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	_spilled.store(true, std::memory_order_release);
+	return true;
+}
+
+void SinkChannel::ThreadMain()
+{
+	EventData batch[kBatchSize];
+	std::size_t count = 0;
+
+	batch[count].type = EventType::Header;
+	batch[count].thread = 0;
+	batch[count].header.frequency = GetClockFrequency();
+	batch[count].header.start = ReadClock();
+	batch[count].header.realtime = ReadRealtime();
+	++count;
+
+	_sink->Consume(batch, count);
+	SendStrings(0, _preamble);
+
+	while (_active.load(std::memory_order_seq_cst))
+	{
+		_signal.Wait(100);
+
+		Drain();
+		_sink->Update();
+	}
+
+	// deliver anything written before the channel was stopped
+	Drain();
+}
+
+ysResult SinkChannel::SendStrings(std::uint32_t first, std::uint32_t last)
+{
+	EventData batch[kBatchSize];
+	std::size_t count = 0;
+
+	for (std::uint32_t index = first; index != last; ++index)
+	{
+		if (MakeStringEvent(_strings, _strings.GetAnnounced(index), batch[count]))
+		{
+			batch[count].thread = 0;
+			++count;
+		}
+
+		if (count == kBatchSize)
+		{
+			YS_TRY(_sink->Consume(batch, count));
+			count = 0;
+		}
+	}
+
+	return count != 0 ? _sink->Consume(batch, count) : ysResult::Success;
+}
+
+ysResult SinkChannel::Deliver(EventData const* events, std::size_t count)
+{
+	ysResult const result = _sink->Consume(events, count);
+
+	// the sink is done with the events, whether or not it managed to use them
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		if (EventPayload* const payload = GetPayload(events[index]))
+			ReleasePayload(payload);
+	}
+
+	return result;
+}
+
+ysResult SinkChannel::Drain()
+{
+	EventData batch[kBatchSize];
+	ysResult result = ysResult::Success;
+
+	for (;;)
+	{
+		// writes are always whole events, so reads are too
+		int const bytes = _buffer.Read(batch, sizeof(batch));
+		if (bytes > 0)
+		{
+			// strings missed while dropping events are due before anything written after the buffer
+			// emptied, and sending them early does no harm
+			std::uint32_t first;
+			std::uint32_t last;
+			{
+				LockGuard guard(_lock);
+				first = _resendFrom;
+				last = _resendTo;
+				_resendFrom = _resendTo = 0;
+			}
+			if (first != last)
+				SendStrings(first, last);
+
+			ysResult const delivered = Deliver(batch, bytes / sizeof(EventData));
+			if (result == ysResult::Success)
+				result = delivered;
+			continue;
+		}
+
+		// the buffer is empty, so the events set aside are next. the writer fills the buffer again
+		// as soon as they have been taken.
+		{
+			LockGuard guard(_lock);
+			if (!_buffer.IsEmpty())
+				continue;
+			_spill.Swap(_draining);
+			_spilled.store(false, std::memory_order_release);
+		}
+
+		if (_draining.Empty())
+			break;
+
+		for (std::size_t index = 0; index < _draining.Size(); index += kBatchSize)
+		{
+			std::size_t const count = _draining.Size() - index < kBatchSize ? _draining.Size() - index : kBatchSize;
+			ysResult const delivered = Deliver(_draining.Data() + index, count);
+			if (result == ysResult::Success)
+				result = delivered;
+		}
+		_draining.Clear();
+	}
+
+	YS_TRY(result);
+	return _sink->Flush();
+}
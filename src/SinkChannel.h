@@ -0,0 +1,113 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Array.h"
+#include "Atomics.h"
+#include "ConcurrentCircularBuffer.h"
+#include "Protocol.h"
+#include "Signal.h"
+#include "Spinlock.h"
+
+#include <thread>
+
+namespace _ys_ {
+
+class Sink;
+class StringTable;
+
+/// Buffers events for a single sink and feeds them to it from a dedicated thread.
+/// The buffer holds several full passes of the background thread over every thread's queue.
+/// Writing never waits for the sink, as the background thread writes with its locks held. If a
+/// lossy sink falls behind far enough to fill the buffer anyway, its events are dropped until it
+/// has caught up, and the strings it missed are sent again before anything that follows. A
+/// lossless sink's excess is set aside instead, and the background thread waits for the sink to
+/// take it once it has let go of its locks.
+class SinkChannel
+{
+	static constexpr std::uint32_t kBufferSize = 1 << 21;
+	static constexpr std::size_t kBatchSize = 256;
+
+	ConcurrentCircularBuffer<kBufferSize> _buffer;
+	Signal _signal;
+	AlignedAtomic<bool> _active;
+	std::atomic<std::uint64_t> _dropped;
+	std::thread _thread;
+
+	Sink* _sink = nullptr;
+	StringTable const& _strings;
+	std::uint32_t _preamble = 0;
+
+	// set while a lossy sink is dropping events. only touched by the writer.
+	bool _overflowed = false;
+	std::uint32_t _missedFrom = 0;
+
+	// the strings to send again before the next events, and the events of a lossless sink that
+	// didn't fit in the buffer, which follow everything in it
+	Spinlock _lock;
+	std::uint32_t _resendFrom = 0;
+	std::uint32_t _resendTo = 0;
+	Array<EventData> _spill;
+	std::atomic<bool> _spilled;
+
+	// owned by the channel's thread
+	Array<EventData> _draining;
+
+	void ThreadMain();
+	ysResult Drain();
+	ysResult Deliver(EventData const* events, std::size_t count);
+	ysResult SendStrings(std::uint32_t first, std::uint32_t last);
+	bool Spill(EventData const& ev);
+
+public:
+	SinkChannel(Sink* sink, StringTable const& strings, ysAllocator allocator);
+	~SinkChannel();
+
+	SinkChannel(SinkChannel const&) = delete;
+	SinkChannel& operator=(SinkChannel const&) = delete;
+
+	Sink* GetSink() const { return _sink; }
+
+	/// <summary> Counts the events dropped because the sink fell behind. </summary>
+	std::uint64_t GetDropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+	/// <summary> Returns true while a lossless sink has events set aside that it hasn't taken yet. </summary>
+	bool IsBacklogged() const { return _spilled.load(std::memory_order_acquire); }
+
+	/// <summary> Starts the channel's thread. </summary>
+	/// <remarks> Must be called from the Yardstick background thread, or while it is blocked from
+	/// writing events, so that the string preamble lines up with the first buffered event. </remarks>
+	void Start();
+
+	/// <summary> Delivers all buffered events and stops the channel's thread. </summary>
+	void Stop();
+
+	/// <summary> Buffers an event for the sink, without waiting for it. </summary>
+	/// <remarks> The channel takes over a reference to the event's payload, unless the event is dropped.
+	/// Writes must not overlap, which the background thread ensures by holding the sinks lock. </remarks>
+	/// <returns> False if the event was dropped, which only happens to a lossy sink that has fallen behind, or when out of memory. </returns>
+	bool Write(EventData const& ev);
+
+	void Post() { _signal.Post(); }
+};
+
+} // namespace _ys_
@@ -0,0 +1,148 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "PointerHash.h"
+
+#include <cstring>
+
+namespace _ys_ {
+
+/// <summary> Durations of the regions recorded at one site, accumulated over a frame. </summary>
+struct SiteStats
+{
+	Site* site;
+	ysStringHandle name;
+	std::uint32_t count;
+	ysTime total;
+	ysTime min;
+	ysTime max;
+	double sumSquares;
+};
+
+/// <summary> Open addressed table of SiteStats, keyed by site and name. </summary>
+/// <remarks> Entries are never removed individually; Clear empties the table in time proportional to the entries in use. </remarks>
+template <std::uint32_t S>
+class SiteStatsTable
+{
+	static constexpr std::uint32_t kCapacity = S;
+	static constexpr std::uint32_t kMask = kCapacity - 1;
+	// entries are only claimed while the table is at most 3/4 full, which keeps probes short
+	static constexpr std::uint32_t kLimit = kCapacity / 4 * 3;
+
+	static_assert((kCapacity & kMask) == 0, "SiteStatsTable size must be a power of 2");
+
+	SiteStats _entries[kCapacity];
+	std::uint32_t _used[kLimit];
+	std::uint32_t _usedCount = 0;
+
+	inline SiteStats* Find(Site* site, ysStringHandle name);
+
+public:
+	SiteStatsTable() { std::memset(_entries, 0, sizeof(_entries)); }
+	SiteStatsTable(SiteStatsTable const&) = delete;
+	SiteStatsTable& operator=(SiteStatsTable const&) = delete;
+
+	/// <summary> Adds a duration to a site's entry. </summary>
+	/// <returns> False if the site has no entry and the table is full. </returns>
+	inline bool Record(Site& site, ysStringHandle name, ysTime duration);
+
+	/// <summary> Adds the durations accumulated by another entry. </summary>
+	/// <returns> False if the site has no entry and the table is full. </returns>
+	inline bool Merge(SiteStats const& stats);
+
+	std::uint32_t GetCount() const { return _usedCount; }
+	SiteStats const& GetEntry(std::uint32_t index) const { return _entries[_used[index]]; }
+
+	inline void Clear();
+};
+
+template <std::uint32_t S>
+SiteStats* SiteStatsTable<S>::Find(Site* site, ysStringHandle name)
+{
+	for (std::uint32_t index = hash_combine(hash_pointer(site), name) & kMask;; index = (index + 1) & kMask)
+	{
+		SiteStats& entry = _entries[index];
+		if (entry.site == site && entry.name == name)
+			return &entry;
+
+		if (entry.site == nullptr)
+		{
+			if (_usedCount == kLimit)
+				return nullptr;
+
+			_used[_usedCount++] = index;
+			entry.site = site;
+			entry.name = name;
+			entry.count = 0;
+			entry.total = 0;
+			entry.min = ~ysTime(0);
+			entry.max = 0;
+			entry.sumSquares = 0;
+			return &entry;
+		}
+	}
+}
+
+template <std::uint32_t S>
+bool SiteStatsTable<S>::Record(Site& site, ysStringHandle name, ysTime duration)
+{
+	SiteStats* const entry = Find(&site, name);
+	if (entry == nullptr)
+		return false;
+
+	++entry->count;
+	entry->total += duration;
+	if (duration < entry->min)
+		entry->min = duration;
+	if (duration > entry->max)
+		entry->max = duration;
+	entry->sumSquares += static_cast<double>(duration) * static_cast<double>(duration);
+	return true;
+}
+
+template <std::uint32_t S>
+bool SiteStatsTable<S>::Merge(SiteStats const& stats)
+{
+	SiteStats* const entry = Find(stats.site, stats.name);
+	if (entry == nullptr)
+		return false;
+
+	entry->count += stats.count;
+	entry->total += stats.total;
+	if (stats.min < entry->min)
+		entry->min = stats.min;
+	if (stats.max > entry->max)
+		entry->max = stats.max;
+	entry->sumSquares += stats.sumSquares;
+	return true;
+}
+
+template <std::uint32_t S>
+void SiteStatsTable<S>::Clear()
+{
+	for (std::uint32_t index = 0; index != _usedCount; ++index)
+		_entries[_used[index]].site = nullptr;
+	_usedCount = 0;
+}
+
+} // namespace _ys_
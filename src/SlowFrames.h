@@ -0,0 +1,90 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace _ys_ {
+
+/// <summary> A region held until its frame is known to be slow or not. </summary>
+struct HeldRegion
+{
+	Site* site;
+	ysStringHandle name;
+	ysTime begin;
+	ysTime end;
+};
+
+/// <summary> The regions one thread has recorded in ysCaptureMode::SlowFrames since its last frame was resolved. </summary>
+struct FrameBuffer
+{
+	static constexpr std::uint32_t kCapacity = 2048;
+
+	std::uint32_t count;
+	HeldRegion regions[kCapacity];
+};
+
+/// <summary> Lengths of the most recent frames, to judge the current one against. </summary>
+class FrameHistory
+{
+	static constexpr std::uint32_t kCapacity = 256;
+
+	ysTime _lengths[kCapacity];
+	ysTime _scratch[kCapacity];
+	std::uint32_t _count = 0;
+	std::uint32_t _next = 0;
+
+public:
+	/// Frames needed before a percentile means anything.
+	static constexpr std::uint32_t kMinimumCount = 32;
+
+	void Add(ysTime length)
+	{
+		_lengths[_next] = length;
+		_next = (_next + 1) % kCapacity;
+		if (_count != kCapacity)
+			++_count;
+	}
+
+	/// <summary> Finds the length a fraction of the recent frames are no longer than. </summary>
+	/// <returns> False if too few frames have ended. </returns>
+	bool FindPercentile(double percentile, ysTime& out_length)
+	{
+		if (_count < kMinimumCount)
+			return false;
+
+		std::uint32_t const rank = static_cast<std::uint32_t>(percentile * (_count - 1));
+		std::copy(_lengths, _lengths + _count, _scratch);
+		std::nth_element(_scratch, _scratch + rank, _scratch + _count);
+		out_length = _scratch[rank];
+		return true;
+	}
+
+	void Clear()
+	{
+		_count = 0;
+		_next = 0;
+	}
+};
+
+} // namespace _ys_
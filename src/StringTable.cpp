@@ -0,0 +1,220 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "StringTable.h"
+
+#include <cstring>
+#include <new>
+
+using namespace _ys_;
+
+ysResult StringTable::Initialize(ysAllocator allocator)
+{
+	Reset();
+
+	_allocator = allocator;
+	_entries = static_cast<Entry*>(_allocator(nullptr, sizeof(Entry) * kCapacity));
+	if (_entries == nullptr)
+		return ysResult::NoMemory;
+
+	for (std::uint32_t i = 0; i != kCapacity; ++i)
+	{
+		Entry* entry = new (_entries + i) Entry;
+		entry->id.store(0, std::memory_order_relaxed);
+		entry->str.store(nullptr, std::memory_order_relaxed);
+		entry->length = 0;
+		entry->announced = false;
+	}
+
+	_announced = static_cast<ysStringHandle*>(_allocator(nullptr, sizeof(ysStringHandle) * kCapacity));
+	if (_announced == nullptr)
+		return ysResult::NoMemory;
+	_announcedCount.store(0, std::memory_order_release);
+
+	return ysResult::Success;
+}
+
+void StringTable::Reset()
+{
+	if (_entries != nullptr)
+		_allocator(_entries, 0);
+	_entries = nullptr;
+
+	if (_announced != nullptr)
+		_allocator(_announced, 0);
+	_announced = nullptr;
+	_announcedCount.store(0, std::memory_order_release);
+
+	Chunk* chunk = _chunks.exchange(nullptr, std::memory_order_acquire);
+	while (chunk != nullptr)
+	{
+		Chunk* const next = chunk->next;
+		_allocator(chunk, 0);
+		chunk = next;
+	}
+}
+
+char* StringTable::AllocateString(std::uint32_t length)
+{
+	std::uint32_t const size = length + 1;
+
+	for (;;)
+	{
+		Chunk* chunk = _chunks.load(std::memory_order_acquire);
+		if (chunk != nullptr)
+		{
+			std::uint32_t const offset = chunk->used.fetch_add(size, std::memory_order_relaxed);
+			if (offset <= chunk->capacity && size <= chunk->capacity - offset)
+				return reinterpret_cast<char*>(chunk + 1) + offset;
+		}
+
+		// the current chunk is exhausted; race to install a new one. strings larger than a
+		// chunk get a chunk of their own.
+		std::uint32_t const capacity = size > kChunkSize ? size : kChunkSize;
+		Chunk* fresh = static_cast<Chunk*>(_allocator(nullptr, sizeof(Chunk) + capacity));
+		if (fresh == nullptr)
+			return nullptr;
+
+		fresh->next = chunk;
+		fresh->capacity = capacity;
+		new (&fresh->used) std::atomic<std::uint32_t>(size);
+
+		if (_chunks.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+			return reinterpret_cast<char*>(fresh + 1);
+
+		_allocator(fresh, 0);
+	}
+}
+
+ysResult StringTable::Intern(char const* str, std::uint32_t length, ysStringHandle hash)
+{
+	return Insert(hash, str, length, true);
+}
+
+ysResult StringTable::Insert(ysStringHandle id, char const* str, std::uint32_t length, bool copy)
+{
+	if (_entries == nullptr)
+		return ysResult::Uninitialized;
+
+	// handle 0 marks an empty entry, so a string hashing to it can never be registered
+	if (id == 0)
+		return ysResult::Collision;
+
+	char const* stored = str;
+
+	for (std::uint32_t probe = 0; probe != kCapacity; ++probe)
+	{
+		Entry& entry = _entries[(id + probe) & kMask];
+
+		ysStringHandle current = entry.id.load(std::memory_order_acquire);
+		if (current == 0)
+		{
+			// the copy is made before the entry is claimed, so that running out of memory leaves the
+			// table untouched. if another thread claims the entry first, the copy goes unused.
+			if (copy && stored == str)
+			{
+				char* const buffer = AllocateString(length);
+				if (buffer == nullptr)
+					return ysResult::NoMemory;
+
+				std::memcpy(buffer, str, length);
+				buffer[length] = '\0';
+				stored = buffer;
+			}
+
+			if (entry.id.compare_exchange_strong(current, id, std::memory_order_acq_rel))
+			{
+				entry.length = length;
+				entry.str.store(stored, std::memory_order_release);
+				return ysResult::Success;
+			}
+			// current now holds the handle that won the entry
+		}
+
+		if (current != id)
+			continue;
+
+		// the entry may have been claimed but not yet published by another thread
+		char const* existing;
+		while ((existing = entry.str.load(std::memory_order_acquire)) == nullptr)
+			;
+
+		if (existing == str || (entry.length == length && std::memcmp(existing, str, length) == 0))
+			return ysResult::Success;
+
+		// a different string already owns the handle. handing out a substitute would make the
+		// handle depend on registration order, so the newcomer is rejected instead.
+		return ysResult::Collision;
+	}
+
+	return ysResult::NoMemory;
+}
+
+StringTable::Entry* StringTable::FindEntry(ysStringHandle id) const
+{
+	if (_entries == nullptr || id == 0)
+		return nullptr;
+
+	for (std::uint32_t probe = 0; probe != kCapacity; ++probe)
+	{
+		Entry& entry = _entries[(id + probe) & kMask];
+
+		ysStringHandle const current = entry.id.load(std::memory_order_acquire);
+		if (current == 0)
+			return nullptr;
+
+		if (current == id)
+		{
+			// the entry may have been claimed but not yet published by another thread
+			while (entry.str.load(std::memory_order_acquire) == nullptr)
+				;
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+char const* StringTable::Find(ysStringHandle id, std::uint32_t& out_length) const
+{
+	Entry const* const entry = FindEntry(id);
+	if (entry == nullptr)
+	{
+		out_length = 0;
+		return nullptr;
+	}
+
+	out_length = entry->length;
+	return entry->str.load(std::memory_order_acquire);
+}
+
+bool StringTable::Announce(ysStringHandle id)
+{
+	Entry* const entry = FindEntry(id);
+	if (entry == nullptr || entry->announced)
+		return false;
+
+	entry->announced = true;
+
+	std::uint32_t const index = _announcedCount.load(std::memory_order_relaxed);
+	_announced[index] = id;
+	_announcedCount.store(index + 1, std::memory_order_release);
+
+	return true;
+}
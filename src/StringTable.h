@@ -0,0 +1,119 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace _ys_ {
+
+/// Computes the handle of a string from its contents at runtime.
+/// Matches hash_string for NUL-terminated strings.
+inline ysStringHandle HashString(char const* str, std::size_t length)
+{
+	ysStringHandle hash = kStringHashBasis;
+	for (std::size_t i = 0; i != length; ++i)
+		hash = (hash ^ static_cast<unsigned char>(str[i])) * kStringHashPrime;
+	return hash;
+}
+
+/// Registry of every string known to Yardstick, keyed by content-derived handle.
+/// Entries are only ever added, never removed, until the table is reset.
+/// The first string registered under a handle owns it; any different string with the same
+/// handle is rejected, so a registered handle always means the same string.
+/// Registration and lookup are lock-free and may be used from any thread.
+class StringTable
+{
+	static constexpr std::uint32_t kCapacity = 1 << 16;
+	static constexpr std::uint32_t kMask = kCapacity - 1;
+	static constexpr std::uint32_t kChunkSize = 64 * 1024;
+
+	struct Entry
+	{
+		std::atomic<ysStringHandle> id;
+		std::atomic<char const*> str;
+		std::uint32_t length;
+
+		// owned by the Yardstick background thread
+		bool announced;
+	};
+
+	// append-only storage for copies of interned strings
+	struct Chunk
+	{
+		Chunk* next;
+		std::uint32_t capacity;
+		std::atomic<std::uint32_t> used;
+	};
+
+	ysAllocator _allocator = nullptr;
+	Entry* _entries = nullptr;
+	std::atomic<Chunk*> _chunks;
+
+	// handles in the order they were announced to sinks
+	ysStringHandle* _announced = nullptr;
+	std::atomic<std::uint32_t> _announcedCount;
+
+	Entry* FindEntry(ysStringHandle id) const;
+	ysResult Insert(ysStringHandle id, char const* str, std::uint32_t length, bool copy);
+	char* AllocateString(std::uint32_t length);
+
+public:
+	StringTable() : _chunks(nullptr), _announcedCount(0) {}
+	~StringTable() { Reset(); }
+	StringTable(StringTable const&) = delete;
+	StringTable& operator=(StringTable const&) = delete;
+
+	ysResult Initialize(ysAllocator allocator);
+	void Reset();
+
+	/// <summary> Registers a string under its handle. </summary>
+	/// <param name="id"> The content-derived handle of the string. </param>
+	/// <param name="str"> The string, which must remain valid until the table is reset. </param>
+	/// <param name="length"> Length of the string in bytes. </param>
+	/// <returns> ysResult::Collision if a different string is registered under the handle,
+	/// ysResult::NoMemory if the table is full, otherwise ysResult::Success. </returns>
+	ysResult Register(ysStringHandle id, char const* str, std::uint32_t length) { return Insert(id, str, length, false); }
+
+	/// <summary> Registers a copy of a string, if no identical string is registered yet. </summary>
+	/// <param name="hash"> The result of HashString for the string. </param>
+	/// <returns> Collision if a different string is registered under the handle, or NoMemory if the
+	/// table or the arena is exhausted. </returns>
+	ysResult Intern(char const* str, std::uint32_t length, ysStringHandle hash);
+
+	/// <summary> Finds a registered string. </summary>
+	/// <returns> The string, or nullptr if the handle is not registered. </returns>
+	char const* Find(ysStringHandle id, std::uint32_t& out_length) const;
+
+	/// <summary> Marks a registered string as announced to sinks. </summary>
+	/// <remarks> Must only be called from the Yardstick background thread. </remarks>
+	/// <returns> True the first time a handle is announced, false otherwise. </returns>
+	bool Announce(ysStringHandle id);
+
+	/// <summary> Number of strings announced so far. Strings are announced in a stable order. </summary>
+	std::uint32_t GetAnnouncedCount() const { return _announcedCount.load(std::memory_order_acquire); }
+
+	/// <summary> Handle of the string announced at the given position. </summary>
+	ysStringHandle GetAnnounced(std::uint32_t index) const { return _announced[index]; }
+};
+
+} // namespace _ys_
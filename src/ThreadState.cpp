@@ -19,11 +19,18 @@
 
 #include "ThreadState.h"
 #include "GlobalState.h"
+#include "Clock.h"
+#include "StringTable.h"
+
+#include <cstring>
 
 using namespace _ys_;
 
-ThreadState::ThreadState() : _thread(std::this_thread::get_id())
+ThreadState::ThreadState() : _thread(std::this_thread::get_id()), _depth(0), _histograms(nullptr), _histogramsTaken(false)
 {
+	std::memset(_internCache, 0, sizeof(_internCache));
+	std::memset(_histogramCache, 0, sizeof(_histogramCache));
+
 	GlobalState::instance().RegisterThread(this);
 }
 
@@ -49,3 +56,163 @@ bool ThreadState::Deque(EventData& out_ev)
 	return _queue.TryDeque(out_ev);
 }
 
+bool ThreadState::RecordRegion(Site& site, ysStringHandle name, ysTime duration)
+{
+	LockGuard guard(_statsLock);
+	return _stats.Record(site, name, duration);
+}
+
+bool ThreadState::HoldRegion(Site& site, ysStringHandle name, ysTime begin, ysTime end)
+{
+	LockGuard guard(_frameLock);
+
+	if (_frame == nullptr)
+	{
+		_frame = GlobalState::instance().CreateFrameBuffer();
+		if (_frame == nullptr)
+			return false;
+	}
+
+	if (_frame->count == FrameBuffer::kCapacity)
+		return false;
+
+	HeldRegion& region = _frame->regions[_frame->count++];
+	region.site = &site;
+	region.name = name;
+	region.begin = begin;
+	region.end = end;
+	return true;
+}
+
+ysTime ThreadState::BeginRegion(Site& site, ysStringHandle name, bool tree)
+{
+	std::uint32_t const depth = _depth.load(std::memory_order_relaxed);
+	if (depth >= kMaxStackDepth)
+	{
+		_depth.store(depth + 1, std::memory_order_relaxed);
+		return ReadClock();
+	}
+
+	CallStackEntry& entry = _stack[depth];
+	entry.site.store(&site, std::memory_order_relaxed);
+	entry.name.store(name, std::memory_order_relaxed);
+	entry.children = 0;
+	entry.node = kNoNode;
+
+	// a region nested in one without a node has none either
+	std::uint32_t const parent = depth == 0 ? kNoNode : _stack[depth - 1].node;
+	if (tree && (depth == 0 || parent != kNoNode))
+	{
+		LockGuard guard(_treeLock);
+		entry.node = _tree.FindChild(parent, site, name);
+	}
+
+	// read last, so the region's time doesn't include entering it
+	ysTime const start = ReadClock();
+	entry.start.store(start, std::memory_order_relaxed);
+	_depth.store(depth + 1, std::memory_order_release);
+	return start;
+}
+
+bool ThreadState::PopRegion(Site& site, ysStringHandle name, ysTime duration)
+{
+	std::uint32_t const depth = _depth.load(std::memory_order_relaxed) - 1;
+	if (depth >= kMaxStackDepth)
+	{
+		_depth.store(depth, std::memory_order_relaxed);
+		return false;
+	}
+
+	// regions emitted without being pushed, such as those begun before the stack was kept, leave
+	// the stack alone
+	CallStackEntry const& entry = _stack[depth];
+	if (entry.site.load(std::memory_order_relaxed) != &site || entry.name.load(std::memory_order_relaxed) != name)
+		return false;
+
+	_depth.store(depth, std::memory_order_release);
+	if (depth != 0)
+		_stack[depth - 1].children += duration;
+
+	if (entry.node == kNoNode)
+		return false;
+
+	ysTime const exclusive = duration > entry.children ? duration - entry.children : 0;
+
+	LockGuard guard(_treeLock);
+	_tree.Record(entry.node, duration, exclusive);
+	return true;
+}
+
+ThreadHistogram* ThreadState::FindHistogram(Site& site)
+{
+	ThreadHistogram* histogram = _histograms.load(std::memory_order_relaxed);
+	while (histogram != nullptr && histogram->site != &site)
+		histogram = histogram->next;
+
+	if (histogram == nullptr)
+	{
+		histogram = GlobalState::instance().CreateHistogram(site);
+		if (histogram == nullptr)
+			return nullptr;
+
+		// only this thread adds to the list, but a shutdown may take it at the same time
+		ThreadHistogram* head = _histograms.load(std::memory_order_relaxed);
+		do
+			histogram->next = head;
+		while (!_histograms.compare_exchange_weak(head, histogram, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	_histogramCache[hash_pointer(&site) & kHistogramCacheMask] = histogram;
+	return histogram;
+}
+
+void ThreadState::ForgetHistograms()
+{
+	// acquired so that the list is seen taken, too
+	_histogramsTaken.exchange(false, std::memory_order_acquire);
+	std::memset(_histogramCache, 0, sizeof(_histogramCache));
+}
+
+ysStringHandle ThreadState::InternString(char const* str, std::size_t length)
+{
+	GlobalState& gs = GlobalState::instance();
+
+	// the cache points into the string arena, which is freed by shutdown
+	if (!gs.IsActive())
+		return 0;
+
+	// a String event only has room for 16 bits of length, so a longer string couldn't be delivered whole
+	if (length > UINT16_MAX)
+		return 0;
+
+	// handles from a previous initialization are meaningless now
+	std::uint32_t const epoch = gs.GetEpoch();
+	if (epoch != _internEpoch)
+	{
+		std::memset(_internCache, 0, sizeof(_internCache));
+		_internEpoch = epoch;
+	}
+
+	ysStringHandle const hash = HashString(str, length);
+	InternCacheEntry& entry = _internCache[hash & kInternCacheMask];
+
+	if (entry.id != 0 && entry.hash == hash && entry.length == length && std::memcmp(entry.str, str, length) == 0)
+		return entry.id;
+
+	ysStringHandle const id = gs.InternString(str, static_cast<std::uint32_t>(length), hash);
+	if (id == 0)
+		return 0;
+
+	// cache the table's copy, as the caller's string may not outlive this call
+	std::uint32_t storedLength;
+	char const* const stored = gs.FindString(id, storedLength);
+	if (stored != nullptr)
+	{
+		entry.hash = hash;
+		entry.id = id;
+		entry.str = stored;
+		entry.length = storedLength;
+	}
+
+	return id;
+}
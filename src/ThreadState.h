@@ -21,8 +21,16 @@
 
 #include <yardstick/yardstick.h>
 
+#include "Atomics.h"
+#include "CallTree.h"
 #include "ConcurrentQueue.h"
+#include "CounterSlots.h"
+#include "Histogram.h"
+#include "PointerHash.h"
 #include "Protocol.h"
+#include "SiteStats.h"
+#include "SlowFrames.h"
+#include "Spinlock.h"
 
 #include <thread>
 
@@ -30,8 +38,65 @@ namespace _ys_ {
 
 class ThreadState
 {
+	static constexpr std::uint32_t kInternCacheSize = 256;
+	static constexpr std::uint32_t kInternCacheMask = kInternCacheSize - 1;
+	static constexpr std::uint32_t kHistogramCacheSize = 64;
+	static constexpr std::uint32_t kHistogramCacheMask = kHistogramCacheSize - 1;
+	static constexpr std::uint32_t kMaxStackDepth = 64;
+
+	// recently interned strings, checked before the global string table
+	struct InternCacheEntry
+	{
+		ysStringHandle hash;
+		ysStringHandle id;
+		char const* str;
+		std::uint32_t length;
+	};
+
 	ConcurrentQueue<EventData, 512> _queue;
 	std::thread::id _thread;
+	std::uint16_t _index = 0;
+
+	InternCacheEntry _internCache[kInternCacheSize];
+	std::uint32_t _internEpoch = 0;
+
+	// regions accumulated in ysCaptureMode::Statistics, harvested by GlobalState at each tick.
+	// the lock is only ever contended by the harvest.
+	Spinlock _statsLock;
+	SiteStatsTable<256> _stats;
+
+	// regions this thread is inside, innermost last. only the regions entered in ysCaptureMode::CallTree
+	// or while sampling are pushed, and regions nested deeper than kMaxStackDepth are only counted.
+	// the depth is published after the entries beneath it, for the background thread to sample.
+	CallStackEntry _stack[kMaxStackDepth];
+	std::atomic<std::uint32_t> _depth;
+	// start of the region last reported as stalled. used by GlobalState _only_.
+	ysTime _stalled = 0;
+
+	// the paths through the regions recorded in ysCaptureMode::CallTree, harvested by GlobalState at
+	// each tick. the lock is only ever contended by the harvest.
+	Spinlock _treeLock;
+	CallTreeTable<512> _tree;
+
+	// regions held in ysCaptureMode::SlowFrames, which GlobalState allocates on first use, resolves
+	// at each tick and eventually frees. the lock is only ever contended by the resolution.
+	Spinlock _frameLock;
+	FrameBuffer* _frame = nullptr;
+
+	// histograms of the sites this thread has recorded, which GlobalState reads and frees when the
+	// thread exits. a shutdown takes the list and raises the flag, upon which the thread forgets its
+	// cache. only this thread touches the cache, so recording takes no lock.
+	std::atomic<ThreadHistogram*> _histograms;
+	std::atomic<bool> _histogramsTaken;
+	ThreadHistogram* _histogramCache[kHistogramCacheSize];
+
+	ThreadHistogram* FindHistogram(Site& site);
+	void ForgetHistograms();
+
+	bool PopRegion(Site& site, ysStringHandle name, ysTime duration);
+
+	// sums of this thread's counter increments, delivered by GlobalState at each tick and flush
+	CounterSlotTable<256> _counters;
 
 	// managed by GlobalState _only_!!!
 	ThreadState* _prev = nullptr;
@@ -52,10 +117,60 @@ public:
 	}
 
 	std::thread::id const& GetThreadId() const { return _thread; }
+	std::uint16_t GetIndex() const { return _index; }
 
 	void Enque(EventData const& ev);
 
 	bool Deque(EventData& out_ev);
+
+	/// <summary> Adds a region to the current frame's statistics. </summary>
+	/// <returns> False if the site could not be given an entry this frame. </returns>
+	bool RecordRegion(Site& site, ysStringHandle name, ysTime duration);
+
+	/// <summary> Holds a region until the end of its frame. </summary>
+	/// <returns> False if the frame's buffer is full or can't be allocated. </returns>
+	bool HoldRegion(Site& site, ysStringHandle name, ysTime begin, ysTime end);
+
+	/// <summary> Pushes a region onto the shadow stack. </summary>
+	/// <param name="tree"> Whether to give the region a node in this thread's call tree. </param>
+	/// <returns> The region's start time, read once it is pushed. </returns>
+	ysTime BeginRegion(Site& site, ysStringHandle name, bool tree);
+
+	/// <summary> Pops a region from the shadow stack if it is the innermost one, adding its times to its node. </summary>
+	/// <returns> False if the region was not pushed or has no node. </returns>
+	inline bool EndRegion(Site& site, ysStringHandle name, ysTime duration);
+
+	/// <summary> Adds a duration to a site's histogram for this thread. </summary>
+	inline void RecordHistogram(Site& site, ysTime duration);
+
+	/// <summary> Adds an increment to this thread's total for a counter. </summary>
+	/// <returns> False if the counter could not be given a slot. </returns>
+	bool AddCount(Site& site, ysStringHandle name, double amount) { return _counters.Add(site, name, amount); }
+
+	ysStringHandle InternString(char const* str, std::size_t length);
 };
 
+bool ThreadState::EndRegion(Site& site, ysStringHandle name, ysTime duration)
+{
+	// regions are only pushed while a call tree is built or threads are sampled, so most regions
+	// find the stack empty and leave without a call
+	return _depth.load(std::memory_order_relaxed) != 0 && PopRegion(site, name, duration);
+}
+
+void ThreadState::RecordHistogram(Site& site, ysTime duration)
+{
+	// histograms taken by a shutdown are only freed by the next one, so recording into one that is
+	// being taken at this moment is harmless
+	if (_histogramsTaken.load(std::memory_order_relaxed))
+		ForgetHistograms();
+
+	ThreadHistogram* histogram = _histogramCache[hash_pointer(&site) & kHistogramCacheMask];
+	if (histogram == nullptr || histogram->site != &site)
+		histogram = FindHistogram(site);
+
+	// a histogram that can't be allocated is simply not kept
+	if (histogram != nullptr)
+		histogram->Record(duration);
+}
+
 } // namespace _ys_
@@ -0,0 +1,83 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "TraceExporter.h"
+
+#include <cstdlib>
+
+using namespace _ys_;
+
+namespace {
+
+void* YS_CALL Allocate(void* block, std::size_t bytes)
+{
+	if (bytes == 0)
+	{
+		std::free(block);
+		return nullptr;
+	}
+	return std::malloc(bytes);
+}
+
+char const* ResolveString(void* userData, ysStringHandle id, std::uint32_t& out_length)
+{
+	return static_cast<ysTraceReader const*>(userData)->FindString(id, out_length);
+}
+
+} // anonymous namespace
+
+ysResult ysExportTrace(ysTraceReader const& reader, char const* path, ysExportFormat format)
+{
+	if (path == nullptr || reader.GetFrequency() == 0)
+		return ysResult::InvalidParameter;
+
+	TraceExporter exporter;
+	exporter.SetResolver(&ResolveString, const_cast<ysTraceReader*>(&reader));
+	YS_TRY(exporter.Open(path, format, &Allocate));
+
+	for (std::size_t index = 0; index != reader.GetProcessCount(); ++index)
+	{
+		ysTraceProcess const& process = reader.GetProcess(index);
+		YS_TRY(exporter.AddProcess(process.name, process.firstThread, process.threads));
+	}
+
+	// the file header stands in for the header event the sink received
+	ysEvent ev;
+	ev.type = ysEventType::Header;
+	ev.thread = 0;
+	ev.header.frequency = reader.GetFrequency();
+	ev.header.start = reader.GetStart();
+
+	ysResult result = exporter.Write(ev);
+
+	// blocks are decoded straight out of the mapping, so memory use does not depend on the size
+	// of the file
+	ysTraceCursor cursor = reader.Read(0, reader.GetBlockCount());
+	while (result == ysResult::Success && cursor.Next(ev))
+		result = exporter.Write(ev);
+
+	ysResult const closed = exporter.Close();
+	if (result != ysResult::Success)
+		return result;
+	if (cursor.HasFailed())
+		return ysResult::InvalidParameter;
+	return closed;
+}
@@ -0,0 +1,828 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "TraceExporter.h"
+
+#include <cmath>
+
+using namespace _ys_;
+
+namespace {
+
+// field numbers from Perfetto's protos/perfetto/trace
+enum ProtoField : std::uint32_t
+{
+	kTracePacket = 1,
+
+	kPacketTimestamp = 8,
+	kPacketSequenceId = 10,
+	kPacketTrackEvent = 11,
+	kPacketInternedData = 12,
+	kPacketSequenceFlags = 13,
+	kPacketTrackDescriptor = 60,
+
+	kInternedEventNames = 2,
+	kEventNameIid = 1,
+	kEventNameName = 2,
+
+	kTrackEventType = 9,
+	kTrackEventNameIid = 10,
+	kTrackEventTrackUuid = 11,
+	kTrackEventName = 23,
+	kTrackEventDoubleCounterValue = 44,
+
+	kTrackUuid = 1,
+	kTrackName = 2,
+	kTrackProcess = 3,
+	kTrackThread = 4,
+	kTrackParentUuid = 5,
+	kTrackCounter = 8,
+
+	kProcessPid = 1,
+	kProcessName = 6,
+
+	kThreadPid = 1,
+	kThreadTid = 2,
+	kThreadName = 5,
+};
+
+enum WireType : std::uint32_t
+{
+	kWireVarint = 0,
+	kWireFixed64 = 1,
+	kWireLength = 2,
+};
+
+enum TrackEventType : std::uint32_t
+{
+	kSliceBegin = 1,
+	kSliceEnd = 2,
+	kCounter = 4,
+};
+
+enum SequenceFlags : std::uint32_t
+{
+	kIncrementalStateCleared = 1,
+	kNeedsIncrementalState = 2,
+};
+
+constexpr std::uint32_t kSequenceId = 1;
+constexpr std::uint32_t kPid = 1;
+constexpr std::uint64_t kProcessTrack = 1;
+constexpr std::uint64_t kFramesTrack = 2;
+
+// lengths of nested messages are written as fixed size varints, so they can be filled in once the
+// message is complete
+constexpr std::size_t kLengthSize = 4;
+
+constexpr char kProcessLabel[] = "Yardstick";
+constexpr char kFramesLabel[] = "Frames";
+
+std::uint64_t ThreadTrack(std::uint16_t thread) { return 0x10000 + thread; }
+std::uint64_t ProcessTrack(std::size_t index) { return 0x20000 + index; }
+// the first process holds the frames and counter tracks, so merged processes follow it
+std::uint32_t ProcessPid(std::size_t index) { return kPid + 1 + static_cast<std::uint32_t>(index); }
+std::uint64_t CounterTrack(ysStringHandle name) { return (std::uint64_t(1) << 32) | name; }
+
+} // anonymous namespace
+
+ysResult TraceExporter::Open(char const* path, ysExportFormat format, ysAllocator allocator)
+{
+	if (path == nullptr || allocator == nullptr)
+		return ysResult::InvalidParameter;
+
+	if (format != ysExportFormat::ChromeJson && format != ysExportFormat::Perfetto)
+		return ysResult::InvalidParameter;
+
+	if (_file != nullptr)
+		return ysResult::AlreadyInitialized;
+
+	_allocator = allocator;
+	_format = format;
+
+	_names.Initialize(_allocator);
+	_pending.Initialize(_allocator);
+	_processes.Initialize(_allocator);
+	_nameCount = 0;
+
+	_buffer = static_cast<char*>(_allocator(nullptr, kBufferSize));
+	if (_buffer == nullptr || !_names.Resize(kInitialNames))
+	{
+		Close();
+		return ysResult::NoMemory;
+	}
+
+	_file = std::fopen(path, "wb");
+	if (_file == nullptr)
+	{
+		Close();
+		return ysResult::System;
+	}
+
+	// output is already gathered into large writes
+	std::setvbuf(_file, nullptr, _IONBF, 0);
+
+	_used = 0;
+	_failed = false;
+	_begun = false;
+	_first = true;
+	_inFrame = false;
+	_frame = 0;
+	std::memset(_threads, 0, sizeof(_threads));
+
+	WritePreamble();
+
+	return ysResult::Success;
+}
+
+ysResult TraceExporter::Close()
+{
+	if (_file != nullptr)
+	{
+		if (_format == ysExportFormat::ChromeJson)
+		{
+			Reserve(4);
+			Put("\n]}\n");
+		}
+
+		Flush();
+
+		if (std::fclose(_file) != 0)
+			_failed = true;
+		_file = nullptr;
+	}
+
+	if (_buffer != nullptr)
+		_allocator(_buffer, 0);
+	_buffer = nullptr;
+	_used = 0;
+
+	_names.Reset();
+	_pending.Reset();
+	_processes.Reset();
+	_nameCount = 0;
+
+	return _failed ? ysResult::System : ysResult::Success;
+}
+
+ysResult TraceExporter::AddProcess(ysStringHandle name, std::uint16_t firstThread, std::uint16_t threads)
+{
+	if (_file == nullptr)
+		return ysResult::Uninitialized;
+
+	Process process;
+	process.name = name;
+	process.firstThread = firstThread;
+	process.threads = threads;
+	process.written = false;
+	return _processes.PushBack(process) ? ysResult::Success : ysResult::NoMemory;
+}
+
+ysResult TraceExporter::Write(ysEvent const& ev)
+{
+	if (_file == nullptr)
+		return ysResult::Uninitialized;
+
+	// a header may also arrive after the first events, when a capture is restarted
+	if (ev.type == ysEventType::Header)
+	{
+		_frequency = ev.header.frequency;
+		_start = ev.header.start;
+		_begun = _frequency != 0;
+		_inFrame = false;
+		return _failed ? ysResult::System : ysResult::Success;
+	}
+
+	if (!_begun)
+		return ysResult::Success;
+
+	switch (ev.type)
+	{
+	case ysEventType::Tick:
+		if (_inFrame)
+			WriteFrame(_frameStart, ev.tick.when);
+		WriteCounters(ev.tick.when);
+		_inFrame = true;
+		_frameStart = ev.tick.when;
+		break;
+	case ysEventType::Region:
+		if ((_threads[ev.thread / 32] & (1u << (ev.thread % 32))) == 0)
+			WriteThread(ev.thread);
+		WriteSlice(ev.thread, ev.region.name, ev.region.begin, ev.region.end);
+		break;
+	case ysEventType::CounterSet:
+		WriteCounter(ev.counter_set.name, ev.counter_set.when, ev.counter_set.value);
+		break;
+	case ysEventType::CounterAdd:
+	{
+		// increments are summed over a frame, and reported when the frame ends
+		Name* const name = FindName(ev.counter_add.name);
+		if (name == nullptr)
+			return ysResult::NoMemory;
+
+		if ((name->flags & kCounterPending) == 0)
+		{
+			if (!_pending.PushBack(name->id))
+				return ysResult::NoMemory;
+			name->flags |= kCounterPending;
+			name->amount = 0;
+		}
+		name->amount += ev.counter_add.amount;
+		break;
+	}
+	case ysEventType::RegionSummary:
+		// summaries have no slices to show, so their mean duration is drawn as a counter, in microseconds
+		if (ev.region_summary.count != 0)
+			WriteCounter(ev.region_summary.name, ev.region_summary.when, static_cast<double>(ev.region_summary.total) / ev.region_summary.count * 1e6 / static_cast<double>(_frequency));
+		break;
+	default:
+		// names are looked up through the resolver as they are needed
+		break;
+	}
+
+	return _failed ? ysResult::System : ysResult::Success;
+}
+
+TraceExporter::Name* TraceExporter::FindName(ysStringHandle id)
+{
+	if (id == 0 || _names.Empty())
+		return nullptr;
+
+	std::size_t const mask = _names.Size() - 1;
+	for (std::size_t index = id & mask;; index = (index + 1) & mask)
+	{
+		Name& name = _names[index];
+		if (name.id == id)
+			return &name;
+
+		if (name.id == 0)
+		{
+			if ((_nameCount + 1) * 2 > _names.Size())
+				return GrowNames() ? FindName(id) : nullptr;
+
+			name.id = id;
+			name.flags = 0;
+			name.amount = 0;
+			++_nameCount;
+			return &name;
+		}
+	}
+}
+
+bool TraceExporter::GrowNames()
+{
+	Array<Name> names;
+	names.Initialize(_allocator);
+	if (!names.Resize(_names.Size() * 2))
+		return false;
+
+	std::size_t const mask = names.Size() - 1;
+	for (Name const& name : _names)
+	{
+		if (name.id == 0)
+			continue;
+
+		std::size_t index = name.id & mask;
+		while (names[index].id != 0)
+			index = (index + 1) & mask;
+		names[index] = name;
+	}
+
+	_names.Swap(names);
+	return true;
+}
+
+std::int64_t TraceExporter::ToNanoseconds(ysTime when) const
+{
+	// split the conversion so that large tick counts do not overflow
+	ysTime const delta = when >= _start ? when - _start : _start - when;
+	ysTime const nanoseconds = delta / _frequency * 1000000000 + delta % _frequency * 1000000000 / _frequency;
+	return when >= _start ? static_cast<std::int64_t>(nanoseconds) : -static_cast<std::int64_t>(nanoseconds);
+}
+
+char const* TraceExporter::Resolve(ysStringHandle id, char (&fallback)[10], std::size_t& out_length) const
+{
+	std::uint32_t length = 0;
+	char const* const str = _resolver != nullptr ? _resolver(_resolverData, id, length) : nullptr;
+	if (str != nullptr)
+	{
+		out_length = length < kMaxNameLength ? length : kMaxNameLength;
+		return str;
+	}
+
+	// unknown strings are shown by handle
+	static char const kHex[] = "0123456789abcdef";
+	fallback[0] = '0';
+	fallback[1] = 'x';
+	for (int digit = 0; digit != 8; ++digit)
+		fallback[2 + digit] = kHex[(id >> (28 - digit * 4)) & 0xf];
+	out_length = sizeof(fallback);
+	return fallback;
+}
+
+void TraceExporter::Flush()
+{
+	if (_used != 0 && !_failed && std::fwrite(_buffer, 1, _used, _file) != _used)
+		_failed = true;
+	_used = 0;
+}
+
+void TraceExporter::Put(char const* str, std::size_t length)
+{
+	std::memcpy(_buffer + _used, str, length);
+	_used += length;
+}
+
+void TraceExporter::PutDecimal(std::uint64_t value)
+{
+	char digits[20];
+	std::size_t count = 0;
+	do
+	{
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	while (count != 0)
+		Put(digits[--count]);
+}
+
+void TraceExporter::PutDouble(double value)
+{
+	// JSON has no representation for infinities or NaN
+	if (!std::isfinite(value))
+		value = 0;
+
+	int const length = std::snprintf(_buffer + _used, 32, "%.17g", value);
+	if (length > 0)
+		_used += static_cast<std::size_t>(length < 32 ? length : 31);
+}
+
+void TraceExporter::PutMicroseconds(std::int64_t nanoseconds)
+{
+	if (nanoseconds < 0)
+	{
+		Put('-');
+		nanoseconds = -nanoseconds;
+	}
+
+	std::uint64_t const fraction = static_cast<std::uint64_t>(nanoseconds) % 1000;
+	PutDecimal(static_cast<std::uint64_t>(nanoseconds) / 1000);
+	Put('.');
+	Put(static_cast<char>('0' + fraction / 100));
+	Put(static_cast<char>('0' + fraction / 10 % 10));
+	Put(static_cast<char>('0' + fraction % 10));
+}
+
+void TraceExporter::PutJsonString(char const* str, std::size_t length)
+{
+	static char const kHex[] = "0123456789abcdef";
+
+	Put('"');
+	for (std::size_t index = 0; index != length; ++index)
+	{
+		unsigned char const c = static_cast<unsigned char>(str[index]);
+		if (c == '"' || c == '\\')
+		{
+			Put('\\');
+			Put(static_cast<char>(c));
+		}
+		else if (c < 0x20)
+		{
+			Put("\\u00", 4);
+			Put(kHex[c >> 4]);
+			Put(kHex[c & 0xf]);
+		}
+		else
+			Put(static_cast<char>(c));
+	}
+	Put('"');
+}
+
+void TraceExporter::PutJsonName(ysStringHandle id)
+{
+	char fallback[10];
+	std::size_t length;
+	char const* const str = Resolve(id, fallback, length);
+	PutJsonString(str, length);
+}
+
+void TraceExporter::PutJsonEvent(char phase, std::uint32_t pid, std::uint16_t thread)
+{
+	if (!_first)
+		Put(',');
+	_first = false;
+
+	Put("\n{\"ph\":\"", 8);
+	Put(phase);
+	Put("\",\"pid\":", 8);
+	PutDecimal(pid);
+	Put(",\"tid\":", 7);
+	PutDecimal(thread);
+}
+
+void TraceExporter::PutVarint(std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		Put(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	Put(static_cast<char>(value));
+}
+
+void TraceExporter::PutFixed64(std::uint32_t field, double value)
+{
+	PutTag(field, kWireFixed64);
+	std::memcpy(_buffer + _used, &value, sizeof(value));
+	_used += sizeof(value);
+}
+
+void TraceExporter::PutProtoString(std::uint32_t field, char const* str, std::size_t length)
+{
+	PutTag(field, kWireLength);
+	PutVarint(length);
+	Put(str, length);
+}
+
+void TraceExporter::PutProtoName(std::uint32_t field, ysStringHandle id)
+{
+	char fallback[10];
+	std::size_t length;
+	char const* const str = Resolve(id, fallback, length);
+	PutProtoString(field, str, length);
+}
+
+std::size_t TraceExporter::BeginMessage(std::uint32_t field)
+{
+	PutTag(field, kWireLength);
+	std::size_t const start = _used;
+	_used += kLengthSize;
+	return start;
+}
+
+void TraceExporter::EndMessage(std::size_t start)
+{
+	std::size_t const length = _used - start - kLengthSize;
+	for (std::size_t index = 0; index != kLengthSize; ++index)
+	{
+		char const more = index + 1 != kLengthSize ? '\x80' : '\0';
+		_buffer[start + index] = static_cast<char>(((length >> (index * 7)) & 0x7f) | more);
+	}
+}
+
+std::size_t TraceExporter::BeginPacket(std::uint32_t sequenceFlags)
+{
+	std::size_t const packet = BeginMessage(kTracePacket);
+
+	PutTag(kPacketSequenceId, kWireVarint);
+	PutVarint(kSequenceId);
+
+	// the first packet starts the sequence, and nothing before it can refer to interned data
+	if (_first)
+		sequenceFlags |= kIncrementalStateCleared;
+	_first = false;
+
+	if (sequenceFlags != 0)
+	{
+		PutTag(kPacketSequenceFlags, kWireVarint);
+		PutVarint(sequenceFlags);
+	}
+
+	return packet;
+}
+
+void TraceExporter::WritePreamble()
+{
+	Reserve(kMaxEventSize);
+
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		Put("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+		PutJsonEvent('M', kPid, 0);
+		Put(",\"name\":\"process_name\",\"args\":{\"name\":");
+		PutJsonString(kProcessLabel, sizeof(kProcessLabel) - 1);
+		Put("}}");
+
+		PutJsonEvent('M', kPid, 0);
+		Put(",\"name\":\"thread_name\",\"args\":{\"name\":");
+		PutJsonString(kFramesLabel, sizeof(kFramesLabel) - 1);
+		Put("}}");
+	}
+	else
+	{
+		std::size_t packet = BeginPacket(0);
+		std::size_t track = BeginMessage(kPacketTrackDescriptor);
+		PutTag(kTrackUuid, kWireVarint);
+		PutVarint(kProcessTrack);
+		std::size_t const process = BeginMessage(kTrackProcess);
+		PutTag(kProcessPid, kWireVarint);
+		PutVarint(kPid);
+		PutProtoString(kProcessName, kProcessLabel, sizeof(kProcessLabel) - 1);
+		EndMessage(process);
+		EndMessage(track);
+		EndMessage(packet);
+
+		packet = BeginPacket(0);
+		track = BeginMessage(kPacketTrackDescriptor);
+		PutTag(kTrackUuid, kWireVarint);
+		PutVarint(kFramesTrack);
+		PutTag(kTrackParentUuid, kWireVarint);
+		PutVarint(kProcessTrack);
+		PutProtoString(kTrackName, kFramesLabel, sizeof(kFramesLabel) - 1);
+		EndMessage(track);
+		EndMessage(packet);
+	}
+}
+
+std::size_t TraceExporter::FindProcess(std::uint16_t thread) const
+{
+	for (std::size_t index = 0; index != _processes.Size(); ++index)
+	{
+		Process const& process = _processes[index];
+		if (thread >= process.firstThread && thread - process.firstThread < process.threads)
+			return index;
+	}
+	return _processes.Size();
+}
+
+std::uint32_t TraceExporter::GetPid(std::uint16_t thread) const
+{
+	if (_processes.Empty())
+		return kPid;
+
+	std::size_t const index = FindProcess(thread);
+	return index != _processes.Size() ? ProcessPid(index) : kPid;
+}
+
+void TraceExporter::WriteProcess(std::size_t index)
+{
+	Process& process = _processes[index];
+	process.written = true;
+
+	Reserve(kMaxEventSize);
+
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		PutJsonEvent('M', ProcessPid(index), 0);
+		Put(",\"name\":\"process_name\",\"args\":{\"name\":");
+		PutJsonName(process.name);
+		Put("}}");
+	}
+	else
+	{
+		std::size_t const packet = BeginPacket(0);
+		std::size_t const track = BeginMessage(kPacketTrackDescriptor);
+		PutTag(kTrackUuid, kWireVarint);
+		PutVarint(ProcessTrack(index));
+		std::size_t const descriptor = BeginMessage(kTrackProcess);
+		PutTag(kProcessPid, kWireVarint);
+		PutVarint(ProcessPid(index));
+		PutProtoName(kProcessName, process.name);
+		EndMessage(descriptor);
+		EndMessage(track);
+		EndMessage(packet);
+	}
+}
+
+void TraceExporter::WriteThread(std::uint16_t thread)
+{
+	_threads[thread / 32] |= 1u << (thread % 32);
+
+	std::size_t const process = FindProcess(thread);
+	if (process != _processes.Size() && !_processes[process].written)
+		WriteProcess(process);
+	std::uint32_t const pid = process != _processes.Size() ? ProcessPid(process) : kPid;
+
+	char label[16] = "Thread ";
+	std::size_t length = 7;
+	for (std::uint32_t divisor = 10000; divisor != 0; divisor /= 10)
+	{
+		if (thread >= divisor || divisor == 1 || length != 7)
+			label[length++] = static_cast<char>('0' + thread / divisor % 10);
+	}
+
+	Reserve(kMaxEventSize);
+
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		PutJsonEvent('M', pid, thread);
+		Put(",\"name\":\"thread_name\",\"args\":{\"name\":");
+		PutJsonString(label, length);
+		Put("}}");
+	}
+	else
+	{
+		std::size_t const packet = BeginPacket(0);
+		std::size_t const track = BeginMessage(kPacketTrackDescriptor);
+		PutTag(kTrackUuid, kWireVarint);
+		PutVarint(ThreadTrack(thread));
+		std::size_t const descriptor = BeginMessage(kTrackThread);
+		PutTag(kThreadPid, kWireVarint);
+		PutVarint(pid);
+		PutTag(kThreadTid, kWireVarint);
+		PutVarint(thread);
+		PutProtoString(kThreadName, label, length);
+		EndMessage(descriptor);
+		EndMessage(track);
+		EndMessage(packet);
+	}
+}
+
+void TraceExporter::WriteSlice(std::uint16_t thread, ysStringHandle name, ysTime begin, ysTime end)
+{
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		std::int64_t const start = ToNanoseconds(begin);
+
+		Reserve(kMaxEventSize);
+		PutJsonEvent('X', GetPid(thread), thread);
+		Put(",\"name\":", 8);
+		PutJsonName(name);
+		Put(",\"ts\":", 6);
+		PutMicroseconds(start);
+		Put(",\"dur\":", 7);
+		PutMicroseconds(ToNanoseconds(end) - start);
+		Put('}');
+	}
+	else
+		WriteProtoSlice(ThreadTrack(thread), begin, end, name, nullptr, 0);
+}
+
+void TraceExporter::WriteFrame(ysTime begin, ysTime end)
+{
+	char label[32] = "Frame ";
+	std::size_t length = 6;
+	{
+		char digits[20];
+		std::size_t count = 0;
+		std::uint64_t frame = _frame;
+		do
+		{
+			digits[count++] = static_cast<char>('0' + frame % 10);
+			frame /= 10;
+		} while (frame != 0);
+		while (count != 0)
+			label[length++] = digits[--count];
+	}
+	++_frame;
+
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		std::int64_t const start = ToNanoseconds(begin);
+
+		Reserve(kMaxEventSize);
+		PutJsonEvent('X', kPid, 0);
+		Put(",\"name\":", 8);
+		PutJsonString(label, length);
+		Put(",\"ts\":", 6);
+		PutMicroseconds(start);
+		Put(",\"dur\":", 7);
+		PutMicroseconds(ToNanoseconds(end) - start);
+		Put('}');
+	}
+	else
+		WriteProtoSlice(kFramesTrack, begin, end, 0, label, length);
+}
+
+void TraceExporter::WriteProtoSlice(std::uint64_t track, ysTime begin, ysTime end, ysStringHandle name, char const* label, std::size_t labelLength)
+{
+	// names are interned on first use, keyed by their handle. if the name table cannot grow, the
+	// name is written out in full instead.
+	Name* const entry = label == nullptr ? FindName(name) : nullptr;
+	bool const intern = entry != nullptr && (entry->flags & kNameInterned) == 0;
+	if (entry != nullptr)
+		entry->flags |= kNameInterned;
+
+	std::int64_t const start = ToNanoseconds(begin);
+	std::int64_t const finish = ToNanoseconds(end);
+
+	Reserve(kMaxEventSize);
+
+	std::size_t packet = BeginPacket(entry != nullptr ? std::uint32_t(kNeedsIncrementalState) : 0);
+	PutTag(kPacketTimestamp, kWireVarint);
+	PutVarint(start > 0 ? static_cast<std::uint64_t>(start) : 0);
+	if (intern)
+	{
+		std::size_t const interned = BeginMessage(kPacketInternedData);
+		std::size_t const eventName = BeginMessage(kInternedEventNames);
+		PutTag(kEventNameIid, kWireVarint);
+		PutVarint(name);
+		PutProtoName(kEventNameName, name);
+		EndMessage(eventName);
+		EndMessage(interned);
+	}
+	std::size_t event = BeginMessage(kPacketTrackEvent);
+	PutTag(kTrackEventType, kWireVarint);
+	PutVarint(kSliceBegin);
+	PutTag(kTrackEventTrackUuid, kWireVarint);
+	PutVarint(track);
+	if (entry != nullptr)
+	{
+		PutTag(kTrackEventNameIid, kWireVarint);
+		PutVarint(name);
+	}
+	else if (label != nullptr)
+		PutProtoString(kTrackEventName, label, labelLength);
+	else
+		PutProtoName(kTrackEventName, name);
+	EndMessage(event);
+	EndMessage(packet);
+
+	packet = BeginPacket(0);
+	PutTag(kPacketTimestamp, kWireVarint);
+	PutVarint(finish > 0 ? static_cast<std::uint64_t>(finish) : 0);
+	event = BeginMessage(kPacketTrackEvent);
+	PutTag(kTrackEventType, kWireVarint);
+	PutVarint(kSliceEnd);
+	PutTag(kTrackEventTrackUuid, kWireVarint);
+	PutVarint(track);
+	EndMessage(event);
+	EndMessage(packet);
+}
+
+void TraceExporter::WriteCounterTrack(ysStringHandle name)
+{
+	Reserve(kMaxEventSize);
+
+	std::size_t const packet = BeginPacket(0);
+	std::size_t const track = BeginMessage(kPacketTrackDescriptor);
+	PutTag(kTrackUuid, kWireVarint);
+	PutVarint(CounterTrack(name));
+	PutTag(kTrackParentUuid, kWireVarint);
+	PutVarint(kProcessTrack);
+	PutProtoName(kTrackName, name);
+	EndMessage(BeginMessage(kTrackCounter));
+	EndMessage(track);
+	EndMessage(packet);
+}
+
+void TraceExporter::WriteCounter(ysStringHandle name, ysTime when, double value)
+{
+	std::int64_t const time = ToNanoseconds(when);
+
+	if (_format == ysExportFormat::ChromeJson)
+	{
+		Reserve(kMaxEventSize);
+		PutJsonEvent('C', kPid, 0);
+		Put(",\"name\":", 8);
+		PutJsonName(name);
+		Put(",\"ts\":", 6);
+		PutMicroseconds(time);
+		Put(",\"args\":{\"value\":", 17);
+		PutDouble(value);
+		Put("}}", 2);
+		return;
+	}
+
+	// if the name table cannot grow the track is described again, which is harmless
+	Name* const entry = FindName(name);
+	if (entry == nullptr || (entry->flags & kCounterTrack) == 0)
+	{
+		WriteCounterTrack(name);
+		if (entry != nullptr)
+			entry->flags |= kCounterTrack;
+	}
+
+	Reserve(kMaxEventSize);
+
+	std::size_t const packet = BeginPacket(0);
+	PutTag(kPacketTimestamp, kWireVarint);
+	PutVarint(time > 0 ? static_cast<std::uint64_t>(time) : 0);
+	std::size_t const event = BeginMessage(kPacketTrackEvent);
+	PutTag(kTrackEventType, kWireVarint);
+	PutVarint(kCounter);
+	PutTag(kTrackEventTrackUuid, kWireVarint);
+	PutVarint(CounterTrack(name));
+	PutFixed64(kTrackEventDoubleCounterValue, value);
+	EndMessage(event);
+	EndMessage(packet);
+}
+
+void TraceExporter::WriteCounters(ysTime when)
+{
+	for (ysStringHandle const id : _pending)
+	{
+		Name* const name = FindName(id);
+		WriteCounter(id, when, name->amount);
+		name->flags &= ~kCounterPending;
+	}
+	_pending.Clear();
+}
@@ -0,0 +1,157 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Array.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace _ys_ {
+
+/// Streams events into Chrome's JSON trace event format or Perfetto's protobuf trace format.
+/// Each thread gets its own track, ticks become slices on a frames track, and counters get a
+/// track each. Counter increments are summed over each frame, as the web tool does. Threads of
+/// files merged from several processes are grouped under a track per process.
+/// Output is written in large chunks, and memory only grows with the number of distinct names.
+class TraceExporter
+{
+public:
+	/// Looks up the contents of a string handle, returning nullptr if it is unknown.
+	using Resolver = char const* (*)(void* userData, ysStringHandle id, std::uint32_t& out_length);
+
+private:
+	static constexpr std::size_t kBufferSize = 1 << 20;
+	// enough for any single event, including escaped names
+	static constexpr std::size_t kMaxNameLength = 65535;
+	static constexpr std::size_t kMaxEventSize = 1024 + 6 * kMaxNameLength;
+	static constexpr std::size_t kInitialNames = 1024;
+
+	enum NameFlags : std::uint32_t
+	{
+		kNameInterned = 1 << 0,
+		kCounterTrack = 1 << 1,
+		kCounterPending = 1 << 2,
+	};
+
+	struct Name
+	{
+		ysStringHandle id;
+		std::uint32_t flags;
+		double amount;
+	};
+
+	struct Process
+	{
+		ysStringHandle name;
+		std::uint16_t firstThread;
+		std::uint16_t threads;
+		bool written;
+	};
+
+	ysAllocator _allocator = nullptr;
+	ysExportFormat _format = ysExportFormat::ChromeJson;
+	std::FILE* _file = nullptr;
+	bool _failed = false;
+
+	char* _buffer = nullptr;
+	std::size_t _used = 0;
+
+	Resolver _resolver = nullptr;
+	void* _resolverData = nullptr;
+
+	bool _begun = false;
+	bool _first = true;
+	ysTime _frequency = 0;
+	ysTime _start = 0;
+
+	bool _inFrame = false;
+	ysTime _frameStart = 0;
+	std::uint64_t _frame = 0;
+
+	// open addressing on the string handle, grown to stay at most half full
+	Array<Name> _names;
+	std::size_t _nameCount = 0;
+	Array<ysStringHandle> _pending;
+
+	std::uint32_t _threads[65536 / 32] = {};
+	Array<Process> _processes;
+
+	Name* FindName(ysStringHandle id);
+	bool GrowNames();
+
+	std::int64_t ToNanoseconds(ysTime when) const;
+	char const* Resolve(ysStringHandle id, char (&fallback)[10], std::size_t& out_length) const;
+
+	void Flush();
+	void Reserve(std::size_t bytes) { if (bytes > kBufferSize - _used) Flush(); }
+	void Put(char c) { _buffer[_used++] = c; }
+	void Put(char const* str, std::size_t length);
+	void Put(char const* str) { Put(str, std::strlen(str)); }
+	void PutDecimal(std::uint64_t value);
+	void PutDouble(double value);
+	void PutMicroseconds(std::int64_t nanoseconds);
+	void PutJsonString(char const* str, std::size_t length);
+	void PutJsonName(ysStringHandle id);
+	void PutJsonEvent(char phase, std::uint32_t pid, std::uint16_t thread);
+	void PutVarint(std::uint64_t value);
+	void PutTag(std::uint32_t field, std::uint32_t wireType) { PutVarint((field << 3) | wireType); }
+	void PutProtoString(std::uint32_t field, char const* str, std::size_t length);
+	void PutProtoName(std::uint32_t field, ysStringHandle id);
+	std::size_t BeginMessage(std::uint32_t field);
+	void EndMessage(std::size_t start);
+	void PutFixed64(std::uint32_t field, double value);
+	std::size_t BeginPacket(std::uint32_t sequenceFlags);
+
+	void WritePreamble();
+	std::size_t FindProcess(std::uint16_t thread) const;
+	std::uint32_t GetPid(std::uint16_t thread) const;
+	void WriteProcess(std::size_t index);
+	void WriteThread(std::uint16_t thread);
+	void WriteSlice(std::uint16_t thread, ysStringHandle name, ysTime begin, ysTime end);
+	void WriteFrame(ysTime begin, ysTime end);
+	void WriteCounter(ysStringHandle name, ysTime when, double value);
+	void WriteCounters(ysTime when);
+	void WriteCounterTrack(ysStringHandle name);
+	void WriteProtoSlice(std::uint64_t track, ysTime begin, ysTime end, ysStringHandle name, char const* label, std::size_t labelLength);
+
+public:
+	TraceExporter() = default;
+	~TraceExporter() { Close(); }
+
+	TraceExporter(TraceExporter const&) = delete;
+	TraceExporter& operator=(TraceExporter const&) = delete;
+
+	ysResult Open(char const* path, ysExportFormat format, ysAllocator allocator);
+	void SetResolver(Resolver resolver, void* userData) { _resolver = resolver; _resolverData = userData; }
+
+	/// <summary> Groups a range of threads under a process track. Must be called before any events are written. </summary>
+	ysResult AddProcess(ysStringHandle name, std::uint16_t firstThread, std::uint16_t threads);
+
+	/// <summary> Exports an event. Events before the first Header event are ignored. </summary>
+	ysResult Write(ysEvent const& ev);
+
+	/// <summary> Finishes the file. </summary>
+	ysResult Close();
+};
+
+} // namespace _ys_
@@ -0,0 +1,193 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace _ys_ {
+
+// Layout of Yardstick trace files.
+//
+// A trace file is a TraceFileHeader followed by any number of blocks. Each block is a
+// TraceBlockHeader, a table of TraceBlockThread entries, and a payload of encoded events in the
+// same wire format used by the websocket protocol. Thread events inside the payload attribute the
+// events that follow them to a thread. Every block starts with no current thread, so blocks can be
+// decoded independently of one another, but String events only appear in the first block that
+// uses them.
+//
+// A finished capture is followed by an index, starting at an 8-byte aligned offset: a
+// TraceIndexHeader followed by arrays of TraceIndexBlock, tick timestamps, TraceIndexString,
+// TraceIndexSite and TraceIndexProcess entries, in that order. Strings and sites are sorted by
+// handle. The file ends with a TraceFileFooter locating the index. Files without a footer, such
+// as those cut short by a crash, can still be read by walking the blocks.
+//
+// Only files merged from several processes have TraceIndexProcess entries. Each gives a process
+// its own range of threads.
+//
+// A flight recorder file is a TraceRingHeader, an area holding every String event seen so far,
+// and a fixed number of equally sized slots that are reused in order. Each slot is a TraceRingSlot
+// followed by at most one block. A slot's sequence is cleared before the slot is reused and set
+// once its block is complete, so even after a crash every slot with a non-zero sequence holds a
+// whole block.
+//
+// Version 1 files have no realtime field in their TraceFileHeader, and are otherwise the same.
+//
+// All values are little-endian.
+
+static constexpr std::uint32_t kTraceFileMagic = 0x46545359; // 'YSTF'
+static constexpr std::uint32_t kTraceBlockMagic = 0x42545359; // 'YSTB'
+static constexpr std::uint32_t kTraceIndexMagic = 0x49545359; // 'YSTI'
+static constexpr std::uint32_t kTraceRingMagic = 0x52545359; // 'YSTR'
+static constexpr std::uint32_t kTraceVersion = 2;
+static constexpr std::uint32_t kTraceVersionNoRealtime = 1;
+
+struct TraceFileHeader
+{
+	std::uint32_t magic;
+	std::uint32_t version;
+	ysTime frequency;
+	ysTime start;
+	/// Wall clock time at start, in nanoseconds since the Unix epoch, or 0 if unknown.
+	std::int64_t realtime;
+};
+
+/// Size of the TraceFileHeader of version 1 files.
+static constexpr std::size_t kTraceFileHeaderSizeNoRealtime = 24;
+
+struct TraceBlockHeader
+{
+	std::uint32_t magic;
+	/// Bytes of encoded events following the thread table.
+	std::uint32_t size;
+	/// Number of events in the block, not counting Thread events.
+	std::uint32_t events;
+	/// Number of TraceBlockThread entries following the header.
+	std::uint16_t threads;
+	std::uint16_t reserved;
+	/// Earliest and latest timestamps of any event in the block.
+	ysTime begin;
+	ysTime end;
+	/// Number of ticks in the stream before this block, and within it.
+	std::uint64_t firstTick;
+	std::uint32_t ticks;
+	std::uint32_t reserved2;
+};
+
+struct TraceBlockThread
+{
+	std::uint16_t thread;
+	std::uint16_t reserved;
+	/// Number of events emitted by the thread within the block.
+	std::uint32_t events;
+};
+
+struct TraceIndexHeader
+{
+	std::uint32_t magic;
+	std::uint32_t processes;
+	std::uint64_t blocks;
+	std::uint64_t ticks;
+	std::uint32_t strings;
+	std::uint32_t sites;
+};
+
+struct TraceIndexBlock
+{
+	/// Offset of the TraceBlockHeader from the start of the file.
+	std::uint64_t offset;
+	ysTime begin;
+	ysTime end;
+	std::uint64_t firstTick;
+	std::uint32_t ticks;
+	std::uint32_t events;
+};
+
+struct TraceIndexString
+{
+	ysStringHandle id;
+	std::uint32_t length;
+	/// Offset of the string's bytes, within the String event that defined it, from the start of the file.
+	std::uint64_t offset;
+};
+
+struct TraceIndexSite
+{
+	ysSiteHandle id;
+	ysStringHandle name;
+	ysStringHandle file;
+	std::uint32_t line;
+};
+
+struct TraceIndexProcess
+{
+	ysStringHandle name;
+	std::uint16_t firstThread;
+	std::uint16_t threads;
+};
+
+struct TraceFileFooter
+{
+	std::uint64_t index;
+	std::uint32_t magic;
+	std::uint32_t version;
+};
+
+struct TraceRingHeader
+{
+	std::uint32_t magic;
+	std::uint32_t version;
+	ysTime frequency;
+	ysTime start;
+	std::int64_t realtime;
+	/// Offsets of the string area and the first slot from the start of the file.
+	std::uint64_t strings;
+	std::uint64_t slots;
+	/// Size of the string area, and the bytes of it holding String events.
+	std::uint32_t stringsCapacity;
+	std::uint32_t stringsUsed;
+	std::uint32_t slotSize;
+	std::uint32_t slotCount;
+};
+
+struct TraceRingSlot
+{
+	/// Order in which the slot's block was written, starting at 1, or 0 if the slot holds no block.
+	std::uint64_t sequence;
+	/// Offset of the block from the start of the slot, and its size.
+	std::uint32_t offset;
+	std::uint32_t size;
+};
+
+static_assert(sizeof(TraceFileHeader) == 32, "TraceFileHeader must not contain padding");
+static_assert(sizeof(TraceBlockHeader) == 48, "TraceBlockHeader must not contain padding");
+static_assert(sizeof(TraceBlockThread) == 8, "TraceBlockThread must not contain padding");
+static_assert(sizeof(TraceIndexHeader) == 32, "TraceIndexHeader must not contain padding");
+static_assert(sizeof(TraceIndexBlock) == 40, "TraceIndexBlock must not contain padding");
+static_assert(sizeof(TraceIndexString) == 16, "TraceIndexString must not contain padding");
+static_assert(sizeof(TraceIndexSite) == 16, "TraceIndexSite must not contain padding");
+static_assert(sizeof(TraceIndexProcess) == 8, "TraceIndexProcess must not contain padding");
+static_assert(sizeof(TraceFileFooter) == 16, "TraceFileFooter must not contain padding");
+static_assert(sizeof(TraceRingHeader) == 64, "TraceRingHeader must not contain padding");
+static_assert(sizeof(TraceRingSlot) == 16, "TraceRingSlot must not contain padding");
+
+} // namespace _ys_
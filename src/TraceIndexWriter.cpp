@@ -0,0 +1,245 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "TraceIndexWriter.h"
+#include "Protocol.h"
+
+#include <algorithm>
+
+using namespace _ys_;
+
+namespace {
+
+// type, id, and size precede the bytes of a String event
+constexpr std::size_t kStringEventPrefix = 1 + sizeof(ysStringHandle) + sizeof(std::uint16_t);
+
+template <typename T>
+bool WriteArray(std::FILE* file, T const* data, std::size_t count)
+{
+	return count == 0 || std::fwrite(data, sizeof(T), count, file) == count;
+}
+
+} // anonymous namespace
+
+void TraceIndexWriter::Initialize(ysAllocator allocator)
+{
+	_allocator = allocator;
+	_blocks.Initialize(allocator);
+	_ticks.Initialize(allocator);
+	_strings.Initialize(allocator);
+	_pending.Initialize(allocator);
+	_processes.Initialize(allocator);
+	_sites.Initialize(allocator);
+	_siteCount = 0;
+	_failed = false;
+}
+
+void TraceIndexWriter::Reset()
+{
+	_blocks.Reset();
+	_ticks.Reset();
+	_strings.Reset();
+	_pending.Reset();
+	_processes.Reset();
+	_sites.Reset();
+	_siteCount = 0;
+	_failed = false;
+}
+
+bool TraceIndexWriter::AddSite(Site const& site)
+{
+	if ((_siteCount + 1) * 2 > _sites.Size())
+	{
+		Array<TraceIndexSite> previous;
+		previous.Swap(_sites);
+		_sites.Initialize(_allocator);
+		if (!_sites.Resize(previous.Empty() ? 256 : previous.Size() * 2))
+			return false;
+
+		_siteCount = 0;
+		for (TraceIndexSite const& entry : previous)
+			if (entry.id != 0)
+				InsertSite(entry);
+	}
+
+	TraceIndexSite entry;
+	entry.id = site.id;
+	entry.name = site.nameId;
+	entry.file = site.fileId;
+	entry.line = site.line;
+	InsertSite(entry);
+	return true;
+}
+
+void TraceIndexWriter::InsertSite(TraceIndexSite const& site)
+{
+	std::size_t const mask = _sites.Size() - 1;
+	for (std::size_t slot = site.id & mask; ; slot = (slot + 1) & mask)
+	{
+		TraceIndexSite& entry = _sites[slot];
+		if (entry.id == site.id)
+			return;
+		if (entry.id == 0)
+		{
+			entry = site;
+			++_siteCount;
+			return;
+		}
+	}
+}
+
+void TraceIndexWriter::AddEvent(EventData const& ev, std::size_t position)
+{
+	if (_failed)
+		return;
+
+	bool added = true;
+
+	switch (ev.type)
+	{
+	case EventType::Tick:
+		added = _ticks.PushBack(ev.tick.when);
+		break;
+	case EventType::Region:
+		added = AddSite(*ev.region.site);
+		break;
+	case EventType::CounterSet:
+		added = AddSite(*ev.counter_set.site);
+		break;
+	case EventType::CounterAdd:
+		// increments decoded from a file no longer know their site
+		added = ev.counter_add.site == nullptr || AddSite(*ev.counter_add.site);
+		break;
+	case EventType::RegionSummary:
+		added = AddSite(*ev.region_summary.site);
+		break;
+	case EventType::Histogram:
+		added = AddSite(*ev.histogram.site);
+		break;
+	case EventType::Quantiles:
+		added = AddSite(*ev.quantiles.site);
+		break;
+	case EventType::Stall:
+		added = AddSite(*ev.stall.site);
+		break;
+	case EventType::String:
+	{
+		PendingString pending;
+		pending.id = ev.string.id;
+		pending.length = ev.string.size;
+		pending.position = position + kStringEventPrefix;
+		added = _pending.PushBack(pending);
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (!added)
+		_failed = true;
+}
+
+void TraceIndexWriter::AddBlock(std::uint64_t offset, TraceBlockHeader const& header)
+{
+	if (_failed)
+		return;
+
+	TraceIndexBlock block;
+	block.offset = offset;
+	block.begin = header.begin;
+	block.end = header.end;
+	block.firstTick = header.firstTick;
+	block.ticks = header.ticks;
+	block.events = header.events;
+	if (!_blocks.PushBack(block))
+	{
+		_failed = true;
+		return;
+	}
+
+	// string positions were relative to the payload, which follows the thread table
+	std::uint64_t const payload = offset + sizeof(TraceBlockHeader) + header.threads * sizeof(TraceBlockThread);
+	for (PendingString const& pending : _pending)
+	{
+		TraceIndexString entry;
+		entry.id = pending.id;
+		entry.length = pending.length;
+		entry.offset = payload + pending.position;
+		if (!_strings.PushBack(entry))
+		{
+			_failed = true;
+			return;
+		}
+	}
+	_pending.Clear();
+}
+
+void TraceIndexWriter::AddProcess(TraceIndexProcess const& process)
+{
+	if (!_failed && !_processes.PushBack(process))
+		_failed = true;
+}
+
+ysResult TraceIndexWriter::Write(std::FILE* file, std::uint64_t offset)
+{
+	if (_failed)
+		return ysResult::NoMemory;
+
+	static char const padding[8] = {};
+	std::size_t const pad = static_cast<std::size_t>((8 - offset % 8) % 8);
+	if (pad != 0 && std::fwrite(padding, 1, pad, file) != pad)
+		return ysResult::System;
+
+	// compact the site table in place before sorting it
+	std::size_t sites = 0;
+	for (TraceIndexSite const& entry : _sites)
+		if (entry.id != 0)
+			_sites[sites++] = entry;
+
+	std::sort(_strings.begin(), _strings.end(), [](TraceIndexString const& lhs, TraceIndexString const& rhs){ return lhs.id < rhs.id; });
+	std::sort(_sites.begin(), _sites.begin() + sites, [](TraceIndexSite const& lhs, TraceIndexSite const& rhs){ return lhs.id < rhs.id; });
+
+	TraceIndexHeader header;
+	header.magic = kTraceIndexMagic;
+	header.processes = static_cast<std::uint32_t>(_processes.Size());
+	header.blocks = _blocks.Size();
+	header.ticks = _ticks.Size();
+	header.strings = static_cast<std::uint32_t>(_strings.Size());
+	header.sites = static_cast<std::uint32_t>(sites);
+
+	TraceFileFooter footer;
+	footer.index = offset + pad;
+	footer.magic = kTraceIndexMagic;
+	footer.version = kTraceVersion;
+
+	if (!WriteArray(file, &header, 1) ||
+		!WriteArray(file, _blocks.Data(), _blocks.Size()) ||
+		!WriteArray(file, _ticks.Data(), _ticks.Size()) ||
+		!WriteArray(file, _strings.Data(), _strings.Size()) ||
+		!WriteArray(file, _sites.Data(), sites) ||
+		!WriteArray(file, _processes.Data(), _processes.Size()) ||
+		!WriteArray(file, &footer, 1))
+		return ysResult::System;
+
+	// the site table is no longer a valid hash table
+	_sites.Clear();
+	_siteCount = 0;
+
+	return ysResult::Success;
+}
@@ -0,0 +1,82 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/yardstick.h>
+
+#include "Array.h"
+#include "TraceFormat.h"
+
+#include <cstdio>
+
+namespace _ys_ {
+
+struct EventData;
+
+/// Collects the index of a trace file as its blocks are produced, and writes it at the end.
+/// Running out of memory only loses the index, so failures are remembered and reported by Write.
+class TraceIndexWriter
+{
+	struct PendingString
+	{
+		ysStringHandle id;
+		std::uint32_t length;
+		std::size_t position;
+	};
+
+	ysAllocator _allocator = nullptr;
+
+	Array<TraceIndexBlock> _blocks;
+	Array<ysTime> _ticks;
+	Array<TraceIndexString> _strings;
+	Array<PendingString> _pending;
+	Array<TraceIndexProcess> _processes;
+
+	// open addressing on the site handle, grown to stay at most half full. handle 0 marks an
+	// empty slot, so a site that happens to hash to 0 is left out of the index.
+	Array<TraceIndexSite> _sites;
+	std::size_t _siteCount = 0;
+
+	bool _failed = false;
+
+	bool AddSite(Site const& site);
+	void InsertSite(TraceIndexSite const& site);
+
+public:
+	void Initialize(ysAllocator allocator);
+	void Reset();
+
+	/// <summary> Records an event appended to the current block. </summary>
+	/// <param name="position"> Offset of the encoded event within the block's payload. </param>
+	void AddEvent(EventData const& ev, std::size_t position);
+
+	/// <summary> Records a finished block, which owns every event added since the previous block. </summary>
+	/// <param name="offset"> Offset of the block from the start of the file. </param>
+	void AddBlock(std::uint64_t offset, TraceBlockHeader const& header);
+
+	/// <summary> Records a process, for files merged from several processes. </summary>
+	void AddProcess(TraceIndexProcess const& process);
+
+	/// <summary> Writes the index and footer. </summary>
+	/// <param name="offset"> Offset of the end of the last block, where writing begins. </param>
+	ysResult Write(std::FILE* file, std::uint64_t offset);
+};
+
+} // namespace _ys_
@@ -0,0 +1,748 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "MappedFile.h"
+#include "TraceFormat.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+using namespace _ys_;
+
+namespace {
+
+// blocks are decoded in chunks of about this many bytes, which is small enough to balance well
+// across threads and large enough that merging partial results is cheap
+constexpr std::size_t kChunkBytes = 8 << 20;
+
+template <typename T>
+T Load(unsigned char const* data)
+{
+	T value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+// returns the number of bytes in the event, or 0 if it is malformed or truncated
+std::size_t DecodeEvent(unsigned char const* pos, unsigned char const* end, std::uint16_t& inout_thread, ysEvent& out_event)
+{
+	std::size_t const available = end - pos;
+
+	out_event.type = static_cast<ysEventType>(pos[0]);
+	out_event.thread = inout_thread;
+
+	switch (out_event.type)
+	{
+	case ysEventType::Tick:
+		if (available < 9)
+			return 0;
+		out_event.tick.when = Load<ysTime>(pos + 1);
+		return 9;
+	case ysEventType::Region:
+		if (available < 29)
+			return 0;
+		out_event.region.line = Load<std::uint32_t>(pos + 1);
+		out_event.region.name = Load<ysStringHandle>(pos + 5);
+		out_event.region.file = Load<ysStringHandle>(pos + 9);
+		out_event.region.begin = Load<ysTime>(pos + 13);
+		out_event.region.end = Load<ysTime>(pos + 21);
+		return 29;
+	case ysEventType::CounterSet:
+		if (available < 29)
+			return 0;
+		out_event.counter_set.line = Load<std::uint32_t>(pos + 1);
+		out_event.counter_set.name = Load<ysStringHandle>(pos + 5);
+		out_event.counter_set.file = Load<ysStringHandle>(pos + 9);
+		out_event.counter_set.when = Load<ysTime>(pos + 13);
+		out_event.counter_set.value = Load<double>(pos + 21);
+		return 29;
+	case ysEventType::String:
+		if (available < 7)
+			return 0;
+		out_event.string.id = Load<ysStringHandle>(pos + 1);
+		out_event.string.size = Load<std::uint16_t>(pos + 5);
+		out_event.string.str = reinterpret_cast<char const*>(pos + 7);
+		if (available - 7 < out_event.string.size)
+			return 0;
+		return 7 + out_event.string.size;
+	case ysEventType::CounterAdd:
+		if (available < 13)
+			return 0;
+		out_event.counter_add.name = Load<ysStringHandle>(pos + 1);
+		out_event.counter_add.amount = Load<double>(pos + 5);
+		return 13;
+	case ysEventType::Thread:
+		if (available < 3)
+			return 0;
+		inout_thread = Load<std::uint16_t>(pos + 1);
+		out_event.thread = inout_thread;
+		return 3;
+	case ysEventType::RegionSummary:
+		if (available < 57)
+			return 0;
+		out_event.region_summary.line = Load<std::uint32_t>(pos + 1);
+		out_event.region_summary.name = Load<ysStringHandle>(pos + 5);
+		out_event.region_summary.file = Load<ysStringHandle>(pos + 9);
+		out_event.region_summary.when = Load<ysTime>(pos + 13);
+		out_event.region_summary.count = Load<std::uint32_t>(pos + 21);
+		out_event.region_summary.total = Load<ysTime>(pos + 25);
+		out_event.region_summary.min = Load<ysTime>(pos + 33);
+		out_event.region_summary.max = Load<ysTime>(pos + 41);
+		out_event.region_summary.sumSquares = Load<double>(pos + 49);
+		return 57;
+	case ysEventType::Histogram:
+		if (available < 23)
+			return 0;
+		out_event.histogram.line = Load<std::uint32_t>(pos + 1);
+		out_event.histogram.name = Load<ysStringHandle>(pos + 5);
+		out_event.histogram.file = Load<ysStringHandle>(pos + 9);
+		out_event.histogram.when = Load<ysTime>(pos + 13);
+		out_event.histogram.buckets = Load<std::uint16_t>(pos + 21);
+		out_event.histogram.data = pos + 23;
+		if ((available - 23) / 6 < out_event.histogram.buckets)
+			return 0;
+		return 23 + 6 * std::size_t(out_event.histogram.buckets);
+	case ysEventType::Quantiles:
+		if (available < 22 + sizeof(ysQuantiles) * ysWindowCount)
+			return 0;
+		out_event.quantiles.line = Load<std::uint32_t>(pos + 1);
+		out_event.quantiles.name = Load<ysStringHandle>(pos + 5);
+		out_event.quantiles.file = Load<ysStringHandle>(pos + 9);
+		out_event.quantiles.when = Load<ysTime>(pos + 13);
+		out_event.quantiles.source = static_cast<ysEventType>(pos[21]);
+		out_event.quantiles.data = pos + 22;
+		return 22 + sizeof(ysQuantiles) * ysWindowCount;
+	case ysEventType::CallTree:
+		if (available < 11)
+			return 0;
+		out_event.call_tree.when = Load<ysTime>(pos + 1);
+		out_event.call_tree.nodes = Load<std::uint16_t>(pos + 9);
+		out_event.call_tree.data = pos + 11;
+		if ((available - 11) / 36 < out_event.call_tree.nodes)
+			return 0;
+		return 11 + 36 * std::size_t(out_event.call_tree.nodes);
+	case ysEventType::Samples:
+		if (available < 15)
+			return 0;
+		out_event.samples.when = Load<ysTime>(pos + 1);
+		out_event.samples.samples = Load<std::uint32_t>(pos + 9);
+		out_event.samples.nodes = Load<std::uint16_t>(pos + 13);
+		out_event.samples.data = pos + 15;
+		if ((available - 15) / 24 < out_event.samples.nodes)
+			return 0;
+		return 15 + 24 * std::size_t(out_event.samples.nodes);
+	case ysEventType::Stall:
+		if (available < 29)
+			return 0;
+		out_event.stall.line = Load<std::uint32_t>(pos + 1);
+		out_event.stall.name = Load<ysStringHandle>(pos + 5);
+		out_event.stall.file = Load<ysStringHandle>(pos + 9);
+		out_event.stall.since = Load<ysTime>(pos + 13);
+		out_event.stall.when = Load<ysTime>(pos + 21);
+		return 29;
+	default:
+		// headers never appear inside blocks
+		return 0;
+	}
+}
+
+} // anonymous namespace
+
+ysTraceCursor::ysTraceCursor(ysTraceReader const& reader, std::size_t first, std::size_t last) : _reader(&reader), _block(first), _last(last)
+{
+	if (_last > reader._blocks.size())
+		_last = reader._blocks.size();
+
+	if (_block < _last)
+		EnterBlock();
+}
+
+void ysTraceCursor::EnterBlock()
+{
+	ysTraceBlock const& block = _reader->_blocks[_block];
+	unsigned char const* const start = _reader->_data + block.offset;
+
+	// the reader validated every block header when it was opened
+	TraceBlockHeader const header = Load<TraceBlockHeader>(start);
+	_pos = start + sizeof(TraceBlockHeader) + header.threads * sizeof(TraceBlockThread);
+	_end = _pos + header.size;
+	_thread = 0;
+}
+
+bool ysTraceCursor::Next(ysEvent& out_event)
+{
+	for (;;)
+	{
+		if (_failed || _block >= _last)
+			return false;
+
+		if (_pos == _end)
+		{
+			if (++_block == _last)
+				return false;
+			EnterBlock();
+			continue;
+		}
+
+		std::size_t const length = DecodeEvent(_pos, _end, _thread, out_event);
+		if (length == 0)
+		{
+			_failed = true;
+			return false;
+		}
+		_pos += length;
+
+		if (out_event.type != ysEventType::Thread)
+			return true;
+	}
+}
+
+ysResult ysTraceReader::Open(char const* path)
+{
+	if (path == nullptr)
+		return ysResult::InvalidParameter;
+
+	Close();
+
+	YS_TRY(Map(path));
+
+	if (_size < sizeof(TraceFileHeader))
+	{
+		Close();
+		return ysResult::InvalidParameter;
+	}
+
+	// flight recorder rings can be read in place, which matters after a crash
+	ysResult result;
+	TraceFileHeader header = Load<TraceFileHeader>(_data);
+	if (header.magic == kTraceRingMagic)
+	{
+		result = ReadRing();
+	}
+	else if (header.magic == kTraceFileMagic && (header.version == kTraceVersion || header.version == kTraceVersionNoRealtime))
+	{
+		_version = header.version;
+		_headerSize = sizeof(TraceFileHeader);
+		if (header.version == kTraceVersionNoRealtime)
+		{
+			_headerSize = kTraceFileHeaderSizeNoRealtime;
+			header.realtime = 0;
+		}
+
+		_frequency = header.frequency;
+		_start = header.start;
+		_realtime = header.realtime;
+
+		result = ReadIndex();
+		if (result != ysResult::Success)
+			result = ScanBlocks();
+	}
+	else
+	{
+		result = ysResult::InvalidParameter;
+	}
+
+	if (result != ysResult::Success)
+	{
+		Close();
+		return result;
+	}
+
+	BuildSearch();
+	return ysResult::Success;
+}
+
+void ysTraceReader::Close()
+{
+	MappedFile::Unmap(const_cast<unsigned char*>(_data), _size);
+
+	_data = nullptr;
+	_size = 0;
+	_frequency = 0;
+	_start = 0;
+	_realtime = 0;
+	_version = 0;
+	_headerSize = 0;
+	_indexed = false;
+	_blocks.clear();
+	_maxEnd.clear();
+	_minBegin.clear();
+	_ticks = nullptr;
+	_tickCount = 0;
+	_ownedTicks.clear();
+	_strings.clear();
+	_sites.clear();
+	_processes.clear();
+}
+
+ysResult ysTraceReader::Map(char const* path)
+{
+	MappedFile file;
+	YS_TRY(file.Open(path));
+
+	// the reader unmaps the file itself when closed
+	_data = file.GetData();
+	_size = file.GetSize();
+	file.Release();
+
+	return ysResult::Success;
+}
+
+ysResult ysTraceReader::ReadIndex()
+{
+	if (_size < _headerSize + sizeof(TraceFileFooter))
+		return ysResult::InvalidParameter;
+
+	TraceFileFooter const footer = Load<TraceFileFooter>(_data + _size - sizeof(TraceFileFooter));
+	if (footer.magic != kTraceIndexMagic || footer.version != _version)
+		return ysResult::InvalidParameter;
+
+	std::uint64_t const limit = _size - sizeof(TraceFileFooter);
+	if (footer.index % 8 != 0 || footer.index > limit || limit - footer.index < sizeof(TraceIndexHeader))
+		return ysResult::InvalidParameter;
+
+	TraceIndexHeader const header = Load<TraceIndexHeader>(_data + footer.index);
+	if (header.magic != kTraceIndexMagic)
+		return ysResult::InvalidParameter;
+
+	std::uint64_t const blocksOffset = footer.index + sizeof(TraceIndexHeader);
+	std::uint64_t const ticksOffset = blocksOffset + header.blocks * sizeof(TraceIndexBlock);
+	std::uint64_t const stringsOffset = ticksOffset + header.ticks * sizeof(ysTime);
+	std::uint64_t const sitesOffset = stringsOffset + header.strings * sizeof(TraceIndexString);
+	std::uint64_t const processesOffset = sitesOffset + header.sites * sizeof(TraceIndexSite);
+	std::uint64_t const endOffset = processesOffset + header.processes * sizeof(TraceIndexProcess);
+	if (header.blocks > limit || header.ticks > limit || endOffset != limit)
+		return ysResult::InvalidParameter;
+
+	_blocks.resize(static_cast<std::size_t>(header.blocks));
+	for (std::size_t index = 0; index != _blocks.size(); ++index)
+	{
+		TraceIndexBlock const entry = Load<TraceIndexBlock>(_data + blocksOffset + index * sizeof(TraceIndexBlock));
+
+		// the cursor trusts block headers, so check them all up front
+		if (entry.offset > footer.index || footer.index - entry.offset < sizeof(TraceBlockHeader))
+			return ysResult::InvalidParameter;
+		TraceBlockHeader const block = Load<TraceBlockHeader>(_data + entry.offset);
+		if (block.magic != kTraceBlockMagic || footer.index - entry.offset < sizeof(TraceBlockHeader) + block.threads * sizeof(TraceBlockThread) + block.size)
+			return ysResult::InvalidParameter;
+
+		ysTraceBlock& out = _blocks[index];
+		out.offset = entry.offset;
+		out.begin = entry.begin;
+		out.end = entry.end;
+		out.firstTick = entry.firstTick;
+		out.ticks = entry.ticks;
+		out.events = entry.events;
+	}
+
+	// the index is 8-byte aligned, so the tick table can be used in place
+	_ticks = reinterpret_cast<ysTime const*>(_data + ticksOffset);
+	_tickCount = header.ticks;
+
+	_strings.resize(header.strings);
+	for (std::size_t index = 0; index != _strings.size(); ++index)
+	{
+		TraceIndexString const entry = Load<TraceIndexString>(_data + stringsOffset + index * sizeof(TraceIndexString));
+		if (entry.offset > _size || _size - entry.offset < entry.length)
+			return ysResult::InvalidParameter;
+
+		_strings[index].id = entry.id;
+		_strings[index].length = entry.length;
+		_strings[index].offset = entry.offset;
+	}
+
+	_sites.resize(header.sites);
+	for (std::size_t index = 0; index != _sites.size(); ++index)
+	{
+		TraceIndexSite const entry = Load<TraceIndexSite>(_data + sitesOffset + index * sizeof(TraceIndexSite));
+		_sites[index].id = entry.id;
+		_sites[index].name = entry.name;
+		_sites[index].file = entry.file;
+		_sites[index].line = entry.line;
+	}
+
+	_processes.resize(header.processes);
+	for (std::size_t index = 0; index != _processes.size(); ++index)
+	{
+		TraceIndexProcess const entry = Load<TraceIndexProcess>(_data + processesOffset + index * sizeof(TraceIndexProcess));
+		_processes[index].name = entry.name;
+		_processes[index].firstThread = entry.firstThread;
+		_processes[index].threads = entry.threads;
+	}
+
+	_indexed = true;
+	return ysResult::Success;
+}
+
+ysResult ysTraceReader::ScanBlock(std::uint64_t offset, std::uint64_t limit, std::uint64_t& out_end)
+{
+	if (offset > limit || limit - offset < sizeof(TraceBlockHeader))
+		return ysResult::InvalidParameter;
+
+	TraceBlockHeader const header = Load<TraceBlockHeader>(_data + offset);
+	if (header.magic != kTraceBlockMagic)
+		return ysResult::InvalidParameter;
+
+	// a capture cut short may end with a partially written block
+	std::uint64_t const payload = offset + sizeof(TraceBlockHeader) + header.threads * sizeof(TraceBlockThread);
+	if (payload > limit || limit - payload < header.size)
+		return ysResult::InvalidParameter;
+
+	std::size_t const ticks = _ownedTicks.size();
+	std::size_t const strings = _strings.size();
+	std::size_t const sites = _sites.size();
+
+	unsigned char const* pos = _data + payload;
+	unsigned char const* const end = pos + header.size;
+	std::uint16_t thread = 0;
+	ysEvent ev;
+	while (pos != end)
+	{
+		std::size_t const length = DecodeEvent(pos, end, thread, ev);
+		if (length == 0)
+		{
+			_ownedTicks.resize(ticks);
+			_strings.resize(strings);
+			_sites.resize(sites);
+			return ysResult::InvalidParameter;
+		}
+
+		if (ev.type == ysEventType::Tick)
+			_ownedTicks.push_back(ev.tick.when);
+		else if (ev.type == ysEventType::String)
+			_strings.push_back(StringEntry{ev.string.id, ev.string.size, static_cast<std::uint64_t>(pos + 7 - _data)});
+		else if (ev.type == ysEventType::Region)
+			_sites.push_back(ysTraceSite{hash_site(ev.region.name, ev.region.file, ev.region.line), ev.region.name, ev.region.file, ev.region.line});
+		else if (ev.type == ysEventType::CounterSet)
+			_sites.push_back(ysTraceSite{hash_site(ev.counter_set.name, ev.counter_set.file, ev.counter_set.line), ev.counter_set.name, ev.counter_set.file, ev.counter_set.line});
+		else if (ev.type == ysEventType::Histogram)
+			_sites.push_back(ysTraceSite{hash_site(ev.histogram.name, ev.histogram.file, ev.histogram.line), ev.histogram.name, ev.histogram.file, ev.histogram.line});
+		else if (ev.type == ysEventType::Stall)
+			_sites.push_back(ysTraceSite{hash_site(ev.stall.name, ev.stall.file, ev.stall.line), ev.stall.name, ev.stall.file, ev.stall.line});
+		else if (ev.type == ysEventType::Quantiles)
+			_sites.push_back(ysTraceSite{hash_site(ev.quantiles.name, ev.quantiles.file, ev.quantiles.line), ev.quantiles.name, ev.quantiles.file, ev.quantiles.line});
+		else if (ev.type == ysEventType::RegionSummary)
+			_sites.push_back(ysTraceSite{hash_site(ev.region_summary.name, ev.region_summary.file, ev.region_summary.line), ev.region_summary.name, ev.region_summary.file, ev.region_summary.line});
+
+		pos += length;
+	}
+
+	ysTraceBlock block;
+	block.offset = offset;
+	block.begin = header.begin;
+	block.end = header.end;
+	block.firstTick = header.firstTick;
+	block.ticks = header.ticks;
+	block.events = header.events;
+	_blocks.push_back(block);
+
+	out_end = payload + header.size;
+	return ysResult::Success;
+}
+
+void ysTraceReader::FinishScan()
+{
+	std::sort(_strings.begin(), _strings.end(), [](StringEntry const& lhs, StringEntry const& rhs){ return lhs.id < rhs.id; });
+	_strings.erase(std::unique(_strings.begin(), _strings.end(), [](StringEntry const& lhs, StringEntry const& rhs){ return lhs.id == rhs.id; }), _strings.end());
+
+	std::sort(_sites.begin(), _sites.end(), [](ysTraceSite const& lhs, ysTraceSite const& rhs){ return lhs.id < rhs.id; });
+	_sites.erase(std::unique(_sites.begin(), _sites.end(), [](ysTraceSite const& lhs, ysTraceSite const& rhs){ return lhs.id == rhs.id; }), _sites.end());
+
+	// the tick table only covers the ticks within the file, so count ticks from its first block
+	std::uint64_t const base = _blocks.empty() ? 0 : _blocks.front().firstTick;
+	for (ysTraceBlock& block : _blocks)
+		block.firstTick -= base;
+
+	_ticks = _ownedTicks.data();
+	_tickCount = _ownedTicks.size();
+	_indexed = false;
+}
+
+ysResult ysTraceReader::ScanBlocks()
+{
+	_blocks.clear();
+	_ownedTicks.clear();
+	_strings.clear();
+	_sites.clear();
+	_processes.clear();
+
+	std::uint64_t offset = _headerSize;
+	while (offset != _size)
+	{
+		std::uint64_t end;
+		if (ScanBlock(offset, _size, end) != ysResult::Success)
+			break;
+		offset = end;
+	}
+
+	FinishScan();
+	return ysResult::Success;
+}
+
+ysResult ysTraceReader::ReadRing()
+{
+	_blocks.clear();
+	_ownedTicks.clear();
+	_strings.clear();
+	_sites.clear();
+
+	if (_size < sizeof(TraceRingHeader))
+		return ysResult::InvalidParameter;
+
+	TraceRingHeader const header = Load<TraceRingHeader>(_data);
+	if (header.version != kTraceVersion || header.slotSize < sizeof(TraceRingSlot) ||
+		header.strings > _size || _size - header.strings < header.stringsUsed ||
+		header.slots > _size || (_size - header.slots) / header.slotSize < header.slotCount)
+		return ysResult::InvalidParameter;
+
+	_frequency = header.frequency;
+	_start = header.start;
+	_realtime = header.realtime;
+
+	unsigned char const* pos = _data + header.strings;
+	unsigned char const* const end = pos + header.stringsUsed;
+	std::uint16_t thread = 0;
+	ysEvent ev;
+	while (pos != end)
+	{
+		std::size_t const length = DecodeEvent(pos, end, thread, ev);
+		if (length == 0 || ev.type != ysEventType::String)
+			return ysResult::InvalidParameter;
+		_strings.push_back(StringEntry{ev.string.id, ev.string.size, static_cast<std::uint64_t>(pos + 7 - _data)});
+		pos += length;
+	}
+
+	// slots are reused in order, so sort the surviving blocks back into sequence
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> slots;
+	for (std::uint32_t index = 0; index != header.slotCount; ++index)
+	{
+		std::uint64_t const offset = header.slots + std::uint64_t(index) * header.slotSize;
+		TraceRingSlot const slot = Load<TraceRingSlot>(_data + offset);
+		if (slot.sequence != 0 && slot.offset >= sizeof(TraceRingSlot) && slot.offset <= header.slotSize && header.slotSize - slot.offset >= slot.size)
+			slots.push_back(std::make_pair(slot.sequence, offset + slot.offset));
+	}
+	std::sort(slots.begin(), slots.end());
+
+	for (auto const& slot : slots)
+	{
+		std::uint64_t const limit = slot.second - (slot.second - header.slots) % header.slotSize + header.slotSize;
+		std::uint64_t blockEnd;
+		YS_TRY(ScanBlock(slot.second, limit, blockEnd));
+	}
+
+	FinishScan();
+	return ysResult::Success;
+}
+
+void ysTraceReader::BuildSearch()
+{
+	std::size_t const count = _blocks.size();
+	_maxEnd.resize(count);
+	_minBegin.resize(count);
+
+	// blocks without timed events never match a time range
+	ysTime maxEnd = 0;
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		ysTraceBlock const& block = _blocks[index];
+		if (block.end > maxEnd)
+			maxEnd = block.end;
+		_maxEnd[index] = maxEnd;
+	}
+
+	ysTime minBegin = ~ysTime(0);
+	for (std::size_t index = count; index-- != 0;)
+	{
+		ysTraceBlock const& block = _blocks[index];
+		if ((block.begin != 0 || block.end != 0) && block.begin < minBegin)
+			minBegin = block.begin;
+		_minBegin[index] = minBegin;
+	}
+}
+
+ysTraceSite const* ysTraceReader::FindSite(ysSiteHandle id) const
+{
+	auto const it = std::lower_bound(_sites.begin(), _sites.end(), id, [](ysTraceSite const& site, ysSiteHandle value){ return site.id < value; });
+	if (it == _sites.end() || it->id != id)
+		return nullptr;
+	return &*it;
+}
+
+ysTraceProcess const* ysTraceReader::FindProcess(std::uint16_t thread) const
+{
+	for (ysTraceProcess const& process : _processes)
+	{
+		if (thread >= process.firstThread && thread - process.firstThread < process.threads)
+			return &process;
+	}
+	return nullptr;
+}
+
+std::uint32_t ysTraceReader::FindThreadLimit(std::size_t first, std::size_t last) const
+{
+	std::uint32_t limit = 1;
+	for (std::size_t index = first; index != last; ++index)
+	{
+		// the reader validated every block header when it was opened
+		unsigned char const* const start = _data + _blocks[index].offset;
+		TraceBlockHeader const header = Load<TraceBlockHeader>(start);
+		for (std::uint16_t entry = 0; entry != header.threads; ++entry)
+		{
+			TraceBlockThread const thread = Load<TraceBlockThread>(start + sizeof(TraceBlockHeader) + entry * sizeof(TraceBlockThread));
+			if (thread.thread >= limit)
+				limit = thread.thread + 1u;
+		}
+	}
+	return limit;
+}
+
+char const* ysTraceReader::FindString(ysStringHandle id, std::uint32_t& out_length) const
+{
+	auto const it = std::lower_bound(_strings.begin(), _strings.end(), id, [](StringEntry const& entry, ysStringHandle value){ return entry.id < value; });
+	if (it == _strings.end() || it->id != id)
+	{
+		out_length = 0;
+		return nullptr;
+	}
+
+	out_length = it->length;
+	return reinterpret_cast<char const*>(_data + it->offset);
+}
+
+char const* ysTraceReader::GetString(std::size_t index, ysStringHandle& out_id, std::uint32_t& out_length) const
+{
+	StringEntry const& entry = _strings[index];
+	out_id = entry.id;
+	out_length = entry.length;
+	return reinterpret_cast<char const*>(_data + entry.offset);
+}
+
+unsigned char const* ysTraceReader::GetBlockData(std::size_t index, std::size_t& out_size) const
+{
+	unsigned char const* const start = _data + _blocks[index].offset;
+	TraceBlockHeader const header = Load<TraceBlockHeader>(start);
+	out_size = header.size;
+	return start + sizeof(TraceBlockHeader) + header.threads * sizeof(TraceBlockThread);
+}
+
+void ysTraceReader::FindBlocks(ysTime begin, ysTime end, std::size_t& out_first, std::size_t& out_last) const
+{
+	// the first block that ends at or after the window begins, and the first block after which
+	// nothing begins before the window ends
+	out_first = std::lower_bound(_maxEnd.begin(), _maxEnd.end(), begin) - _maxEnd.begin();
+	out_last = std::upper_bound(_minBegin.begin(), _minBegin.end(), end) - _minBegin.begin();
+	if (out_last < out_first)
+		out_last = out_first;
+}
+
+std::size_t ysTraceReader::FindTickBlock(std::uint64_t tick) const
+{
+	auto const it = std::upper_bound(_blocks.begin(), _blocks.end(), tick, [](std::uint64_t value, ysTraceBlock const& block){ return value < block.firstTick + block.ticks; });
+	if (it == _blocks.end() || tick < it->firstTick)
+		return _blocks.size();
+	return it - _blocks.begin();
+}
+
+ysResult ysTraceReader::RunChunks(std::size_t first, std::size_t last, unsigned threads, std::size_t slots, ChunkDecoder const& decode, ChunkMerger const& merge) const
+{
+	if (last > _blocks.size())
+		last = _blocks.size();
+	if (first >= last)
+		return ysResult::Success;
+
+	// chunk boundaries depend only on the file, never on the number of threads, so that the
+	// merged result is always the same
+	std::vector<std::size_t> bounds(1, first);
+	std::size_t bytes = 0;
+	for (std::size_t index = first; index != last; ++index)
+	{
+		std::size_t size;
+		GetBlockData(index, size);
+		bytes += size;
+		if (bytes >= kChunkBytes)
+		{
+			bounds.push_back(index + 1);
+			bytes = 0;
+		}
+	}
+	if (bounds.back() != last)
+		bounds.push_back(last);
+
+	std::size_t const chunks = bounds.size() - 1;
+	if (threads > chunks)
+		threads = static_cast<unsigned>(chunks);
+
+	// a chunk may only start once the chunk that last used its slot has been merged
+	std::mutex lock;
+	std::condition_variable changed;
+	std::size_t next = 0;
+	std::size_t merged = 0;
+	std::vector<char> done(chunks, 0);
+	ysResult result = ysResult::Success;
+
+	auto const work = [&]() {
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;)
+		{
+			changed.wait(guard, [&]{ return result != ysResult::Success || next == chunks || next < merged + slots; });
+			if (result != ysResult::Success || next == chunks)
+				return;
+
+			std::size_t const chunk = next++;
+			guard.unlock();
+			ysResult const decoded = decode(chunk % slots, bounds[chunk], bounds[chunk + 1]);
+			guard.lock();
+
+			done[chunk] = 1;
+			if (decoded != ysResult::Success && result == ysResult::Success)
+				result = decoded;
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (unsigned index = 0; index != threads; ++index)
+		workers.emplace_back(work);
+
+	for (std::size_t chunk = 0; chunk != chunks; ++chunk)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&]{ return result != ysResult::Success || done[chunk] != 0; });
+		if (result != ysResult::Success)
+			break;
+		guard.unlock();
+
+		merge(chunk % slots);
+
+		guard.lock();
+		merged = chunk + 1;
+		changed.notify_all();
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	return result;
+}
@@ -0,0 +1,120 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+void ysDurationHistogram::Merge(ysDurationHistogram const& other)
+{
+	if (other._counts.size() > _counts.size())
+		_counts.resize(other._counts.size());
+
+	for (std::size_t index = 0; index != other._counts.size(); ++index)
+		_counts[index] += other._counts[index];
+	_count += other._count;
+}
+
+ysTime ysDurationHistogram::GetQuantile(double quantile) const
+{
+	if (_count == 0)
+		return 0;
+
+	if (quantile < 0)
+		quantile = 0;
+	if (quantile > 1)
+		quantile = 1;
+
+	// the rank of the wanted value, counting from 1
+	std::uint64_t rank = static_cast<std::uint64_t>(quantile * _count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > _count)
+		rank = _count;
+
+	std::uint64_t seen = 0;
+	for (std::size_t index = 0; index != _counts.size(); ++index)
+	{
+		seen += _counts[index];
+		if (seen >= rank)
+		{
+			ysTime const lowest = GetBucketLowest(index);
+			ysTime const next = GetBucketLowest(index + 1);
+			return next > lowest ? lowest + (next - lowest) / 2 : lowest;
+		}
+	}
+
+	return GetBucketLowest(_counts.size() - 1);
+}
+
+ysRegionStats::Site& ysRegionStats::FindSite(std::vector<Site>& sites, std::unordered_map<std::uint64_t, std::size_t>& lookup, Site const& like, std::uint16_t thread)
+{
+	// a site's statistics per thread are keyed by the site and the thread together
+	std::uint64_t const key = thread != 0 ? (std::uint64_t(like.id) << 16) | thread : like.id;
+	auto const it = lookup.find(key);
+	if (it != lookup.end())
+		return sites[it->second];
+
+	lookup.emplace(key, sites.size());
+
+	Site site;
+	site.id = like.id;
+	site.name = like.name;
+	site.file = like.file;
+	site.line = like.line;
+	site.thread = thread;
+	site.count = 0;
+	site.summarized = 0;
+	site.total = 0;
+	site.self = 0;
+	site.min = ~ysTime(0);
+	site.max = 0;
+	sites.push_back(std::move(site));
+	return sites.back();
+}
+
+ysRegionStats::Site& ysRegionStats::FindSite(ysSiteHandle id, ysStringHandle name, ysStringHandle file, std::uint32_t line)
+{
+	Site like;
+	like.id = id;
+	like.name = name;
+	like.file = file;
+	like.line = line;
+	return FindSite(_sites, _lookup, like, 0);
+}
+
+void ysRegionStats::MergeSite(Site& site, Site const& from)
+{
+	site.count += from.count;
+	site.summarized += from.summarized;
+	site.total += from.total;
+	site.self += from.self;
+	if (from.min < site.min)
+		site.min = from.min;
+	if (from.max > site.max)
+		site.max = from.max;
+	site.durations.Merge(from.durations);
+}
+
+void ysRegionStats::Merge(ysRegionStats const& other)
+{
+	for (Site const& from : other._sites)
+		MergeSite(FindSite(_sites, _lookup, from, 0), from);
+	for (Site const& from : other._threadSites)
+		MergeSite(FindSite(_threadSites, _threadLookup, from, from.thread), from);
+}
+
@@ -0,0 +1,337 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "BlockWriter.h"
+#include "Protocol.h"
+#include "StringTable.h"
+#include "TraceFormat.h"
+#include "TraceIndexWriter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+
+using namespace _ys_;
+
+namespace {
+
+constexpr std::size_t kBlockSize = 1 << 20;
+
+void* YS_CALL Allocate(void* block, std::size_t bytes)
+{
+	if (bytes == 0)
+	{
+		std::free(block);
+		return nullptr;
+	}
+	return std::malloc(bytes);
+}
+
+} // anonymous namespace
+
+struct ysTraceWriter::State
+{
+	std::FILE* file = nullptr;
+	char* buffer = nullptr;
+	BlockWriter block;
+	std::uint64_t offset = 0;
+	TraceIndexWriter index;
+	bool failed = false;
+
+	// decoded events no longer point at their sites, so a site is made up for each one seen
+	std::unordered_map<ysSiteHandle, Site> sites;
+	std::unordered_set<ysStringHandle> strings;
+
+	Site* FindSite(ysStringHandle name, ysStringHandle file, std::uint32_t line);
+	ysResult Append(EventData const& ev);
+	ysResult SubmitBlock();
+};
+
+Site* ysTraceWriter::State::FindSite(ysStringHandle name, ysStringHandle file, std::uint32_t line)
+{
+	ysSiteHandle const id = hash_site(name, file, line);
+	auto const inserted = sites.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple());
+
+	Site& site = inserted.first->second;
+	if (inserted.second)
+	{
+		site.name = nullptr;
+		site.file = nullptr;
+		site.line = line;
+		site.nameId = name;
+		site.fileId = file;
+		site.id = id;
+		site.flags = 0;
+		site.minimum = 0;
+		site.category = 0;
+		site.epoch = 0;
+		site.filter.store(kSiteEnabled, std::memory_order_relaxed);
+		site.minimumTicks = 0;
+		site.next = nullptr;
+	}
+	return &site;
+}
+
+ysResult ysTraceWriter::State::Append(EventData const& ev)
+{
+	if (failed)
+		return ysResult::System;
+
+	if (!block.Append(ev))
+	{
+		YS_TRY(SubmitBlock());
+		if (!block.Append(ev))
+			return ysResult::InvalidParameter;
+	}
+
+	index.AddEvent(ev, block.GetLastPosition());
+	return ysResult::Success;
+}
+
+ysResult ysTraceWriter::State::SubmitBlock()
+{
+	std::size_t size;
+	void const* const data = block.Finish(size);
+	if (std::fwrite(data, 1, size, file) != size)
+	{
+		failed = true;
+		return ysResult::System;
+	}
+
+	index.AddBlock(offset, block.GetHeader());
+	offset += size;
+
+	block.Begin(buffer, kBlockSize, block.GetNextTick());
+	return ysResult::Success;
+}
+
+ysResult ysTraceWriter::Open(char const* path, ysTime frequency, ysTime start, std::int64_t realtime)
+{
+	if (path == nullptr || frequency == 0)
+		return ysResult::InvalidParameter;
+
+	if (_state != nullptr)
+		return ysResult::AlreadyInitialized;
+
+	_state = new State;
+	_state->index.Initialize(&Allocate);
+
+	_state->buffer = static_cast<char*>(std::malloc(kBlockSize));
+	_state->file = std::fopen(path, "wb");
+	if (_state->buffer == nullptr || _state->file == nullptr)
+	{
+		ysResult const result = _state->buffer == nullptr ? ysResult::NoMemory : ysResult::System;
+		Close();
+		return result;
+	}
+
+	TraceFileHeader header;
+	header.magic = kTraceFileMagic;
+	header.version = kTraceVersion;
+	header.frequency = frequency;
+	header.start = start;
+	header.realtime = realtime;
+	if (std::fwrite(&header, sizeof(header), 1, _state->file) != 1)
+	{
+		Close();
+		return ysResult::System;
+	}
+
+	_state->offset = sizeof(header);
+	_state->block.Begin(_state->buffer, kBlockSize, 0);
+	return ysResult::Success;
+}
+
+ysResult ysTraceWriter::Write(ysEvent const& ev)
+{
+	if (_state == nullptr)
+		return ysResult::Uninitialized;
+
+	EventData data;
+	data.type = ev.type;
+	data.thread = ev.thread;
+
+	switch (ev.type)
+	{
+	case ysEventType::Tick:
+		data.tick.when = ev.tick.when;
+		break;
+	case ysEventType::Region:
+		data.region.site = _state->FindSite(ev.region.name, ev.region.file, ev.region.line);
+		data.region.name = ev.region.name;
+		data.region.begin = ev.region.begin;
+		data.region.end = ev.region.end;
+		break;
+	case ysEventType::CounterSet:
+		data.counter_set.site = _state->FindSite(ev.counter_set.name, ev.counter_set.file, ev.counter_set.line);
+		data.counter_set.name = ev.counter_set.name;
+		data.counter_set.when = ev.counter_set.when;
+		data.counter_set.value = ev.counter_set.value;
+		break;
+	case ysEventType::CounterAdd:
+		data.counter_add.site = nullptr;
+		data.counter_add.name = ev.counter_add.name;
+		data.counter_add.amount = ev.counter_add.amount;
+		break;
+	case ysEventType::RegionSummary:
+		data.region_summary.site = _state->FindSite(ev.region_summary.name, ev.region_summary.file, ev.region_summary.line);
+		data.region_summary.name = ev.region_summary.name;
+		data.region_summary.count = ev.region_summary.count;
+		data.region_summary.when = ev.region_summary.when;
+		data.region_summary.total = ev.region_summary.total;
+		data.region_summary.min = ev.region_summary.min;
+		data.region_summary.max = ev.region_summary.max;
+		data.region_summary.sumSquares = ev.region_summary.sumSquares;
+		break;
+	case ysEventType::Histogram:
+	{
+		std::uint32_t const size = ev.histogram.buckets * 6u;
+		data.histogram.site = _state->FindSite(ev.histogram.name, ev.histogram.file, ev.histogram.line);
+		data.histogram.when = ev.histogram.when;
+		data.histogram.buckets = ev.histogram.buckets;
+		data.histogram.data = CreatePayload(&Allocate, size);
+		if (data.histogram.data == nullptr)
+			return ysResult::NoMemory;
+		std::memcpy(data.histogram.data->GetData(), ev.histogram.data, size);
+
+		ysResult const result = _state->Append(data);
+		ReleasePayload(data.histogram.data);
+		return result;
+	}
+	case ysEventType::Quantiles:
+	{
+		std::uint32_t const size = sizeof(ysQuantiles) * ysWindowCount;
+		data.quantiles.site = _state->FindSite(ev.quantiles.name, ev.quantiles.file, ev.quantiles.line);
+		data.quantiles.name = ev.quantiles.name;
+		data.quantiles.source = ev.quantiles.source;
+		data.quantiles.when = ev.quantiles.when;
+		data.quantiles.data = CreatePayload(&Allocate, size);
+		if (data.quantiles.data == nullptr)
+			return ysResult::NoMemory;
+		std::memcpy(data.quantiles.data->GetData(), ev.quantiles.data, size);
+
+		ysResult const result = _state->Append(data);
+		ReleasePayload(data.quantiles.data);
+		return result;
+	}
+	case ysEventType::CallTree:
+	{
+		std::uint32_t const size = 36 * std::uint32_t(ev.call_tree.nodes);
+		data.call_tree.when = ev.call_tree.when;
+		data.call_tree.nodes = ev.call_tree.nodes;
+		data.call_tree.data = CreatePayload(&Allocate, size);
+		if (data.call_tree.data == nullptr)
+			return ysResult::NoMemory;
+		std::memcpy(data.call_tree.data->GetData(), ev.call_tree.data, size);
+
+		ysResult const result = _state->Append(data);
+		ReleasePayload(data.call_tree.data);
+		return result;
+	}
+	case ysEventType::Samples:
+	{
+		std::uint32_t const size = 24 * std::uint32_t(ev.samples.nodes);
+		data.samples.when = ev.samples.when;
+		data.samples.samples = ev.samples.samples;
+		data.samples.nodes = ev.samples.nodes;
+		data.samples.data = CreatePayload(&Allocate, size);
+		if (data.samples.data == nullptr)
+			return ysResult::NoMemory;
+		std::memcpy(data.samples.data->GetData(), ev.samples.data, size);
+
+		ysResult const result = _state->Append(data);
+		ReleasePayload(data.samples.data);
+		return result;
+	}
+	case ysEventType::Stall:
+		data.stall.site = _state->FindSite(ev.stall.name, ev.stall.file, ev.stall.line);
+		data.stall.name = ev.stall.name;
+		data.stall.since = ev.stall.since;
+		data.stall.when = ev.stall.when;
+		break;
+	case ysEventType::String:
+		if (!_state->strings.insert(ev.string.id).second)
+			return ysResult::Success;
+		data.string.id = ev.string.id;
+		data.string.size = ev.string.size;
+		data.string.str = ev.string.str;
+		break;
+	default:
+		return ysResult::Success;
+	}
+
+	return _state->Append(data);
+}
+
+ysResult ysTraceWriter::AddProcess(char const* name, std::uint16_t firstThread, std::uint16_t threads)
+{
+	if (_state == nullptr)
+		return ysResult::Uninitialized;
+
+	std::size_t const length = std::strlen(name);
+	if (length > UINT16_MAX)
+		return ysResult::InvalidParameter;
+
+	ysEvent ev;
+	ev.type = ysEventType::String;
+	ev.thread = 0;
+	ev.string.id = HashString(name, length);
+	ev.string.size = static_cast<std::uint16_t>(length);
+	ev.string.str = name;
+	YS_TRY(Write(ev));
+
+	TraceIndexProcess process;
+	process.name = ev.string.id;
+	process.firstThread = firstThread;
+	process.threads = threads;
+	_state->index.AddProcess(process);
+	return ysResult::Success;
+}
+
+ysResult ysTraceWriter::Close()
+{
+	if (_state == nullptr)
+		return ysResult::Success;
+
+	ysResult result = ysResult::Success;
+	if (_state->file != nullptr)
+	{
+		if (!_state->block.IsEmpty())
+			result = _state->SubmitBlock();
+
+		// without an index, readers fall back to walking the blocks
+		if (result == ysResult::Success && !_state->failed)
+			result = _state->index.Write(_state->file, _state->offset);
+
+		if (std::fclose(_state->file) != 0)
+			result = ysResult::System;
+	}
+	if (_state->failed)
+		result = ysResult::System;
+
+	_state->index.Reset();
+	std::free(_state->buffer);
+	delete _state;
+	_state = nullptr;
+
+	return result;
+}
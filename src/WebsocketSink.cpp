@@ -19,8 +19,9 @@
 
 #include "WebsocketSink.h"
 #include "Clock.h"
-#include "PointerHash.h"
+#include "GlobalState.h"
 #include "Protocol.h"
+#include "StringTable.h"
 #include <cstring>
 #include <new>
 
@@ -30,23 +31,34 @@
 
 using namespace _ys_;
 
-struct WebsocketSink::Session
+struct WebsocketSink::Block
 {
-	static constexpr std::size_t kBufSize = 4096;
-	static constexpr std::size_t kTableSize = 4096;
-	static constexpr std::size_t kTableBitMask = (kTableSize * 8) - 1;
+	// large enough for any single encoded event, including the longest string
+	static constexpr std::uint32_t kCapacity = 128 * 1024;
 
+	// note: no constructor or destructor is called for this struct!
+	Block* _next;
+	std::uint32_t _refs;
+	std::uint32_t _size;
+	// earliest timestamp of any event in the block
+	ysTime _begin;
+	char _data[kCapacity];
+};
+
+struct WebsocketSink::Session
+{
 	// note: no constructor or destructor is called for this struct!
 	Session* _prev;
 	Session* _next;
 	WebsocketSink* _sink;
 	WebbyConnection* _connection;
-	std::size_t _bufpos;
-	char* _buffer;
-	unsigned char* _table;
+
+	// next block to send from, referenced by the session, and how much of it is already sent
+	Block* _cursor;
+	std::uint32_t _offset;
 };
 
-WebsocketSink::WebsocketSink()
+WebsocketSink::WebsocketSink(StringTable const& strings) : _strings(strings)
 {
 #if defined(_WIN32)
 	WORD wsa_version = MAKEWORD(2, 2);
@@ -57,6 +69,8 @@ WebsocketSink::WebsocketSink()
 
 WebsocketSink::~WebsocketSink()
 {
+	Close();
+
 #if defined(_WIN32)
 	WSACleanup();
 #endif
@@ -89,11 +103,9 @@ void WebsocketSink::webby_connected(struct WebbyConnection* connection)
 	if (session == nullptr)
 		return;
 
-	EventData ev;
-	ev.type = EventType::Header;
-	ev.header.frequency = GetClockFrequency();
-	ev.header.start = ReadClock();
-	sink.WriteSessionEvent(session, ev);
+	// history is replayed at full speed, before the session joins the live stream
+	if (sink.SendPreamble(session) == ysResult::Success)
+		sink.FlushSession(session);
 }
 
 void WebsocketSink::webby_closed(struct WebbyConnection* connection)
@@ -104,45 +116,63 @@ void WebsocketSink::webby_closed(struct WebbyConnection* connection)
 
 int WebsocketSink::webby_frame(struct WebbyConnection* connection, const struct WebbyWsFrame* frame)
 {
-	WebsocketSink& sink = *static_cast<WebsocketSink*>(connection->user_data);
-	Session* session = sink.FindSession(connection);
+	// commands are short text frames; anything else is discarded by webby
+	if (frame->opcode != WEBBY_WS_OP_TEXT_FRAME)
+		return 0;
 
 	char buffer[1024];
-	auto const len = WebbyRead(connection, buffer, sizeof(buffer));
-	if (len >= 0)
+	int const length = frame->payload_length < int(sizeof(buffer)) ? frame->payload_length : int(sizeof(buffer)) - 1;
+
+	// WebbyRead blocks until it has read exactly the requested amount
+	if (WebbyRead(connection, buffer, length) != 0)
+		return 1;
+	buffer[length] = '\0';
+
+	WebsocketSink& sink = *static_cast<WebsocketSink*>(connection->user_data);
+	sink.HandleCommand(buffer);
+	return 0;
+}
+
+void WebsocketSink::HandleCommand(char const* command)
+{
+	static char const kEnable[] = "enable ";
+	static char const kDisable[] = "disable ";
+
+	if (std::strcmp(command, "dump") == 0)
+		GlobalState::RequestFlightRecorderDump();
+	else if (std::strncmp(command, kEnable, sizeof(kEnable) - 1) == 0)
 	{
-		// #FIXME: need a callback/command mechanism in Yardstick
+		char const* const category = command + sizeof(kEnable) - 1;
+		GlobalState::instance().SetCategoryEnabled(HashString(category, std::strlen(category)), true);
+	}
+	else if (std::strncmp(command, kDisable, sizeof(kDisable) - 1) == 0)
+	{
+		char const* const category = command + sizeof(kDisable) - 1;
+		GlobalState::instance().SetCategoryEnabled(HashString(category, std::strlen(category)), false);
 	}
-	return 0;
 }
 
 WebsocketSink::Session* WebsocketSink::CreateSession(WebbyConnection* connection)
 {
+	// new sessions start with the oldest retained history, or else at the live edge of the stream
+	Block* const block = _history != nullptr ? _history : _tail != nullptr ? _tail : AppendBlock();
+	if (block == nullptr)
+		return nullptr;
+
 	Session* session = (Session*)_allocator(nullptr, sizeof(Session));
 	if (session == nullptr)
 		return nullptr;
 
-	session->_next = _sessions;
 	session->_prev = nullptr;
+	session->_next = _sessions;
 	session->_sink = this;
 	session->_connection = connection;
-	session->_bufpos = 0;
-
-	session->_buffer = (char*)_allocator(nullptr, Session::kBufSize);
-	if (session->_buffer == nullptr)
-	{
-		DestroySession(session);
-		return nullptr;
-	}
-
-	session->_table = (unsigned char*)_allocator(nullptr, Session::kTableSize);
-	if (session->_table == nullptr)
-	{
-		DestroySession(session);
-		return nullptr;
-	}
-	std::memset(session->_table, 0, Session::kTableSize);
+	session->_cursor = block;
+	session->_offset = block == _history ? 0 : block->_size;
+	++block->_refs;
 
+	if (_sessions != nullptr)
+		_sessions->_prev = session;
 	_sessions = session;
 
 	return session;
@@ -158,6 +188,9 @@ WebsocketSink::Session* WebsocketSink::FindSession(WebbyConnection* connection)
 
 void WebsocketSink::DestroySession(Session* session)
 {
+	if (session == nullptr)
+		return;
+
 	if (session->_next != nullptr)
 		session->_next->_prev = session->_prev;
 	if (session->_prev != nullptr)
@@ -165,106 +198,200 @@ void WebsocketSink::DestroySession(Session* session)
 	if (_sessions == session)
 		_sessions = session->_next;
 
-	_allocator(session->_buffer, 0);
+	ReleaseBlock(session->_cursor);
 	_allocator(session, 0);
 }
 
-ysResult WebsocketSink::WriteSessionString(Session* session, char const* str)
+ysResult WebsocketSink::SendPreamble(Session* session)
 {
-	ysStringHandle const handle = hash_pointer(str);
-	std::uint32_t const index = handle & Session::kTableBitMask;
-	std::uint32_t const byteIndex = index >> 3;
-	std::uint32_t const bitMask = 1 << (index & 5);
+	// the preamble is everything a session needs to interpret the shared blocks: the clock
+	// header, then every string announced so far. strings announced later arrive in the blocks.
+	// sessions replaying history start their clock with the history.
+	Block* const scratch = static_cast<Block*>(_allocator(nullptr, sizeof(Block)));
+	if (scratch == nullptr)
+		return ysResult::NoMemory;
 
-	unsigned char& byte = session->_table[byteIndex];
+	std::size_t used = 0;
+	ysResult result = ysResult::Success;
 
-	if ((byte & bitMask) == 0)
-	{
-		EventData ev;
-		ev.type = EventType::String;
-		ev.string.id = handle;
-		ev.string.size = static_cast<std::uint16_t>(std::strlen(str));
-		ev.string.str = str;
+	EventData ev;
+	ev.type = EventType::Header;
+	ev.thread = 0;
+	ev.header.frequency = GetClockFrequency();
+	ev.header.start = ReadClock();
+	if (session->_offset == 0 && session->_cursor->_begin < ev.header.start)
+		ev.header.start = session->_cursor->_begin;
 
+	std::uint32_t const count = _strings.GetAnnouncedCount();
+	for (std::uint32_t index = 0; result == ysResult::Success; ++index)
+	{
 		std::size_t const size = EncodeSize(ev);
-		if (size > Session::kBufSize - session->_bufpos)
-			YS_TRY(FlushSession(session));
-
-		if (size <= Session::kBufSize - session->_bufpos)
+		if (size > Block::kCapacity - used)
 		{
-			std::size_t written;
-			YS_TRY(EncodeEvent(session->_buffer + session->_bufpos, Session::kBufSize - session->_bufpos, ev, written));
-			session->_bufpos += written;
+			WebbyBeginSocketFrame(session->_connection, WEBBY_WS_OP_BINARY_FRAME);
+			WebbyWrite(session->_connection, scratch->_data, used);
+			WebbyEndSocketFrame(session->_connection);
+			used = 0;
 		}
-		else
+
+		std::size_t written;
+		result = EncodeEvent(scratch->_data + used, Block::kCapacity - used, ev, written);
+		used += written;
+
+		while (index != count && !MakeStringEvent(_strings, _strings.GetAnnounced(index), ev))
+			++index;
+		if (index == count)
+			break;
+	}
+
+	if (used != 0)
+	{
+		WebbyBeginSocketFrame(session->_connection, WEBBY_WS_OP_BINARY_FRAME);
+		WebbyWrite(session->_connection, scratch->_data, used);
+		WebbyEndSocketFrame(session->_connection);
+	}
+
+	_allocator(scratch, 0);
+	return result;
+}
+
+ysResult WebsocketSink::FlushSession(Session* session)
+{
+	for (;;)
+	{
+		Block* const block = session->_cursor;
+
+		if (session->_offset < block->_size)
 		{
-			// #FIXME - we can optimize this at least a little
 			WebbyBeginSocketFrame(session->_connection, WEBBY_WS_OP_BINARY_FRAME);
-			WebbyPrintf(session->_connection, "\x05");
-			WebbyWrite(session->_connection, &handle, sizeof(handle));
-			WebbyWrite(session->_connection, &ev.string.size, sizeof(ev.string.size));
-			WebbyWrite(session->_connection, str, ev.string.size);
+			WebbyWrite(session->_connection, block->_data + session->_offset, block->_size - session->_offset);
 			WebbyEndSocketFrame(session->_connection);
+			session->_offset = block->_size;
 		}
 
-		byte |= bitMask;
+		// the last block may still grow, so the session stays on it
+		if (block->_next == nullptr)
+			break;
+
+		session->_cursor = block->_next;
+		session->_offset = 0;
+		++session->_cursor->_refs;
+		ReleaseBlock(block);
 	}
-	
+
 	return ysResult::Success;
 }
 
-ysResult WebsocketSink::WriteSessionEvent(Session* session, EventData const& ev)
+WebsocketSink::Block* WebsocketSink::AppendBlock()
 {
-	// flush any strings
-	switch (ev.type)
+	Block* const block = static_cast<Block*>(_allocator(nullptr, sizeof(Block)));
+	if (block == nullptr)
+		return nullptr;
+
+	// the sink holds a reference to the block it appends to
+	block->_next = nullptr;
+	block->_refs = 1;
+	block->_size = 0;
+	block->_begin = ~ysTime(0);
+
+	Block* const previous = _tail;
+	if (previous != nullptr)
+		previous->_next = block;
+	else
+		_head = block;
+	_tail = block;
+
+	if (previous != nullptr)
+		ReleaseBlock(previous);
+
+	// history holds a reference to its oldest block, and lets go of it once enough newer
+	// blocks have accumulated
+	if (_historyLimit != 0)
 	{
-	case EventType::Region:
-		YS_TRY(WriteSessionString(session, ev.counter_set.name));
-		YS_TRY(WriteSessionString(session, ev.counter_set.file));
-		break;
-	case EventType::CounterSet:
-		YS_TRY(WriteSessionString(session, ev.record.name));
-		YS_TRY(WriteSessionString(session, ev.record.file));
-		break;
-	case EventType::String:
-		// #FIXME - what do we even do here?
-		break;
-	case EventType::CounterAdd:
-		YS_TRY(WriteSessionString(session, ev.counter_add.name));
-		break;
-	default: break;
+		if (_history == nullptr)
+		{
+			_history = block;
+			++block->_refs;
+			_historyCount = 1;
+		}
+		else if (++_historyCount > _historyLimit)
+		{
+			Block* const oldest = _history;
+			_history = oldest->_next;
+			++_history->_refs;
+			--_historyCount;
+			ReleaseBlock(oldest);
+		}
 	}
 
-	std::size_t length = EncodeSize(ev);
-	if (length > Session::kBufSize - session->_bufpos)
-		YS_TRY(FlushSession(session));
+	return block;
+}
 
-	YS_TRY(EncodeEvent(session->_buffer + session->_bufpos, Session::kBufSize - session->_bufpos, ev, length));
-	session->_bufpos += length;
+void WebsocketSink::ReleaseBlock(Block* block)
+{
+	--block->_refs;
 
-	return ysResult::Success;
+	// blocks are only ever released in stream order, so anything unreferenced at the head
+	// can no longer be reached by any session
+	while (_head != nullptr && _head->_refs == 0)
+	{
+		Block* const next = _head->_next;
+		_allocator(_head, 0);
+		_head = next;
+	}
+
+	if (_head == nullptr)
+		_tail = nullptr;
 }
 
-ysResult WebsocketSink::FlushSession(Session* session)
+ysResult WebsocketSink::WriteEvent(EventData const& ev)
 {
-	if (session->_bufpos != 0)
+	std::size_t const size = EncodeSize(ev);
+	if (_tail == nullptr || size > Block::kCapacity - _tail->_size)
 	{
-		WebbyBeginSocketFrame(session->_connection, WEBBY_WS_OP_BINARY_FRAME);
-		WebbyWrite(session->_connection, session->_buffer, session->_bufpos);
-		WebbyEndSocketFrame(session->_connection);
-		session->_bufpos = 0;
+		if (AppendBlock() == nullptr)
+			return ysResult::NoMemory;
 	}
 
+	std::size_t written;
+	YS_TRY(EncodeEvent(_tail->_data + _tail->_size, Block::kCapacity - _tail->_size, ev, written));
+	_tail->_size += static_cast<std::uint32_t>(written);
+
+	ysTime when = _tail->_begin;
+	if (ev.type == EventType::Tick)
+		when = ev.tick.when;
+	else if (ev.type == EventType::Region)
+		when = ev.region.begin;
+	else if (ev.type == EventType::CounterSet)
+		when = ev.counter_set.when;
+	else if (ev.type == EventType::RegionSummary)
+		when = ev.region_summary.when;
+	else if (ev.type == EventType::Histogram)
+		when = ev.histogram.when;
+	else if (ev.type == EventType::Quantiles)
+		when = ev.quantiles.when;
+	else if (ev.type == EventType::CallTree)
+		when = ev.call_tree.when;
+	else if (ev.type == EventType::Samples)
+		when = ev.samples.when;
+	else if (ev.type == EventType::Stall)
+		when = ev.stall.when;
+	if (when < _tail->_begin)
+		_tail->_begin = when;
+
 	return ysResult::Success;
 }
 
-ysResult WebsocketSink::Listen(unsigned short port, ysAllocator allocator)
+ysResult WebsocketSink::Listen(unsigned short port, std::size_t history, ysAllocator allocator)
 {
 	Close();
 
 	_allocator = allocator;
 	_port = port;
 
+	// history is kept in whole blocks, rounding up
+	_historyLimit = static_cast<std::uint32_t>((history + Block::kCapacity - 1) / Block::kCapacity);
+
 	struct WebbyServerConfig config;
 	std::memset(&config, 0, sizeof(config));
 
@@ -309,12 +436,22 @@ ysResult WebsocketSink::Close()
 		_server = nullptr;
 	}
 
-	if (_allocator != nullptr)
+	if (_memory != nullptr)
 		_allocator(_memory, 0);
+	_memory = nullptr;
 
 	while (_sessions != nullptr)
 		DestroySession(_sessions);
 
+	if (_history != nullptr)
+		ReleaseBlock(_history);
+	_history = nullptr;
+	_historyCount = 0;
+
+	// with no sessions or history left, the sink's own reference is the only one remaining
+	if (_tail != nullptr)
+		ReleaseBlock(_tail);
+
 	return ysResult::Success;
 }
 
@@ -337,13 +474,22 @@ ysResult WebsocketSink::Flush()
 		FlushSession(session);
 
 	return ysResult::Success;
-
 }
 
-ysResult WebsocketSink::WriteEvent(EventData const& ev)
+ysResult WebsocketSink::Consume(EventData const* events, std::size_t count)
 {
-	for (Session* session = _sessions; session != nullptr; session = session->_next)
-		WriteSessionEvent(session, ev);
+	// nobody is watching and nothing is kept for later, so there is no point in encoding anything
+	if (_sessions == nullptr && _historyLimit == 0)
+		return ysResult::Success;
+
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		// sessions get their header as part of the preamble
+		if (events[index].type == EventType::Header)
+			continue;
+
+		YS_TRY(WriteEvent(events[index]));
+	}
 
 	return ysResult::Success;
 }
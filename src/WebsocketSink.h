@@ -21,16 +21,23 @@
 
 #include <yardstick/yardstick.h>
 
+#include "Sink.h"
 #include "webby/webby.h"
 
 namespace _ys_ {
 
 struct EventData;
+class StringTable;
 
-class WebsocketSink
+/// Streams events to connected web tools.
+/// Events are encoded once into a chain of shared blocks, and each session only tracks how far
+/// along that chain it has sent.
+class WebsocketSink : public Sink
 {
+	struct Block;
 	struct Session;
 
+	StringTable const& _strings;
 	ysAllocator _allocator = nullptr;
 	unsigned short _port = 0;
 
@@ -39,6 +46,15 @@ class WebsocketSink
 
 	Session* _sessions = nullptr;
 
+	// oldest block still referenced, and the block currently being appended to
+	Block* _head = nullptr;
+	Block* _tail = nullptr;
+
+	// oldest block replayed to new sessions, and the number of blocks from it to the tail
+	Block* _history = nullptr;
+	std::uint32_t _historyCount = 0;
+	std::uint32_t _historyLimit = 0;
+
 	static void webby_log(const char* text);
 	static int webby_dispatch(struct WebbyConnection *connection);
 	static int webby_connect(struct WebbyConnection *connection);
@@ -46,27 +62,31 @@ class WebsocketSink
 	static void webby_closed(struct WebbyConnection *connection);
 	static int webby_frame(struct WebbyConnection *connection, const struct WebbyWsFrame *frame);
 
+	void HandleCommand(char const* command);
+
 	Session* CreateSession(WebbyConnection* connection);
 	Session* FindSession(WebbyConnection* connection);
 	void DestroySession(Session* session);
 
-	ysResult WriteSessionString(Session* session, char const* str);
-	ysResult WriteSessionEvent(Session* session, EventData const& ev);
+	ysResult SendPreamble(Session* session);
 	ysResult FlushSession(Session* session);
 
-public:
-	WebsocketSink();
-	~WebsocketSink();
+	Block* AppendBlock();
+	void ReleaseBlock(Block* block);
+	ysResult WriteEvent(EventData const& ev);
 
-	WebsocketSink(WebsocketSink const&) = delete;
-	WebsocketSink& operator=(WebsocketSink const&) = delete;
+public:
+	explicit WebsocketSink(StringTable const& strings);
+	~WebsocketSink() override;
 
-	ysResult Listen(unsigned short port, ysAllocator alloc);
+	/// <summary> Starts listening for tool connections. </summary>
+	/// <param name="history"> Bytes of recent events to replay to each new connection. </param>
+	ysResult Listen(unsigned short port, std::size_t history, ysAllocator alloc);
 	ysResult Close();
-	
-	ysResult Update();
-	ysResult WriteEvent(EventData const& ev);
-	ysResult Flush();
+
+	ysResult Consume(EventData const* events, std::size_t count) override;
+	ysResult Flush() override;
+	ysResult Update() override;
 };
 
 }
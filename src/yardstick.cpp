@@ -3,6 +3,9 @@
 #include "GlobalState.h"
 #include "ThreadState.h"
 #include "Clock.h"
+#include "Histogram.h"
+
+#include <csignal>
 
 using namespace _ys_;
 
@@ -14,6 +17,11 @@ namespace
 		thrd.Enque(ev);
 		return ysResult::Success;
 	}
+
+	extern "C" void DumpSignalHandler(int)
+	{
+		GlobalState::RequestFlightRecorderDump();
+	}
 }
 
 YS_API ysResult YS_CALL _ys_::initialize(ysAllocator allocator)
@@ -26,36 +34,99 @@ YS_API ysResult YS_CALL _ys_::shutdown()
 	return GlobalState::instance().Shutdown();
 }
 
-YS_API ysResult YS_CALL _ys_::emit_record(ysTime when, double value, char const* name, char const* file, int line)
+YS_API ysStringHandle YS_CALL _ys_::intern_string(char const* str, std::size_t length)
+{
+	if (str == nullptr)
+		return 0;
+
+	ThreadState& thrd = ThreadState::thread_instance();
+	return thrd.InternString(str, length);
+}
+
+YS_API ysResult YS_CALL _ys_::emit_record(ysTime when, double value, Site& site, ysStringHandle name)
 {
+	if (GlobalState::instance().IsFiltered(site))
+		return ysResult::Success;
+
 	EventData ev;
 	ev.type = EventType::CounterSet;
-	ev.record.line = line;
-	ev.record.name = name;
-	ev.record.file = file;
-	ev.record.when = when;
-	ev.record.value = value;
+	ev.counter_set.site = &site;
+	ev.counter_set.name = name;
+	ev.counter_set.when = when;
+	ev.counter_set.value = value;
 	return EmitEvent(ev);
 }
 
-YS_API ysResult YS_CALL _ys_::emit_count(double amount, char const* name)
+YS_API ysResult YS_CALL _ys_::emit_count(double amount, Site& site, ysStringHandle name)
 {
+	GlobalState& gs = GlobalState::instance();
+	if (!gs.IsActive() || gs.IsFiltered(site))
+		return ysResult::Success;
+
+	if ((site.flags & kSitePerCpu) != 0 && gs.AddCpuCount(site, amount))
+		return ysResult::Success;
+
+	// increments are summed on this thread and delivered by the background thread. a counter
+	// that can't be given a slot is delivered one increment at a time.
+	ThreadState& thrd = ThreadState::thread_instance();
+	if (thrd.AddCount(site, name, amount))
+		return ysResult::Success;
+
 	EventData ev;
 	ev.type = EventType::CounterAdd;
+	ev.counter_add.site = &site;
 	ev.counter_add.name = name;
 	ev.counter_add.amount = amount;
 	return EmitEvent(ev);
 }
 
-YS_API ysResult YS_CALL _ys_::emit_region(ysTime startTime, ysTime endTime, char const* name, char const* file, int line)
+YS_API ysResult YS_CALL _ys_::emit_region(ysTime startTime, ysTime endTime, Site& site, ysStringHandle name)
 {
+	GlobalState& gs = GlobalState::instance();
+	ThreadState& thrd = ThreadState::thread_instance();
+	ysTime const duration = endTime > startTime ? endTime - startTime : 0;
+
+	// the region leaves the shadow stack whatever the current mode, so the stack stays balanced
+	// when the mode changes while regions are open
+	bool const inTree = thrd.EndRegion(site, name, duration);
+
+	// a region whose category was disabled while it was open is discarded
+	if (site.filter.load(std::memory_order_relaxed) == kSiteDisabled)
+		return ysResult::Success;
+
+	if ((site.flags & kSiteHistogram) != 0 && gs.IsActive())
+		thrd.RecordHistogram(site, duration);
+
+	if (gs.GetCaptureMode() == ysCaptureMode::Statistics)
+	{
+		if (!gs.IsActive())
+			return ysResult::Success;
+
+		// a site that can't be given an entry this frame is delivered as an ordinary region
+		if (thrd.RecordRegion(site, name, duration))
+			return ysResult::Success;
+	}
+
+	// a region without a node in the call tree is delivered as an ordinary region
+	if (inTree)
+		return ysResult::Success;
+
+	// as is a short region that can't be given an entry in this frame's statistics
+	if (gs.IsActive() && gs.IsShort(site, duration) && thrd.RecordRegion(site, name, duration))
+		return ysResult::Success;
+
+	// a region is held until its frame is judged, and one that can't be is summarized instead, so
+	// a frame with more regions than the buffer holds loses the detail of the rest
+	if (gs.GetCaptureMode() == ysCaptureMode::SlowFrames && gs.IsActive() &&
+		(thrd.HoldRegion(site, name, startTime, endTime) || thrd.RecordRegion(site, name, duration)))
+		return ysResult::Success;
+
 	EventData ev;
 	ev.type = EventType::Region;
-	ev.counter_set.line = line;
-	ev.counter_set.name = name;
-	ev.counter_set.file = file;
-	ev.counter_set.begin = startTime;
-	ev.counter_set.end = endTime;
+	ev.region.site = &site;
+	ev.region.name = name;
+	ev.region.begin = startTime;
+	ev.region.end = endTime;
 	return EmitEvent(ev);
 }
 
@@ -64,6 +135,21 @@ YS_API ysTime YS_CALL _ys_::read_clock()
 	return ReadClock();
 }
 
+YS_API ysTime YS_CALL _ys_::begin_region(Site& site, ysStringHandle name)
+{
+	GlobalState& gs = GlobalState::instance();
+
+	// the region is discarded when it ends
+	if (gs.IsFiltered(site))
+		return ReadClock();
+
+	bool const tree = gs.GetCaptureMode() == ysCaptureMode::CallTree;
+	if ((tree || gs.IsSampling()) && gs.IsActive())
+		return ThreadState::thread_instance().BeginRegion(site, name, tree);
+
+	return ReadClock();
+}
+
 YS_API ysResult YS_CALL _ys_::tick()
 {
 	EventData ev;
@@ -72,7 +158,149 @@ YS_API ysResult YS_CALL _ys_::tick()
 	return EmitEvent(ev);
 }
 
-YS_API ysResult YS_CALL _ys_::listen_web(unsigned short port)
+YS_API ysResult YS_CALL _ys_::listen_web(unsigned short port, std::size_t history)
+{
+	return GlobalState::instance().ListenWebsocket(port, history);
+}
+
+YS_API ysResult YS_CALL _ys_::start_capture(char const* path)
+{
+	return GlobalState::instance().StartCapture(path);
+}
+
+YS_API ysResult YS_CALL _ys_::stop_capture()
+{
+	return GlobalState::instance().StopCapture();
+}
+
+YS_API ysResult YS_CALL _ys_::start_export(char const* path, ysExportFormat format)
+{
+	return GlobalState::instance().StartExport(path, format);
+}
+
+YS_API ysResult YS_CALL _ys_::stop_export()
+{
+	return GlobalState::instance().StopExport();
+}
+
+YS_API ysResult YS_CALL _ys_::start_flight_recorder(char const* path, std::size_t bytes)
+{
+	return GlobalState::instance().StartFlightRecorder(path, bytes);
+}
+
+YS_API ysResult YS_CALL _ys_::stop_flight_recorder()
+{
+	return GlobalState::instance().StopFlightRecorder();
+}
+
+YS_API ysResult YS_CALL _ys_::dump_flight_recorder(char const* path)
+{
+	return GlobalState::instance().DumpFlightRecorder(path);
+}
+
+YS_API void YS_CALL _ys_::request_flight_recorder_dump()
+{
+	GlobalState::RequestFlightRecorderDump();
+}
+
+YS_API ysResult YS_CALL _ys_::dump_flight_recorder_on_signal(int signal)
+{
+	if (std::signal(signal, &DumpSignalHandler) == SIG_ERR)
+		return ysResult::System;
+	return ysResult::Success;
+}
+
+YS_API ysResult YS_CALL _ys_::add_callback_sink(ysEventCallback callback, void* userData)
+{
+	return GlobalState::instance().AddCallbackSink(callback, userData);
+}
+
+YS_API ysResult YS_CALL _ys_::remove_callback_sink(ysEventCallback callback, void* userData)
+{
+	return GlobalState::instance().RemoveCallbackSink(callback, userData);
+}
+
+YS_API ysResult YS_CALL _ys_::query_dropped_events(std::uint64_t* out_count)
+{
+	return GlobalState::instance().QueryDroppedEvents(out_count);
+}
+
+YS_API ysResult YS_CALL _ys_::query_string_collisions(std::uint64_t* out_count)
+{
+	return GlobalState::instance().QueryStringCollisions(out_count);
+}
+
+YS_API ysResult YS_CALL _ys_::set_capture_mode(ysCaptureMode mode)
+{
+	return GlobalState::instance().SetCaptureMode(mode);
+}
+
+YS_API ysResult YS_CALL _ys_::set_minimum_duration(std::uint64_t nanoseconds)
+{
+	return GlobalState::instance().SetMinimumDuration(nanoseconds);
+}
+
+YS_API ysResult YS_CALL _ys_::set_slow_frame_threshold(std::uint64_t nanoseconds, double percentile)
+{
+	return GlobalState::instance().SetSlowFrameThreshold(nanoseconds, percentile);
+}
+
+YS_API ysResult YS_CALL _ys_::set_category_enabled(char const* category, bool enabled)
+{
+	if (category == nullptr)
+		return ysResult::InvalidParameter;
+
+	return GlobalState::instance().SetCategoryEnabled(HashString(category, std::strlen(category)), enabled);
+}
+
+YS_API ysResult YS_CALL _ys_::query_histogram(ysStringHandle name, ysHistogram* out_histogram)
+{
+	return GlobalState::instance().QueryHistogram(name, out_histogram);
+}
+
+YS_API ysTime YS_CALL _ys_::histogram_quantile(ysHistogram const* histogram, double quantile)
+{
+	if (histogram == nullptr || histogram->count == 0)
+		return 0;
+
+	if (quantile < 0)
+		quantile = 0;
+	if (quantile > 1)
+		quantile = 1;
+
+	// the rank of the wanted value, counting from 1
+	std::uint64_t rank = static_cast<std::uint64_t>(quantile * histogram->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > histogram->count)
+		rank = histogram->count;
+
+	std::uint64_t seen = 0;
+	for (std::uint32_t index = 0; index != kHistogramBuckets; ++index)
+	{
+		seen += histogram->buckets[index];
+		if (seen >= rank)
+		{
+			ysTime const lowest = HistogramBucketLowest(index);
+			ysTime const next = index + 1 != kHistogramBuckets ? HistogramBucketLowest(index + 1) : lowest;
+			return next > lowest ? lowest + (next - lowest) / 2 : lowest;
+		}
+	}
+
+	return HistogramBucketLowest(kHistogramBuckets - 1);
+}
+
+YS_API ysResult YS_CALL _ys_::query_quantiles(ysStringHandle name, ysEventType source, ysWindow window, ysQuantiles* out_quantiles)
+{
+	return GlobalState::instance().QueryQuantiles(name, source, window, out_quantiles);
+}
+
+YS_API ysResult YS_CALL _ys_::start_sampling(std::uint32_t rate, std::uint32_t stallMilliseconds)
+{
+	return GlobalState::instance().StartSampling(rate, stallMilliseconds);
+}
+
+YS_API ysResult YS_CALL _ys_::stop_sampling()
 {
-	return GlobalState::instance().ListenWebsocket(port);
+	return GlobalState::instance().StopSampling();
 }
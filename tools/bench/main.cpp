@@ -0,0 +1,439 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename T>
+void Append(std::vector<unsigned char>& out, T const& value)
+{
+	unsigned char bytes[sizeof(value)];
+	std::memcpy(bytes, &value, sizeof(value));
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void AppendType(std::vector<unsigned char>& out, ysEventType type)
+{
+	out.push_back(static_cast<unsigned char>(type));
+}
+
+// a mix resembling a capture: mostly regions, switching between a few threads, with counters
+// and a tick now and then
+std::vector<unsigned char> MakeStream(std::size_t bytes)
+{
+	std::vector<unsigned char> out;
+	out.reserve(bytes + 64);
+
+	std::mt19937 random(1);
+	ysTime now = 1000;
+	std::uint16_t thread = 0;
+
+	AppendType(out, ysEventType::String);
+	Append(out, ysStringHandle(1));
+	Append(out, std::uint16_t(4));
+	out.insert(out.end(), {'w', 'o', 'r', 'k'});
+
+	while (out.size() < bytes)
+	{
+		std::uint32_t const roll = random() % 1000;
+		if (roll < 20)
+		{
+			thread = static_cast<std::uint16_t>(1 + random() % 8);
+			AppendType(out, ysEventType::Thread);
+			Append(out, thread);
+		}
+		else if (roll < 21)
+		{
+			AppendType(out, ysEventType::Tick);
+			Append(out, now);
+		}
+		else if (roll < 80)
+		{
+			AppendType(out, ysEventType::CounterAdd);
+			Append(out, ysStringHandle(2 + roll % 4));
+			Append(out, 1.0);
+		}
+		else if (roll < 90)
+		{
+			AppendType(out, ysEventType::CounterSet);
+			Append(out, std::uint32_t(10));
+			Append(out, ysStringHandle(6));
+			Append(out, ysStringHandle(7));
+			Append(out, now);
+			Append(out, double(roll));
+		}
+		else
+		{
+			ysTime const length = random() % 5000;
+			AppendType(out, ysEventType::Region);
+			Append(out, std::uint32_t(20 + roll % 16));
+			Append(out, ysStringHandle(1));
+			Append(out, ysStringHandle(7));
+			Append(out, now);
+			Append(out, now + length);
+		}
+		now += random() % 100;
+	}
+
+	return out;
+}
+
+struct SumVisitor : ysEventVisitor
+{
+	std::uint64_t regions = 0;
+	ysTime duration = 0;
+	double counters = 0;
+
+	void OnRegion(ysRegionEvent const& ev) { ++regions; duration += ev.end - ev.begin; }
+	void OnCounterAdd(ysCounterAddEvent const& ev) { counters += ev.amount; }
+	void OnCounterSet(ysCounterSetEvent const& ev) { counters += ev.value; }
+};
+
+template <typename Function>
+double Measure(char const* name, std::size_t bytes, int repeats, Function&& function)
+{
+	double best = 0;
+	for (int repeat = 0; repeat != repeats; ++repeat)
+	{
+		Clock::time_point const start = Clock::now();
+		function();
+		double const seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		double const rate = bytes / seconds / 1e9;
+		if (rate > best)
+			best = rate;
+	}
+
+	std::printf("%-24s %8.2f GB/s\n", name, best);
+	return best;
+}
+
+int BenchmarkDecode(std::vector<unsigned char> const& stream, int repeats)
+{
+	std::printf("decoding %.1f MB\n", stream.size() / 1e6);
+
+	std::uint64_t check = 0;
+
+	Measure("visitor", stream.size(), repeats, [&]{
+		ysEventDecoder decoder;
+		SumVisitor visitor;
+		decoder.Decode(stream.data(), stream.size(), visitor);
+		check += visitor.regions + visitor.duration;
+	});
+
+	// streams arrive in pieces over the network, so split events across calls too
+	Measure("visitor, 4KB pieces", stream.size(), repeats, [&]{
+		ysEventDecoder decoder;
+		SumVisitor visitor;
+		for (std::size_t offset = 0; offset < stream.size(); offset += 4093)
+			decoder.Decode(stream.data() + offset, std::min<std::size_t>(4093, stream.size() - offset), visitor);
+		check += visitor.regions + visitor.duration;
+	});
+
+	ysEventBatch batch;
+	Measure("batch, 1MB pieces", stream.size(), repeats, [&]{
+		ysEventDecoder decoder;
+		for (std::size_t offset = 0; offset < stream.size(); offset += 1 << 20)
+		{
+			batch.Clear();
+			decoder.Decode(stream.data() + offset, std::min<std::size_t>(1 << 20, stream.size() - offset), batch);
+			check += batch.regions.begin.size();
+		}
+	});
+
+	return check != 0 ? 0 : 1;
+}
+
+int BenchmarkFile(char const* path, int repeats)
+{
+	ysTraceReader reader;
+	if (reader.Open(path) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysbench: cannot read trace file '%s'\n", path);
+		return 1;
+	}
+
+	std::size_t bytes = 0;
+	for (std::size_t index = 0; index != reader.GetBlockCount(); ++index)
+	{
+		std::size_t size;
+		reader.GetBlockData(index, size);
+		bytes += size;
+	}
+	std::printf("decoding %.1f MB in %zu blocks\n", bytes / 1e6, reader.GetBlockCount());
+
+	std::uint64_t check = 0;
+
+	Measure("cursor", bytes, repeats, [&]{
+		ysTraceCursor cursor = reader.Read(0, reader.GetBlockCount());
+		ysEvent ev;
+		while (cursor.Next(ev))
+			check += ev.type == ysEventType::Region ? ev.region.end - ev.region.begin : 0;
+	});
+
+	Measure("visitor", bytes, repeats, [&]{
+		SumVisitor visitor;
+		reader.Decode(0, reader.GetBlockCount(), visitor);
+		check += visitor.duration;
+	});
+
+	return check != 0 ? 0 : 1;
+}
+
+// aggregates the file sequentially and then with increasing numbers of threads, checking that
+// every run agrees
+int BenchmarkStats(char const* path, int repeats)
+{
+	ysTraceReader reader;
+	if (reader.Open(path) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysbench: cannot read trace file '%s'\n", path);
+		return 1;
+	}
+
+	std::size_t bytes = 0;
+	for (std::size_t index = 0; index != reader.GetBlockCount(); ++index)
+	{
+		std::size_t size;
+		reader.GetBlockData(index, size);
+		bytes += size;
+	}
+	std::printf("aggregating %.1f MB in %zu blocks\n", bytes / 1e6, reader.GetBlockCount());
+
+	ysRegionStats expected;
+	Measure("sequential", bytes, repeats, [&]{
+		expected = ysRegionStats();
+		reader.Decode(0, reader.GetBlockCount(), expected);
+	});
+
+	bool matches = true;
+	unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned threads = 1; threads <= cores * 2; threads *= 2)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "parallel, %u threads", threads);
+
+		ysRegionStats stats;
+		Measure(name, bytes, repeats, [&]{
+			stats = ysRegionStats();
+			reader.DecodeParallel(0, reader.GetBlockCount(), stats, threads);
+		});
+
+		std::vector<ysRegionStats::Site> const& lhs = expected.GetSites();
+		std::vector<ysRegionStats::Site> const& rhs = stats.GetSites();
+		matches = matches && lhs.size() == rhs.size();
+		for (std::size_t index = 0; matches && index != lhs.size(); ++index)
+		{
+			matches = lhs[index].id == rhs[index].id && lhs[index].count == rhs[index].count && lhs[index].total == rhs[index].total &&
+				lhs[index].min == rhs[index].min && lhs[index].max == rhs[index].max &&
+				lhs[index].durations.GetQuantile(0.99) == rhs[index].durations.GetQuantile(0.99);
+		}
+	}
+
+	if (!matches)
+	{
+		std::fprintf(stderr, "ysbench: parallel results differ from sequential results\n");
+		return 1;
+	}
+	return 0;
+}
+
+void* YS_CALL Allocate(void* block, std::size_t bytes)
+{
+	if (bytes == 0)
+	{
+		std::free(block);
+		return nullptr;
+	}
+	return std::malloc(bytes);
+}
+
+template <typename Function>
+double TimeCalls(std::size_t calls, Function&& function)
+{
+	Clock::time_point const start = Clock::now();
+	for (std::size_t call = 0; call != calls; ++call)
+		function();
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / calls;
+}
+
+template <typename Function>
+double MeasureCall(char const* name, std::size_t calls, int repeats, Function&& function)
+{
+	double best = 0;
+	for (int repeat = 0; repeat != repeats; ++repeat)
+	{
+		double const nanoseconds = TimeCalls(calls, function);
+		if (repeat == 0 || nanoseconds < best)
+			best = nanoseconds;
+	}
+
+	std::printf("%-24s %8.2f ns\n", name, best);
+	return best;
+}
+
+// times two calls in alternating rounds, so that the machine speeding up or slowing down affects
+// both alike, and reports the best round of each and the cost of the second over the first
+template <typename Base, typename Extra>
+void MeasureDifference(char const* name, char const* baseName, char const* extraName, std::size_t calls, int repeats, Base&& base, Extra&& extra)
+{
+	std::size_t const rounds = 10;
+	double bestBase = 0;
+	double bestExtra = 0;
+	for (std::size_t round = 0; round != rounds * repeats; ++round)
+	{
+		double const baseNanoseconds = TimeCalls(calls / rounds, base);
+		double const extraNanoseconds = TimeCalls(calls / rounds, extra);
+		if (round == 0 || baseNanoseconds < bestBase)
+			bestBase = baseNanoseconds;
+		if (round == 0 || extraNanoseconds < bestExtra)
+			bestExtra = extraNanoseconds;
+	}
+
+	std::printf("%-24s %8.2f ns\n", baseName, bestBase);
+	std::printf("%-24s %8.2f ns\n", extraName, bestExtra);
+	std::printf("%-24s %8.2f ns\n", name, bestExtra - bestBase);
+}
+
+// sums the increments delivered to the counters named "counter"
+void YS_CALL SumCounter(void* userData, ysEvent const* events, std::size_t count)
+{
+	static ysStringHandle const name = ysInternString("counter");
+	for (std::size_t index = 0; index != count; ++index)
+	{
+		if (events[index].type == ysEventType::CounterAdd && events[index].counter_add.name == name)
+			*static_cast<double*>(userData) += events[index].counter_add.amount;
+	}
+}
+
+// regions are summarized in statistics mode, so the queue to the background thread never
+// dominates and the histogram's own cost shows as the difference between the two
+int BenchmarkRecord(int repeats)
+{
+	std::size_t const calls = 10000000;
+
+	if (ysInitialize(&Allocate) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysbench: cannot initialize\n");
+		return 1;
+	}
+	ysSetCaptureMode(ysCaptureMode::Statistics);
+
+	double counted = 0;
+	ysAddCallbackSink(&SumCounter, &counted);
+
+	std::printf("recording %zu regions\n", calls);
+	MeasureDifference("histogram only", "region", "region with histogram", calls, repeats, []{ ysProfile("region"); }, []{ ysProfileHistogram("histogram"); });
+	ysDisableCategory("disabled");
+	MeasureCall("disabled region", calls, repeats, []{ ysProfileIn("disabled", "region"); });
+
+	std::printf("adding to a counter %zu times\n", calls);
+	volatile double local = 0;
+	MeasureCall("plain add", calls, repeats, [&local]{ local = local + 1; });
+	MeasureCall("counter add", calls, repeats, []{ ysCounterAdd("counter", 1); });
+	MeasureCall("per-CPU counter add", calls, repeats, []{ ysCounterAddPerCpu("counter", 1); });
+
+	// in events mode every region goes through the queue to the background thread, unless it is
+	// shorter than the minimum duration and only counted in the frame's statistics
+	ysSetCaptureMode(ysCaptureMode::Events);
+	std::printf("queueing %zu regions\n", calls / 10);
+	MeasureCall("region", calls / 10, repeats, []{ ysProfile("queued"); });
+	ysSetMinimumDuration(1000);
+	MeasureCall("region below minimum", calls / 10, repeats, []{ ysProfile("queued"); });
+	ysSetMinimumDuration(0);
+
+	// in slow frames mode regions are held on this thread until the frame ends, which is kept
+	// short enough for the buffer, and none of these frames is slow enough to be delivered
+	ysSetCaptureMode(ysCaptureMode::SlowFrames);
+	ysSetSlowFrameThreshold(0, 0);
+	std::size_t held = 0;
+	MeasureCall("region held for frame", calls / 10, repeats, [&held]{ { ysProfile("held"); } if (++held % 1024 == 0) ysTick(); });
+	ysSetCaptureMode(ysCaptureMode::Events);
+
+	// let the background thread merge everything, and check that it all arrived
+	ysTick();
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ysHistogram* const result = new ysHistogram;
+	ysQueryHistogram("histogram", result);
+	std::printf("median %llu ticks, p99 %llu ticks\n", static_cast<unsigned long long>(ysHistogramQuantile(result, 0.5)), static_cast<unsigned long long>(ysHistogramQuantile(result, 0.99)));
+
+	bool const complete = result->count == calls * repeats;
+	delete result;
+	ysRemoveCallbackSink(&SumCounter, &counted);
+	ysShutdown();
+
+	if (!complete)
+	{
+		std::fprintf(stderr, "ysbench: histogram is missing durations\n");
+		return 1;
+	}
+	if (counted != static_cast<double>(2 * calls * repeats))
+	{
+		std::fprintf(stderr, "ysbench: counter is missing increments\n");
+		return 1;
+	}
+	return 0;
+}
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysbench decode [trace file]\n");
+	std::fprintf(stderr, "       ysbench stats <trace file>\n");
+	std::fprintf(stderr, "       ysbench record\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	int const repeats = 5;
+
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (std::strcmp(argv[1], "stats") == 0 && argc > 2)
+		return BenchmarkStats(argv[2], repeats);
+
+	if (std::strcmp(argv[1], "record") == 0)
+		return BenchmarkRecord(repeats);
+
+	if (std::strcmp(argv[1], "decode") == 0)
+	{
+		if (argc > 2)
+			return BenchmarkFile(argv[2], repeats);
+		return BenchmarkDecode(MakeStream(256 << 20), repeats);
+	}
+
+	PrintUsage();
+	return 1;
+}
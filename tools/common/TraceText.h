@@ -0,0 +1,59 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <yardstick/trace.h>
+
+#include <cstdio>
+#include <string>
+
+// text helpers shared by the command line tools
+namespace ystools {
+
+/// <summary> Looks up a string of a trace. </summary>
+/// <returns> The string, or its handle in hexadecimal if the trace lacks it. </returns>
+inline std::string GetString(ysTraceReader const& reader, ysStringHandle id)
+{
+	std::uint32_t length;
+	char const* const str = reader.FindString(id, length);
+	if (str == nullptr)
+	{
+		char buffer[16];
+		std::snprintf(buffer, sizeof(buffer), "0x%08x", id);
+		return buffer;
+	}
+	return std::string(str, length);
+}
+
+/// <summary> Quotes a CSV field. </summary>
+inline std::string Quote(std::string const& text)
+{
+	std::string quoted = "\"";
+	for (char const c : text)
+	{
+		if (c == '"')
+			quoted += '"';
+		quoted += c;
+	}
+	quoted += '"';
+	return quoted;
+}
+
+} // namespace ystools
@@ -0,0 +1,480 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "TraceText.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum class Metric
+{
+	Mean,
+	P50,
+	P90,
+	P99,
+};
+
+enum class Verdict
+{
+	Unchanged,
+	Regression,
+	Improvement,
+	Added,
+	Removed,
+};
+
+struct Options
+{
+	char const* baseline = nullptr;
+	char const* candidate = nullptr;
+	Metric metric = Metric::Mean;
+	double threshold = 5;
+	double alpha = 0.001;
+	double minImpact = 0;
+	double maxFrameRegression = -1;
+	bool csv = false;
+};
+
+// one trace file, aggregated
+struct Trace
+{
+	ysTraceReader reader;
+	ysRegionStats stats;
+	double seconds = 0;
+	// self time is compared per frame, or per second of capture if the trace has no frames
+	double periods = 0;
+};
+
+struct Comparison
+{
+	ysRegionStats::Site const* baseline = nullptr;
+	ysRegionStats::Site const* candidate = nullptr;
+	double baselineValue = 0;
+	double candidateValue = 0;
+	double change = 0;
+	double distance = 0;
+	double pValue = 1;
+	double impact = 0;
+	Verdict verdict = Verdict::Unchanged;
+};
+
+double MetricValue(ysRegionStats::Site const& site, Metric metric, double frequency)
+{
+	switch (metric)
+	{
+	case Metric::Mean: return site.count != 0 ? double(site.total) / site.count / frequency : 0;
+	case Metric::P50: return double(site.durations.GetQuantile(0.5)) / frequency;
+	case Metric::P90: return double(site.durations.GetQuantile(0.9)) / frequency;
+	case Metric::P99: return double(site.durations.GetQuantile(0.99)) / frequency;
+	}
+	return 0;
+}
+
+// the largest difference between the two distributions, evaluated at every bucket boundary. the
+// clocks of the two traces may differ, so boundaries are compared in seconds.
+double KolmogorovDistance(ysDurationHistogram const& lhs, double lhsFrequency, ysDurationHistogram const& rhs, double rhsFrequency)
+{
+	double const lhsCount = double(lhs.GetCount());
+	double const rhsCount = double(rhs.GetCount());
+
+	std::size_t lhsIndex = 0;
+	std::size_t rhsIndex = 0;
+	double lhsSeen = 0;
+	double rhsSeen = 0;
+	double distance = 0;
+
+	while (lhsIndex != lhs.GetBucketCount() || rhsIndex != rhs.GetBucketCount())
+	{
+		double const lhsEdge = lhsIndex != lhs.GetBucketCount() ? double(ysDurationHistogram::GetBucketLowest(lhsIndex + 1)) / lhsFrequency : HUGE_VAL;
+		double const rhsEdge = rhsIndex != rhs.GetBucketCount() ? double(ysDurationHistogram::GetBucketLowest(rhsIndex + 1)) / rhsFrequency : HUGE_VAL;
+		double const edge = std::min(lhsEdge, rhsEdge);
+
+		if (lhsEdge == edge)
+			lhsSeen += double(lhs.GetBucket(lhsIndex++));
+		if (rhsEdge == edge)
+			rhsSeen += double(rhs.GetBucket(rhsIndex++));
+
+		distance = std::max(distance, std::fabs(lhsSeen / lhsCount - rhsSeen / rhsCount));
+	}
+
+	return distance;
+}
+
+// probability of a distance at least this large if both samples came from one distribution
+double KolmogorovPValue(double distance, std::uint64_t lhsCount, std::uint64_t rhsCount)
+{
+	double const effective = double(lhsCount) * double(rhsCount) / double(lhsCount + rhsCount);
+	double const root = std::sqrt(effective);
+	double const lambda = (root + 0.12 + 0.11 / root) * distance;
+
+	if (lambda < 0.2)
+		return 1;
+
+	double sum = 0;
+	double sign = 1;
+	for (int term = 1; term != 100; ++term)
+	{
+		double const value = sign * std::exp(-2 * term * term * lambda * lambda);
+		sum += value;
+		if (std::fabs(value) < 1e-12)
+			break;
+		sign = -sign;
+	}
+
+	return std::min(1.0, std::max(0.0, 2 * sum));
+}
+
+// the sites of both traces with one name and file, in the order of their lines
+struct SiteGroup
+{
+	std::vector<ysRegionStats::Site const*> baseline;
+	std::vector<ysRegionStats::Site const*> candidate;
+};
+
+// pairs the sites of a group in the order of their lines, so that sites moved by edits elsewhere in
+// their file are still compared. if sites were added or removed, those keeping their line are paired
+// first.
+void MatchSites(SiteGroup const& group, std::vector<Comparison>& out_comparisons)
+{
+	bool const sameCount = group.baseline.size() == group.candidate.size();
+	std::vector<bool> matched(group.candidate.size(), false);
+	std::vector<ysRegionStats::Site const*> unmatched;
+
+	for (ysRegionStats::Site const* site : group.baseline)
+	{
+		if (sameCount)
+		{
+			unmatched.push_back(site);
+			continue;
+		}
+
+		std::size_t index = 0;
+		while (index != group.candidate.size() && (matched[index] || group.candidate[index]->line != site->line))
+			++index;
+
+		if (index == group.candidate.size())
+		{
+			unmatched.push_back(site);
+			continue;
+		}
+
+		matched[index] = true;
+		out_comparisons.emplace_back();
+		out_comparisons.back().baseline = site;
+		out_comparisons.back().candidate = group.candidate[index];
+	}
+
+	std::size_t next = 0;
+	for (std::size_t index = 0; index != group.candidate.size(); ++index)
+	{
+		if (matched[index])
+			continue;
+
+		out_comparisons.emplace_back();
+		out_comparisons.back().candidate = group.candidate[index];
+		if (next != unmatched.size())
+			out_comparisons.back().baseline = unmatched[next++];
+	}
+
+	for (; next != unmatched.size(); ++next)
+	{
+		out_comparisons.emplace_back();
+		out_comparisons.back().baseline = unmatched[next];
+	}
+}
+
+bool LoadTrace(char const* path, Trace& out_trace)
+{
+	if (out_trace.reader.Open(path) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysdiff: cannot read trace file '%s'\n", path);
+		return false;
+	}
+
+	ysTraceReader const& reader = out_trace.reader;
+	if (reader.Decode(0, reader.GetBlockCount(), out_trace.stats) != ysResult::Success)
+		std::fprintf(stderr, "ysdiff: '%s' is damaged, and only its readable part was compared\n", path);
+
+	ysTime begin = ~ysTime(0);
+	ysTime end = 0;
+	for (std::size_t index = 0; index != reader.GetBlockCount(); ++index)
+	{
+		ysTraceBlock const& block = reader.GetBlock(index);
+		if (block.begin == 0 && block.end == 0)
+			continue;
+		begin = std::min(begin, block.begin);
+		end = std::max(end, block.end);
+	}
+	out_trace.seconds = end > begin ? double(end - begin) / reader.GetFrequency() : 0;
+
+	return true;
+}
+
+char const* VerdictName(Verdict verdict)
+{
+	switch (verdict)
+	{
+	case Verdict::Unchanged: return "-";
+	case Verdict::Regression: return "REGRESSION";
+	case Verdict::Improvement: return "improvement";
+	case Verdict::Added: return "added";
+	case Verdict::Removed: return "removed";
+	}
+	return "";
+}
+
+bool ParseNumber(char const* text, double& out_value)
+{
+	char* end;
+	out_value = std::strtod(text, &end);
+	return end != text && *end == '\0' && out_value >= 0;
+}
+
+bool ParseMetric(char const* text, Metric& out_metric)
+{
+	if (std::strcmp(text, "mean") == 0)
+		out_metric = Metric::Mean;
+	else if (std::strcmp(text, "p50") == 0)
+		out_metric = Metric::P50;
+	else if (std::strcmp(text, "p90") == 0)
+		out_metric = Metric::P90;
+	else if (std::strcmp(text, "p99") == 0)
+		out_metric = Metric::P99;
+	else
+		return false;
+	return true;
+}
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysdiff [options] <baseline trace> <candidate trace>\n");
+	std::fprintf(stderr, "  --metric <mean|p50|p90|p99>      duration compared between sites (default mean)\n");
+	std::fprintf(stderr, "  --threshold <percent>            smallest change reported as a regression or improvement (default 5)\n");
+	std::fprintf(stderr, "  --alpha <p>                      significance level of the distribution test (default 0.001)\n");
+	std::fprintf(stderr, "  --min-impact <us>                smallest change in frame time reported (default 0)\n");
+	std::fprintf(stderr, "  --max-frame-regression <us>      fail only if regressions add up to more frame time than this\n");
+	std::fprintf(stderr, "  --csv                            print comma separated values\n");
+	std::fprintf(stderr, "exits with 2 if a regression is found, and 1 on error\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& out_options)
+{
+	for (int arg = 1; arg != argc; ++arg)
+	{
+		bool const hasValue = arg + 1 != argc;
+		if (std::strcmp(argv[arg], "--metric") == 0 && hasValue)
+		{
+			if (!ParseMetric(argv[++arg], out_options.metric))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--threshold") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], out_options.threshold))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--alpha") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], out_options.alpha))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--min-impact") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], out_options.minImpact))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--max-frame-regression") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], out_options.maxFrameRegression))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--csv") == 0)
+			out_options.csv = true;
+		else if (argv[arg][0] == '-')
+			return false;
+		else if (out_options.baseline == nullptr)
+			out_options.baseline = argv[arg];
+		else if (out_options.candidate == nullptr)
+			out_options.candidate = argv[arg];
+		else
+			return false;
+	}
+
+	return out_options.candidate != nullptr;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Trace baseline;
+	Trace candidate;
+	if (!LoadTrace(options.baseline, baseline) || !LoadTrace(options.candidate, candidate))
+		return 1;
+
+	// frame time is only comparable if both traces have frames
+	bool const perFrame = baseline.reader.GetTickCount() > 1 && candidate.reader.GetTickCount() > 1;
+	baseline.periods = perFrame ? double(baseline.reader.GetTickCount() - 1) : baseline.seconds;
+	candidate.periods = perFrame ? double(candidate.reader.GetTickCount() - 1) : candidate.seconds;
+	if (baseline.periods <= 0 || candidate.periods <= 0)
+	{
+		std::fprintf(stderr, "ysdiff: a trace has no timed events to compare\n");
+		return 1;
+	}
+
+	double const baselineFrequency = double(baseline.reader.GetFrequency());
+	double const candidateFrequency = double(candidate.reader.GetFrequency());
+
+	// sites are matched by name and file, whose handles are derived from the strings alone and so
+	// are the same in every run of every build. lines only tell apart sites sharing both.
+	std::map<std::pair<ysStringHandle, ysStringHandle>, SiteGroup> groups;
+	for (ysRegionStats::Site const& site : baseline.stats.GetSites())
+		groups[std::make_pair(site.name, site.file)].baseline.push_back(&site);
+	for (ysRegionStats::Site const& site : candidate.stats.GetSites())
+		groups[std::make_pair(site.name, site.file)].candidate.push_back(&site);
+
+	std::vector<Comparison> comparisons;
+	std::uint64_t summarized = 0;
+	for (auto& entry : groups)
+	{
+		SiteGroup& group = entry.second;
+		auto const byLine = [](ysRegionStats::Site const* lhs, ysRegionStats::Site const* rhs) { return lhs->line < rhs->line; };
+		std::sort(group.baseline.begin(), group.baseline.end(), byLine);
+		std::sort(group.candidate.begin(), group.candidate.end(), byLine);
+		MatchSites(group, comparisons);
+	}
+
+	std::vector<Comparison> results;
+	results.reserve(comparisons.size());
+	for (Comparison& comparison : comparisons)
+	{
+		double const baselineSelf = comparison.baseline != nullptr ? double(comparison.baseline->self) / baselineFrequency / baseline.periods : 0;
+		double const candidateSelf = comparison.candidate != nullptr ? double(comparison.candidate->self) / candidateFrequency / candidate.periods : 0;
+		comparison.impact = candidateSelf - baselineSelf;
+
+		if (comparison.baseline == nullptr || comparison.candidate == nullptr)
+		{
+			comparison.verdict = comparison.baseline == nullptr ? Verdict::Added : Verdict::Removed;
+			if (comparison.baseline != nullptr)
+				comparison.baselineValue = MetricValue(*comparison.baseline, options.metric, baselineFrequency);
+			if (comparison.candidate != nullptr)
+				comparison.candidateValue = MetricValue(*comparison.candidate, options.metric, candidateFrequency);
+			results.push_back(comparison);
+			continue;
+		}
+
+		comparison.baselineValue = MetricValue(*comparison.baseline, options.metric, baselineFrequency);
+		comparison.candidateValue = MetricValue(*comparison.candidate, options.metric, candidateFrequency);
+		comparison.change = comparison.baselineValue > 0 ? (comparison.candidateValue / comparison.baselineValue - 1) * 100 : 0;
+
+		// regions only seen in summaries have no durations, so a site without any can't be tested
+		ysDurationHistogram const& baselineDurations = comparison.baseline->durations;
+		ysDurationHistogram const& candidateDurations = comparison.candidate->durations;
+		summarized += comparison.baseline->summarized + comparison.candidate->summarized;
+		if (baselineDurations.GetCount() != 0 && candidateDurations.GetCount() != 0)
+		{
+			comparison.distance = KolmogorovDistance(baselineDurations, baselineFrequency, candidateDurations, candidateFrequency);
+			comparison.pValue = KolmogorovPValue(comparison.distance, baselineDurations.GetCount(), candidateDurations.GetCount());
+		}
+
+		// a change must be significant, large relative to the site, and large for the frame
+		bool const significant = comparison.pValue < options.alpha && std::fabs(comparison.impact) * 1e6 >= options.minImpact;
+		if (significant && comparison.change >= options.threshold)
+			comparison.verdict = Verdict::Regression;
+		else if (significant && comparison.change <= -options.threshold)
+			comparison.verdict = Verdict::Improvement;
+
+		results.push_back(comparison);
+	}
+
+	if (summarized != 0)
+	{
+		std::fprintf(stderr, "ysdiff: %llu regions were only captured in per-frame summaries; they are counted in each site's mean, but not in its quantiles, self time or distribution test\n",
+			static_cast<unsigned long long>(summarized));
+	}
+
+	std::sort(results.begin(), results.end(), [](Comparison const& lhs, Comparison const& rhs) {
+		double const lhsImpact = std::fabs(lhs.impact);
+		double const rhsImpact = std::fabs(rhs.impact);
+		if (lhsImpact != rhsImpact)
+			return lhsImpact > rhsImpact;
+		ysSiteHandle const lhsId = lhs.baseline != nullptr ? lhs.baseline->id : lhs.candidate->id;
+		ysSiteHandle const rhsId = rhs.baseline != nullptr ? rhs.baseline->id : rhs.candidate->id;
+		return lhsId < rhsId;
+	});
+
+	char const* const metric = options.metric == Metric::Mean ? "mean" : options.metric == Metric::P50 ? "p50" : options.metric == Metric::P90 ? "p90" : "p99";
+	char const* const period = perFrame ? "frame" : "s";
+
+	if (options.csv)
+		std::printf("verdict,name,file,line,baseline_%s_us,candidate_%s_us,change_percent,ks_distance,p_value,impact_us_per_%s\n", metric, metric, period);
+	else
+		std::printf("%-12s %-32s %14s %14s %9s %8s %10s %14s  %s\n", "verdict", "name", "base us", "cand us", "change", "ks d", "p", perFrame ? "us/frame" : "us/s", "location");
+
+	std::size_t regressions = 0;
+	double regressed = 0;
+	for (Comparison const& comparison : results)
+	{
+		Trace const& trace = comparison.candidate != nullptr ? candidate : baseline;
+		ysRegionStats::Site const& site = comparison.candidate != nullptr ? *comparison.candidate : *comparison.baseline;
+		std::string const name = ystools::GetString(trace.reader, site.name);
+		std::string const file = ystools::GetString(trace.reader, site.file);
+
+		if (comparison.verdict == Verdict::Regression)
+		{
+			++regressions;
+			regressed += comparison.impact;
+		}
+
+		if (options.csv)
+		{
+			std::printf("%s,%s,%s,%u,%.3f,%.3f,%.2f,%.4f,%.3g,%.3f\n", VerdictName(comparison.verdict), ystools::Quote(name).c_str(), ystools::Quote(file).c_str(), site.line,
+				comparison.baselineValue * 1e6, comparison.candidateValue * 1e6, comparison.change, comparison.distance, comparison.pValue, comparison.impact * 1e6);
+		}
+		else
+		{
+			std::printf("%-12s %-32s %14.3f %14.3f %8.1f%% %8.4f %10.3g %+14.3f  %s:%u\n", VerdictName(comparison.verdict), name.c_str(),
+				comparison.baselineValue * 1e6, comparison.candidateValue * 1e6, comparison.change, comparison.distance, comparison.pValue, comparison.impact * 1e6, file.c_str(), site.line);
+		}
+	}
+
+	if (!options.csv)
+		std::printf("\n%zu regressions, adding %.3f us per %s\n", regressions, regressed * 1e6, period);
+
+	if (options.maxFrameRegression >= 0)
+		return regressed * 1e6 > options.maxFrameRegression ? 2 : 0;
+	return regressions != 0 ? 2 : 0;
+}
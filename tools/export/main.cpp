@@ -0,0 +1,80 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysexport [--chrome|--perfetto] <input> <output>\n");
+	std::fprintf(stderr, "  --chrome    Chrome JSON trace event format (default)\n");
+	std::fprintf(stderr, "  --perfetto  Perfetto protobuf trace format\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	ysExportFormat format = ysExportFormat::ChromeJson;
+	char const* input = nullptr;
+	char const* output = nullptr;
+
+	for (int arg = 1; arg != argc; ++arg)
+	{
+		if (std::strcmp(argv[arg], "--chrome") == 0)
+			format = ysExportFormat::ChromeJson;
+		else if (std::strcmp(argv[arg], "--perfetto") == 0)
+			format = ysExportFormat::Perfetto;
+		else if (input == nullptr)
+			input = argv[arg];
+		else if (output == nullptr)
+			output = argv[arg];
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (input == nullptr || output == nullptr)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ysTraceReader reader;
+	if (reader.Open(input) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysexport: cannot read trace file '%s'\n", input);
+		return 1;
+	}
+
+	ysResult const result = ysExportTrace(reader, output, format);
+	if (result != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysexport: failed to write '%s' (error %d)\n", output, static_cast<int>(result));
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,354 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// merged files count time in nanoseconds
+constexpr ysTime kFrequency = 1000000000;
+
+struct Options
+{
+	char const* output = nullptr;
+	std::vector<char const*> inputs;
+	std::size_t framesFrom = 0;
+};
+
+// an event read ahead of its turn, ordered by time and then by the order it was read in
+struct Pending
+{
+	ysEvent event;
+	ysTime key;
+	std::uint64_t sequence;
+
+	bool operator>(Pending const& rhs) const { return key != rhs.key ? key > rhs.key : sequence > rhs.sequence; }
+};
+
+struct Input
+{
+	char const* path = nullptr;
+	std::string name;
+	ysTraceReader reader;
+	ysTraceCursor cursor;
+	bool exhausted = false;
+
+	// the next event, and its time on the merged clock
+	ysEvent event;
+	ysTime key = 0;
+
+	// the merged clock reading at the input's start
+	ysTime base = 0;
+	std::uint16_t firstThread = 0;
+	std::uint16_t threads = 0;
+
+	// a file is only ordered per thread, so events are read ahead into a heap until no unread event
+	// can come before the earliest. that is known from the earliest begin of the blocks from each one
+	// on, as every timed event falls within its block's range.
+	std::vector<Pending> pending;
+	std::vector<ysTime> minBegin;
+	ysTime lastKey = 0;
+	std::uint64_t sequence = 0;
+
+	ysTime ToMerged(ysTime when) const;
+	void Open();
+	bool Read();
+	bool Next();
+};
+
+ysTime Input::ToMerged(ysTime when) const
+{
+	// split the conversion so that long traces at high frequencies don't overflow
+	ysTime const frequency = reader.GetFrequency();
+	std::int64_t const ticks = static_cast<std::int64_t>(when - reader.GetStart());
+	std::int64_t const whole = ticks / static_cast<std::int64_t>(frequency);
+	std::int64_t const part = ticks % static_cast<std::int64_t>(frequency);
+	return base + whole * kFrequency + part * static_cast<std::int64_t>(kFrequency) / static_cast<std::int64_t>(frequency);
+}
+
+void Input::Open()
+{
+	std::size_t const count = reader.GetBlockCount();
+	minBegin.resize(count);
+
+	// blocks without timed events never hold back an earlier one
+	ysTime earliest = ~ysTime(0);
+	for (std::size_t index = count; index-- != 0;)
+	{
+		ysTraceBlock const& block = reader.GetBlock(index);
+		if ((block.begin != 0 || block.end != 0) && block.begin < earliest)
+			earliest = block.begin;
+		minBegin[index] = earliest;
+	}
+
+	cursor = reader.Read(0, count);
+	key = lastKey = base;
+}
+
+// reads an event into the heap, converting it to the merged clock and threads. strings go first,
+// ahead of the events that use them. other events without a time of their own keep the time of the
+// event read before them, so they stay in place.
+bool Input::Read()
+{
+	Pending entry;
+	ysEvent& event = entry.event;
+	if (!cursor.Next(event))
+		return false;
+
+	ysTime key = lastKey;
+	switch (event.type)
+	{
+	case ysEventType::Tick:
+		event.tick.when = key = ToMerged(event.tick.when);
+		break;
+	case ysEventType::Region:
+		event.region.begin = ToMerged(event.region.begin);
+		event.region.end = key = ToMerged(event.region.end);
+		break;
+	case ysEventType::CounterSet:
+		event.counter_set.when = key = ToMerged(event.counter_set.when);
+		break;
+	case ysEventType::RegionSummary:
+		event.region_summary.when = key = ToMerged(event.region_summary.when);
+		break;
+	case ysEventType::Histogram:
+		event.histogram.when = key = ToMerged(event.histogram.when);
+		break;
+	case ysEventType::Quantiles:
+		event.quantiles.when = key = ToMerged(event.quantiles.when);
+		break;
+	case ysEventType::CallTree:
+		event.call_tree.when = key = ToMerged(event.call_tree.when);
+		break;
+	case ysEventType::Samples:
+		event.samples.when = key = ToMerged(event.samples.when);
+		break;
+	case ysEventType::Stall:
+		event.stall.since = ToMerged(event.stall.since);
+		event.stall.when = key = ToMerged(event.stall.when);
+		break;
+	default:
+		break;
+	}
+	lastKey = key;
+
+	event.thread = static_cast<std::uint16_t>(event.thread + firstThread);
+	entry.key = event.type == ysEventType::String ? 0 : key;
+	entry.sequence = sequence++;
+	pending.push_back(entry);
+	std::push_heap(pending.begin(), pending.end(), std::greater<Pending>());
+	return true;
+}
+
+// moves on to the earliest event that no unread event can come before
+bool Input::Next()
+{
+	for (;;)
+	{
+		if (!pending.empty())
+		{
+			// the rest of the cursor's block and the blocks after it are still to be read
+			bool const ready = exhausted || minBegin[cursor.GetBlock()] == ~ysTime(0) || pending.front().key <= ToMerged(minBegin[cursor.GetBlock()]);
+			if (ready)
+			{
+				std::pop_heap(pending.begin(), pending.end(), std::greater<Pending>());
+				event = pending.back().event;
+				key = pending.back().key;
+				pending.pop_back();
+				return true;
+			}
+		}
+		else if (exhausted)
+			return false;
+
+		if (!Read())
+			exhausted = true;
+	}
+}
+
+std::string GetProcessName(char const* path)
+{
+	char const* name = path;
+	for (char const* pos = path; *pos != '\0'; ++pos)
+	{
+		if (*pos == '/' || *pos == '\\')
+			name = pos + 1;
+	}
+
+	char const* const extension = std::strrchr(name, '.');
+	return extension != nullptr && extension != name ? std::string(name, extension) : std::string(name);
+}
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysmerge [options] -o <output> <input> <input>...\n");
+	std::fprintf(stderr, "  -o <output>             the merged trace file to write\n");
+	std::fprintf(stderr, "  --frames-from <index>   keep the frames of this input, the first by default\n");
+	std::fprintf(stderr, "each input becomes a process named after its file, with its own threads\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& out_options)
+{
+	for (int arg = 1; arg != argc; ++arg)
+	{
+		bool const hasValue = arg + 1 != argc;
+		if (std::strcmp(argv[arg], "-o") == 0 && hasValue)
+			out_options.output = argv[++arg];
+		else if (std::strcmp(argv[arg], "--frames-from") == 0 && hasValue)
+		{
+			char* end;
+			char const* const text = argv[++arg];
+			out_options.framesFrom = std::strtoul(text, &end, 10);
+			if (end == text || *end != '\0')
+				return false;
+		}
+		else if (argv[arg][0] == '-')
+			return false;
+		else
+			out_options.inputs.push_back(argv[arg]);
+	}
+
+	return out_options.output != nullptr && !out_options.inputs.empty() && out_options.framesFrom < out_options.inputs.size();
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<Input>> inputs;
+	bool realtime = true;
+	for (char const* path : options.inputs)
+	{
+		std::unique_ptr<Input> input(new Input);
+		input->path = path;
+		input->name = GetProcessName(path);
+		if (input->reader.Open(path) != ysResult::Success)
+		{
+			std::fprintf(stderr, "ysmerge: cannot read trace file '%s'\n", path);
+			return 1;
+		}
+
+		realtime = realtime && input->reader.GetRealtime() != 0;
+		inputs.push_back(std::move(input));
+	}
+
+	// processes are aligned by the wall clock reading taken with each start. older files lack
+	// one, and can only be merged on the assumption that they share a clock, as on one machine.
+	if (!realtime)
+		std::fprintf(stderr, "ysmerge: some inputs do not record the wall clock, so their own clocks are assumed to agree\n");
+
+	ysTime start = ~ysTime(0);
+	std::uint32_t threads = 0;
+	for (std::unique_ptr<Input> const& input : inputs)
+	{
+		ysTraceReader const& reader = input->reader;
+		if (realtime)
+			input->base = static_cast<ysTime>(reader.GetRealtime());
+		else
+			input->base = reader.GetStart() / reader.GetFrequency() * kFrequency + reader.GetStart() % reader.GetFrequency() * kFrequency / reader.GetFrequency();
+		start = std::min(start, input->base);
+
+		// each process gets a range of threads of its own
+		std::uint32_t const limit = reader.FindThreadLimit(0, reader.GetBlockCount());
+		if (threads + limit > 65536)
+		{
+			std::fprintf(stderr, "ysmerge: the inputs have more threads than a trace file can hold\n");
+			return 1;
+		}
+		input->firstThread = static_cast<std::uint16_t>(threads);
+		input->threads = static_cast<std::uint16_t>(limit);
+		threads += limit;
+
+		input->Open();
+	}
+
+	ysTraceWriter writer;
+	if (writer.Open(options.output, kFrequency, start, realtime ? static_cast<std::int64_t>(start) : 0) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysmerge: cannot create '%s'\n", options.output);
+		return 1;
+	}
+
+	ysResult result = ysResult::Success;
+	for (std::unique_ptr<Input> const& input : inputs)
+	{
+		if (result == ysResult::Success)
+			result = writer.AddProcess(input->name.c_str(), input->firstThread, input->threads);
+	}
+
+	// each input gives its events in time order, so always taking the earliest next event merges
+	// them while holding only a few blocks' worth of events per input
+	using Entry = std::pair<ysTime, std::size_t>;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	for (std::size_t index = 0; index != inputs.size(); ++index)
+	{
+		if (inputs[index]->Next())
+			queue.push(Entry(inputs[index]->key, index));
+	}
+
+	while (result == ysResult::Success && !queue.empty())
+	{
+		std::size_t const index = queue.top().second;
+		queue.pop();
+
+		Input& input = *inputs[index];
+
+		// a merged trace has one frame sequence, so only one process's frames are kept
+		if (input.event.type != ysEventType::Tick || index == options.framesFrom)
+			result = writer.Write(input.event);
+
+		if (input.Next())
+			queue.push(Entry(input.key, index));
+	}
+
+	ysResult const closed = writer.Close();
+	if (result == ysResult::Success)
+		result = closed;
+	if (result != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysmerge: failed to write '%s' (error %d)\n", options.output, static_cast<int>(result));
+		return 1;
+	}
+
+	for (std::unique_ptr<Input> const& input : inputs)
+	{
+		if (input->cursor.HasFailed())
+			std::fprintf(stderr, "ysmerge: '%s' is damaged, and only its readable part was merged\n", input->path);
+	}
+
+	return 0;
+}
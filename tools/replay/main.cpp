@@ -0,0 +1,490 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "webby/webby.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// events are sent in websocket frames of about this size; the web tool parses each frame on its own,
+// so a frame always holds whole events
+constexpr std::size_t kFrameBytes = 64 * 1024;
+
+struct Options
+{
+	char const* path = nullptr;
+	unsigned short port = 8080;
+	// playback rate relative to real time, or 0 to send as fast as possible
+	double speed = 1.0;
+	double seekSeconds = 0;
+};
+
+// each connection plays the trace back independently, from its own position
+struct Session
+{
+	WebbyConnection* connection = nullptr;
+
+	// next event to send
+	std::size_t block = 0;
+	std::size_t offset = 0;
+
+	// timed events before this are skipped after a seek
+	ysTime seek = 0;
+
+	// the trace time shown at wallStart, advancing at speed from then on
+	ysTime origin = 0;
+	Clock::time_point wallStart;
+	double speed = 1.0;
+	bool paused = false;
+};
+
+template <typename T>
+void Append(std::vector<unsigned char>& buffer, T value)
+{
+	unsigned char bytes[sizeof(value)];
+	std::memcpy(bytes, &value, sizeof(value));
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+// finds the time of the events used to pace playback
+bool GetEventTime(unsigned char const* pos, ysTime& out_when)
+{
+	switch (static_cast<ysEventType>(pos[0]))
+	{
+	case ysEventType::Tick: out_when = _ys_::load_value<ysTime>(pos + 1); return true;
+	case ysEventType::Region: out_when = _ys_::load_value<ysTime>(pos + 21); return true;
+	case ysEventType::CounterSet: out_when = _ys_::load_value<ysTime>(pos + 13); return true;
+	case ysEventType::RegionSummary: out_when = _ys_::load_value<ysTime>(pos + 13); return true;
+	case ysEventType::Histogram: out_when = _ys_::load_value<ysTime>(pos + 13); return true;
+	case ysEventType::Quantiles: out_when = _ys_::load_value<ysTime>(pos + 13); return true;
+	case ysEventType::CallTree: out_when = _ys_::load_value<ysTime>(pos + 1); return true;
+	case ysEventType::Samples: out_when = _ys_::load_value<ysTime>(pos + 1); return true;
+	case ysEventType::Stall: out_when = _ys_::load_value<ysTime>(pos + 21); return true;
+	default: return false;
+	}
+}
+
+class ReplayServer
+{
+public:
+	ReplayServer(ysTraceReader const& reader, Options const& options) : _reader(reader), _options(options) {}
+	~ReplayServer() { Close(); }
+
+	bool Listen();
+	void Close();
+
+	/// <summary> Serves connections and sends them the events that are due. </summary>
+	/// <returns> True if any session had events to send. </returns>
+	bool Update();
+
+private:
+	static void webby_log(const char* text);
+	static int webby_dispatch(struct WebbyConnection* connection);
+	static int webby_connect(struct WebbyConnection* connection);
+	static void webby_connected(struct WebbyConnection* connection);
+	static void webby_closed(struct WebbyConnection* connection);
+	static int webby_frame(struct WebbyConnection* connection, const struct WebbyWsFrame* frame);
+
+	Session* FindSession(WebbyConnection* connection);
+	void SendPreamble(Session& session);
+	void SendFrame(Session& session);
+	bool Pump(Session& session, Clock::time_point now);
+	void Seek(Session& session, double seconds, Clock::time_point now);
+	ysTime GetPosition(Session const& session, Clock::time_point now) const;
+	void HandleCommand(Session& session, char const* command);
+
+	ysTraceReader const& _reader;
+	Options const& _options;
+	WebbyServer* _server = nullptr;
+	std::vector<unsigned char> _memory;
+	std::vector<Session> _sessions;
+	std::vector<unsigned char> _scratch;
+};
+
+void ReplayServer::webby_log(const char*)
+{
+}
+
+int ReplayServer::webby_dispatch(struct WebbyConnection*)
+{
+	// we support no static files or paths with this tool
+	return 1;
+}
+
+int ReplayServer::webby_connect(struct WebbyConnection*)
+{
+	return 0;
+}
+
+void ReplayServer::webby_connected(struct WebbyConnection* connection)
+{
+	ReplayServer& server = *static_cast<ReplayServer*>(connection->user_data);
+
+	Session session;
+	session.connection = connection;
+	session.speed = server._options.speed;
+	server.Seek(session, server._options.seekSeconds, Clock::now());
+
+	server._sessions.push_back(session);
+	server.SendPreamble(server._sessions.back());
+}
+
+void ReplayServer::webby_closed(struct WebbyConnection* connection)
+{
+	ReplayServer& server = *static_cast<ReplayServer*>(connection->user_data);
+
+	Session* const session = server.FindSession(connection);
+	if (session != nullptr)
+		server._sessions.erase(server._sessions.begin() + (session - server._sessions.data()));
+}
+
+int ReplayServer::webby_frame(struct WebbyConnection* connection, const struct WebbyWsFrame* frame)
+{
+	// commands are short text frames; anything else is discarded by webby
+	if (frame->opcode != WEBBY_WS_OP_TEXT_FRAME)
+		return 0;
+
+	char buffer[1024];
+	int const length = frame->payload_length < int(sizeof(buffer)) ? frame->payload_length : int(sizeof(buffer)) - 1;
+
+	// WebbyRead blocks until it has read exactly the requested amount
+	if (WebbyRead(connection, buffer, length) != 0)
+		return 1;
+	buffer[length] = '\0';
+
+	ReplayServer& server = *static_cast<ReplayServer*>(connection->user_data);
+	Session* const session = server.FindSession(connection);
+	if (session != nullptr)
+		server.HandleCommand(*session, buffer);
+	return 0;
+}
+
+bool ReplayServer::Listen()
+{
+	struct WebbyServerConfig config;
+	std::memset(&config, 0, sizeof(config));
+
+	config.bind_address = "127.0.0.1";
+	config.listening_port = _options.port;
+	config.flags = WEBBY_SERVER_WEBSOCKETS;
+	config.connection_max = 4;
+	config.request_buffer_size = 2048;
+	config.io_buffer_size = 8192;
+	config.dispatch = &webby_dispatch;
+	config.log = &webby_log;
+	config.ws_connect = &webby_connect;
+	config.ws_connected = &webby_connected;
+	config.ws_closed = &webby_closed;
+	config.ws_frame = &webby_frame;
+	config.user_data = this;
+
+	_memory.resize(WebbyServerMemoryNeeded(&config));
+	_server = WebbyServerInit(&config, _memory.data(), _memory.size());
+	return _server != nullptr;
+}
+
+void ReplayServer::Close()
+{
+	if (_server != nullptr)
+		WebbyServerShutdown(_server);
+	_server = nullptr;
+	_sessions.clear();
+}
+
+Session* ReplayServer::FindSession(WebbyConnection* connection)
+{
+	for (Session& session : _sessions)
+	{
+		if (session.connection == connection)
+			return &session;
+	}
+	return nullptr;
+}
+
+void ReplayServer::SendFrame(Session& session)
+{
+	if (_scratch.empty())
+		return;
+
+	WebbyBeginSocketFrame(session.connection, WEBBY_WS_OP_BINARY_FRAME);
+	WebbyWrite(session.connection, _scratch.data(), _scratch.size());
+	WebbyEndSocketFrame(session.connection);
+	_scratch.clear();
+}
+
+void ReplayServer::SendPreamble(Session& session)
+{
+	_scratch.clear();
+	_scratch.push_back(static_cast<unsigned char>(ysEventType::Header));
+	Append(_scratch, _reader.GetFrequency());
+	Append(_scratch, _reader.GetStart());
+
+	// every string is sent up front, as events after a seek may refer to strings written long before
+	for (std::size_t index = 0; index != _reader.GetStringCount(); ++index)
+	{
+		ysStringHandle id;
+		std::uint32_t length;
+		char const* const str = _reader.GetString(index, id, length);
+
+		if (_scratch.size() + 7 + length > kFrameBytes)
+			SendFrame(session);
+
+		_scratch.push_back(static_cast<unsigned char>(ysEventType::String));
+		Append(_scratch, id);
+		Append(_scratch, static_cast<std::uint16_t>(length));
+		_scratch.insert(_scratch.end(), str, str + length);
+	}
+
+	SendFrame(session);
+}
+
+void ReplayServer::Seek(Session& session, double seconds, Clock::time_point now)
+{
+	ysTime const seek = _reader.GetStart() + static_cast<ysTime>(seconds * _reader.GetFrequency());
+
+	std::size_t last;
+	_reader.FindBlocks(seek, ~ysTime(0), session.block, last);
+	session.offset = 0;
+	session.seek = seek;
+
+	// playback starts with the first event rather than waiting out any gap before it
+	session.origin = seek;
+	if (session.block != _reader.GetBlockCount() && _reader.GetBlock(session.block).begin > seek)
+		session.origin = _reader.GetBlock(session.block).begin;
+	session.wallStart = now;
+}
+
+ysTime ReplayServer::GetPosition(Session const& session, Clock::time_point now) const
+{
+	if (session.speed <= 0)
+		return ~ysTime(0);
+	if (session.paused)
+		return session.origin;
+
+	double const elapsed = std::chrono::duration<double>(now - session.wallStart).count();
+	return session.origin + static_cast<ysTime>(elapsed * session.speed * _reader.GetFrequency());
+}
+
+void ReplayServer::HandleCommand(Session& session, char const* command)
+{
+	Clock::time_point const now = Clock::now();
+	double value;
+	char* end;
+
+	if (std::strncmp(command, "seek ", 5) == 0)
+	{
+		value = std::strtod(command + 5, &end);
+		if (end != command + 5 && value >= 0)
+			Seek(session, value, now);
+	}
+	else if (std::strncmp(command, "speed ", 6) == 0)
+	{
+		value = std::strtod(command + 6, &end);
+		if (end != command + 6 && value >= 0)
+		{
+			// the new rate applies from the current position on
+			session.origin = GetPosition(session, now);
+			session.wallStart = now;
+			session.speed = value;
+		}
+	}
+	else if (std::strcmp(command, "pause") == 0 && !session.paused && session.speed > 0)
+	{
+		session.origin = GetPosition(session, now);
+		session.paused = true;
+	}
+	else if (std::strcmp(command, "resume") == 0 && session.paused)
+	{
+		session.wallStart = now;
+		session.paused = false;
+	}
+}
+
+bool ReplayServer::Pump(Session& session, Clock::time_point now)
+{
+	ysTime const position = GetPosition(session, now);
+	std::size_t const blocks = _reader.GetBlockCount();
+	bool sent = false;
+
+	_scratch.clear();
+	while (session.block != blocks && _scratch.size() < kFrameBytes)
+	{
+		std::size_t size;
+		unsigned char const* const data = _reader.GetBlockData(session.block, size);
+
+		// blocks start with no thread selected, but the web tool keeps its thread across frames
+		if (session.offset == 0)
+		{
+			_scratch.push_back(static_cast<unsigned char>(ysEventType::Thread));
+			Append(_scratch, std::uint16_t(0));
+		}
+
+		while (session.offset != size && _scratch.size() < kFrameBytes)
+		{
+			unsigned char const* const pos = data + session.offset;
+			std::size_t const available = size - session.offset;
+
+			// the rest of a damaged block is skipped
+			std::size_t const length = _ys_::encoded_event_size(pos, available);
+			if (length == 0 || length > available)
+			{
+				session.offset = size;
+				break;
+			}
+
+			ysTime when;
+			bool const timed = GetEventTime(pos, when);
+			if (timed && when > position)
+			{
+				SendFrame(session);
+				return sent;
+			}
+
+			if (!timed || when >= session.seek)
+				_scratch.insert(_scratch.end(), pos, pos + length);
+			session.offset += length;
+			sent = true;
+		}
+
+		if (session.offset == size)
+		{
+			++session.block;
+			session.offset = 0;
+		}
+	}
+
+	SendFrame(session);
+	return sent;
+}
+
+bool ReplayServer::Update()
+{
+	WebbyServerUpdate(_server);
+
+	Clock::time_point const now = Clock::now();
+	bool busy = false;
+	for (Session& session : _sessions)
+		busy |= Pump(session, now);
+	return busy;
+}
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysreplay [options] <trace file>\n");
+	std::fprintf(stderr, "  --port <port>      listen on this port, 8080 by default\n");
+	std::fprintf(stderr, "  --speed <factor>   play back at this multiple of real time\n");
+	std::fprintf(stderr, "  --fast             send events as fast as possible\n");
+	std::fprintf(stderr, "  --seek <seconds>   start playback this long into the trace\n");
+	std::fprintf(stderr, "connected clients may send the commands 'seek <seconds>', 'speed <factor>', 'pause' and 'resume'\n");
+}
+
+bool ParseNumber(char const* text, double& out_value)
+{
+	char* end;
+	out_value = std::strtod(text, &end);
+	return end != text && *end == '\0' && out_value >= 0;
+}
+
+bool ParseOptions(int argc, char** argv, Options& out_options)
+{
+	for (int arg = 1; arg != argc; ++arg)
+	{
+		bool const hasValue = arg + 1 != argc;
+		double value;
+		if (std::strcmp(argv[arg], "--port") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], value) || value < 1 || value > 65535)
+				return false;
+			out_options.port = static_cast<unsigned short>(value);
+		}
+		else if (std::strcmp(argv[arg], "--speed") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], value) || value == 0)
+				return false;
+			out_options.speed = value;
+		}
+		else if (std::strcmp(argv[arg], "--fast") == 0)
+			out_options.speed = 0;
+		else if (std::strcmp(argv[arg], "--seek") == 0 && hasValue)
+		{
+			if (!ParseNumber(argv[++arg], out_options.seekSeconds))
+				return false;
+		}
+		else if (argv[arg][0] == '-' || out_options.path != nullptr)
+			return false;
+		else
+			out_options.path = argv[arg];
+	}
+
+	return out_options.path != nullptr;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ysTraceReader reader;
+	if (reader.Open(options.path) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysreplay: cannot read trace file '%s'\n", options.path);
+		return 1;
+	}
+
+#if defined(_WIN32)
+	WSADATA wsa_data;
+	WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+	ReplayServer server(reader, options);
+	if (!server.Listen())
+	{
+		std::fprintf(stderr, "ysreplay: cannot listen on port %u\n", static_cast<unsigned>(options.port));
+		return 1;
+	}
+
+	std::fprintf(stderr, "ysreplay: serving '%s' on port %u\n", options.path, static_cast<unsigned>(options.port));
+
+	// sessions that are caught up wait for their next event, which is at most a few milliseconds late
+	for (;;)
+	{
+		if (!server.Update())
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+}
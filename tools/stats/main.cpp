@@ -0,0 +1,238 @@
+/* Yardstick
+ * Copyright (c) 2014-1016 Sean Middleditch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <yardstick/trace.h>
+
+#include "TraceText.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+	char const* path = nullptr;
+	double beginSeconds = -1;
+	double endSeconds = -1;
+	std::int64_t firstFrame = -1;
+	std::int64_t lastFrame = -1;
+	bool csv = false;
+};
+
+// a row of the table: a site's statistics overall, or on one thread
+struct Row
+{
+	ysRegionStats::Site const* site;
+	bool overall;
+};
+
+bool ParseFrames(char const* text, std::int64_t& out_first, std::int64_t& out_last)
+{
+	char* end;
+	out_first = std::strtoll(text, &end, 10);
+	if (end == text || *end != ':')
+		return false;
+
+	char const* const last = end + 1;
+	out_last = std::strtoll(last, &end, 10);
+	return end != last && *end == '\0' && out_first >= 0 && out_last >= out_first;
+}
+
+bool ParseSeconds(char const* text, double& out_seconds)
+{
+	char* end;
+	out_seconds = std::strtod(text, &end);
+	return end != text && *end == '\0' && out_seconds >= 0;
+}
+
+void PrintUsage()
+{
+	std::fprintf(stderr, "usage: ysstats [options] <trace file>\n");
+	std::fprintf(stderr, "  --begin <seconds>      only count regions starting at or after this time\n");
+	std::fprintf(stderr, "  --end <seconds>        only count regions ending at or before this time\n");
+	std::fprintf(stderr, "  --frames <first:last>  only count regions within these frames\n");
+	std::fprintf(stderr, "  --csv                  print comma separated values\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& out_options)
+{
+	for (int arg = 1; arg != argc; ++arg)
+	{
+		bool const hasValue = arg + 1 != argc;
+		if (std::strcmp(argv[arg], "--begin") == 0 && hasValue)
+		{
+			if (!ParseSeconds(argv[++arg], out_options.beginSeconds))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--end") == 0 && hasValue)
+		{
+			if (!ParseSeconds(argv[++arg], out_options.endSeconds))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--frames") == 0 && hasValue)
+		{
+			if (!ParseFrames(argv[++arg], out_options.firstFrame, out_options.lastFrame))
+				return false;
+		}
+		else if (std::strcmp(argv[arg], "--csv") == 0)
+			out_options.csv = true;
+		else if (argv[arg][0] == '-' || out_options.path != nullptr)
+			return false;
+		else
+			out_options.path = argv[arg];
+	}
+
+	return out_options.path != nullptr;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ysTraceReader reader;
+	if (reader.Open(options.path) != ysResult::Success)
+	{
+		std::fprintf(stderr, "ysstats: cannot read trace file '%s'\n", options.path);
+		return 1;
+	}
+
+	ysTime const frequency = reader.GetFrequency();
+	ysTime begin = 0;
+	ysTime end = ~ysTime(0);
+
+	if (options.beginSeconds >= 0)
+		begin = reader.GetStart() + static_cast<ysTime>(options.beginSeconds * frequency);
+	if (options.endSeconds >= 0)
+		end = reader.GetStart() + static_cast<ysTime>(options.endSeconds * frequency);
+
+	// frame n runs from tick n until tick n + 1
+	if (options.firstFrame >= 0)
+	{
+		std::uint64_t const ticks = reader.GetTickCount();
+		if (static_cast<std::uint64_t>(options.firstFrame) >= ticks)
+		{
+			std::fprintf(stderr, "ysstats: the trace only has %llu frames\n", static_cast<unsigned long long>(ticks));
+			return 1;
+		}
+
+		begin = std::max(begin, reader.GetTickTime(options.firstFrame));
+		if (static_cast<std::uint64_t>(options.lastFrame) + 1 < ticks)
+			end = std::min(end, reader.GetTickTime(options.lastFrame + 1));
+	}
+
+	// regions are only counted in full, so blocks entirely outside the window are skipped
+	std::size_t first = 0;
+	std::size_t last = reader.GetBlockCount();
+	if (begin != 0 || end != ~ysTime(0))
+		reader.FindBlocks(begin, end, first, last);
+
+	ysRegionStats stats(begin, end, true);
+	if (reader.Decode(first, last, stats) != ysResult::Success)
+		std::fprintf(stderr, "ysstats: the trace is damaged, and only its readable part was analyzed\n");
+
+	std::vector<Row> rows;
+	std::unordered_map<ysSiteHandle, ysTime> totals;
+	std::uint64_t summarized = 0;
+	for (ysRegionStats::Site const& site : stats.GetSites())
+	{
+		rows.push_back(Row{&site, true});
+		totals[site.id] = site.total;
+		summarized += site.summarized;
+	}
+	for (ysRegionStats::Site const& site : stats.GetThreadSites())
+		rows.push_back(Row{&site, false});
+
+	if (summarized != 0)
+	{
+		std::fprintf(stderr, "ysstats: %llu regions were only captured in per-frame summaries; they are counted in each site's count, total, mean, min and max, but not in its self time, quantiles or threads\n",
+			static_cast<unsigned long long>(summarized));
+	}
+
+	// sites with the highest total come first, each followed by its threads
+	std::sort(rows.begin(), rows.end(), [&totals](Row const& lhs, Row const& rhs) {
+		ysTime const lhsTotal = totals[lhs.site->id];
+		ysTime const rhsTotal = totals[rhs.site->id];
+		if (lhsTotal != rhsTotal)
+			return lhsTotal > rhsTotal;
+		if (lhs.site->id != rhs.site->id)
+			return lhs.site->id < rhs.site->id;
+		if (lhs.overall != rhs.overall)
+			return lhs.overall;
+		return lhs.site->thread < rhs.site->thread;
+	});
+
+	double const toMicroseconds = 1e6 / frequency;
+
+	if (options.csv)
+		std::printf("name,file,line,thread,count,total_us,self_us,mean_us,min_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+	else
+		std::printf("%-32s %-8s %10s %12s %12s %10s %10s %10s %10s %10s %10s %10s  %s\n",
+			"name", "thread", "count", "total ms", "self ms", "mean us", "min us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "location");
+
+	for (Row const& row : rows)
+	{
+		ysRegionStats::Site const& entry = *row.site;
+		std::string const name = ystools::GetString(reader, entry.name);
+		std::string const file = ystools::GetString(reader, entry.file);
+
+		char thread[16];
+		if (row.overall)
+			std::snprintf(thread, sizeof(thread), "all");
+		else
+			std::snprintf(thread, sizeof(thread), "%u", entry.thread);
+
+		double const total = entry.total * toMicroseconds;
+		double const self = entry.self * toMicroseconds;
+		double const mean = total / entry.count;
+		double const min = entry.min * toMicroseconds;
+		double const max = entry.max * toMicroseconds;
+		double const p50 = entry.durations.GetQuantile(0.5) * toMicroseconds;
+		double const p90 = entry.durations.GetQuantile(0.9) * toMicroseconds;
+		double const p99 = entry.durations.GetQuantile(0.99) * toMicroseconds;
+		double const p999 = entry.durations.GetQuantile(0.999) * toMicroseconds;
+
+		if (options.csv)
+		{
+			std::printf("%s,%s,%u,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+				ystools::Quote(name).c_str(), ystools::Quote(file).c_str(), entry.line, thread, static_cast<unsigned long long>(entry.count),
+				total, self, mean, min, p50, p90, p99, p999, max);
+		}
+		else
+		{
+			std::printf("%-32s %-8s %10llu %12.3f %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f  %s:%u\n",
+				row.overall ? name.c_str() : "", thread, static_cast<unsigned long long>(entry.count),
+				total / 1000, self / 1000, mean, min, p50, p90, p99, p999, max, file.c_str(), entry.line);
+		}
+	}
+
+	return 0;
+}
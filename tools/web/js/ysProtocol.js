@@ -112,6 +112,122 @@ class YsEventReader {
 				name: data.getUint32(pos + 1, true),
 				amount: data.getFloat64(pos + 5, true)
 			};
+		case 7 /*THREAD*/:
+			this._pos += 3;
+			return {
+				type: 'thread',
+				thread: data.getUint16(pos + 1, true)
+			};
+		case 8 /*REGION_SUMMARY*/:
+			this._pos += 57;
+			return {
+				type: 'region_summary',
+				line: data.getUint32(pos + 1, true),
+				name: data.getUint32(pos + 5, true),
+				file: data.getUint32(pos + 9, true),
+				when: data.getUint64(pos + 13, true),
+				count: data.getUint32(pos + 21, true),
+				total: data.getUint64(pos + 25, true),
+				min: data.getUint64(pos + 33, true),
+				max: data.getUint64(pos + 41, true),
+				sumSquares: data.getFloat64(pos + 49, true)
+			};
+		case 9 /*HISTOGRAM*/:
+			var count = data.getUint16(pos + 21, true);
+			var buckets = [];
+			for (var i = 0; i != count; ++i)
+				buckets.push([data.getUint16(pos + 23 + i * 6, true), data.getUint32(pos + 25 + i * 6, true)]);
+			
+			this._pos += 23 + count * 6;
+			return {
+				type: 'histogram',
+				line: data.getUint32(pos + 1, true),
+				name: data.getUint32(pos + 5, true),
+				file: data.getUint32(pos + 9, true),
+				when: data.getUint64(pos + 13, true),
+				buckets: buckets
+			};
+		case 10 /*QUANTILES*/:
+			// one entry per window: the last 1s, 10s and 60s
+			var windows = [];
+			for (var i = 0; i != 3; ++i) {
+				var at = pos + 22 + i * 40;
+				windows.push({
+					count: data.getUint64(at, true),
+					p50: data.getFloat64(at + 8, true),
+					p90: data.getFloat64(at + 16, true),
+					p99: data.getFloat64(at + 24, true),
+					p999: data.getFloat64(at + 32, true)
+				});
+			}
+			
+			this._pos += 142;
+			return {
+				type: 'quantiles',
+				line: data.getUint32(pos + 1, true),
+				name: data.getUint32(pos + 5, true),
+				file: data.getUint32(pos + 9, true),
+				when: data.getUint64(pos + 13, true),
+				// the event type the values come from: 3 for region durations, 4 for counter values
+				source: data.getUint8(pos + 21),
+				windows: windows
+			};
+		case 11 /*CALL_TREE*/:
+			// each node's parent is the index of an earlier node, or 0xFFFFFFFF for a root
+			var count = data.getUint16(pos + 9, true);
+			var nodes = [];
+			for (var i = 0; i != count; ++i) {
+				var at = pos + 11 + i * 36;
+				nodes.push({
+					parent: data.getUint32(at, true),
+					name: data.getUint32(at + 4, true),
+					file: data.getUint32(at + 8, true),
+					line: data.getUint32(at + 12, true),
+					count: data.getUint32(at + 16, true),
+					inclusive: data.getUint64(at + 20, true),
+					exclusive: data.getUint64(at + 28, true)
+				});
+			}
+			
+			this._pos += 11 + count * 36;
+			return {
+				type: 'call_tree',
+				when: data.getUint64(pos + 1, true),
+				nodes: nodes
+			};
+		case 12 /*SAMPLES*/:
+			// each node's parent is the index of an earlier node, or 0xFFFFFFFF for a root
+			var count = data.getUint16(pos + 13, true);
+			var nodes = [];
+			for (var i = 0; i != count; ++i) {
+				var at = pos + 15 + i * 24;
+				nodes.push({
+					parent: data.getUint32(at, true),
+					name: data.getUint32(at + 4, true),
+					file: data.getUint32(at + 8, true),
+					line: data.getUint32(at + 12, true),
+					self: data.getUint32(at + 16, true),
+					total: data.getUint32(at + 20, true)
+				});
+			}
+			
+			this._pos += 15 + count * 24;
+			return {
+				type: 'samples',
+				when: data.getUint64(pos + 1, true),
+				samples: data.getUint32(pos + 9, true),
+				nodes: nodes
+			};
+		case 13 /*STALL*/:
+			this._pos += 29;
+			return {
+				type: 'stall',
+				line: data.getUint32(pos + 1, true),
+				name: data.getUint32(pos + 5, true),
+				file: data.getUint32(pos + 9, true),
+				since: data.getUint64(pos + 13, true),
+				when: data.getUint64(pos + 21, true)
+			};
 		default /*NONE or Unknown*/:
 			this._error = 'protocol parse error: pos '+pos+' byte='+type;
 			this._pos += data.byteLength;
@@ -177,6 +293,11 @@ class YsProtocol {
 		};
 	}
 	
+	send(command) {
+		if (this._ws)
+			this._ws.send(command);
+	}
+	
 	disconnect() {
 		if (this._ws) {
 			this._ws.close();
@@ -179,6 +179,23 @@ class YsState {
 		
 		this._counters = new YsStateCounters();
 		
+		// the most recent summary of each region name, in statistics mode
+		this._summaries = new Map();
+		
+		// the most recent frame's histogram of each region name, as [bucket, count] pairs
+		this._histograms = new Map();
+		
+		// the most recent quantiles of each region and counter site, over each window. a region and a
+		// counter may share a name, as may sites in different places.
+		this._quantiles = new Map();
+		
+		// the most recent frame's call tree
+		this._callTree = null;
+		
+		// the most recent second's stack samples, and the latest stalls
+		this._samples = null;
+		this._stalls = [];
+		
 		protocol.on('connect', () => this.emit('connected'));
 		protocol.on('disconnect', (ev) => { this._frames.endFrame(this._lastTick); this.emit('disconnected', ev); });
 		protocol.on('error', (e) => this.emit('error', e));
@@ -186,6 +203,12 @@ class YsState {
 	}
 	
 	get counters() { return this._counters; }
+	get summaries() { return this._summaries; }
+	get histograms() { return this._histograms; }
+	get quantiles() { return this._quantiles; }
+	get callTree() { return this._callTree; }
+	get samples() { return this._samples; }
+	get stalls() { return this._stalls; }
 	get stats() { return this._protocol.stats; }
 	get frames() { return this._frames; }
 	
@@ -204,6 +227,14 @@ class YsState {
 		this._protocol.disconnect();
 	}
 	
+	dumpFlightRecorder() {
+		this._protocol.send('dump');
+	}
+	
+	setCategoryEnabled(category, enabled) {
+		this._protocol.send((enabled ? 'enable ' : 'disable ') + category);
+	}
+	
 	on(ev, cb) {
 		var cbs = this._callbacks.get(ev);
 		if (cbs === undefined)
@@ -253,6 +284,26 @@ class YsState {
 		case 'counter_add':
 			this._counters.addCounter(ev.name, ev.amount);
 			break;
+		case 'region_summary':
+			this._summaries.set(ev.name, ev);
+			break;
+		case 'histogram':
+			this._histograms.set(ev.name, ev);
+			break;
+		case 'quantiles':
+			this._quantiles.set(ev.source + ':' + ev.name + ':' + ev.file + ':' + ev.line, ev);
+			break;
+		case 'call_tree':
+			this._callTree = ev;
+			break;
+		case 'samples':
+			this._samples = ev;
+			break;
+		case 'stall':
+			this._stalls.push(ev);
+			if (this._stalls.length > 10)
+				this._stalls.shift();
+			break;
 		}
 			
 		this.emit(ev.type, ev);
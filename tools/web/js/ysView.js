@@ -103,4 +103,148 @@ window.YsView = function(ysState, options){
 		
 		chart.render();
 	});
+	
+	// quantiles arrive in a batch once a second, so the table is redrawn at most once a frame
+	var quantilesChanged = false;
+	ysState.on('quantiles', function(ev){
+		quantilesChanged = true;
+	});
+	ysState.on('tick', function(ev){
+		if (!quantilesChanged || !options.quantiles)
+			return;
+		quantilesChanged = false;
+		
+		// durations are shown in milliseconds, counter values as they are
+		var format = (q, value)=>q.source == 3 ? (value * ysState.period * 1000).toFixed(3) : value.toPrecision(4);
+		var rows = '<tr><th>Name</th><th>Count (1s)</th><th>p50 (1s)</th><th>p99 (1s)</th><th>p99 (10s)</th><th>p99 (60s)</th><th>p99.9 (60s)</th></tr>';
+		for (var q of ysState.quantiles.values()) {
+			rows += '<tr><td>' + ysState.tostr(q.name) + (q.source == 3 ? ' (ms)' : '') + '</td>' +
+				'<td>' + q.windows[0].count + '</td>' +
+				'<td>' + format(q, q.windows[0].p50) + '</td>' +
+				'<td>' + format(q, q.windows[0].p99) + '</td>' +
+				'<td>' + format(q, q.windows[1].p99) + '</td>' +
+				'<td>' + format(q, q.windows[2].p99) + '</td>' +
+				'<td>' + format(q, q.windows[2].p999) + '</td></tr>';
+		}
+		options.quantiles.innerHTML = rows;
+	});
+	
+	// the latest frame's call tree is drawn as a flame graph, roots at the bottom. a node whose
+	// regions didn't end this frame only encloses others, so it is as wide as its children.
+	var callTreeChanged = false;
+	var flameRects = [];
+	var rowHeight = 16;
+	ysState.on('call_tree', function(ev){
+		callTreeChanged = true;
+	});
+	ysState.on('tick', function(ev){
+		var canvas = options.flamegraph;
+		if (!callTreeChanged || !canvas)
+			return;
+		callTreeChanged = false;
+		
+		var nodes = ysState.callTree.nodes;
+		var root = 0xFFFFFFFF;
+		
+		// children always follow their parent, so widths are summed in reverse
+		var width = new Array(nodes.length).fill(0);
+		var children = new Array(nodes.length).fill(0);
+		for (var i = nodes.length; i-- != 0;) {
+			width[i] = Math.max(nodes[i].inclusive, children[i]);
+			if (nodes[i].parent != root)
+				children[nodes[i].parent] += width[i];
+		}
+		
+		var offset = [], next = [], level = [];
+		var total = 0, depth = 0;
+		for (var i = 0; i != nodes.length; ++i) {
+			var parent = nodes[i].parent;
+			if (parent == root) {
+				offset[i] = total;
+				level[i] = 0;
+				total += width[i];
+			} else {
+				offset[i] = next[parent];
+				level[i] = level[parent] + 1;
+				next[parent] += width[i];
+			}
+			next[i] = offset[i];
+			depth = Math.max(depth, level[i] + 1);
+		}
+		
+		canvas.style.height = (depth * rowHeight) + 'px';
+		canvas.width = canvas.clientWidth;
+		canvas.height = depth * rowHeight;
+		
+		var ctx = canvas.getContext('2d');
+		var scale = total > 0 ? canvas.width / total : 0;
+		ctx.font = '11px sans-serif';
+		ctx.textBaseline = 'middle';
+		flameRects.length = 0;
+		for (var i = 0; i != nodes.length; ++i) {
+			var x = offset[i] * scale;
+			var w = width[i] * scale;
+			var y = canvas.height - (level[i] + 1) * rowHeight;
+			var name = ysState.tostr(nodes[i].name);
+			var label = name + ' ' + (nodes[i].inclusive * ysState.period * 1000).toFixed(3) + 'ms (self ' + (nodes[i].exclusive * ysState.period * 1000).toFixed(3) + 'ms, ' + nodes[i].count + 'x)';
+			
+			// stable colours, so a site keeps its colour from frame to frame
+			ctx.fillStyle = 'hsl(' + (nodes[i].name % 60 + 10) + ', 80%, ' + (55 + nodes[i].line % 20) + '%)';
+			ctx.fillRect(x, y, Math.max(w - 1, 1), rowHeight - 1);
+			if (w > 40) {
+				ctx.save();
+				ctx.beginPath();
+				ctx.rect(x, y, w - 1, rowHeight - 1);
+				ctx.clip();
+				ctx.fillStyle = '#000';
+				ctx.fillText(label, x + 2, y + rowHeight / 2);
+				ctx.restore();
+			}
+			flameRects.push({x: x, y: y, w: w, label: label});
+		}
+	});
+	if (options.flamegraph) {
+		options.flamegraph.addEventListener('mousemove', function(e){
+			var bounds = options.flamegraph.getBoundingClientRect();
+			var x = e.clientX - bounds.left, y = e.clientY - bounds.top;
+			var title = '';
+			for (var rect of flameRects)
+				if (x >= rect.x && x < rect.x + rect.w && y >= rect.y && y < rect.y + rowHeight)
+					title = rect.label;
+			options.flamegraph.title = title;
+		});
+	}
+	
+	// samples arrive once a second; the table lists the regions threads were most often found in
+	ysState.on('samples', function(ev){
+		if (!options.samples || ev.samples == 0)
+			return;
+		
+		// the same region may be reached by several paths
+		var regions = new Map();
+		for (var node of ev.nodes) {
+			var region = regions.get(node.name) || {self: 0, total: 0};
+			region.self += node.self;
+			region.total += node.total;
+			regions.set(node.name, region);
+		}
+		
+		var sorted = Array.from(regions.entries()).sort((a, b)=>b[1].self - a[1].self).slice(0, 10);
+		var rows = '<tr><th>Region (' + ev.samples + ' samples)</th><th>Self</th><th>Total</th></tr>';
+		for (var entry of sorted) {
+			rows += '<tr><td>' + ysState.tostr(entry[0]) + '</td>' +
+				'<td>' + (entry[1].self * 100 / ev.samples).toFixed(1) + '%</td>' +
+				'<td>' + (entry[1].total * 100 / ev.samples).toFixed(1) + '%</td></tr>';
+		}
+		options.samples.innerHTML = rows;
+	});
+	ysState.on('stall', function(ev){
+		if (!options.stalls)
+			return;
+		
+		var lines = '';
+		for (var stall of ysState.stalls)
+			lines += '<div>Stalled in ' + ysState.tostr(stall.name) + ' for ' + ((stall.when - stall.since) * ysState.period * 1000).toFixed(0) + 'ms at ' + ysState.tostr(stall.file) + ':' + stall.line + '</div>';
+		options.stalls.innerHTML = lines;
+	});
 };
\ No newline at end of file